@@ -81,6 +81,100 @@ function(project_setup_dependencies)
     )
   endif()
 
+  if(NOT TARGET meshoptimizer)
+    cpmaddpackage(
+      NAME
+      meshoptimizer
+      VERSION
+      0.22
+      GITHUB_REPOSITORY
+      zeux/meshoptimizer
+    )
+  endif()
+
+  if(NOT TARGET bc7enc)
+    # only a pinned commit makes the encoded textures reproducible
+    set(BC7ENC_GIT_SHA
+        ""
+        CACHE STRING "bc7enc_rdo commit the texture encoders are built from")
+    if(BC7ENC_GIT_SHA)
+      set(BC7ENC_GIT_TAG ${BC7ENC_GIT_SHA})
+    else()
+      message(WARNING "BC7ENC_GIT_SHA is not set, building bc7enc_rdo from "
+                      "master which is not reproducible")
+      set(BC7ENC_GIT_TAG master)
+    endif()
+    # no cmake project of its own, the encoders are built as a static library
+    cpmaddpackage(
+      NAME
+      bc7enc
+      GIT_TAG
+      ${BC7ENC_GIT_TAG}
+      GITHUB_REPOSITORY
+      richgel999/bc7enc_rdo
+      DOWNLOAD_ONLY
+      YES
+    )
+    add_library(bc7enc STATIC ${bc7enc_SOURCE_DIR}/bc7enc.cpp
+                              ${bc7enc_SOURCE_DIR}/rgbcx.cpp)
+    target_include_directories(bc7enc SYSTEM PUBLIC ${bc7enc_SOURCE_DIR})
+  endif()
+
+  if(NOT TARGET lz4)
+    # only the block format is used, built from its sources like bc7enc
+    cpmaddpackage(
+      NAME
+      lz4
+      VERSION
+      1.10.0
+      GITHUB_REPOSITORY
+      lz4/lz4
+      DOWNLOAD_ONLY
+      YES
+    )
+    add_library(lz4 STATIC ${lz4_SOURCE_DIR}/lib/lz4.c
+                           ${lz4_SOURCE_DIR}/lib/lz4hc.c)
+    target_include_directories(lz4 SYSTEM PUBLIC ${lz4_SOURCE_DIR}/lib)
+  endif()
+
+  if(NOT TARGET draco)
+    # decoder of KHR_draco_mesh_compression, limited to the glTF bitstream
+    cpmaddpackage(
+      NAME
+      draco
+      VERSION
+      1.5.7
+      GIT_TAG
+      1.5.7
+      GITHUB_REPOSITORY
+      google/draco
+      OPTIONS
+      "DRACO_GLTF_BITSTREAM ON"
+      "DRACO_JS_GLUE OFF"
+      "DRACO_TESTS OFF"
+    )
+    # the build tree does not attach the include directories to the target,
+    # draco_features.h is generated into the binary directory
+    target_include_directories(draco SYSTEM INTERFACE ${draco_SOURCE_DIR}/src ${draco_BINARY_DIR})
+  endif()
+
+  if(NOT TARGET simdjson)
+    # the amalgamated single header build, with its error code api only
+    cpmaddpackage(
+      NAME
+      simdjson
+      VERSION
+      3.10.1
+      GITHUB_REPOSITORY
+      simdjson/simdjson
+      DOWNLOAD_ONLY
+      YES
+    )
+    add_library(simdjson STATIC ${simdjson_SOURCE_DIR}/singleheader/simdjson.cpp)
+    target_include_directories(simdjson SYSTEM PUBLIC ${simdjson_SOURCE_DIR}/singleheader)
+    target_compile_definitions(simdjson PUBLIC SIMDJSON_EXCEPTIONS=0)
+  endif()
+
   if(NOT TARGET tinygltf)
     cpmaddpackage(
       NAME
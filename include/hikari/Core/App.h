@@ -2,6 +2,8 @@
 
 #include "hikari/hikari_export.hpp"
 
+#include <cstdint>
+
 namespace hkr {
 
 class Window;
@@ -11,11 +13,26 @@ class RenderEngine;
 struct AppSettings {
   char* appName;
   char* assetPath;
+  // asset pack written by hikari_cook --pack, its files are read instead of
+  // the loose ones below assetPath. Null reads the loose files only.
+  char* assetPackPath = nullptr;
   char* modelRelPath;
   char* cubemapRelPath;
   int width = 800;
   int height = 600;
   bool vsync = true;
+  // create base color and emissive textures of the model in srgb formats so
+  // that sampling them returns linear color
+  bool srgbColorTextures = false;
+  // parse .gltf/.glb files with simdjson instead of tinygltf, which skips the
+  // intermediate tinygltf::Model of large scenes
+  bool simdjsonglTF = false;
+  // cap in MB of the memory of streamed texture mip levels, 0 lets them use
+  // what the device memory budget leaves
+  uint32_t textureBudgetMB = 0;
+  // samples per pixel the ray tracer traces every frame, they are averaged
+  // with those of the previous frames until the view changes
+  uint32_t raytracingSamples = 1;
 };
 
 class HKR_EXPORT App {
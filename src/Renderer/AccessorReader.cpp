@@ -0,0 +1,378 @@
+#include "Renderer/AccessorReader.h"
+#include "Util/Assert.h"
+#include "Util/Simd.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+namespace {
+
+template <typename T>
+T Load(const uint8_t* p) {
+  T value;
+  memcpy(&value, p, sizeof(T));
+  return value;
+}
+
+template <typename T, bool Normalized>
+float ToFloat(T value) {
+  if constexpr (std::is_floating_point_v<T> || !Normalized) {
+    return static_cast<float>(value);
+  } else if constexpr (std::is_signed_v<T>) {
+    return std::max(static_cast<float>(value) /
+                        static_cast<float>(std::numeric_limits<T>::max()),
+                    -1.0f);
+  } else {
+    return static_cast<float>(value) /
+           static_cast<float>(std::numeric_limits<T>::max());
+  }
+}
+
+// call f with a value of the component type
+template <typename F>
+void DispatchComponentType(int componentType, F&& f) {
+  switch (componentType) {
+    case TINYGLTF_COMPONENT_TYPE_BYTE:
+      f(int8_t{});
+      break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      f(uint8_t{});
+      break;
+    case TINYGLTF_COMPONENT_TYPE_SHORT:
+      f(int16_t{});
+      break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+      f(uint16_t{});
+      break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+      f(uint32_t{});
+      break;
+    case TINYGLTF_COMPONENT_TYPE_FLOAT:
+      f(float{});
+      break;
+    default:
+      HKR_ASSERT(0);
+  }
+}
+
+// call f with the component count as std::integral_constant
+template <typename F>
+void DispatchComponents(uint32_t components, F&& f) {
+  switch (components) {
+    case 1:
+      f(std::integral_constant<uint32_t, 1>{});
+      break;
+    case 2:
+      f(std::integral_constant<uint32_t, 2>{});
+      break;
+    case 3:
+      f(std::integral_constant<uint32_t, 3>{});
+      break;
+    case 4:
+      f(std::integral_constant<uint32_t, 4>{});
+      break;
+    default:
+      HKR_ASSERT(0);
+  }
+}
+
+// the simd kernels below return how many leading elements they converted,
+// the rest is left to the scalar loop of the caller
+
+size_t ConvertUnorm16([[maybe_unused]] const uint8_t* src,
+                      [[maybe_unused]] size_t n,
+                      [[maybe_unused]] float* dst) {
+  size_t i = 0;
+  [[maybe_unused]] constexpr float scale = 1.0f / 65535.0f;
+#if defined(HKR_SIMD_AVX2)
+  const __m256 scaleV = _mm256_set1_ps(scale);
+  for (; i + 8 <= n; i += 8) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+    _mm256_storeu_ps(
+        dst + i,
+        _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(v)), scaleV));
+  }
+#elif defined(HKR_SIMD_SSE2)
+  const __m128 scaleV = _mm_set1_ps(scale);
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= n; i += 8) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+    const __m128i lo = _mm_unpacklo_epi16(v, zero);
+    const __m128i hi = _mm_unpackhi_epi16(v, zero);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scaleV));
+    _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scaleV));
+  }
+#elif defined(HKR_SIMD_NEON)
+  for (; i + 8 <= n; i += 8) {
+    const uint16x8_t v = vld1q_u16(reinterpret_cast<const uint16_t*>(src) + i);
+    vst1q_f32(dst + i,
+              vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))), scale));
+    vst1q_f32(dst + i + 4,
+              vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(v))), scale));
+  }
+#endif
+  return i;
+}
+
+size_t ConvertUnorm8([[maybe_unused]] const uint8_t* src,
+                     [[maybe_unused]] size_t n,
+                     [[maybe_unused]] float* dst) {
+  size_t i = 0;
+  [[maybe_unused]] constexpr float scale = 1.0f / 255.0f;
+#if defined(HKR_SIMD_AVX2)
+  const __m256 scaleV = _mm256_set1_ps(scale);
+  for (; i + 8 <= n; i += 8) {
+    const __m128i v =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_ps(
+        dst + i,
+        _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v)), scaleV));
+  }
+#elif defined(HKR_SIMD_SSE2)
+  const __m128 scaleV = _mm_set1_ps(scale);
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= n; i += 8) {
+    const __m128i v = _mm_unpacklo_epi8(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)), zero);
+    const __m128i lo = _mm_unpacklo_epi16(v, zero);
+    const __m128i hi = _mm_unpackhi_epi16(v, zero);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scaleV));
+    _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scaleV));
+  }
+#elif defined(HKR_SIMD_NEON)
+  for (; i + 8 <= n; i += 8) {
+    const uint16x8_t v = vmovl_u8(vld1_u8(src + i));
+    vst1q_f32(dst + i,
+              vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))), scale));
+    vst1q_f32(dst + i + 4,
+              vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(v))), scale));
+  }
+#endif
+  return i;
+}
+
+size_t AddBase16([[maybe_unused]] const uint8_t* src,
+                 [[maybe_unused]] size_t n,
+                 [[maybe_unused]] uint32_t base,
+                 [[maybe_unused]] uint32_t* dst) {
+  size_t i = 0;
+#if defined(HKR_SIMD_AVX2)
+  const __m256i baseV = _mm256_set1_epi32(static_cast<int>(base));
+  for (; i + 8 <= n; i += 8) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        _mm256_add_epi32(_mm256_cvtepu16_epi32(v), baseV));
+  }
+#elif defined(HKR_SIMD_SSE2)
+  const __m128i baseV = _mm_set1_epi32(static_cast<int>(base));
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= n; i += 8) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_add_epi32(_mm_unpacklo_epi16(v, zero), baseV));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4),
+                     _mm_add_epi32(_mm_unpackhi_epi16(v, zero), baseV));
+  }
+#elif defined(HKR_SIMD_NEON)
+  const uint32x4_t baseV = vdupq_n_u32(base);
+  for (; i + 8 <= n; i += 8) {
+    const uint16x8_t v = vld1q_u16(reinterpret_cast<const uint16_t*>(src) + i);
+    vst1q_u32(dst + i, vaddq_u32(vmovl_u16(vget_low_u16(v)), baseV));
+    vst1q_u32(dst + i + 4, vaddq_u32(vmovl_u16(vget_high_u16(v)), baseV));
+  }
+#endif
+  return i;
+}
+
+size_t AddBase32([[maybe_unused]] const uint8_t* src,
+                 [[maybe_unused]] size_t n,
+                 [[maybe_unused]] uint32_t base,
+                 [[maybe_unused]] uint32_t* dst) {
+  size_t i = 0;
+#if defined(HKR_SIMD_AVX2)
+  const __m256i baseV = _mm256_set1_epi32(static_cast<int>(base));
+  for (; i + 8 <= n; i += 8) {
+    const __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        _mm256_add_epi32(v, baseV));
+  }
+#elif defined(HKR_SIMD_SSE2)
+  const __m128i baseV = _mm_set1_epi32(static_cast<int>(base));
+  for (; i + 4 <= n; i += 4) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_add_epi32(v, baseV));
+  }
+#elif defined(HKR_SIMD_NEON)
+  const uint32x4_t baseV = vdupq_n_u32(base);
+  for (; i + 4 <= n; i += 4) {
+    vst1q_u32(dst + i,
+              vaddq_u32(vld1q_u32(reinterpret_cast<const uint32_t*>(src) + i),
+                        baseV));
+  }
+#endif
+  return i;
+}
+
+// n packed scalars into packed floats
+template <typename T, bool Normalized>
+void ConvertPacked(const uint8_t* src, size_t n, float* dst) {
+  if constexpr (std::is_same_v<T, float>) {
+    memcpy(dst, src, n * sizeof(float));
+  } else {
+    size_t i = 0;
+    if constexpr (std::is_same_v<T, uint16_t> && Normalized) {
+      i = ConvertUnorm16(src, n, dst);
+    } else if constexpr (std::is_same_v<T, uint8_t> && Normalized) {
+      i = ConvertUnorm8(src, n, dst);
+    }
+    for (; i < n; i++) {
+      dst[i] = ToFloat<T, Normalized>(Load<T>(src + i * sizeof(T)));
+    }
+  }
+}
+
+template <typename T, bool Normalized>
+void ReadFloatsAs(const hkr::AccessorView& view,
+                  float* dst,
+                  uint32_t dstStride) {
+  // packed elements into packed floats are one flat conversion
+  if (view.stride == sizeof(T) * view.components &&
+      dstStride == view.components) {
+    ConvertPacked<T, Normalized>(
+        view.data, static_cast<size_t>(view.count) * view.components, dst);
+    return;
+  }
+  DispatchComponents(view.components, [&](auto components) {
+    constexpr uint32_t N = decltype(components)::value;
+    for (size_t i = 0; i < view.count; i++) {
+      const uint8_t* src = view.data + i * view.stride;
+      for (uint32_t k = 0; k < N; k++) {
+        dst[i * dstStride + k] =
+            ToFloat<T, Normalized>(Load<T>(src + k * sizeof(T)));
+      }
+    }
+  });
+}
+
+}  // namespace
+
+namespace hkr {
+
+AccessorView GetAccessorView(const tinygltf::Model& model, int accessorIndex) {
+  AccessorView view;
+  if (accessorIndex < 0) {
+    return view;
+  }
+  const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+  if (accessor.bufferView < 0) {
+    return view;
+  }
+  const tinygltf::BufferView& bufferView =
+      model.bufferViews[accessor.bufferView];
+  view.data = &model.buffers[bufferView.buffer]
+                   .data[accessor.byteOffset + bufferView.byteOffset];
+  view.count = static_cast<uint32_t>(accessor.count);
+  view.stride = static_cast<uint32_t>(accessor.ByteStride(bufferView));
+  view.componentType = accessor.componentType;
+  view.components =
+      static_cast<uint32_t>(tinygltf::GetNumComponentsInType(accessor.type));
+  view.normalized = accessor.normalized;
+  return view;
+}
+
+AccessorView GetAttributeView(const tinygltf::Model& model,
+                              const tinygltf::Primitive& prim,
+                              const char* name) {
+  auto it = prim.attributes.find(name);
+  if (it == prim.attributes.end()) {
+    return {};
+  }
+  return GetAccessorView(model, it->second);
+}
+
+void ReadFloats(const AccessorView& view, float* dst, uint32_t dstStride) {
+  HKR_ASSERT(view.components <= dstStride);
+  DispatchComponentType(view.componentType, [&](auto component) {
+    using T = decltype(component);
+    if (view.normalized) {
+      ReadFloatsAs<T, true>(view, dst, dstStride);
+    } else {
+      ReadFloatsAs<T, false>(view, dst, dstStride);
+    }
+  });
+}
+
+void ReadUint16(const AccessorView& view, uint16_t* dst, uint32_t dstStride) {
+  HKR_ASSERT(view.components <= dstStride);
+  DispatchComponentType(view.componentType, [&](auto component) {
+    using T = decltype(component);
+    if constexpr (std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t>) {
+      DispatchComponents(view.components, [&](auto components) {
+        constexpr uint32_t N = decltype(components)::value;
+        for (size_t i = 0; i < view.count; i++) {
+          const uint8_t* src = view.data + i * view.stride;
+          for (uint32_t k = 0; k < N; k++) {
+            dst[i * dstStride + k] = Load<T>(src + k * sizeof(T));
+          }
+        }
+      });
+    } else {
+      HKR_ASSERT(0);
+    }
+  });
+}
+
+void ReadIndices(const AccessorView& view, uint32_t baseVertex, uint32_t* dst) {
+  HKR_ASSERT(view.components == 1);
+  DispatchComponentType(view.componentType, [&](auto component) {
+    using T = decltype(component);
+    if constexpr (std::is_unsigned_v<T>) {
+      size_t i = 0;
+      if (view.stride == sizeof(T)) {
+        if constexpr (std::is_same_v<T, uint16_t>) {
+          i = AddBase16(view.data, view.count, baseVertex, dst);
+        } else if constexpr (std::is_same_v<T, uint32_t>) {
+          i = AddBase32(view.data, view.count, baseVertex, dst);
+        }
+      }
+      for (; i < view.count; i++) {
+        dst[i] = Load<T>(view.data + i * view.stride) + baseVertex;
+      }
+    } else {
+      HKR_ASSERT(0);
+    }
+  });
+}
+
+void ReadIndices(const AccessorView& view, uint16_t* dst) {
+  HKR_ASSERT(view.components == 1);
+  DispatchComponentType(view.componentType, [&](auto component) {
+    using T = decltype(component);
+    if constexpr (std::is_same_v<T, uint16_t>) {
+      if (view.stride == sizeof(T)) {
+        memcpy(dst, view.data, view.count * sizeof(T));
+        return;
+      }
+    }
+    if constexpr (std::is_unsigned_v<T>) {
+      for (size_t i = 0; i < view.count; i++) {
+        const T index = Load<T>(view.data + i * view.stride);
+        HKR_ASSERT(index <= std::numeric_limits<uint16_t>::max());
+        dst[i] = static_cast<uint16_t>(index);
+      }
+    } else {
+      HKR_ASSERT(0);
+    }
+  });
+}
+
+}  // namespace hkr
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <tiny_gltf.h>
+
+#include <cstdint>
+
+namespace hkr {
+
+// A glTF accessor resolved to its bytes. The readers below pick a kernel once
+// per accessor from the component type, component count, normalization and
+// whether the elements are tightly packed, rather than switching per element.
+// Packed float accessors are copied as they are and packed 8/16 bit ones are
+// converted with simd.
+struct AccessorView {
+  const uint8_t* data = nullptr;
+  uint32_t count = 0;
+  uint32_t stride = 0;
+  int componentType = -1;
+  uint32_t components = 0;
+  bool normalized = false;
+};
+
+// data is null if the accessor is absent or has no buffer view
+AccessorView GetAccessorView(const tinygltf::Model& model, int accessorIndex);
+AccessorView GetAttributeView(const tinygltf::Model& model,
+                              const tinygltf::Primitive& prim,
+                              const char* name);
+
+// every component of every element as float, dstStride floats apart,
+// normalized integers map to [0, 1] or [-1, 1], dst components past the
+// accessor's are left untouched
+void ReadFloats(const AccessorView& view, float* dst, uint32_t dstStride);
+// unsigned integer components, dstStride elements apart
+void ReadUint16(const AccessorView& view, uint16_t* dst, uint32_t dstStride);
+// indices offset by baseVertex
+void ReadIndices(const AccessorView& view, uint32_t baseVertex, uint32_t* dst);
+// indices narrowed to 16 bit, they must fit
+void ReadIndices(const AccessorView& view, uint16_t* dst);
+
+}  // namespace hkr
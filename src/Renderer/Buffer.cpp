@@ -15,12 +15,20 @@ BufferBase::BufferBase(VmaAllocator allocator,
 void BufferBase::Create(VmaAllocator allocator,
                         VmaAllocationCreateFlags allocFlags,
                         VkDeviceSize size,
-                        VkBufferUsageFlags2 usage) {
+                        VkBufferUsageFlags2 usage,
+                        std::span<const uint32_t> queueFamilyIndices) {
   VkBufferCreateInfo bufferInfo{};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferInfo.size = size;
   bufferInfo.usage = usage;
-  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  if (queueFamilyIndices.size() > 1) {
+    bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount =
+        static_cast<uint32_t>(queueFamilyIndices.size());
+    bufferInfo.pQueueFamilyIndices = queueFamilyIndices.data();
+  } else {
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  }
 
   VmaAllocationCreateInfo allocCreateInfo = {};
   allocCreateInfo.flags = allocFlags;
@@ -107,9 +115,21 @@ Buffer::Buffer(VmaAllocator allocator,
 
 void Buffer::Create(VmaAllocator allocator,
                     VkDeviceSize size,
-                    VkBufferUsageFlags2 usage) {
+                    VkBufferUsageFlags2 usage,
+                    std::span<const uint32_t> queueFamilyIndices) {
   BufferBase::Create(allocator, 0, size,
-                     VK_BUFFER_USAGE_2_TRANSFER_DST_BIT | usage);
+                     VK_BUFFER_USAGE_2_TRANSFER_DST_BIT | usage,
+                     queueFamilyIndices);
+}
+
+void Buffer::Create(VmaAllocator allocator,
+                    VmaAllocationCreateFlags allocFlags,
+                    VkDeviceSize size,
+                    VkBufferUsageFlags2 usage,
+                    std::span<const uint32_t> queueFamilyIndices) {
+  BufferBase::Create(allocator, allocFlags, size,
+                     VK_BUFFER_USAGE_2_TRANSFER_DST_BIT | usage,
+                     queueFamilyIndices);
 }
 
 void Buffer::Create(VmaAllocator allocator,
@@ -3,6 +3,9 @@
 #include <volk.h>
 #include <vk_mem_alloc.h>
 
+#include <cstdint>
+#include <span>
+
 namespace hkr {
 
 // general buffer (may not be used directly)
@@ -14,14 +17,16 @@ public:
              VmaAllocationCreateFlags allocFlags,
              VkDeviceSize size,
              VkBufferUsageFlags2 usage);
+  // the buffer is shared by the queue families if there is more than one
   void Create(VmaAllocator allocator,
               VmaAllocationCreateFlags allocFlags,
               VkDeviceSize size,
-              VkBufferUsageFlags2 usage);
+              VkBufferUsageFlags2 usage,
+              std::span<const uint32_t> queueFamilyIndices = {});
   void Cleanup(VmaAllocator allocator);
 
-  VkBuffer buffer;
-  VmaAllocation allocation;
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VmaAllocation allocation = VK_NULL_HANDLE;
 };
 
 // host visible buffer (may not be used directly)
@@ -71,9 +76,19 @@ public:
   Buffer() = default;
   ~Buffer() = default;
   Buffer(VmaAllocator allocator, VkDeviceSize size, VkBufferUsageFlags2 usage);
+  // buffers written by an UploadBatcher are shared by its queue families,
+  // see UploadBatcher::GetQueueFamilyIndices
   void Create(VmaAllocator allocator,
               VkDeviceSize size,
-              VkBufferUsageFlags2 usage);
+              VkBufferUsageFlags2 usage,
+              std::span<const uint32_t> queueFamilyIndices = {});
+  // allocFlags may ask for host access, the buffer stays a transfer
+  // destination in case vma falls back to memory the host cannot write
+  void Create(VmaAllocator allocator,
+              VmaAllocationCreateFlags allocFlags,
+              VkDeviceSize size,
+              VkBufferUsageFlags2 usage,
+              std::span<const uint32_t> queueFamilyIndices = {});
   void Create(VmaAllocator allocator,
               VkCommandBuffer commandBuffer,
               StagingBuffer& stagingBuffer,
@@ -12,7 +12,11 @@ struct UniformBufferObject {
   alignas(16) Mat4 proj;
   Vec4 viewPos;
   Vec3 lightPos;
-  uint32_t frame = 0;  // for raytracing
+  // frames in the running average of the ray tracer, also seeds its random
+  // numbers
+  uint32_t frame = 0;
+  // samples per pixel the ray tracer adds to the average every frame
+  uint32_t samplesPerFrame = 1;
 };
 
 }  // namespace hkr
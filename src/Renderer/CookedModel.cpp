@@ -0,0 +1,449 @@
+#include "Renderer/CookedModel.h"
+#include "Renderer/CookedTexture.h"
+#include "Renderer/MeshOptimize.h"
+#include "Util/Assert.h"
+#include "Util/Filesystem.h"
+#include "Util/Hash.h"
+#include "Util/ThreadPool.h"
+
+#include <tiny_gltf.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+namespace {
+
+template <typename T>
+void AppendSection(std::vector<uint8_t>& file,
+                   hkr::CookedHeader& header,
+                   hkr::CookedSection section,
+                   const std::vector<T>& data) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  const size_t offset =
+      (file.size() + hkr::COOKED_SECTION_ALIGNMENT - 1) &
+      ~static_cast<size_t>(hkr::COOKED_SECTION_ALIGNMENT - 1);
+  const size_t size = data.size() * sizeof(T);
+  file.resize(offset + size);
+  if (size > 0) {
+    memcpy(file.data() + offset, data.data(), size);
+  }
+  header.sections[static_cast<size_t>(section)] = {offset, size};
+}
+
+constexpr size_t SECTION_ELEMENT_SIZES[] = {
+    sizeof(hkr::CookedDependency),
+    sizeof(hkr::SamplerDesc),
+    sizeof(hkr::TextureDesc),
+    sizeof(hkr::MaterialDesc),
+    sizeof(hkr::MeshDesc),
+    sizeof(hkr::PrimitiveDesc),
+    sizeof(hkr::NodeDesc),
+    sizeof(uint32_t),
+    sizeof(uint32_t),
+    sizeof(hkr::CookedImage),
+    hkr::VERTEX_STREAM_STRIDES[hkr::VERTEX_STREAM_POSITION],
+    hkr::VERTEX_STREAM_STRIDES[hkr::VERTEX_STREAM_ATTRIBUTES],
+    hkr::VERTEX_STREAM_STRIDES[hkr::VERTEX_STREAM_COLOR],
+    hkr::VERTEX_STREAM_STRIDES[hkr::VERTEX_STREAM_SKIN],
+    sizeof(uint8_t),
+    sizeof(uint8_t),
+};
+static_assert(std::size(SECTION_ELEMENT_SIZES) ==
+              static_cast<size_t>(hkr::CookedSection::Count));
+
+uint32_t GetMipLevelCount(uint32_t width, uint32_t height) {
+  uint32_t levels = 1;
+  while ((width | height) >> levels) {
+    levels++;
+  }
+  return levels;
+}
+
+// append the full rgba8 mip chain of the image, each level is a 2x2 box filter
+// of the previous one
+void AppendMipChain(const std::vector<uint8_t>& pixels,
+                    uint32_t width,
+                    uint32_t height,
+                    uint32_t mipLevels,
+                    std::vector<uint8_t>& imageData) {
+  imageData.insert(imageData.end(), pixels.begin(), pixels.end());
+  std::vector<uint8_t> src = pixels;
+  std::vector<uint8_t> dst;
+  for (uint32_t level = 1; level < mipLevels; level++) {
+    const uint32_t dstWidth = std::max(width >> 1, 1u);
+    const uint32_t dstHeight = std::max(height >> 1, 1u);
+    dst.resize(dstWidth * dstHeight * 4);
+    for (uint32_t y = 0; y < dstHeight; y++) {
+      const uint32_t y0 = std::min(y * 2, height - 1);
+      const uint32_t y1 = std::min(y * 2 + 1, height - 1);
+      for (uint32_t x = 0; x < dstWidth; x++) {
+        const uint32_t x0 = std::min(x * 2, width - 1);
+        const uint32_t x1 = std::min(x * 2 + 1, width - 1);
+        for (uint32_t c = 0; c < 4; c++) {
+          const uint32_t sum = src[(y0 * width + x0) * 4 + c] +
+                               src[(y0 * width + x1) * 4 + c] +
+                               src[(y1 * width + x0) * 4 + c] +
+                               src[(y1 * width + x1) * 4 + c];
+          dst[(y * dstWidth + x) * 4 + c] =
+              static_cast<uint8_t>((sum + 2) / 4);
+        }
+      }
+    }
+    imageData.insert(imageData.end(), dst.begin(), dst.end());
+    src.swap(dst);
+    width = dstWidth;
+    height = dstHeight;
+  }
+}
+
+// block format of every image by the material slots it is used in: bc7 for
+// color and for metallic-roughness, whose channels are sampled separately,
+// bc5 for normal maps, whose z the shaders rebuild from x and y, and bc4 for
+// occlusion. Images used in several slots take the first format in that
+// order, unused ones bc7.
+std::vector<hkr::BlockFormat> GetImageBlockFormats(
+    const tinygltf::Model& model) {
+  enum : uint32_t {
+    ROLE_COLOR = 1,
+    ROLE_NORMAL = 2,
+    ROLE_OCCLUSION = 4,
+  };
+  std::vector<uint32_t> roles(model.images.size(), 0);
+  auto addRole = [&](int textureIndex, uint32_t role) {
+    if (textureIndex < 0 ||
+        static_cast<size_t>(textureIndex) >= model.textures.size()) {
+      return;
+    }
+    const int source = model.textures[textureIndex].source;
+    if (source >= 0 && static_cast<size_t>(source) < roles.size()) {
+      roles[source] |= role;
+    }
+  };
+  for (const tinygltf::Material& material : model.materials) {
+    addRole(material.pbrMetallicRoughness.baseColorTexture.index, ROLE_COLOR);
+    addRole(material.pbrMetallicRoughness.metallicRoughnessTexture.index,
+            ROLE_COLOR);
+    addRole(material.emissiveTexture.index, ROLE_COLOR);
+    addRole(material.normalTexture.index, ROLE_NORMAL);
+    addRole(material.occlusionTexture.index, ROLE_OCCLUSION);
+  }
+  std::vector<hkr::BlockFormat> formats(roles.size());
+  for (size_t i = 0; i < roles.size(); i++) {
+    if (roles[i] == 0 || (roles[i] & ROLE_COLOR)) {
+      formats[i] = hkr::BlockFormat::BC7;
+    } else if (roles[i] & ROLE_NORMAL) {
+      formats[i] = hkr::BlockFormat::BC5;
+    } else {
+      formats[i] = hkr::BlockFormat::BC4;
+    }
+  }
+  return formats;
+}
+
+bool IsDataUri(const std::string& uri) {
+  return uri.rfind("data:", 0) == 0;
+}
+
+// directory of the file, "." if it has none
+std::string GetDirectory(const std::string& fileName) {
+  const size_t pos = fileName.find_last_of('/');
+  return pos == std::string::npos ? "." : fileName.substr(0, pos);
+}
+
+}  // namespace
+
+namespace hkr {
+
+std::string GetCookedFileName(const std::string& fileName) {
+  return fileName.substr(0, fileName.find_last_of('.')) + ".hkm";
+}
+
+bool CookModel(const std::string& fileName,
+               const std::string& cookedFileName,
+               const CookOptions& options,
+               ThreadPool& threadPool,
+               CookReport& report,
+               std::string& err) {
+  tinygltf::Model model;
+  tinygltf::TinyGLTF loader;
+  // ktx2 images are kept as they are, the others keep their channels and are
+  // expanded by ExpandToRGBA
+  tinygltf::LoadImageDataOption option;
+  option.preserve_channels = true;
+  loader.SetImageLoader(
+      [](tinygltf::Image* image, const int imageIndex, std::string* err,
+         std::string* warn, int req_width, int req_height,
+         const unsigned char* bytes, int size, void* userData) -> bool {
+        if (!image->uri.empty() && GetFileExtension(image->uri) == "ktx2") {
+          return true;
+        }
+        return tinygltf::LoadImageData(image, imageIndex, err, warn, req_width,
+                                       req_height, bytes, size, userData);
+      },
+      &option);
+  std::string warn;
+  const bool result = LoadglTFFile(loader, model, fileName, err, warn,
+                                   &threadPool);
+  if (!result) {
+    return false;
+  }
+
+  // source files, the model itself first
+  const std::string directory = GetDirectory(fileName);
+  std::vector<CookedDependency> dependencies;
+  auto addDependency = [&](const std::string& path) -> int32_t {
+    for (size_t i = 0; i < dependencies.size(); i++) {
+      if (path == dependencies[i].path) {
+        return static_cast<int32_t>(i);
+      }
+    }
+    MappedFile file;
+    if (path.size() >= sizeof(CookedDependency::path) ||
+        !file.Open(directory + "/" + path)) {
+      err = "cannot read dependency: " + path;
+      return -1;
+    }
+    CookedDependency& dependency = dependencies.emplace_back();
+    dependency.hash = HashFnv1a(file.GetData(), file.GetSize());
+    dependency.size = file.GetSize();
+    dependency.writeTime = GetWriteTime(directory + "/" + path);
+    memcpy(dependency.path, path.data(), path.size());
+    return static_cast<int32_t>(dependencies.size() - 1);
+  };
+  if (addDependency(fileName.substr(fileName.find_last_of('/') + 1)) < 0) {
+    return false;
+  }
+  for (const tinygltf::Buffer& buffer : model.buffers) {
+    if (!buffer.uri.empty() && !IsDataUri(buffer.uri) &&
+        addDependency(buffer.uri) < 0) {
+      return false;
+    }
+  }
+
+  // tables
+  ModelDesc desc;
+  BuildModelDesc(model, desc);
+
+  // vertex streams and indices of all meshes
+  MeshData meshData;
+  for (uint32_t stream = 0; stream < VERTEX_STREAM_COUNT; stream++) {
+    if (desc.HasVertexStream(static_cast<VertexStream>(stream))) {
+      meshData.vertexStreams[stream].resize(static_cast<size_t>(
+          desc.vertexCount) * VERTEX_STREAM_STRIDES[stream]);
+    }
+  }
+  meshData.indices.resize(desc.indexDataSize);
+  threadPool.ParallelFor(
+      static_cast<uint32_t>(desc.meshes.size()), [&](uint32_t i) {
+        DecodeMesh(model, desc, i, GetMeshDestination(desc, i, meshData));
+      });
+  if (options.optimizeMeshes) {
+    auto tStart = std::chrono::high_resolution_clock::now();
+    OptimizeMeshes(desc, meshData, threadPool, report.meshesBefore,
+                   report.meshesAfter);
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    report.optimizeMilliseconds =
+        std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+  }
+
+  // images with their mip chain, either block compressed into ktx2 files
+  // next to the model or kept as rgba8 in the cooked model
+  std::vector<CookedImage> images(model.images.size());
+  for (size_t i = 0; i < model.images.size(); i++) {
+    const tinygltf::Image& image = model.images[i];
+    const bool external = !image.uri.empty() && !IsDataUri(image.uri);
+    if (external && GetFileExtension(image.uri) == "ktx2") {
+      images[i].format = CookedImageFormat::KTX2;
+      images[i].dependencyIndex = addDependency(image.uri);
+      if (images[i].dependencyIndex < 0) {
+        return false;
+      }
+      continue;
+    }
+    if (external && addDependency(image.uri) < 0) {
+      return false;
+    }
+  }
+  std::vector<uint8_t> imageData;
+  if (options.compressTextures) {
+    auto tStart = std::chrono::high_resolution_clock::now();
+    const std::vector<BlockFormat> formats = GetImageBlockFormats(model);
+    std::vector<std::string> paths(model.images.size());
+    std::vector<std::string> errors(model.images.size());
+    threadPool.ParallelFor(
+        static_cast<uint32_t>(model.images.size()), [&](uint32_t i) {
+          if (images[i].format == CookedImageFormat::KTX2) {
+            return;
+          }
+          const tinygltf::Image& image = model.images[i];
+          const uint32_t width = static_cast<uint32_t>(image.width);
+          const uint32_t height = static_cast<uint32_t>(image.height);
+          const uint32_t mipLevels = GetMipLevelCount(width, height);
+          std::vector<uint8_t> pixels;
+          std::vector<uint8_t> mipChain;
+          ExpandToRGBA(image, pixels);
+          AppendMipChain(pixels, width, height, mipLevels, mipChain);
+          paths[i] = GetCookedImagePath(fileName, image.uri, i);
+          CookTexture(directory + "/" + paths[i], formats[i], mipChain.data(),
+                      width, height, mipLevels, threadPool, errors[i]);
+        });
+    for (size_t i = 0; i < images.size(); i++) {
+      if (!errors[i].empty()) {
+        err = errors[i];
+        return false;
+      }
+      if (paths[i].empty()) {
+        continue;
+      }
+      images[i].format = CookedImageFormat::KTX2;
+      images[i].dependencyIndex = addDependency(paths[i]);
+      if (images[i].dependencyIndex < 0) {
+        return false;
+      }
+      report.compressedImageCount++;
+    }
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    report.compressMilliseconds =
+        std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+  } else {
+    std::vector<uint8_t> pixels;
+    for (size_t i = 0; i < model.images.size(); i++) {
+      CookedImage& cookedImage = images[i];
+      if (cookedImage.format == CookedImageFormat::KTX2) {
+        continue;
+      }
+      ExpandToRGBA(model.images[i], pixels);
+      cookedImage.width = static_cast<uint32_t>(model.images[i].width);
+      cookedImage.height = static_cast<uint32_t>(model.images[i].height);
+      cookedImage.mipLevels =
+          GetMipLevelCount(cookedImage.width, cookedImage.height);
+      cookedImage.offset = imageData.size();
+      AppendMipChain(pixels, cookedImage.width, cookedImage.height,
+                     cookedImage.mipLevels, imageData);
+      cookedImage.size = imageData.size() - cookedImage.offset;
+      // keep every mip chain aligned for the staging copies
+      imageData.resize((imageData.size() + 15) & ~static_cast<size_t>(15));
+    }
+  }
+
+  CookedHeader header;
+  std::vector<uint8_t> file(sizeof(CookedHeader));
+  AppendSection(file, header, CookedSection::Dependencies, dependencies);
+  AppendSection(file, header, CookedSection::Samplers, desc.samplers);
+  AppendSection(file, header, CookedSection::Textures, desc.textures);
+  AppendSection(file, header, CookedSection::Materials, desc.materials);
+  AppendSection(file, header, CookedSection::Meshes, desc.meshes);
+  AppendSection(file, header, CookedSection::Primitives, desc.primitives);
+  AppendSection(file, header, CookedSection::Nodes, desc.nodes);
+  AppendSection(file, header, CookedSection::NodeChildren, desc.nodeChildren);
+  AppendSection(file, header, CookedSection::SceneNodes, desc.sceneNodes);
+  AppendSection(file, header, CookedSection::Images, images);
+  for (uint32_t stream = 0; stream < VERTEX_STREAM_COUNT; stream++) {
+    AppendSection(file, header,
+                  GetVertexStreamSection(static_cast<VertexStream>(stream)),
+                  meshData.vertexStreams[stream]);
+  }
+  AppendSection(file, header, CookedSection::Indices, meshData.indices);
+  AppendSection(file, header, CookedSection::ImageData, imageData);
+  memcpy(file.data(), &header, sizeof(CookedHeader));
+
+  std::ofstream out(cookedFileName, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    err = "cannot write cooked model: " + cookedFileName;
+    return false;
+  }
+  out.write(reinterpret_cast<const char*>(file.data()),
+            static_cast<std::streamsize>(file.size()));
+  if (!out) {
+    err = "cannot write cooked model: " + cookedFileName;
+    return false;
+  }
+  return true;
+}
+
+bool CookedModel::Open(const std::string& fileName,
+                       const std::string& sourceFileName) {
+  if (!mFile.Open(fileName)) {
+    return false;
+  }
+  if (mFile.GetSize() < sizeof(CookedHeader) ||
+      GetHeader().magic != COOKED_MODEL_MAGIC ||
+      GetHeader().version != COOKED_MODEL_VERSION) {
+    HKR_WARN("Ignoring invalid cooked model: {}", fileName);
+    mFile.Close();
+    return false;
+  }
+  for (size_t i = 0; i < static_cast<size_t>(CookedSection::Count); i++) {
+    const CookedHeader::Section& range = GetHeader().sections[i];
+    if (range.offset % COOKED_SECTION_ALIGNMENT != 0 ||
+        range.size % SECTION_ELEMENT_SIZES[i] != 0 ||
+        range.offset > mFile.GetSize() ||
+        range.size > mFile.GetSize() - range.offset) {
+      HKR_WARN("Ignoring truncated cooked model: {}", fileName);
+      mFile.Close();
+      return false;
+    }
+  }
+
+  // the cooked model is stale once any of its sources changed. Sources are
+  // only read when their size matches but their write time does not, after a
+  // copy or a checkout, so that an up to date model costs a stat per source.
+  // Packs are built from cooked trees, their files carry no times.
+  mDirectory = GetDirectory(sourceFileName);
+  for (const CookedDependency& dependency :
+       GetSection<CookedDependency>(CookedSection::Dependencies)) {
+    const std::string path(
+        dependency.path,
+        strnlen(dependency.path, sizeof(CookedDependency::path)));
+    const std::string sourcePath = mDirectory + "/" + path;
+    size_t size = 0;
+    bool current = GetAssetSize(sourcePath, size) && size == dependency.size;
+    if (current && !IsPackedAsset(sourcePath)) {
+      const int64_t writeTime = GetWriteTime(sourcePath);
+      AssetFile source;
+      current = (writeTime >= 0 && writeTime == dependency.writeTime) ||
+                (source.Open(sourcePath) &&
+                 HashFnv1a(source.GetData(), source.GetSize()) ==
+                     dependency.hash);
+    }
+    if (!current) {
+      HKR_WARN("Ignoring stale cooked model: {} ({} changed)", fileName, path);
+      mFile.Close();
+      return false;
+    }
+  }
+  return true;
+}
+
+void CookedModel::ReadDesc(ModelDesc& desc) const {
+  auto copy = [this](auto& dst, CookedSection section) {
+    using T = typename std::remove_reference_t<decltype(dst)>::value_type;
+    std::span<const T> src = GetSection<T>(section);
+    dst.assign(src.begin(), src.end());
+  };
+  copy(desc.samplers, CookedSection::Samplers);
+  copy(desc.textures, CookedSection::Textures);
+  copy(desc.materials, CookedSection::Materials);
+  copy(desc.meshes, CookedSection::Meshes);
+  copy(desc.primitives, CookedSection::Primitives);
+  copy(desc.nodes, CookedSection::Nodes);
+  copy(desc.nodeChildren, CookedSection::NodeChildren);
+  copy(desc.sceneNodes, CookedSection::SceneNodes);
+  desc.imageCount = static_cast<uint32_t>(
+      GetSection<CookedImage>(CookedSection::Images).size());
+  desc.vertexCount = static_cast<uint32_t>(
+      GetSection<Vec3>(CookedSection::PositionStream).size());
+  for (uint32_t stream = 0; stream < VERTEX_STREAM_COUNT; stream++) {
+    if (!GetSection<uint8_t>(
+             GetVertexStreamSection(static_cast<VertexStream>(stream)))
+             .empty()) {
+      desc.vertexStreamMask |= 1u << stream;
+    }
+  }
+  desc.indexDataSize = GetSection<uint8_t>(CookedSection::Indices).size();
+}
+
+}  // namespace hkr
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "Renderer/MeshOptimize.h"
+#include "Renderer/ModelDesc.h"
+#include "Util/AssetPack.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+namespace hkr {
+
+class ThreadPool;
+
+// A cooked model (.hkm) is produced once from a .gltf/.glb file by
+// hikari_cook. It holds the tables of ModelDesc, gpu ready vertex streams,
+// indices and either rgba8 images with their full mip chain or references to
+// the block compressed ktx2 files cooked next to them, so loading it is a
+// matter of mapping the file and copying the blobs into staging memory. It
+// records the size, write time and content hash of every file it was cooked
+// from and is ignored once any of them changes.
+//
+// layout: CookedHeader, then the sections in CookedSection order, each one an
+// array of its element type starting at a 16 byte aligned offset
+constexpr uint32_t COOKED_MODEL_MAGIC = 0x4d524b48;  // "HKRM"
+constexpr uint32_t COOKED_MODEL_VERSION = 5;
+constexpr uint64_t COOKED_SECTION_ALIGNMENT = 16;
+
+enum class CookedSection : uint32_t {
+  Dependencies,  // CookedDependency
+  Samplers,      // SamplerDesc
+  Textures,      // TextureDesc
+  Materials,     // MaterialDesc
+  Meshes,        // MeshDesc
+  Primitives,    // PrimitiveDesc
+  Nodes,         // NodeDesc
+  NodeChildren,  // uint32_t
+  SceneNodes,    // uint32_t
+  Images,        // CookedImage
+  // one section per VertexStream in the same order, empty if the model lacks
+  // the stream
+  PositionStream,
+  AttributeStream,
+  ColorStream,
+  SkinStream,
+  // uint16_t or uint32_t indices per PrimitiveDesc::indexType
+  Indices,    // uint8_t
+  ImageData,  // uint8_t
+  Count,
+};
+
+struct CookedHeader {
+  uint32_t magic = COOKED_MODEL_MAGIC;
+  uint32_t version = COOKED_MODEL_VERSION;
+  struct Section {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+  } sections[static_cast<size_t>(CookedSection::Count)];
+};
+
+// a source file, path relative to the directory of the source model. The
+// hash is only compared when the size matches but the write time does not.
+struct CookedDependency {
+  uint64_t hash = 0;
+  uint64_t size = 0;
+  // see GetWriteTime
+  int64_t writeTime = -1;
+  char path[232] = {};
+};
+
+enum class CookedImageFormat : uint32_t {
+  RGBA8,
+  // ktx2 file, either the original one or the block compressed one cooked
+  // from the source image, loaded through libktx
+  KTX2,
+};
+
+struct CookedImage {
+  CookedImageFormat format = CookedImageFormat::RGBA8;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t mipLevels = 0;
+  // mip chain in the image data section, largest level first
+  uint64_t offset = 0;
+  uint64_t size = 0;
+  // ktx2 file in the dependencies section
+  int32_t dependencyIndex = -1;
+  uint32_t padding = 0;
+};
+
+inline CookedSection GetVertexStreamSection(VertexStream stream) {
+  return static_cast<CookedSection>(
+      static_cast<uint32_t>(CookedSection::PositionStream) + stream);
+}
+
+// cooked model file next to the source file
+std::string GetCookedFileName(const std::string& fileName);
+
+struct CookOptions {
+  // see OptimizeMeshes
+  bool optimizeMeshes = true;
+  // write images as block compressed ktx2 files next to the model, see
+  // CookTexture, instead of rgba8 into the cooked model
+  bool compressTextures = true;
+};
+
+struct CookReport {
+  // vertex cache statistics of all primitives, left empty unless the meshes
+  // are optimized
+  MeshStats meshesBefore;
+  MeshStats meshesAfter;
+  double optimizeMilliseconds = 0.0;
+  uint32_t compressedImageCount = 0;
+  double compressMilliseconds = 0.0;
+};
+
+// parse, decode and write the cooked model, meshes are decoded and optimized
+// and images compressed on the thread pool. Returns false and fills err on
+// failure.
+bool CookModel(const std::string& fileName,
+               const std::string& cookedFileName,
+               const CookOptions& options,
+               ThreadPool& threadPool,
+               CookReport& report,
+               std::string& err);
+
+class CookedModel {
+public:
+  // open the cooked model of the source model, returns false if it is
+  // missing, malformed or out of date with its sources
+  bool Open(const std::string& fileName, const std::string& sourceFileName);
+
+  template <typename T>
+  std::span<const T> GetSection(CookedSection section) const {
+    const CookedHeader::Section& range =
+        GetHeader().sections[static_cast<size_t>(section)];
+    return {reinterpret_cast<const T*>(mFile.GetData() + range.offset),
+            static_cast<size_t>(range.size / sizeof(T))};
+  }
+  // copy the tables, which are small compared to the blobs
+  void ReadDesc(ModelDesc& desc) const;
+  // directory the dependency paths are relative to, the source model's
+  const std::string& GetDirectory() const { return mDirectory; }
+
+private:
+  const CookedHeader& GetHeader() const {
+    return *reinterpret_cast<const CookedHeader*>(mFile.GetData());
+  }
+
+private:
+  AssetFile mFile;
+  std::string mDirectory;
+};
+
+}  // namespace hkr
@@ -0,0 +1,241 @@
+#include "Renderer/CookedTexture.h"
+#include "Util/AssetPack.h"
+#include "Util/Filesystem.h"
+#include "Util/Hash.h"
+#include "Util/MappedFile.h"
+#include "Util/ThreadPool.h"
+
+#include <glm/gtc/packing.hpp>
+#include <ktx.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+// keys of the source hash, size and write time in the key/value data of
+// cooked cubemaps
+constexpr char SOURCE_HASH_KEY[] = "HkrSourceHash";
+constexpr char SOURCE_SIZE_KEY[] = "HkrSourceSize";
+constexpr char SOURCE_WRITE_TIME_KEY[] = "HkrSourceWriteTime";
+
+// VkFormat values, the cook tool is built without the vulkan headers
+constexpr uint32_t FORMAT_R16G16B16A16_SFLOAT = 97;
+constexpr uint32_t FORMAT_R32G32B32A32_SFLOAT = 109;
+
+// ktx2 texture with storage for every level and face, images are compressed
+// straight into it
+ktxTexture2* CreateTexture(hkr::BlockFormat format,
+                           uint32_t width,
+                           uint32_t height,
+                           uint32_t mipLevels,
+                           uint32_t faceCount) {
+  ktxTextureCreateInfo createInfo{};
+  createInfo.vkFormat = hkr::GetBlockVkFormat(format);
+  createInfo.baseWidth = width;
+  createInfo.baseHeight = height;
+  createInfo.baseDepth = 1;
+  createInfo.numDimensions = 2;
+  createInfo.numLevels = mipLevels;
+  createInfo.numLayers = 1;
+  createInfo.numFaces = faceCount;
+  createInfo.isArray = KTX_FALSE;
+  createInfo.generateMipmaps = KTX_FALSE;
+  ktxTexture2* texture = nullptr;
+  if (ktxTexture2_Create(&createInfo, KTX_TEXTURE_CREATE_ALLOC_STORAGE,
+                         &texture) != KTX_SUCCESS) {
+    return nullptr;
+  }
+  return texture;
+}
+
+uint8_t* GetImage(ktxTexture2* texture, uint32_t level, uint32_t face) {
+  ktx_size_t offset = 0;
+  ktxTexture2_GetImageOffset(texture, level, 0, face, &offset);
+  return texture->pData + offset;
+}
+
+// write and destroy the texture
+bool WriteTexture(ktxTexture2* texture,
+                  const std::string& fileName,
+                  std::string& err) {
+  const bool result = ktxTexture_WriteToNamedFile(
+                          ktxTexture(texture), fileName.c_str()) == KTX_SUCCESS;
+  ktxTexture2_Destroy(texture);
+  if (!result) {
+    err = "cannot write cooked texture: " + fileName;
+  }
+  return result;
+}
+
+std::string FormatHash(uint64_t hash) {
+  char text[17];
+  std::snprintf(text, sizeof(text), "%016llx",
+                static_cast<unsigned long long>(hash));
+  return text;
+}
+
+bool AddValue(ktxTexture2* texture, const char* key, const std::string& value) {
+  return ktxHashList_AddKVPair(&texture->kvDataHead, key,
+                               static_cast<unsigned int>(value.size() + 1),
+                               value.c_str()) == KTX_SUCCESS;
+}
+
+// empty if the key is missing
+std::string FindValue(ktxTexture2* texture, const char* key) {
+  unsigned int length = 0;
+  void* value = nullptr;
+  if (ktxHashList_FindValue(&texture->kvDataHead, key, &length, &value) !=
+      KTX_SUCCESS) {
+    return {};
+  }
+  const char* text = static_cast<const char*>(value);
+  return std::string(text, strnlen(text, length));
+}
+
+}  // namespace
+
+namespace hkr {
+
+bool CookTexture(const std::string& cookedFileName,
+                 BlockFormat format,
+                 const uint8_t* mipChain,
+                 uint32_t width,
+                 uint32_t height,
+                 uint32_t mipLevels,
+                 ThreadPool& threadPool,
+                 std::string& err) {
+  ktxTexture2* texture = CreateTexture(format, width, height, mipLevels, 1);
+  if (!texture) {
+    err = "cannot create cooked texture: " + cookedFileName;
+    return false;
+  }
+  const uint8_t* levelTexels = mipChain;
+  for (uint32_t level = 0; level < mipLevels; level++) {
+    const uint32_t levelWidth = std::max(width >> level, 1u);
+    const uint32_t levelHeight = std::max(height >> level, 1u);
+    CompressImage(format, levelTexels, levelWidth, levelHeight,
+                  GetImage(texture, level, 0), threadPool);
+    levelTexels += static_cast<size_t>(levelWidth) * levelHeight * 4;
+  }
+  return WriteTexture(texture, cookedFileName, err);
+}
+
+std::string GetCookedImagePath(const std::string& modelFileName,
+                               const std::string& uri,
+                               size_t imageIndex) {
+  if (!uri.empty() && uri.rfind("data:", 0) != 0) {
+    return uri + ".ktx2";
+  }
+  std::string name = modelFileName.substr(modelFileName.find_last_of('/') + 1);
+  name = name.substr(0, name.find_last_of('.'));
+  return name + ".image" + std::to_string(imageIndex) + ".ktx2";
+}
+
+std::string GetCookedCubemapFileName(const std::string& fileName) {
+  return fileName.substr(0, fileName.find_last_of('.')) + ".bc6h.ktx2";
+}
+
+bool CookCubemap(const std::string& fileName,
+                 const std::string& cookedFileName,
+                 ThreadPool& threadPool,
+                 std::string& err) {
+  MappedFile source;
+  ktxTexture2* src = nullptr;
+  if (!source.Open(fileName) ||
+      ktxTexture2_CreateFromMemory(source.GetData(), source.GetSize(),
+                                   KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT,
+                                   &src) != KTX_SUCCESS) {
+    err = "cannot read cubemap: " + fileName;
+    return false;
+  }
+  if (src->numFaces != 6 || src->numLayers != 1 || src->baseDepth != 1 ||
+      (src->vkFormat != FORMAT_R16G16B16A16_SFLOAT &&
+       src->vkFormat != FORMAT_R32G32B32A32_SFLOAT)) {
+    err = "not a half or float rgba cubemap: " + fileName;
+    ktxTexture2_Destroy(src);
+    return false;
+  }
+  ktxTexture2* texture = CreateTexture(BlockFormat::BC6H, src->baseWidth,
+                                       src->baseHeight, src->numLevels, 6);
+  if (!texture) {
+    err = "cannot create cooked texture: " + cookedFileName;
+    ktxTexture2_Destroy(src);
+    return false;
+  }
+  std::vector<uint16_t> halfs;
+  for (uint32_t level = 0; level < src->numLevels; level++) {
+    const uint32_t levelWidth = std::max(src->baseWidth >> level, 1u);
+    const uint32_t levelHeight = std::max(src->baseHeight >> level, 1u);
+    const size_t componentCount =
+        static_cast<size_t>(levelWidth) * levelHeight * 4;
+    for (uint32_t face = 0; face < 6; face++) {
+      ktx_size_t offset = 0;
+      ktxTexture2_GetImageOffset(src, level, 0, face, &offset);
+      const void* texels = src->pData + offset;
+      if (src->vkFormat == FORMAT_R32G32B32A32_SFLOAT) {
+        halfs.resize(componentCount);
+        for (size_t i = 0; i < componentCount; i++) {
+          float value;
+          memcpy(&value, src->pData + offset + i * sizeof(float),
+                 sizeof(float));
+          halfs[i] = glm::packHalf1x16(value);
+        }
+        texels = halfs.data();
+      }
+      CompressImage(BlockFormat::BC6H, texels, levelWidth, levelHeight,
+                    GetImage(texture, level, face), threadPool);
+    }
+  }
+  ktxTexture2_Destroy(src);
+
+  if (!AddValue(texture, SOURCE_HASH_KEY,
+                FormatHash(HashFnv1a(source.GetData(), source.GetSize()))) ||
+      !AddValue(texture, SOURCE_SIZE_KEY, std::to_string(source.GetSize())) ||
+      !AddValue(texture, SOURCE_WRITE_TIME_KEY,
+                std::to_string(GetWriteTime(fileName)))) {
+    err = "cannot write cooked texture: " + cookedFileName;
+    ktxTexture2_Destroy(texture);
+    return false;
+  }
+  return WriteTexture(texture, cookedFileName, err);
+}
+
+bool IsCookedCubemapCurrent(const std::string& cookedFileName,
+                            const std::string& fileName) {
+  AssetFile cookedFile;
+  ktxTexture2* cooked = nullptr;
+  if (!cookedFile.Open(cookedFileName) ||
+      ktxTexture2_CreateFromMemory(cookedFile.GetData(), cookedFile.GetSize(),
+                                   KTX_TEXTURE_CREATE_NO_FLAGS,
+                                   &cooked) != KTX_SUCCESS) {
+    return false;
+  }
+  const std::string hash = FindValue(cooked, SOURCE_HASH_KEY);
+  const std::string recordedSize = FindValue(cooked, SOURCE_SIZE_KEY);
+  const std::string recordedWriteTime =
+      FindValue(cooked, SOURCE_WRITE_TIME_KEY);
+  ktxTexture2_Destroy(cooked);
+  // the source is only hashed when its size matches but it was written again,
+  // sources in the mounted asset pack are compared by size alone
+  size_t size = 0;
+  if (hash.empty() || !GetAssetSize(fileName, size) ||
+      recordedSize != std::to_string(size)) {
+    return false;
+  }
+  if (IsPackedAsset(fileName)) {
+    return true;
+  }
+  const int64_t writeTime = GetWriteTime(fileName);
+  if (writeTime >= 0 && recordedWriteTime == std::to_string(writeTime)) {
+    return true;
+  }
+  AssetFile source;
+  return source.Open(fileName) &&
+         hash == FormatHash(HashFnv1a(source.GetData(), source.GetSize()));
+}
+
+}  // namespace hkr
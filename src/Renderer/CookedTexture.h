@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Renderer/TextureCompress.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace hkr {
+
+class ThreadPool;
+
+// Cooked textures are ktx2 files of block compressed images with their full
+// mip chain, written by hikari_cook and loaded like any other ktx2 file.
+
+// compress an rgba8 mip chain, levels tightly packed largest first, and write
+// it as a ktx2 file. Returns false and fills err on failure.
+bool CookTexture(const std::string& cookedFileName,
+                 BlockFormat format,
+                 const uint8_t* mipChain,
+                 uint32_t width,
+                 uint32_t height,
+                 uint32_t mipLevels,
+                 ThreadPool& threadPool,
+                 std::string& err);
+
+// cooked file of a glTF image relative to the model directory: <uri>.ktx2
+// next to external images, <model>.image<index>.ktx2 for embedded ones
+std::string GetCookedImagePath(const std::string& modelFileName,
+                               const std::string& uri,
+                               size_t imageIndex);
+
+// cooked cubemap file next to the source file, sky.ktx2 -> sky.bc6h.ktx2
+std::string GetCookedCubemapFileName(const std::string& fileName);
+
+// compress every face and level of a half or float rgba cubemap to bc6h.
+// The cooked file records the content hash, size and write time of its
+// source.
+bool CookCubemap(const std::string& fileName,
+                 const std::string& cookedFileName,
+                 ThreadPool& threadPool,
+                 std::string& err);
+
+// whether the cooked cubemap exists and was cooked from the source as it is,
+// the source is hashed only if its size matches and its write time does not
+bool IsCookedCubemapCurrent(const std::string& cookedFileName,
+                            const std::string& fileName);
+
+}  // namespace hkr
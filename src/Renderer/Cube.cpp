@@ -1,11 +1,11 @@
 #include "Renderer/Cube.h"
+#include "Renderer/UploadBatcher.h"
 #include "Util/vk_util.h"
 
 namespace hkr {
 
 void Cube::Create(VkDevice device,
-                  VkQueue queue,
-                  VkCommandPool commandPool,
+                  UploadBatcher& uploader,
                   VmaAllocator allocator,
                   VkBufferUsageFlags2 bufferUsageFlags) {
   std::array<CubeVertex, 8> vertexData;
@@ -31,29 +31,14 @@ void Cube::Create(VkDevice device,
   size_t vertexDataSize = vertexData.size() * sizeof(CubeVertex);
   size_t indexDataSize = indexData.size() * sizeof(uint32_t);
 
-  StagingBuffer vertexStaging;
-  vertexStaging.Create(allocator, vertexDataSize);
-  vertexStaging.Map(allocator);
-  vertexStaging.Write(vertexData.data(), vertexDataSize);
-  vertexStaging.Unmap(allocator);
   vertices.Create(allocator, vertexDataSize,
-                  VK_BUFFER_USAGE_2_VERTEX_BUFFER_BIT | bufferUsageFlags);
-  StagingBuffer indexStaging;
-  indexStaging.Create(allocator, indexDataSize);
-  indexStaging.Map(allocator);
-  indexStaging.Write(indexData.data(), indexDataSize);
-  indexStaging.Unmap(allocator);
+                  VK_BUFFER_USAGE_2_VERTEX_BUFFER_BIT | bufferUsageFlags,
+                  uploader.GetQueueFamilyIndices());
   indices.Create(allocator, indexDataSize,
-                 VK_BUFFER_USAGE_2_INDEX_BUFFER_BIT | bufferUsageFlags);
-
-  VkCommandBuffer commandBuffer = BeginOneTimeCommands(device, commandPool);
-  CopyBufferToBuffer(commandBuffer, vertexStaging.buffer, vertices.buffer,
-                     vertexDataSize);
-  CopyBufferToBuffer(commandBuffer, indexStaging.buffer, indices.buffer,
-                     indexDataSize);
-  EndOneTimeCommands(device, queue, commandPool, commandBuffer);
-  vertexStaging.Cleanup(allocator);
-  indexStaging.Cleanup(allocator);
+                 VK_BUFFER_USAGE_2_INDEX_BUFFER_BIT | bufferUsageFlags,
+                 uploader.GetQueueFamilyIndices());
+  uploader.UploadBuffer(vertices.buffer, vertexData.data(), vertexDataSize);
+  uploader.UploadBuffer(indices.buffer, indexData.data(), indexDataSize);
 }
 
 void Cube::Draw() {}
@@ -5,6 +5,8 @@
 
 namespace hkr {
 
+class UploadBatcher;
+
 struct CubeVertex {
   Vec3 pos;
 };
@@ -13,8 +15,7 @@ struct CubeVertex {
 class Cube {
 public:
   void Create(VkDevice device,
-              VkQueue queue,
-              VkCommandPool commandPool,
+              UploadBatcher& uploader,
               VmaAllocator allocator,
               VkBufferUsageFlags2 bufferUsageFlags = 0);
   void Draw();
@@ -1,10 +1,13 @@
 #include "Renderer/Image.h"
 #include "Renderer/Buffer.h"
+#include "Renderer/UploadBatcher.h"
+#include "Util/AssetPack.h"
 #include "Util/vk_debug.h"
 #include "Util/vk_util.h"
 
 #include <ktx.h>
 #include <cstdint>
+#include <cstring>
 
 namespace {
 
@@ -19,10 +22,57 @@ VkImageAspectFlags GetAspectFlags(VkFormat format) {
   return flags;
 }
 
+// texture on the contents of a ktx2 file, only supercompressed image data is
+// loaded here, the rest is left in the file for StageKtxTexture
+ktxTexture2* OpenKtxFile(const hkr::AssetFile& file) {
+  ktxTexture2* texture = nullptr;
+  ktxResult result =
+      ktxTexture2_CreateFromMemory(file.GetData(), file.GetSize(),
+                                   KTX_TEXTURE_CREATE_NO_FLAGS, &texture);
+  HKR_ASSERT(result == KTX_SUCCESS);
+  if (texture->supercompressionScheme != KTX_SS_NONE) {
+    result = ktxTexture2_LoadImageData(texture, nullptr, 0);
+    HKR_ASSERT(result == KTX_SUCCESS);
+  }
+  return texture;
+}
+
+// copy the image data of the texture into staging memory of the current
+// batch, straight from its source if it is not loaded
+hkr::UploadBatcher::Allocation StageKtxTexture(hkr::UploadBatcher& uploader,
+                                               ktxTexture2* texture) {
+  hkr::UploadBatcher::Allocation staging =
+      uploader.Allocate(texture->dataSize);
+  if (texture->pData) {
+    memcpy(staging.data, texture->pData, texture->dataSize);
+  } else {
+    ktxResult result = ktxTexture_LoadImageData(
+        ktxTexture(texture), static_cast<ktx_uint8_t*>(staging.data),
+        texture->dataSize);
+    HKR_ASSERT(result == KTX_SUCCESS);
+  }
+  return staging;
+}
+
 }  // namespace
 
 namespace hkr {
 
+VkFormat GetSrgbFormat(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+      return VK_FORMAT_R8G8B8A8_SRGB;
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+      return VK_FORMAT_BC7_SRGB_BLOCK;
+    case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+      return VK_FORMAT_ASTC_4x4_SRGB_BLOCK;
+    case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+      return VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK;
+    default:
+      return format;
+  }
+}
+
 ImageBase::ImageBase(VkDevice device,
                      VmaAllocator allocator,
                      VmaAllocatorCreateFlags allocFlags,
@@ -79,9 +129,16 @@ void ImageBase::Create(VkDevice device,
   vmaCreateImage(allocator, &imageInfo, &allocInfo, &image, &allocation,
                  nullptr);
 
-  // create imageView
+  // create imageView, images with extended usage may have usages their own
+  // format does not support, which are left to views of other formats
+  VkImageViewUsageCreateInfo usageInfo{};
+  usageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+  usageInfo.usage = usage & ~VK_IMAGE_USAGE_STORAGE_BIT;
   VkImageViewCreateInfo viewInfo{};
   viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  if (flags & VK_IMAGE_CREATE_EXTENDED_USAGE_BIT) {
+    viewInfo.pNext = &usageInfo;
+  }
   viewInfo.image = image;
   viewInfo.viewType = viewType;
   viewInfo.format = format;
@@ -154,31 +211,53 @@ void Texture::Create(VkDevice device,
       numSamples);
 }
 
-void Texture::Load(VkDevice device,
-                   VmaAllocator allocator,
-                   VkQueue queue,
-                   VkCommandPool commandPool,
-                   const std::string& fileName) {
+void Texture::CreateWithMipStorage(VkDevice device,
+                                   VmaAllocator allocator,
+                                   uint32_t width,
+                                   uint32_t height,
+                                   uint32_t mipLevels,
+                                   VkFormat format) {
+  ImageBase::Create(
+      device, allocator, 0, width, height, 1, mipLevels, 1, format,
+      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+          VK_IMAGE_USAGE_STORAGE_BIT,
+      VK_SAMPLE_COUNT_1_BIT,
+      VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT);
+}
+
+VkDeviceSize Texture::Load(VkDevice device,
+                           VmaAllocator allocator,
+                           UploadBatcher& uploader,
+                           const std::string& fileName,
+                           bool srgb) {
   size_t extensionPos = fileName.find_last_of(".");
   HKR_ASSERT(extensionPos != std::string::npos);
   std::string_view fileExtension = fileName.substr(extensionPos + 1);
   HKR_ASSERT(fileExtension == "ktx2");
-  ktxTexture2* ktxTexture = nullptr;
-  ktxResult result = ktxTexture2_CreateFromNamedFile(
-      fileName.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &ktxTexture);
-  HKR_ASSERT(result == KTX_SUCCESS);
+  AssetFile file;
+  [[maybe_unused]] const bool opened = file.Open(fileName);
+  HKR_ASSERT(opened);
+  ktxTexture2* ktxTexture = OpenKtxFile(file);
+  VkDeviceSize textureSize =
+      Load(device, allocator, uploader, ktxTexture, srgb);
+  ktxTexture2_Destroy(ktxTexture);
+  return textureSize;
+}
+
+VkDeviceSize Texture::Load(VkDevice device,
+                           VmaAllocator allocator,
+                           UploadBatcher& uploader,
+                           ktxTexture2* ktxTexture,
+                           bool srgb) {
   uint32_t width = ktxTexture->baseWidth;
   uint32_t height = ktxTexture->baseHeight;
   uint32_t mipLevels = ktxTexture->numLevels;
   auto format = static_cast<VkFormat>(ktxTexture->vkFormat);
-  ktx_uint8_t* textureData = ktxTexture->pData;
+  if (srgb) {
+    format = GetSrgbFormat(format);
+  }
   ktx_size_t textureSize = ktxTexture->dataSize;
-  // create staging buffer and copy texture data
-  StagingBuffer staging;
-  staging.Create(allocator, textureSize);
-  staging.Map(allocator);
-  staging.Write(textureData, textureSize);
-  staging.Unmap(allocator);
+  UploadBatcher::Allocation staging = StageKtxTexture(uploader, ktxTexture);
   // copyRegions for mipmaps
   std::vector<VkBufferImageCopy2> copyRegions(mipLevels);
   for (size_t i = 0; i < mipLevels; i++) {
@@ -188,7 +267,7 @@ void Texture::Load(VkDevice device,
     HKR_ASSERT(result == KTX_SUCCESS);
     VkBufferImageCopy2 copyRegion{};
     copyRegion.sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2;
-    copyRegion.bufferOffset = offset;
+    copyRegion.bufferOffset = staging.offset + offset;
     copyRegion.bufferRowLength = 0;
     copyRegion.bufferImageHeight = 0;
     copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -203,16 +282,15 @@ void Texture::Load(VkDevice device,
   // create image
   Create(device, allocator, width, height, mipLevels, format,
          VK_SAMPLE_COUNT_1_BIT);
-  VkCommandBuffer commandBuffer = BeginOneTimeCommands(device, commandPool);
+  VkCommandBuffer commandBuffer = uploader.GetCommandBuffer();
   TransitImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_UNDEFINED,
                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
   CopyBufferToTexture(commandBuffer, staging.buffer, image, copyRegions);
-  TransitImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels);
-  EndOneTimeCommands(device, queue, commandPool, commandBuffer);
-
-  ktxTexture2_Destroy(ktxTexture);
-  staging.Cleanup(allocator);
+  // hand the image over to the graphics queue
+  uploader.TransferImage(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                         {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1});
+  return textureSize;
 }
 
 void Texture::Cleanup(VkDevice device, VmaAllocator allocator) {
@@ -245,29 +323,21 @@ void Cubemap::Create(VkDevice device,
 
 void Cubemap::Load(VkDevice device,
                    VmaAllocator allocator,
-                   VkQueue queue,
-                   VkCommandPool commandPool,
+                   UploadBatcher& uploader,
                    const std::string& fileName) {
   size_t extensionPos = fileName.find_last_of(".");
   HKR_ASSERT(extensionPos != std::string::npos);
   std::string_view fileExtension = fileName.substr(extensionPos + 1);
   HKR_ASSERT(fileExtension == "ktx2");
-  ktxTexture2* ktxCubeMap = nullptr;
-  ktxResult result = ktxTexture2_CreateFromNamedFile(
-      fileName.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &ktxCubeMap);
-  HKR_ASSERT(result == KTX_SUCCESS);
+  AssetFile file;
+  [[maybe_unused]] const bool opened = file.Open(fileName);
+  HKR_ASSERT(opened);
+  ktxTexture2* ktxCubeMap = OpenKtxFile(file);
   uint32_t width = ktxCubeMap->baseWidth;
   uint32_t height = ktxCubeMap->baseHeight;
   uint32_t mipLevels = ktxCubeMap->numLevels;
   auto format = static_cast<VkFormat>(ktxCubeMap->vkFormat);
-  ktx_uint8_t* textureData = ktxCubeMap->pData;
-  ktx_size_t textureSize = ktxCubeMap->dataSize;
-  // create staging buffer and copy texture data
-  StagingBuffer staging;
-  staging.Create(allocator, textureSize);
-  staging.Map(allocator);
-  staging.Write(textureData, textureSize);
-  staging.Unmap(allocator);
+  UploadBatcher::Allocation staging = StageKtxTexture(uploader, ktxCubeMap);
   // copyRegions for mipmaps
   std::vector<VkBufferImageCopy2> copyRegions(6 * mipLevels);
   for (size_t face = 0; face < 6; face++) {
@@ -278,7 +348,7 @@ void Cubemap::Load(VkDevice device,
       HKR_ASSERT(result == KTX_SUCCESS);
       VkBufferImageCopy2 copyRegion{};
       copyRegion.sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2;
-      copyRegion.bufferOffset = offset;
+      copyRegion.bufferOffset = staging.offset + offset;
       copyRegion.bufferRowLength = 0;
       copyRegion.bufferImageHeight = 0;
       copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -294,16 +364,16 @@ void Cubemap::Load(VkDevice device,
   // create image
   Create(device, allocator, width, height, mipLevels, format,
          VK_SAMPLE_COUNT_1_BIT);
-  VkCommandBuffer commandBuffer = BeginOneTimeCommands(device, commandPool);
+  VkCommandBuffer commandBuffer = uploader.GetCommandBuffer();
   TransitImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_UNDEFINED,
                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, 6);
   CopyBufferToTexture(commandBuffer, staging.buffer, image, copyRegions);
-  TransitImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels, 6);
-  EndOneTimeCommands(device, queue, commandPool, commandBuffer);
+  // hand the image over to the graphics queue
+  uploader.TransferImage(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                         {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 6});
 
   ktxTexture2_Destroy(ktxCubeMap);
-  staging.Cleanup(allocator);
 }
 
 void Cubemap::Cleanup(VkDevice device, VmaAllocator allocator) {
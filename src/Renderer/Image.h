@@ -6,8 +6,16 @@
 #include <cstdint>
 #include <string>
 
+struct ktxTexture2;
+
 namespace hkr {
 
+class UploadBatcher;
+
+// srgb counterpart of the unorm color formats cooked, transcoded or loaded as
+// textures, other formats are returned as is
+VkFormat GetSrgbFormat(VkFormat format);
+
 // general image (may not be used directly)
 class ImageBase {
 public:
@@ -41,9 +49,9 @@ public:
               VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D);
   void Cleanup(VkDevice device, VmaAllocator allocator);
 
-  VkImage image;
-  VkImageView imageView;
-  VmaAllocation allocation;
+  VkImage image = VK_NULL_HANDLE;
+  VkImageView imageView = VK_NULL_HANDLE;
+  VmaAllocation allocation = VK_NULL_HANDLE;
 };
 
 // color/depth attachment, storage image with dedicated memory allocation
@@ -89,13 +97,27 @@ public:
               uint32_t mipLevels,
               VkFormat format,
               VkSampleCountFlagBits numSamples = VK_SAMPLE_COUNT_1_BIT);
-  // create image and load data from file
-  // TODO: may split out the staging part
-  void Load(VkDevice device,
-            VmaAllocator allocator,
-            VkQueue queue,
-            VkCommandPool commandPool,
-            const std::string& fileName);
+  // storage usage and unorm views for MipGenerator, also for srgb formats
+  void CreateWithMipStorage(VkDevice device,
+                            VmaAllocator allocator,
+                            uint32_t width,
+                            uint32_t height,
+                            uint32_t mipLevels,
+                            VkFormat format);
+  // create image and record the upload of file data into the current batch,
+  // returns the number of bytes staged. srgb views unorm color formats as
+  // their srgb counterparts.
+  VkDeviceSize Load(VkDevice device,
+                    VmaAllocator allocator,
+                    UploadBatcher& uploader,
+                    const std::string& fileName,
+                    bool srgb = false);
+  // same for a texture already loaded, and transcoded, by a loader thread
+  VkDeviceSize Load(VkDevice device,
+                    VmaAllocator allocator,
+                    UploadBatcher& uploader,
+                    ktxTexture2* ktxTexture,
+                    bool srgb = false);
   void Cleanup(VkDevice device, VmaAllocator allocator);
 };
 
@@ -118,12 +140,10 @@ public:
               uint32_t mipLevels,
               VkFormat format,
               VkSampleCountFlagBits numSamples = VK_SAMPLE_COUNT_1_BIT);
-  // create image and load data from file
-  // TODO: may split out the staging part
+  // create image and record the upload of file data into the current batch
   void Load(VkDevice device,
             VmaAllocator allocator,
-            VkQueue queue,
-            VkCommandPool commandPool,
+            UploadBatcher& uploader,
             const std::string& fileName);
   void Cleanup(VkDevice device, VmaAllocator allocator);
 };
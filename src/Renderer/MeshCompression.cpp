@@ -0,0 +1,488 @@
+#include "Renderer/MeshCompression.h"
+#include "Util/ThreadPool.h"
+
+#include <draco/compression/decode.h>
+#include <meshoptimizer.h>
+
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// func(T{}) with T the type of a glTF component type
+template <typename F>
+bool DispatchComponentType(int32_t componentType, F&& func) {
+  switch (componentType) {
+    case TINYGLTF_COMPONENT_TYPE_BYTE:
+      return func(int8_t{});
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      return func(uint8_t{});
+    case TINYGLTF_COMPONENT_TYPE_SHORT:
+      return func(int16_t{});
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+      return func(uint16_t{});
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+      return func(uint32_t{});
+    case TINYGLTF_COMPONENT_TYPE_FLOAT:
+      return func(float{});
+    default:
+      return false;
+  }
+}
+
+uint64_t AlignDecoded(uint64_t size) {
+  return (size + 3) & ~uint64_t{3};
+}
+
+// run func(i) for every job on the thread pool, or serially without one
+void RunJobs(hkr::ThreadPool* threadPool,
+             uint32_t count,
+             const std::function<void(uint32_t)>& func) {
+  if (threadPool) {
+    threadPool->ParallelFor(count, func);
+  } else {
+    for (uint32_t i = 0; i < count; i++) {
+      func(i);
+    }
+  }
+}
+
+bool ReadMeshoptExtension(const tinygltf::Value& ext,
+                          hkr::MeshoptBufferView& view) {
+  auto getInt = [&](const char* key, auto& value) {
+    if (ext.Has(key)) {
+      value = static_cast<std::remove_reference_t<decltype(value)>>(
+          ext.Get(key).GetNumberAsInt());
+    }
+  };
+  getInt("buffer", view.buffer);
+  getInt("byteOffset", view.byteOffset);
+  getInt("byteLength", view.byteLength);
+  getInt("byteStride", view.byteStride);
+  getInt("count", view.count);
+  return ext.Has("mode") &&
+         hkr::ParseMeshoptMode(ext.Get("mode").Get<std::string>(),
+                               view.mode) &&
+         (!ext.Has("filter") ||
+          hkr::ParseMeshoptFilter(ext.Get("filter").Get<std::string>(),
+                                  view.filter));
+}
+
+}  // namespace
+
+namespace hkr {
+
+bool ParseMeshoptMode(const std::string& name, MeshoptMode& mode) {
+  if (name == "ATTRIBUTES") {
+    mode = MeshoptMode::Attributes;
+  } else if (name == "TRIANGLES") {
+    mode = MeshoptMode::Triangles;
+  } else if (name == "INDICES") {
+    mode = MeshoptMode::Indices;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ParseMeshoptFilter(const std::string& name, MeshoptFilter& filter) {
+  if (name == "NONE") {
+    filter = MeshoptFilter::None;
+  } else if (name == "OCTAHEDRAL") {
+    filter = MeshoptFilter::Octahedral;
+  } else if (name == "QUATERNION") {
+    filter = MeshoptFilter::Quaternion;
+  } else if (name == "EXPONENTIAL") {
+    filter = MeshoptFilter::Exponential;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool DecodeMeshoptBufferView(const MeshoptBufferView& view,
+                             std::span<const uint8_t> src,
+                             uint8_t* dst) {
+  const size_t count = view.count;
+  const size_t stride = view.byteStride;
+  // the decoders assert on strides they do not support
+  const bool indexStride = stride == 2 || stride == 4;
+  bool valid = false;
+  switch (view.mode) {
+    case MeshoptMode::Attributes:
+      valid = stride > 0 && stride <= 256 && stride % 4 == 0;
+      break;
+    case MeshoptMode::Triangles:
+      valid = indexStride && count % 3 == 0;
+      break;
+    case MeshoptMode::Indices:
+      valid = indexStride;
+      break;
+  }
+  switch (view.filter) {
+    case MeshoptFilter::None:
+      break;
+    case MeshoptFilter::Octahedral:
+      valid = valid && (stride == 4 || stride == 8);
+      break;
+    case MeshoptFilter::Quaternion:
+      valid = valid && stride == 8;
+      break;
+    case MeshoptFilter::Exponential:
+      valid = valid && stride % 4 == 0;
+      break;
+  }
+  if (!valid) {
+    return false;
+  }
+
+  int result = -1;
+  switch (view.mode) {
+    case MeshoptMode::Attributes:
+      result = meshopt_decodeVertexBuffer(dst, count, stride, src.data(),
+                                          src.size());
+      break;
+    case MeshoptMode::Triangles:
+      result = meshopt_decodeIndexBuffer(dst, count, stride, src.data(),
+                                         src.size());
+      break;
+    case MeshoptMode::Indices:
+      result = meshopt_decodeIndexSequence(dst, count, stride, src.data(),
+                                           src.size());
+      break;
+  }
+  if (result != 0) {
+    return false;
+  }
+  // filters undo the quantization of the encoder in place
+  switch (view.filter) {
+    case MeshoptFilter::None:
+      break;
+    case MeshoptFilter::Octahedral:
+      meshopt_decodeFilterOct(dst, count, stride);
+      break;
+    case MeshoptFilter::Quaternion:
+      meshopt_decodeFilterQuat(dst, count, stride);
+      break;
+    case MeshoptFilter::Exponential:
+      meshopt_decodeFilterExp(dst, count, stride);
+      break;
+  }
+  return true;
+}
+
+uint64_t GetDracoTargetSize(const DracoTarget& target) {
+  return uint64_t{target.count} * target.components *
+         static_cast<uint32_t>(
+             tinygltf::GetComponentSizeInBytes(target.componentType));
+}
+
+bool DecodeDracoPrimitive(std::span<const uint8_t> src,
+                          std::span<const DracoTarget> attributes,
+                          const DracoTarget& indices,
+                          std::string& err) {
+  draco::DecoderBuffer buffer;
+  buffer.Init(reinterpret_cast<const char*>(src.data()), src.size());
+  draco::Decoder decoder;
+  auto decoded = decoder.DecodeMeshFromBuffer(&buffer);
+  if (!decoded.ok()) {
+    err = "draco: " + decoded.status().error_msg_string();
+    return false;
+  }
+  const std::unique_ptr<draco::Mesh> mesh = std::move(decoded).value();
+
+  for (const DracoTarget& target : attributes) {
+    const draco::PointAttribute* attribute =
+        mesh->GetAttributeByUniqueId(target.uniqueId);
+    if (!attribute || mesh->num_points() != target.count) {
+      err = "draco attribute " + std::to_string(target.uniqueId) +
+            " is missing or does not match its accessor";
+      return false;
+    }
+    const bool converted =
+        DispatchComponentType(target.componentType, [&](auto component) {
+          using T = decltype(component);
+          T* dst = reinterpret_cast<T*>(target.dst);
+          for (uint32_t i = 0; i < target.count; i++) {
+            if (!attribute->ConvertValue<T>(
+                    attribute->mapped_index(draco::PointIndex(i)),
+                    static_cast<int8_t>(target.components),
+                    dst + size_t{i} * target.components)) {
+              return false;
+            }
+          }
+          return true;
+        });
+    if (!converted) {
+      err = "draco attribute " + std::to_string(target.uniqueId) +
+            " cannot be converted to its accessor's type";
+      return false;
+    }
+  }
+
+  if (uint64_t{mesh->num_faces()} * 3 != indices.count) {
+    err = "draco index count does not match its accessor";
+    return false;
+  }
+  const bool written =
+      DispatchComponentType(indices.componentType, [&](auto component) {
+        using T = decltype(component);
+        if constexpr (std::is_same_v<T, uint8_t> ||
+                      std::is_same_v<T, uint16_t> ||
+                      std::is_same_v<T, uint32_t>) {
+          T* dst = reinterpret_cast<T*>(indices.dst);
+          for (draco::FaceIndex f(0); f < mesh->num_faces(); f++) {
+            const draco::Mesh::Face& face = mesh->face(f);
+            for (int k = 0; k < 3; k++) {
+              *dst++ = static_cast<T>(face[k].value());
+            }
+          }
+          return true;
+        } else {
+          return false;
+        }
+      });
+  if (!written) {
+    err = "draco indices have an invalid component type";
+    return false;
+  }
+  return true;
+}
+
+MeshDecompressor::MeshDecompressor(std::vector<uint64_t> bufferSizes)
+    : mBufferSizes(std::move(bufferSizes)) {}
+
+bool MeshDecompressor::IsValidRange(int32_t buffer,
+                                    uint64_t offset,
+                                    uint64_t length) const {
+  return buffer >= 0 && static_cast<size_t>(buffer) < mBufferSizes.size() &&
+         offset <= mBufferSizes[buffer] &&
+         length <= mBufferSizes[buffer] - offset;
+}
+
+bool MeshDecompressor::AddMeshoptView(int32_t bufferView,
+                                      const MeshoptBufferView& meshopt,
+                                      uint32_t& dstBuffer,
+                                      std::string& err) {
+  if (!IsValidRange(meshopt.buffer, meshopt.byteOffset, meshopt.byteLength)) {
+    err = "invalid EXT_meshopt_compression in buffer view " +
+          std::to_string(bufferView);
+    return false;
+  }
+  dstBuffer = static_cast<uint32_t>(mBufferSizes.size() + mJobs.size());
+  Job& job = mJobs.emplace_back();
+  job.bufferView = bufferView;
+  job.meshopt = meshopt;
+  job.size = meshopt.GetDecodedSize();
+  return true;
+}
+
+bool MeshDecompressor::AddDracoPrimitive(
+    int32_t bufferView,
+    int32_t buffer,
+    uint64_t byteOffset,
+    uint64_t byteLength,
+    std::span<const Attribute> attributes,
+    int32_t indices,
+    std::span<const Accessor> accessors,
+    std::vector<TargetView>& views,
+    std::string& err) {
+  if (!IsValidRange(buffer, byteOffset, byteLength)) {
+    err = "draco buffer view " + std::to_string(bufferView) +
+          " lies outside its buffer";
+    return false;
+  }
+  auto isAccessor = [&](int32_t index) {
+    return index >= 0 && static_cast<size_t>(index) < accessors.size();
+  };
+  bool valid = isAccessor(indices);
+  for (const Attribute& attribute : attributes) {
+    valid = valid && isAccessor(attribute.accessor);
+  }
+  if (!valid) {
+    err = "invalid accessor of a KHR_draco_mesh_compression primitive";
+    return false;
+  }
+
+  const uint32_t dstBuffer =
+      static_cast<uint32_t>(mBufferSizes.size() + mJobs.size());
+  Job& job = mJobs.emplace_back();
+  job.bufferView = bufferView;
+  job.buffer = buffer;
+  job.byteOffset = byteOffset;
+  job.byteLength = byteLength;
+  // every target gets a view of its own in the decoded buffer
+  auto addTarget = [&](int32_t accessorIndex, DracoTarget& target) {
+    const Accessor& accessor = accessors[accessorIndex];
+    target.componentType = accessor.componentType;
+    target.components = accessor.components;
+    target.count = accessor.count;
+    TargetView& view = views.emplace_back();
+    view.accessor = accessorIndex;
+    view.buffer = dstBuffer;
+    view.byteOffset = job.size;
+    view.byteLength = GetDracoTargetSize(target);
+    job.offsets.push_back(job.size);
+    job.size = AlignDecoded(job.size + view.byteLength);
+  };
+  for (const Attribute& attribute : attributes) {
+    DracoTarget& target = job.attributes.emplace_back();
+    target.uniqueId = attribute.uniqueId;
+    addTarget(attribute.accessor, target);
+  }
+  addTarget(indices, job.indices);
+  return true;
+}
+
+bool MeshDecompressor::Decode(std::span<const std::span<const uint8_t>> sources,
+                              std::span<uint8_t* const> decoded,
+                              ThreadPool* threadPool,
+                              std::string& err) {
+  for (size_t i = 0; i < mJobs.size(); i++) {
+    Job& job = mJobs[i];
+    for (size_t k = 0; k < job.attributes.size(); k++) {
+      job.attributes[k].dst = decoded[i] + job.offsets[k];
+    }
+    if (!job.offsets.empty()) {
+      job.indices.dst = decoded[i] + job.offsets.back();
+    }
+  }
+
+  RunJobs(threadPool, GetBufferCount(), [&](uint32_t i) {
+    Job& job = mJobs[i];
+    if (job.offsets.empty()) {
+      const std::span<const uint8_t> src = sources[job.meshopt.buffer].subspan(
+          job.meshopt.byteOffset, job.meshopt.byteLength);
+      if (!DecodeMeshoptBufferView(job.meshopt, src, decoded[i])) {
+        job.err = "corrupt EXT_meshopt_compression data in buffer view " +
+                  std::to_string(job.bufferView);
+      }
+    } else {
+      DecodeDracoPrimitive(
+          sources[job.buffer].subspan(job.byteOffset, job.byteLength),
+          job.attributes, job.indices, job.err);
+    }
+  });
+  for (const Job& job : mJobs) {
+    if (!job.err.empty()) {
+      err = job.err;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DecompressModel(tinygltf::Model& model,
+                     ThreadPool* threadPool,
+                     std::string& err) {
+  std::vector<uint64_t> bufferSizes;
+  for (const tinygltf::Buffer& buffer : model.buffers) {
+    bufferSizes.push_back(buffer.data.size());
+  }
+  MeshDecompressor decompressor(std::move(bufferSizes));
+  // the views and accessors are pointed at the decoded buffers up front, the
+  // jobs only fill them
+  for (size_t i = 0; i < model.bufferViews.size(); i++) {
+    tinygltf::BufferView& bufferView = model.bufferViews[i];
+    auto ext = bufferView.extensions.find("EXT_meshopt_compression");
+    if (ext == bufferView.extensions.end()) {
+      continue;
+    }
+    MeshoptBufferView meshopt;
+    uint32_t dstBuffer = 0;
+    if (!ReadMeshoptExtension(ext->second, meshopt)) {
+      err = "invalid EXT_meshopt_compression in buffer view " +
+            std::to_string(i);
+      return false;
+    }
+    if (!decompressor.AddMeshoptView(static_cast<int32_t>(i), meshopt,
+                                     dstBuffer, err)) {
+      return false;
+    }
+    bufferView.buffer = static_cast<int>(dstBuffer);
+    bufferView.byteOffset = 0;
+    bufferView.byteLength = meshopt.GetDecodedSize();
+  }
+
+  std::vector<MeshDecompressor::Accessor> accessors;
+  std::vector<MeshDecompressor::Attribute> dracoAttributes;
+  std::vector<MeshDecompressor::TargetView> targetViews;
+  for (tinygltf::Mesh& mesh : model.meshes) {
+    for (tinygltf::Primitive& prim : mesh.primitives) {
+      auto ext = prim.extensions.find("KHR_draco_mesh_compression");
+      if (ext == prim.extensions.end() || prim.indices < 0) {
+        continue;
+      }
+      const tinygltf::Value& draco = ext->second;
+      const int bufferView =
+          draco.Has("bufferView") ? draco.Get("bufferView").GetNumberAsInt()
+                                  : -1;
+      if (bufferView < 0 ||
+          static_cast<size_t>(bufferView) >= model.bufferViews.size() ||
+          !draco.Has("attributes")) {
+        err = "invalid KHR_draco_mesh_compression in mesh " + mesh.name;
+        return false;
+      }
+      if (accessors.empty()) {
+        for (const tinygltf::Accessor& accessor : model.accessors) {
+          MeshDecompressor::Accessor& target = accessors.emplace_back();
+          target.componentType = accessor.componentType;
+          target.components = static_cast<uint32_t>(
+              tinygltf::GetNumComponentsInType(accessor.type));
+          target.count = static_cast<uint32_t>(accessor.count);
+        }
+      }
+      dracoAttributes.clear();
+      const tinygltf::Value& attributes = draco.Get("attributes");
+      for (const std::string& name : attributes.Keys()) {
+        auto it = prim.attributes.find(name);
+        if (it == prim.attributes.end()) {
+          continue;
+        }
+        MeshDecompressor::Attribute& attribute = dracoAttributes.emplace_back();
+        attribute.uniqueId =
+            static_cast<uint32_t>(attributes.Get(name).GetNumberAsInt());
+        attribute.accessor = it->second;
+      }
+      const tinygltf::BufferView& view = model.bufferViews[bufferView];
+      if (!decompressor.AddDracoPrimitive(
+              bufferView, view.buffer, view.byteOffset, view.byteLength,
+              dracoAttributes, prim.indices, accessors, targetViews, err)) {
+        return false;
+      }
+    }
+  }
+  if (decompressor.IsEmpty()) {
+    return true;
+  }
+
+  for (const MeshDecompressor::TargetView& target : targetViews) {
+    tinygltf::BufferView& view = model.bufferViews.emplace_back();
+    view.buffer = static_cast<int>(target.buffer);
+    view.byteOffset = target.byteOffset;
+    view.byteLength = target.byteLength;
+    tinygltf::Accessor& accessor = model.accessors[target.accessor];
+    accessor.bufferView = static_cast<int>(model.bufferViews.size() - 1);
+    accessor.byteOffset = 0;
+  }
+  const size_t firstBuffer = model.buffers.size();
+  model.buffers.resize(firstBuffer + decompressor.GetBufferCount());
+  std::vector<std::span<const uint8_t>> sources;
+  std::vector<uint8_t*> decoded;
+  for (size_t i = 0; i < model.buffers.size(); i++) {
+    std::vector<uint8_t>& data = model.buffers[i].data;
+    if (i < firstBuffer) {
+      sources.emplace_back(data);
+    } else {
+      data.resize(decompressor.GetBufferSize(
+          static_cast<uint32_t>(i - firstBuffer)));
+      decoded.push_back(data.data());
+    }
+  }
+  return decompressor.Decode(sources, decoded, threadPool, err);
+}
+
+}  // namespace hkr
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace hkr {
+
+class ThreadPool;
+
+// Decoding of the two glTF geometry compression extensions. Both front ends
+// decode into buffers of their own and point the buffer views and accessors
+// at them, so that nothing downstream of the parse sees compressed data.
+
+// EXT_meshopt_compression: a buffer view whose bytes are decoded from a range
+// of another buffer, its own buffer may be a fallback without data
+enum class MeshoptMode : uint32_t {
+  Attributes,
+  Triangles,
+  Indices,
+};
+
+enum class MeshoptFilter : uint32_t {
+  None,
+  Octahedral,
+  Quaternion,
+  Exponential,
+};
+
+struct MeshoptBufferView {
+  int32_t buffer = -1;
+  uint64_t byteOffset = 0;
+  uint64_t byteLength = 0;
+  uint32_t byteStride = 0;
+  uint32_t count = 0;
+  MeshoptMode mode = MeshoptMode::Attributes;
+  MeshoptFilter filter = MeshoptFilter::None;
+
+  // of the decoded buffer view
+  uint64_t GetDecodedSize() const { return uint64_t{count} * byteStride; }
+};
+
+// mode and filter from their glTF names, return false for unknown ones
+bool ParseMeshoptMode(const std::string& name, MeshoptMode& mode);
+bool ParseMeshoptFilter(const std::string& name, MeshoptFilter& filter);
+
+// decode the compressed range src into dst of GetDecodedSize() bytes,
+// returns false if the data is corrupt
+bool DecodeMeshoptBufferView(const MeshoptBufferView& view,
+                             std::span<const uint8_t> src,
+                             uint8_t* dst);
+
+// KHR_draco_mesh_compression: an attribute or the indices of a primitive
+// decoded from its draco buffer view, written tightly packed in the
+// component type of its accessor
+struct DracoTarget {
+  // draco attribute id, unused for indices
+  uint32_t uniqueId = 0;
+  int32_t componentType = -1;
+  uint32_t components = 0;
+  uint32_t count = 0;
+  uint8_t* dst = nullptr;
+};
+
+// size of the decoded data of a target
+uint64_t GetDracoTargetSize(const DracoTarget& target);
+
+// decode a draco mesh and write its attributes and indices to their targets,
+// returns false and fills err if it cannot be decoded or its counts differ
+// from those of the accessors
+bool DecodeDracoPrimitive(std::span<const uint8_t> src,
+                          std::span<const DracoTarget> attributes,
+                          const DracoTarget& indices,
+                          std::string& err);
+
+// Layout of the decoded data, shared by both front ends. Every compressed
+// buffer view and draco primitive is decoded into a buffer of its own,
+// numbered after the model's buffers. The front ends add them, point their
+// buffer views and accessors at the returned locations, allocate
+// GetBufferSize() bytes for every decoded buffer and call Decode.
+class MeshDecompressor {
+public:
+  // an accessor as the draco decoder writes it
+  struct Accessor {
+    int32_t componentType = -1;
+    uint32_t components = 0;
+    uint32_t count = 0;
+  };
+
+  // a draco attribute and the accessor it is written to
+  struct Attribute {
+    uint32_t uniqueId = 0;
+    int32_t accessor = -1;
+  };
+
+  // a draco target in a decoded buffer, the front end appends a buffer view
+  // of this range and points the accessor at it
+  struct TargetView {
+    int32_t accessor = -1;
+    uint32_t buffer = 0;
+    uint64_t byteOffset = 0;
+    uint64_t byteLength = 0;
+  };
+
+  // compressed ranges are checked against the sizes of the model's buffers
+  explicit MeshDecompressor(std::vector<uint64_t> bufferSizes);
+
+  // returns false and fills err if the compressed range lies outside its
+  // buffer, the view is to be pointed at dstBuffer from offset 0
+  bool AddMeshoptView(int32_t bufferView,
+                      const MeshoptBufferView& meshopt,
+                      uint32_t& dstBuffer,
+                      std::string& err);
+  // accessors are all of the model's. Returns false and fills err if the
+  // draco buffer view lies outside its buffer or an accessor index is out of
+  // range, otherwise appends a view per attribute and the indices last.
+  bool AddDracoPrimitive(int32_t bufferView,
+                         int32_t buffer,
+                         uint64_t byteOffset,
+                         uint64_t byteLength,
+                         std::span<const Attribute> attributes,
+                         int32_t indices,
+                         std::span<const Accessor> accessors,
+                         std::vector<TargetView>& views,
+                         std::string& err);
+
+  bool IsEmpty() const { return mJobs.empty(); }
+  // of the decoded buffers
+  uint32_t GetBufferCount() const {
+    return static_cast<uint32_t>(mJobs.size());
+  }
+  uint64_t GetBufferSize(uint32_t index) const { return mJobs[index].size; }
+
+  // sources are the data of the model's buffers, decoded the
+  // GetBufferCount() decoded buffers. Spread across the thread pool if there
+  // is one, returns false and fills err if any data is corrupt.
+  bool Decode(std::span<const std::span<const uint8_t>> sources,
+              std::span<uint8_t* const> decoded,
+              ThreadPool* threadPool,
+              std::string& err);
+
+private:
+  bool IsValidRange(int32_t buffer, uint64_t offset, uint64_t length) const;
+
+private:
+  // a compressed buffer view or primitive decoded into a buffer of its own
+  struct Job {
+    int32_t bufferView = -1;
+    // meshopt
+    MeshoptBufferView meshopt;
+    // draco, the range of its buffer view
+    int32_t buffer = -1;
+    uint64_t byteOffset = 0;
+    uint64_t byteLength = 0;
+    std::vector<DracoTarget> attributes;
+    DracoTarget indices;
+    // of the targets in the decoded buffer, indices last
+    std::vector<uint64_t> offsets;
+    uint64_t size = 0;
+    std::string err;
+  };
+
+  std::vector<uint64_t> mBufferSizes;
+  std::vector<Job> mJobs;
+};
+
+// decode every compressed buffer view and primitive of a parsed model into
+// buffers appended to it, spread across the thread pool if there is one.
+// Returns false and fills err on failure.
+bool DecompressModel(tinygltf::Model& model,
+                     ThreadPool* threadPool,
+                     std::string& err);
+
+}  // namespace hkr
@@ -0,0 +1,177 @@
+#include "Renderer/MeshOptimize.h"
+#include "Util/ThreadPool.h"
+
+#include <meshoptimizer.h>
+
+#include <cstring>
+#include <utility>
+
+namespace {
+
+constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+// how much worse than the vertex cache optimized order the overdraw
+// optimized order may transform vertices
+constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+// vertex streams and indices of one primitive, indices are relative to its
+// first vertex
+struct PrimitiveData {
+  std::array<std::vector<uint8_t>, hkr::VERTEX_STREAM_COUNT> vertexStreams;
+  std::vector<uint32_t> indices;
+  uint32_t vertexCount = 0;
+};
+
+void Analyze(const PrimitiveData& prim, hkr::MeshStats& stats) {
+  const meshopt_VertexCacheStatistics cache = meshopt_analyzeVertexCache(
+      prim.indices.data(), prim.indices.size(), prim.vertexCount,
+      VERTEX_CACHE_SIZE, 0, 0);
+  stats.vertexCount += prim.vertexCount;
+  stats.triangleCount += prim.indices.size() / 3;
+  stats.transformedVertexCount += cache.vertices_transformed;
+}
+
+void Accumulate(hkr::MeshStats& total, const hkr::MeshStats& stats) {
+  total.vertexCount += stats.vertexCount;
+  total.triangleCount += stats.triangleCount;
+  total.transformedVertexCount += stats.transformedVertexCount;
+}
+
+// move every vertex to remap[vertex], vertices remapped to ~0u are dropped
+void Remap(PrimitiveData& prim,
+           const std::vector<uint32_t>& remap,
+           size_t newVertexCount) {
+  meshopt_remapIndexBuffer(prim.indices.data(), prim.indices.data(),
+                           prim.indices.size(), remap.data());
+  for (uint32_t stream = 0; stream < hkr::VERTEX_STREAM_COUNT; stream++) {
+    std::vector<uint8_t>& vertices = prim.vertexStreams[stream];
+    if (vertices.empty()) {
+      continue;
+    }
+    const size_t stride = hkr::VERTEX_STREAM_STRIDES[stream];
+    std::vector<uint8_t> remapped(newVertexCount * stride);
+    meshopt_remapVertexBuffer(remapped.data(), vertices.data(),
+                              prim.vertexCount, stride, remap.data());
+    vertices = std::move(remapped);
+  }
+  prim.vertexCount = static_cast<uint32_t>(newVertexCount);
+}
+
+void Optimize(PrimitiveData& prim) {
+  uint32_t* indices = prim.indices.data();
+  const size_t indexCount = prim.indices.size();
+  std::vector<uint32_t> remap(prim.vertexCount);
+
+  // weld, vertices are compared by their quantized streams so vertices that
+  // only differ below the stream precision are merged too
+  meshopt_Stream streams[hkr::VERTEX_STREAM_COUNT];
+  size_t streamCount = 0;
+  for (uint32_t stream = 0; stream < hkr::VERTEX_STREAM_COUNT; stream++) {
+    if (!prim.vertexStreams[stream].empty()) {
+      const size_t stride = hkr::VERTEX_STREAM_STRIDES[stream];
+      streams[streamCount++] = {prim.vertexStreams[stream].data(), stride,
+                                stride};
+    }
+  }
+  Remap(prim, remap,
+        meshopt_generateVertexRemapMulti(remap.data(), indices, indexCount,
+                                         prim.vertexCount, streams,
+                                         streamCount));
+
+  // triangle order
+  meshopt_optimizeVertexCache(indices, indices, indexCount, prim.vertexCount);
+  meshopt_optimizeOverdraw(
+      indices, indices, indexCount,
+      reinterpret_cast<const float*>(
+          prim.vertexStreams[hkr::VERTEX_STREAM_POSITION].data()),
+      prim.vertexCount, sizeof(hkr::Vec3), OVERDRAW_THRESHOLD);
+
+  // vertex order
+  Remap(prim, remap,
+        meshopt_optimizeVertexFetchRemap(remap.data(), indices, indexCount,
+                                         prim.vertexCount));
+}
+
+}  // namespace
+
+namespace hkr {
+
+void OptimizeMeshes(ModelDesc& desc,
+                    MeshData& data,
+                    ThreadPool& threadPool,
+                    MeshStats& before,
+                    MeshStats& after) {
+  const uint32_t primitiveCount = static_cast<uint32_t>(desc.primitives.size());
+  std::vector<PrimitiveData> prims(primitiveCount);
+  std::vector<MeshStats> primsBefore(primitiveCount);
+  std::vector<MeshStats> primsAfter(primitiveCount);
+  threadPool.ParallelFor(primitiveCount, [&](uint32_t i) {
+    const PrimitiveDesc& primDesc = desc.primitives[i];
+    PrimitiveData& prim = prims[i];
+    prim.vertexCount = primDesc.vertexCount;
+    for (uint32_t stream = 0; stream < VERTEX_STREAM_COUNT; stream++) {
+      if (desc.HasVertexStream(static_cast<VertexStream>(stream))) {
+        const size_t stride = VERTEX_STREAM_STRIDES[stream];
+        const uint8_t* vertices =
+            data.vertexStreams[stream].data() + primDesc.firstVertex * stride;
+        prim.vertexStreams[stream].assign(
+            vertices, vertices + primDesc.vertexCount * stride);
+      }
+    }
+    const uint8_t* indices = data.indices.data() + GetIndexDataOffset(primDesc);
+    if (primDesc.indexType == IndexType::Uint16) {
+      const uint16_t* indices16 = reinterpret_cast<const uint16_t*>(indices);
+      prim.indices.assign(indices16, indices16 + primDesc.indexCount);
+    } else {
+      prim.indices.resize(primDesc.indexCount);
+      memcpy(prim.indices.data(), indices, GetIndexDataSize(primDesc));
+    }
+
+    Analyze(prim, primsBefore[i]);
+    Optimize(prim);
+    Analyze(prim, primsAfter[i]);
+  });
+
+  // welded primitives get new ranges and possibly 16 bit indices
+  for (uint32_t i = 0; i < primitiveCount; i++) {
+    desc.primitives[i].vertexCount = prims[i].vertexCount;
+  }
+  LayoutPrimitives(desc);
+  for (uint32_t stream = 0; stream < VERTEX_STREAM_COUNT; stream++) {
+    if (desc.HasVertexStream(static_cast<VertexStream>(stream))) {
+      data.vertexStreams[stream].assign(
+          static_cast<size_t>(desc.vertexCount) * VERTEX_STREAM_STRIDES[stream],
+          0);
+    }
+  }
+  data.indices.assign(desc.indexDataSize, 0);
+  threadPool.ParallelFor(primitiveCount, [&](uint32_t i) {
+    const PrimitiveDesc& primDesc = desc.primitives[i];
+    const PrimitiveData& prim = prims[i];
+    for (uint32_t stream = 0; stream < VERTEX_STREAM_COUNT; stream++) {
+      if (!prim.vertexStreams[stream].empty()) {
+        memcpy(data.vertexStreams[stream].data() +
+                   primDesc.firstVertex * VERTEX_STREAM_STRIDES[stream],
+               prim.vertexStreams[stream].data(),
+               prim.vertexStreams[stream].size());
+      }
+    }
+    uint8_t* indices = data.indices.data() + GetIndexDataOffset(primDesc);
+    if (primDesc.indexType == IndexType::Uint16) {
+      uint16_t* indices16 = reinterpret_cast<uint16_t*>(indices);
+      for (size_t j = 0; j < prim.indices.size(); j++) {
+        indices16[j] = static_cast<uint16_t>(prim.indices[j]);
+      }
+    } else {
+      memcpy(indices, prim.indices.data(), GetIndexDataSize(primDesc));
+    }
+  });
+
+  before = {};
+  after = {};
+  for (uint32_t i = 0; i < primitiveCount; i++) {
+    Accumulate(before, primsBefore[i]);
+    Accumulate(after, primsAfter[i]);
+  }
+}
+
+}  // namespace hkr
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Renderer/ModelDesc.h"
+
+#include <cstdint>
+
+namespace hkr {
+
+class ThreadPool;
+
+// post-transform vertex cache behaviour of a set of primitives, simulated
+// with a 16 entry fifo
+struct MeshStats {
+  uint64_t vertexCount = 0;
+  uint64_t triangleCount = 0;
+  uint64_t transformedVertexCount = 0;
+
+  // average cache miss ratio, vertices transformed per triangle, 0.5 at best
+  float GetACMR() const {
+    return triangleCount ? static_cast<float>(transformedVertexCount) /
+                               static_cast<float>(triangleCount)
+                         : 0.0f;
+  }
+  // average transform to vertex ratio, 1 at best
+  float GetATVR() const {
+    return vertexCount ? static_cast<float>(transformedVertexCount) /
+                             static_cast<float>(vertexCount)
+                       : 0.0f;
+  }
+};
+
+// Weld the vertices of every primitive whose quantized streams are identical,
+// reorder its triangles for the vertex cache and then for overdraw, and its
+// vertices in the order the triangles fetch them. Primitives shrink when
+// vertices are welded, so desc and data are laid out anew. The primitives are
+// optimized in parallel on the thread pool.
+void OptimizeMeshes(ModelDesc& desc,
+                    MeshData& data,
+                    ThreadPool& threadPool,
+                    MeshStats& before,
+                    MeshStats& after);
+
+}  // namespace hkr
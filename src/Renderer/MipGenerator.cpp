@@ -0,0 +1,224 @@
+#include "Renderer/MipGenerator.h"
+#include "Renderer/Buffer.h"
+#include "Renderer/Descriptor.h"
+#include "Renderer/UploadBatcher.h"
+#include "Util/Assert.h"
+#include "Util/vk_debug.h"
+#include "Util/vk_util.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+// tile of level 0 reduced by one workgroup, see mipgen.comp
+constexpr uint32_t TILE_SIZE = 64;
+// counters are bound at offsets valid for any minStorageBufferOffsetAlignment
+constexpr VkDeviceSize COUNTER_STRIDE = 256;
+
+// storage views of srgb images
+VkFormat GetStorageFormat(VkFormat format) {
+  return format == VK_FORMAT_R8G8B8A8_SRGB ? VK_FORMAT_R8G8B8A8_UNORM : format;
+}
+
+}  // namespace
+
+namespace hkr {
+
+void MipGenerator::Init(VkDevice device,
+                        VmaAllocator allocator,
+                        const std::string& assetPath) {
+  mDevice = device;
+  mAllocator = allocator;
+
+  DescriptorSetLayoutBuilder layoutBuilder(2);
+  // every level of the image
+  layoutBuilder.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                           VK_SHADER_STAGE_COMPUTE_BIT, MAX_MIP_LEVELS);
+  // finished workgroup counter
+  layoutBuilder.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                           VK_SHADER_STAGE_COMPUTE_BIT);
+  mDescriptorSetLayout = layoutBuilder.Build(mDevice);
+
+  VkPushConstantRange pushConstant{};
+  pushConstant.offset = 0;
+  pushConstant.size = sizeof(PushConstants);
+  pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &mDescriptorSetLayout;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+  VK_CHECK(vkCreatePipelineLayout(mDevice, &pipelineLayoutInfo, nullptr,
+                                  &mPipelineLayout));
+
+  VkShaderModule shaderModule =
+      LoadShaderModule(mDevice, assetPath + "spirv/mipgen.comp.spv");
+  VkComputePipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = shaderModule;
+  pipelineInfo.stage.pName = "main";
+  pipelineInfo.layout = mPipelineLayout;
+  VK_CHECK(vkCreateComputePipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineInfo,
+                                    nullptr, &mPipeline));
+  vkDestroyShaderModule(mDevice, shaderModule, nullptr);
+}
+
+void MipGenerator::Cleanup() {
+  vkDestroyPipeline(mDevice, mPipeline, nullptr);
+  vkDestroyPipelineLayout(mDevice, mPipelineLayout, nullptr);
+  vkDestroyDescriptorSetLayout(mDevice, mDescriptorSetLayout, nullptr);
+}
+
+void MipGenerator::Add(VkImage image,
+                       VkFormat format,
+                       uint32_t width,
+                       uint32_t height,
+                       uint32_t mipLevels,
+                       uint32_t flags,
+                       float alphaCutoff) {
+  HKR_ASSERT(format == VK_FORMAT_R8G8B8A8_UNORM ||
+             format == VK_FORMAT_R8G8B8A8_SRGB);
+  if (mipLevels <= 1) {
+    return;
+  }
+  mRequests.push_back({image, format, width, height,
+                       std::min(mipLevels, MAX_MIP_LEVELS), flags,
+                       alphaCutoff});
+}
+
+void MipGenerator::Record(UploadBatcher& uploader) {
+  if (mRequests.empty()) {
+    return;
+  }
+  const uint32_t requestCount = static_cast<uint32_t>(mRequests.size());
+
+  // descriptor sets, level views and counters live as long as the batch
+  std::array<VkDescriptorPoolSize, 2> poolSizes{
+      VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                           requestCount * MAX_MIP_LEVELS},
+      VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, requestCount},
+  };
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.pPoolSizes = poolSizes.data();
+  poolInfo.maxSets = requestCount;
+  VkDescriptorPool descriptorPool;
+  VK_CHECK(
+      vkCreateDescriptorPool(mDevice, &poolInfo, nullptr, &descriptorPool));
+  std::vector<VkDescriptorSetLayout> setLayouts(requestCount,
+                                                mDescriptorSetLayout);
+  std::vector<VkDescriptorSet> descriptorSets(requestCount);
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool;
+  allocInfo.descriptorSetCount = requestCount;
+  allocInfo.pSetLayouts = setLayouts.data();
+  VK_CHECK(
+      vkAllocateDescriptorSets(mDevice, &allocInfo, descriptorSets.data()));
+
+  Buffer counters;
+  counters.Create(mAllocator, requestCount * COUNTER_STRIDE,
+                  VK_BUFFER_USAGE_2_STORAGE_BUFFER_BIT);
+
+  std::vector<VkImageView> views;
+  views.reserve(requestCount * MAX_MIP_LEVELS);
+  for (uint32_t i = 0; i < requestCount; i++) {
+    const Request& request = mRequests[i];
+    std::array<VkDescriptorImageInfo, MAX_MIP_LEVELS> imageInfos{};
+    for (uint32_t level = 0; level < MAX_MIP_LEVELS; level++) {
+      // levels past the chain repeat its last one and are never written
+      if (level >= request.mipLevels) {
+        imageInfos[level] = imageInfos[request.mipLevels - 1];
+        continue;
+      }
+      VkImageViewUsageCreateInfo usageInfo{};
+      usageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+      usageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT;
+      VkImageViewCreateInfo viewInfo{};
+      viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      viewInfo.pNext = &usageInfo;
+      viewInfo.image = request.image;
+      viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      viewInfo.format = GetStorageFormat(request.format);
+      viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+      VkImageView view;
+      VK_CHECK(vkCreateImageView(mDevice, &viewInfo, nullptr, &view));
+      views.push_back(view);
+      imageInfos[level].imageView = view;
+      imageInfos[level].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = counters.buffer;
+    bufferInfo.offset = i * COUNTER_STRIDE;
+    bufferInfo.range = sizeof(uint32_t);
+    DescriptorSetWriter writer(2);
+    writer.Write(descriptorSets[i], 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                 MAX_MIP_LEVELS, imageInfos.data());
+    writer.Write(descriptorSets[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                 &bufferInfo);
+    writer.Update(mDevice);
+  }
+
+  VkCommandBuffer commandBuffer = uploader.GetGraphicsCommandBuffer();
+  vkCmdFillBuffer(commandBuffer, counters.buffer, 0, VK_WHOLE_SIZE, 0);
+  InsertMemoryBarrier(
+      commandBuffer, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+          VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mPipeline);
+  std::vector<VkImageMemoryBarrier2> barriers(requestCount);
+  for (uint32_t i = 0; i < requestCount; i++) {
+    const Request& request = mRequests[i];
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            mPipelineLayout, 0, 1, &descriptorSets[i], 0,
+                            nullptr);
+    const uint32_t groupCountX = (request.width + TILE_SIZE - 1) / TILE_SIZE;
+    const uint32_t groupCountY = (request.height + TILE_SIZE - 1) / TILE_SIZE;
+    PushConstants pushConstants{request.width,      request.height,
+                                request.mipLevels,  request.flags,
+                                request.alphaCutoff, groupCountX * groupCountY};
+    vkCmdPushConstants(commandBuffer, mPipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants),
+                       &pushConstants);
+    vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+
+    VkImageMemoryBarrier2& barrier = barriers[i];
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = request.image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0,
+                                VK_REMAINING_MIP_LEVELS, 0, 1};
+  }
+  VkDependencyInfo dependInfo{};
+  dependInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  dependInfo.imageMemoryBarrierCount = requestCount;
+  dependInfo.pImageMemoryBarriers = barriers.data();
+  vkCmdPipelineBarrier2(commandBuffer, &dependInfo);
+
+  uploader.Defer([device = mDevice, allocator = mAllocator, descriptorPool,
+                  counters, views = std::move(views)]() mutable {
+    for (VkImageView view : views) {
+      vkDestroyImageView(device, view, nullptr);
+    }
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    counters.Cleanup(allocator);
+  });
+  mRequests.clear();
+}
+
+}  // namespace hkr
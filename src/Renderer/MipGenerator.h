@@ -0,0 +1,83 @@
+#pragma once
+
+#include <volk.h>
+#include <vk_mem_alloc.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hkr {
+
+class UploadBatcher;
+
+// how texels are averaged into the next level
+enum MipFlags : uint32_t {
+  // filter srgb encoded color in linear space
+  MIP_FLAG_SRGB = 1,
+  // renormalize tangent space normals
+  MIP_FLAG_NORMAL = 2,
+  // keep the fraction of texels passing the alpha test
+  MIP_FLAG_ALPHA_COVERAGE = 4,
+};
+
+// Generates the mip chains of textures with a compute shader, a single
+// dispatch per texture, instead of a blit and two barriers per level. It
+// works for rgba8 unorm and srgb images, srgb ones are written through unorm
+// views. Textures are queued with Add and the whole queue is recorded by
+// Record with one barrier before and one after all dispatches.
+class MipGenerator {
+public:
+  // at most 4096x4096 textures get their full chain
+  static constexpr uint32_t MAX_MIP_LEVELS = 13;
+
+  void Init(VkDevice device, VmaAllocator allocator, const std::string& assetPath);
+  void Cleanup();
+
+  // queue the generation of levels 1 and up from level 0. The image has been
+  // created with Texture::CreateWithMipStorage, level 0 is written and every
+  // level is in VK_IMAGE_LAYOUT_GENERAL on the graphics queue by the time the
+  // queue is recorded, and it ends up in
+  // VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+  void Add(VkImage image,
+           VkFormat format,
+           uint32_t width,
+           uint32_t height,
+           uint32_t mipLevels,
+           uint32_t flags,
+           float alphaCutoff = 0.5f);
+  // record every queued texture into the graphics command buffer of the
+  // current batch, resources are released once the batch has executed
+  void Record(UploadBatcher& uploader);
+  bool IsEmpty() const { return mRequests.empty(); }
+
+private:
+  struct Request {
+    VkImage image;
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+    uint32_t flags;
+    float alphaCutoff;
+  };
+
+  struct PushConstants {
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+    uint32_t flags;
+    float alphaCutoff;
+    uint32_t workgroupCount;
+  };
+
+private:
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VmaAllocator mAllocator = VK_NULL_HANDLE;
+  VkDescriptorSetLayout mDescriptorSetLayout = VK_NULL_HANDLE;
+  VkPipelineLayout mPipelineLayout = VK_NULL_HANDLE;
+  VkPipeline mPipeline = VK_NULL_HANDLE;
+  std::vector<Request> mRequests;
+};
+
+}  // namespace hkr
@@ -1,16 +1,26 @@
 #include "Renderer/Model.h"
 #include "Renderer/Buffer.h"
+#include "Renderer/CookedModel.h"
+#include "Renderer/CookedTexture.h"
 #include "Renderer/Image.h"
 #include "Renderer/Descriptor.h"
+#include "Renderer/MipGenerator.h"
+#include "Renderer/TexelConvert.h"
+#include "Renderer/UploadBatcher.h"
 #include "Util/vk_debug.h"
 #include "Util/Assert.h"
 #include "Util/vk_util.h"
 #include "Util/Filesystem.h"
+#include "Util/ThreadPool.h"
 
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 #include <tiny_gltf.h>
+#include <ktx.h>
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
 
 namespace {
 
@@ -59,23 +69,148 @@ VkSamplerAddressMode glTFAddressModeToVkAddressMode(int glTFAddressMode) {
   }
 }
 
+// bytes of image/mesh data recorded into the upload batch per frame
+constexpr VkDeviceSize UPLOAD_BUDGET_PER_FRAME = 32 * 1024 * 1024;
+
+// stands in for images that fail to load
+constexpr uint8_t WHITE_TEXEL[4] = {255, 255, 255, 255};
+
+// levels of at most this many texels per side are resident from the start
+// and never dropped
+constexpr uint32_t MIP_TAIL_SIZE = 64;
+// frames a request is honored for, only every 64th pixel reports so a small
+// texture can go unreported for a few frames
+constexpr uint64_t STREAM_RETAIN_FRAMES = 120;
+// share of the memory heap budget kept free for everything but streamed
+// levels, as a divisor
+constexpr VkDeviceSize STREAM_RESERVE_DIVISOR = 10;
+
+// texels past a cell of the feedback grid whose tiles a cell needs, the
+// footprints of anisotropic filtering reach that far
+constexpr uint32_t SPARSE_TILE_MARGIN = 8;
+// free pages of sparse images kept for reuse
+constexpr size_t SPARSE_FREE_PAGES = 64;
+
+// first level of the mip tail
+uint32_t GetMipTail(uint32_t width, uint32_t height, uint32_t mipLevels) {
+  uint32_t level = 0;
+  while (level + 1 < mipLevels &&
+         std::max(width >> level, height >> level) > MIP_TAIL_SIZE) {
+    level++;
+  }
+  return level;
+}
+
+// tiles of a level of a sparse texture that the samples of a cell of the
+// feedback grid reach, last ones included. The margin does not wrap around.
+struct TileRange {
+  uint32_t x0, y0, x1, y1;
+};
+
+TileRange GetCellTiles(const hkr::SparseTexture& texture,
+                       uint32_t cell,
+                       uint32_t level) {
+  constexpr uint32_t GRID_SIZE = hkr::TextureFeedback::GRID_SIZE;
+  auto getRange = [](uint32_t index, uint32_t size, uint32_t tileSize,
+                     uint32_t tileCount, uint32_t& first, uint32_t& last) {
+    const uint64_t begin = uint64_t{index} * size / GRID_SIZE;
+    const uint64_t end =
+        (uint64_t{index + 1} * size + GRID_SIZE - 1) / GRID_SIZE;
+    first = static_cast<uint32_t>(
+        begin > SPARSE_TILE_MARGIN ? (begin - SPARSE_TILE_MARGIN) / tileSize
+                                   : 0);
+    last = static_cast<uint32_t>(std::min<uint64_t>(
+        (end + SPARSE_TILE_MARGIN - 1) / tileSize, tileCount - 1));
+  };
+  const VkExtent2D extent = texture.GetLevelExtent(level);
+  const VkExtent2D tileExtent = texture.GetTileExtent();
+  const VkExtent2D tileCount = texture.GetTileCount(level);
+  TileRange range;
+  getRange(cell % GRID_SIZE, extent.width, tileExtent.width, tileCount.width,
+           range.x0, range.x1);
+  getRange(cell / GRID_SIZE, extent.height, tileExtent.height,
+           tileCount.height, range.y0, range.y1);
+  return range;
+}
+
 }  // namespace
 
 namespace hkr {
 
+static void CreateDefaultImage(VkDevice device,
+                               UploadBatcher& uploader,
+                               VmaAllocator allocator,
+                               glTFImage& defaultImage) {
+  defaultImage.image.Create(device, allocator, 1, 1, 1,
+                            VK_FORMAT_R8G8B8A8_UNORM);
+  std::array<uint8_t, 4> defaultImageData{255, 255, 255, 255};
+  uint32_t dataSize = defaultImageData.size() * sizeof(uint8_t);
+  UploadBatcher::Allocation staging = uploader.Allocate(dataSize);
+  memcpy(staging.data, defaultImageData.data(), dataSize);
+  VkCommandBuffer commandBuffer = uploader.GetCommandBuffer();
+  TransitImageLayout(commandBuffer, defaultImage.image.image,
+                     VK_IMAGE_LAYOUT_UNDEFINED,
+                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1);
+  CopyBufferToImage(commandBuffer, staging.buffer, defaultImage.image.image, 1,
+                    1, staging.offset);
+  uploader.TransferImage(defaultImage.image.image,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                         {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+}
+
 void glTFModel::Load(VkDevice device,
-                     VkQueue queue,
-                     VkCommandPool commandPool,
+                     UploadBatcher& uploader,
+                     MipGenerator& mipGenerator,
+                     ThreadPool& threadPool,
                      VmaAllocator allocator,
+                     const TextureFormatSupport& textureFormats,
                      const std::string& fileName,
-                     VkBufferUsageFlags2 bufferUsageFlags) {
+                     VkBufferUsageFlags2 bufferUsageFlags,
+                     bool srgbColorTextures,
+                     glTFParser parser) {
   mDevice = device;
-  mQueue = queue;
-  mCommandPool = commandPool;
+  mUploader = &uploader;
+  mMipGenerator = &mipGenerator;
   mAllocator = allocator;
   mBufferUsageFlags = bufferUsageFlags;
+  mSrgbColorTextures = srgbColorTextures;
+  mParser = parser;
+  mTextureFormats = textureFormats;
+  mPagePool.Init(allocator);
+  mFileName = fileName;
+  mFilePath = GetFilePath(fileName);
+  mLoadStart = std::chrono::high_resolution_clock::now();
   HKR_INFO("Loading model: {}", fileName.c_str());
-  tinygltf::Model model;
+  mThreadPool = &threadPool;
+  mPendingJobs++;
+  threadPool.Submit([this, fileName]() {
+    LoadAsync(fileName);
+    FinishJob();
+  });
+}
+
+void glTFModel::LoadAsync(const std::string& fileName) {
+  if (LoadCooked(fileName)) {
+    return;
+  }
+  const bool result = mParser == glTFParser::Simdjson
+                          ? LoadSimdjson(fileName)
+                          : LoadTinyglTF(fileName);
+  if (!result) {
+    auto event = std::make_unique<LoadEvent>();
+    event->type = LoadEvent::Type::Failed;
+    Publish(std::move(event));
+  }
+}
+
+bool glTFModel::LoadTinyglTF(const std::string& fileName) {
+  auto model = std::make_shared<tinygltf::Model>();
+  // encoded image bytes by image index, decoding is deferred to one job per
+  // image instead of running serially inside the parse. External ktx2 files
+  // are read by the job itself, embedded ones (KHR_texture_basisu) are kept
+  // like any other image.
+  auto encodedImages = std::make_shared<std::vector<std::vector<uint8_t>>>();
   tinygltf::TinyGLTF loader;
   loader.SetImageLoader(
       [](tinygltf::Image* image, const int imageIndex, std::string* err,
@@ -84,60 +219,687 @@ void glTFModel::Load(VkDevice device,
         if (!image->uri.empty() && GetFileExtension(image->uri) == "ktx2") {
           return true;
         }
-        return tinygltf::LoadImageData(image, imageIndex, err, warn, req_width,
-                                       req_height, bytes, size, userData);
+        auto& encoded =
+            *static_cast<std::vector<std::vector<uint8_t>>*>(userData);
+        if (encoded.size() <= static_cast<size_t>(imageIndex)) {
+          encoded.resize(imageIndex + 1);
+        }
+        encoded[imageIndex].assign(bytes, bytes + size);
+        return true;
       },
-      nullptr);
+      encodedImages.get());
   std::string err;
   std::string warn;
-  bool result = false;
-  auto fileExtension = GetFileExtension(fileName);
-  if (fileExtension == "gltf") {
-    result = loader.LoadASCIIFromFile(&model, &err, &warn, fileName);
-  } else if (fileExtension == "glb") {
-    result = loader.LoadBinaryFromFile(&model, &err, &warn, fileName);
-  } else {
-    HKR_ASSERT(0);
-  }
+  auto tParseStart = std::chrono::high_resolution_clock::now();
+  const bool result = LoadglTFFile(loader, *model, fileName, err, warn,
+                                   mThreadPool);
   if (!warn.empty()) {
     HKR_WARN(warn.c_str());
   }
   if (!err.empty()) {
     HKR_ERROR(err.c_str());
   }
-  HKR_ASSERT(result);
-  mFilePath = GetFilePath(fileName);
+  if (!result) {
+    return false;
+  }
+  encodedImages->resize(model->images.size());
+  auto desc = std::make_shared<ModelDesc>();
+  BuildModelDesc(*model, *desc);
+  auto tParseEnd = std::chrono::high_resolution_clock::now();
+  HKR_INFO("Parsed {} with tinygltf in {:.2f} ms", fileName,
+           std::chrono::duration<double, std::milli>(tParseEnd - tParseStart)
+               .count());
+
+  auto source = std::make_shared<glTFSource>();
+  source->imageCount = desc->imageCount;
+  source->readImage = [model, encodedImages](uint32_t imageIndex,
+                                             std::string& uri,
+                                             std::vector<uint8_t>& encoded) {
+    uri = model->images[imageIndex].uri;
+    encoded.swap((*encodedImages)[imageIndex]);
+  };
+  source->decodeMesh = [model](const ModelDesc& desc, uint32_t meshIndex,
+                               const MeshDestination& dst) {
+    DecodeMesh(*model, desc, meshIndex, dst);
+  };
+  DecodeModel(desc, source);
+  return true;
+}
+
+bool glTFModel::LoadSimdjson(const std::string& fileName) {
+  // the document keeps the file and its buffers mapped until the last mesh
+  // and image are decoded
+  auto document = std::make_shared<glTFDocument>();
+  auto desc = std::make_shared<ModelDesc>();
+  std::string err;
+  auto tParseStart = std::chrono::high_resolution_clock::now();
+  if (!document->Load(fileName, *desc, err, mThreadPool)) {
+    HKR_ERROR(err.c_str());
+    return false;
+  }
+  auto tParseEnd = std::chrono::high_resolution_clock::now();
+  HKR_INFO("Parsed {} with simdjson in {:.2f} ms", fileName,
+           std::chrono::duration<double, std::milli>(tParseEnd - tParseStart)
+               .count());
+
+  auto source = std::make_shared<glTFSource>();
+  source->imageCount = document->GetImageCount();
+  source->readImage = [document](uint32_t imageIndex, std::string& uri,
+                                 std::vector<uint8_t>& encoded) {
+    uri = document->GetImageUri(imageIndex);
+    std::string err;
+    if (!document->ReadImage(imageIndex, encoded, err)) {
+      // decoding the empty bytes fails and keeps the default image
+      HKR_ERROR(err.c_str());
+    }
+  };
+  source->decodeMesh = [document](const ModelDesc& desc, uint32_t meshIndex,
+                                  const MeshDestination& dst) {
+    DecodeMesh(document->GetPrimitiveAccessors(meshIndex), desc, meshIndex,
+               dst);
+  };
+  DecodeModel(desc, source);
+  return true;
+}
+
+void glTFModel::DecodeModel(const std::shared_ptr<ModelDesc>& desc,
+                            const std::shared_ptr<const glTFSource>& source) {
+  // the render thread creates samplers, materials and nodes from the
+  // structure while meshes and images are decoded here, the geometry buffers
+  // are created first so that meshes can be decoded into them. Only the
+  // meshes and images the default scene reaches are decoded.
+  CreateGeometryBuffers(*desc);
+  auto resources =
+      std::make_shared<const SceneResources>(GetSceneResources(*desc));
+  auto structure = std::make_unique<LoadEvent>();
+  structure->type = LoadEvent::Type::Structure;
+  structure->desc = desc;
+  structure->resources = resources;
+  if (!Publish(std::move(structure))) {
+    return;
+  }
+
+  // fan image decoding out across the pool, each image is handed over as
+  // soon as it is decoded
+  const size_t imageCount = resources->imageIndices.size();
+  auto remainingImages = std::make_shared<std::atomic<size_t>>(imageCount);
+  auto tDecodeStart = std::chrono::high_resolution_clock::now();
+  for (uint32_t i : resources->imageIndices) {
+    mPendingJobs++;
+    mThreadPool->Submit([this, source, remainingImages, imageCount,
+                         tDecodeStart, i]() {
+      if (!mCancelled) {
+        std::string uri;
+        std::vector<uint8_t> encoded;
+        source->readImage(i, uri, encoded);
+        DecodeImage(uri, i, encoded);
+      }
+      if (--(*remainingImages) == 0) {
+        auto tEnd = std::chrono::high_resolution_clock::now();
+        HKR_INFO("Decoded {} images in {:.2f} ms", imageCount,
+                 std::chrono::duration<double, std::milli>(tEnd - tDecodeStart)
+                     .count());
+      }
+      FinishJob();
+    });
+  }
+
+  // meshes are decoded in parallel meanwhile, every primitive already has its
+  // slot in the geometry buffers from the ModelDesc so the result does not
+  // depend on the order the meshes finish in
+  const std::vector<uint32_t>& meshIndices = resources->meshIndices;
+  auto tMeshStart = std::chrono::high_resolution_clock::now();
+  mThreadPool->ParallelFor(
+      static_cast<uint32_t>(meshIndices.size()), [&](uint32_t i) {
+        if (mCancelled) {
+          return;
+        }
+        auto event = std::make_unique<LoadEvent>();
+        event->type = LoadEvent::Type::Mesh;
+        event->index = meshIndices[i];
+        source->decodeMesh(*desc, event->index,
+                           BeginMeshWrite(*desc, *event));
+        EndMeshWrite(*desc, *event);
+        Publish(std::move(event));
+      });
+  if (mCancelled) {
+    return;
+  }
+  auto tMeshEnd = std::chrono::high_resolution_clock::now();
+  HKR_INFO("Decoded {} of {} meshes in {:.2f} ms", meshIndices.size(),
+           desc->meshes.size(),
+           std::chrono::duration<double, std::milli>(tMeshEnd - tMeshStart)
+               .count());
+}
+
+bool glTFModel::LoadCooked(const std::string& fileName) {
+  auto cooked = std::make_shared<CookedModel>();
+  if (!cooked->Open(GetCookedFileName(fileName), fileName)) {
+    return false;
+  }
+  HKR_INFO("Using cooked model: {}", GetCookedFileName(fileName));
+  auto desc = std::make_shared<ModelDesc>();
+  cooked->ReadDesc(*desc);
+  CreateGeometryBuffers(*desc);
+  auto resources =
+      std::make_shared<const SceneResources>(GetSceneResources(*desc));
+  auto structure = std::make_unique<LoadEvent>();
+  structure->type = LoadEvent::Type::Structure;
+  structure->desc = desc;
+  structure->resources = resources;
+  if (!Publish(std::move(structure))) {
+    return true;
+  }
+
+  // meshes are copied out of the mapping, rgba8 images are handed over as
+  // slices of it, there is no cpu work left besides the copies and the
+  // transcoding of basis universal ktx2 files
+  auto indices = cooked->GetSection<uint8_t>(CookedSection::Indices);
+  for (uint32_t i : resources->meshIndices) {
+    auto event = std::make_unique<LoadEvent>();
+    event->type = LoadEvent::Type::Mesh;
+    event->index = i;
+    const MeshDestination dst = BeginMeshWrite(*desc, *event);
+    const MeshRange& range = event->meshRange;
+    for (uint32_t stream = 0; stream < VERTEX_STREAM_COUNT; stream++) {
+      if (dst.vertexStreams[stream]) {
+        const uint32_t stride = VERTEX_STREAM_STRIDES[stream];
+        auto src = cooked->GetSection<uint8_t>(
+            GetVertexStreamSection(static_cast<VertexStream>(stream)));
+        memcpy(dst.vertexStreams[stream],
+               src.data() + static_cast<size_t>(range.firstVertex) * stride,
+               static_cast<size_t>(range.vertexCount) * stride);
+      }
+    }
+    if (dst.indices) {
+      memcpy(dst.indices, indices.data() + range.indexDataOffset,
+             range.indexDataSize);
+    }
+    EndMeshWrite(*desc, *event);
+    if (!Publish(std::move(event))) {
+      return true;
+    }
+  }
+
+  auto dependencies =
+      cooked->GetSection<CookedDependency>(CookedSection::Dependencies);
+  auto imageData = cooked->GetSection<uint8_t>(CookedSection::ImageData);
+  auto images = cooked->GetSection<CookedImage>(CookedSection::Images);
+  const std::vector<uint32_t>& imageIndices = resources->imageIndices;
+  mThreadPool->ParallelFor(
+      static_cast<uint32_t>(imageIndices.size()), [&](uint32_t j) {
+        const uint32_t i = imageIndices[j];
+        if (mCancelled) {
+          return;
+        }
+        const CookedImage& image = images[i];
+        auto event = std::make_unique<LoadEvent>();
+        event->type = LoadEvent::Type::Image;
+        event->index = i;
+        if (image.format == CookedImageFormat::KTX2) {
+          const std::string imageFileName =
+              cooked->GetDirectory() + "/" +
+              dependencies[image.dependencyIndex].path;
+          std::string err;
+          event->ktxTexture =
+              LoadKtxTexture(imageFileName, mTextureFormats, err);
+          if (!event->ktxTexture) {
+            // keep the default image in place of the broken one
+            HKR_ERROR("Failed to load image {}: {}", i, err);
+            event->pixelBytes = WHITE_TEXEL;
+            event->width = 1;
+            event->height = 1;
+          }
+        } else {
+          event->cooked = cooked;
+          event->pixelBytes = imageData.subspan(image.offset, image.size);
+          event->width = static_cast<int>(image.width);
+          event->height = static_cast<int>(image.height);
+          event->mipLevels = image.mipLevels;
+        }
+        Publish(std::move(event));
+      });
+  return true;
+}
+
+void glTFModel::DecodeImage(const std::string& uri,
+                            size_t imageIndex,
+                            std::vector<uint8_t>& encoded) {
+  if (mCancelled) {
+    return;
+  }
+  auto event = std::make_unique<LoadEvent>();
+  event->type = LoadEvent::Type::Image;
+  event->index = static_cast<uint32_t>(imageIndex);
+  // block compressed images cooked by hikari_cook are used in place of their
+  // source as long as they are not older than it
+  const bool external = !uri.empty() && uri.rfind("data:", 0) != 0;
+  const std::string cookedFileName =
+      mFilePath + "/" + GetCookedImagePath(mFileName, uri, imageIndex);
+  std::string ktxFileName;
+  if (!uri.empty() && GetFileExtension(uri) == "ktx2") {
+    ktxFileName = mFilePath + "/" + uri;
+  } else if (!IsKtx2(encoded.data(), encoded.size()) &&
+             IsUpToDate(cookedFileName,
+                        external ? mFilePath + "/" + uri : mFileName)) {
+    ktxFileName = cookedFileName;
+  }
+
+  std::string err;
+  std::string warn;
+  bool result = false;
+  tinygltf::Image decoded;
+  if (!ktxFileName.empty() || IsKtx2(encoded.data(), encoded.size())) {
+    // ktx2 files and embedded ktx2 images, basis universal ones are
+    // transcoded here so the render thread only copies blocks
+    event->ktxTexture =
+        ktxFileName.empty()
+            ? LoadKtxTexture(encoded.data(), encoded.size(), mTextureFormats,
+                             err)
+            : LoadKtxTexture(ktxFileName, mTextureFormats, err);
+    std::vector<uint8_t>().swap(encoded);
+    if (event->ktxTexture) {
+      Publish(std::move(event));
+      return;
+    }
+  } else {
+    // gray, gray-alpha and rgb images keep their channels, ConvertToRGBA8
+    // expands them
+    tinygltf::LoadImageDataOption option;
+    option.preserve_channels = true;
+    result = tinygltf::LoadImageData(
+        &decoded, static_cast<int>(imageIndex), &err, &warn, 0, 0,
+        encoded.data(), static_cast<int>(encoded.size()), &option);
+    // the encoded bytes are no longer needed
+    std::vector<uint8_t>().swap(encoded);
+    if (!warn.empty()) {
+      HKR_WARN(warn.c_str());
+    }
+  }
+  const uint8_t* texels = WHITE_TEXEL;
+  uint32_t components = 4;
+  uint32_t bits = 8;
+  if (!result) {
+    // keep the default image in place of the broken one
+    HKR_ERROR("Failed to decode image {}: {}", imageIndex, err);
+    event->width = 1;
+    event->height = 1;
+  } else {
+    event->width = decoded.width;
+    event->height = decoded.height;
+    texels = decoded.image.data();
+    components = static_cast<uint32_t>(decoded.component);
+    bits = static_cast<uint32_t>(decoded.bits);
+  }
+  // expand straight into the staging buffer the upload copies from
+  const size_t texelCount =
+      static_cast<size_t>(event->width) * static_cast<size_t>(event->height);
+  event->staging.Create(mAllocator, texelCount * 4);
+  ConvertToRGBA8(texels, components, bits, texelCount,
+                 static_cast<uint8_t*>(event->staging.Map(mAllocator)));
+  vmaFlushAllocation(mAllocator, event->staging.allocation, 0, VK_WHOLE_SIZE);
+  Publish(std::move(event));
+}
+
+bool glTFModel::Publish(std::unique_ptr<LoadEvent>&& event) {
+  if (mEvents.TryPush(std::move(event))) {
+    return !mCancelled;
+  }
+  // the render thread drains the queue once per frame, sleep until it has
+  // made room. TryPush leaves the event alone when the queue is full, and it
+  // is retried under the lock the render thread notifies under, so a wake up
+  // cannot slip between the check and the wait.
+  std::unique_lock<std::mutex> lock(mEventsMutex);
+  mEventsPopped.wait(lock, [&] {
+    return mCancelled || mEvents.TryPush(std::move(event));
+  });
+  if (event) {
+    DiscardEvent(*event);
+    return false;
+  }
+  return !mCancelled;
+}
+
+void glTFModel::FinishJob() {
+  // notified under the lock Cleanup waits with, the job touches nothing of
+  // the model after it
+  if (--mPendingJobs == 0) {
+    std::lock_guard<std::mutex> lock(mEventsMutex);
+    mJobsDone.notify_all();
+  }
+}
+
+void glTFModel::DiscardEvent(LoadEvent& event) {
+  if (event.staging.buffer != VK_NULL_HANDLE) {
+    event.staging.Unmap(mAllocator);
+    event.staging.Cleanup(mAllocator);
+    event.staging = {};
+  }
+}
+
+void glTFModel::CreateGeometryBuffers(const ModelDesc& desc) {
+  // prefer memory the loader can write meshes to directly (resizable bar or
+  // unified memory), vma falls back to device local memory filled through
+  // staging
+  const VmaAllocationCreateFlags allocFlags =
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT |
+      VMA_ALLOCATION_CREATE_MAPPED_BIT;
+  auto getMappedData = [this](const Buffer& buffer) {
+    VmaAllocationInfo allocInfo;
+    vmaGetAllocationInfo(mAllocator, buffer.allocation, &allocInfo);
+    return static_cast<uint8_t*>(allocInfo.pMappedData);
+  };
+  bool mapped = true;
+  mVertexStreamMask = desc.vertexStreamMask;
+  for (uint32_t stream = 0; stream < VERTEX_STREAM_COUNT; stream++) {
+    if (HasVertexStream(static_cast<VertexStream>(stream))) {
+      vertexStreams[stream].Create(
+          mAllocator, allocFlags,
+          VkDeviceSize{desc.vertexCount} * VERTEX_STREAM_STRIDES[stream],
+          VK_BUFFER_USAGE_2_VERTEX_BUFFER_BIT | mBufferUsageFlags,
+          mUploader->GetQueueFamilyIndices());
+      mMappedGeometry.vertexStreams[stream] =
+          getMappedData(vertexStreams[stream]);
+      mapped = mapped && mMappedGeometry.vertexStreams[stream];
+    }
+  }
+  indices.Create(mAllocator, allocFlags, desc.indexDataSize,
+                 VK_BUFFER_USAGE_2_INDEX_BUFFER_BIT | mBufferUsageFlags,
+                 mUploader->GetQueueFamilyIndices());
+  mMappedGeometry.indices = getMappedData(indices);
+  mapped = mapped && mMappedGeometry.indices;
+  if (!mapped) {
+    mMappedGeometry = {};
+  }
+  HKR_INFO("Writing geometry {}", mapped ? "directly to gpu memory"
+                                         : "through staging buffers");
+}
+
+MeshDestination glTFModel::BeginMeshWrite(const ModelDesc& desc,
+                                          LoadEvent& event) {
+  const MeshRange range = GetMeshRange(desc, event.index);
+  event.meshRange = range;
+  MeshDestination dst;
+  if (mMappedGeometry.indices) {
+    for (uint32_t stream = 0; stream < VERTEX_STREAM_COUNT; stream++) {
+      if (mMappedGeometry.vertexStreams[stream]) {
+        dst.vertexStreams[stream] =
+            mMappedGeometry.vertexStreams[stream] +
+            static_cast<size_t>(range.firstVertex) *
+                VERTEX_STREAM_STRIDES[stream];
+      }
+    }
+    dst.indices = mMappedGeometry.indices + range.indexDataOffset;
+    return dst;
+  }
+
+  // the streams back to back followed by the indices, strides are multiples
+  // of 4 so the indices stay aligned
+  VkDeviceSize size = range.indexDataSize;
+  for (uint32_t stream = 0; stream < VERTEX_STREAM_COUNT; stream++) {
+    if (desc.HasVertexStream(static_cast<VertexStream>(stream))) {
+      size += VkDeviceSize{range.vertexCount} * VERTEX_STREAM_STRIDES[stream];
+    }
+  }
+  if (size == 0) {
+    return dst;
+  }
+  event.staging.Create(mAllocator, size);
+  uint8_t* data = static_cast<uint8_t*>(event.staging.Map(mAllocator));
+  for (uint32_t stream = 0; stream < VERTEX_STREAM_COUNT; stream++) {
+    if (desc.HasVertexStream(static_cast<VertexStream>(stream))) {
+      dst.vertexStreams[stream] = data;
+      data += range.vertexCount * VERTEX_STREAM_STRIDES[stream];
+    }
+  }
+  dst.indices = data;
+  return dst;
+}
+
+void glTFModel::EndMeshWrite(const ModelDesc& desc, LoadEvent& event) {
+  // make the writes visible in case the memory is not host coherent
+  if (event.staging.buffer != VK_NULL_HANDLE) {
+    vmaFlushAllocation(mAllocator, event.staging.allocation, 0, VK_WHOLE_SIZE);
+    return;
+  }
+  const MeshRange& range = event.meshRange;
+  if (!mMappedGeometry.indices) {
+    return;
+  }
+  for (uint32_t stream = 0; stream < VERTEX_STREAM_COUNT; stream++) {
+    if (desc.HasVertexStream(static_cast<VertexStream>(stream))) {
+      const VkDeviceSize stride = VERTEX_STREAM_STRIDES[stream];
+      vmaFlushAllocation(mAllocator, vertexStreams[stream].allocation,
+                         range.firstVertex * stride,
+                         range.vertexCount * stride);
+    }
+  }
+  vmaFlushAllocation(mAllocator, indices.allocation, range.indexDataOffset,
+                     range.indexDataSize);
+}
+
+void glTFModel::Update(uint32_t currentFrame) {
+  mFrameCount++;
+  // publish meshes and images whose uploads have completed
+  while (!mPendingUploads.empty() &&
+         mUploader->IsComplete(mPendingUploads.front().value)) {
+    const PendingUpload& upload = mPendingUploads.front();
+    const bool wasResident = IsResident();
+    if (upload.type == LoadEvent::Type::Mesh) {
+      meshes[upload.index].resident = true;
+      mResidentMeshCount++;
+    } else if (upload.type == LoadEvent::Type::Image &&
+               upload.tile != UINT32_MAX) {
+      // sampled once the residency is updated
+      SparseImage& sparse = mSparseImages[upload.index];
+      SparseTile& tile = sparse.tiles[upload.tile];
+      tile.pending = false;
+      tile.resident = true;
+      sparse.residencyDirty = true;
+    } else if (upload.type == LoadEvent::Type::Image) {
+      glTFImage& image = images[upload.index];
+      if (upload.mipChange) {
+        // the frames in flight still sample the previous range
+        mRetiredImages.push_back({mFrameCount, image.image});
+        image.image = image.pendingImage;
+        image.pendingImage = {};
+        image.residentMip = image.pendingMip;
+      } else {
+        image.resident = true;
+        mResidentImageCount++;
+        if (image.sparse) {
+          mSparseImages[upload.index].residencyDirty = true;
+        }
+      }
+      mImageVersion++;
+    }
+    mPendingUploads.pop_front();
+    if (!wasResident && IsResident()) {
+      auto tEnd = std::chrono::high_resolution_clock::now();
+      HKR_INFO("Model resident after {:.2f} ms",
+               std::chrono::duration<double, std::milli>(tEnd - mLoadStart)
+                   .count());
+    }
+  }
+
+  // images replaced by another mip range once no frame in flight can sample
+  // them anymore
+  while (!mRetiredImages.empty() &&
+         mFrameCount - mRetiredImages.front().frame > MAX_FRAMES_IN_FLIGHT) {
+    mRetiredImages.front().image.Cleanup(mDevice, mAllocator);
+    mRetiredImages.pop_front();
+  }
+  // same for evicted tiles, their pages are reused once unbound
+  while (!mRetiredTiles.empty() &&
+         mFrameCount - mRetiredTiles.front().frame > MAX_FRAMES_IN_FLIGHT) {
+    const RetiredTile& retired = mRetiredTiles.front();
+    SparseImage& sparse = mSparseImages[retired.imageIndex];
+    SparseTile& tile = sparse.tiles[retired.tile];
+    uint32_t level, x, y;
+    sparse.GetTileCoords(retired.tile, level, x, y);
+    sparse.texture.BindTile(*mUploader, level, x, y, VK_NULL_HANDLE);
+    mUploader->Defer([this, page = tile.page]() { mPagePool.Free(page); });
+    tile.page = VK_NULL_HANDLE;
+    mRetiredTiles.pop_front();
+  }
+
+  // record uploads for what the loader has handed over, bounded per frame so
+  // a burst of large images does not stall the frame
+  const size_t firstNew = mPendingUploads.size();
+  VkDeviceSize uploaded = 0;
+  std::unique_ptr<LoadEvent> event;
+  bool popped = false;
+  while (uploaded < UPLOAD_BUDGET_PER_FRAME && mEvents.TryPop(event)) {
+    uploaded += ProcessEvent(*event);
+    popped = true;
+  }
+  if (popped) {
+    std::lock_guard<std::mutex> lock(mEventsMutex);
+    mEventsPopped.notify_all();
+  }
+  // mip levels of streamed images share what is left of the budget
+  if (mStructureReady) {
+    UpdateStreaming(currentFrame, uploaded);
+    UpdateResidency();
+  }
+  if (mPendingUploads.size() > firstNew) {
+    // mips of every image uploaded this frame in one go
+    mMipGenerator->Record(*mUploader);
+    uint64_t value = mUploader->Submit();
+    for (size_t i = firstNew; i < mPendingUploads.size(); i++) {
+      mPendingUploads[i].value = value;
+    }
+  }
+}
+
+bool glTFModel::IsResident() const {
+  return mStructureReady && mResidentMeshCount == mSceneMeshCount &&
+         mResidentImageCount == mSceneImageCount;
+}
+
+VkImageView glTFModel::GetImageView(int imageIndex) const {
+  if (imageIndex >= 0 && images[imageIndex].resident) {
+    return images[imageIndex].image.imageView;
+  }
+  return images.back().image.imageView;
+}
+
+VkImageLayout glTFModel::GetImageLayout(int imageIndex) const {
+  if (imageIndex >= 0 && images[imageIndex].resident &&
+      images[imageIndex].sparse) {
+    return VK_IMAGE_LAYOUT_GENERAL;
+  }
+  return VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+}
+
+VkDeviceSize glTFModel::ProcessEvent(LoadEvent& event) {
+  switch (event.type) {
+    case LoadEvent::Type::Structure:
+      return LoadStructure(event);
+    case LoadEvent::Type::Mesh:
+      return UploadMesh(event);
+    case LoadEvent::Type::Image:
+      return UploadImage(event);
+    case LoadEvent::Type::Failed:
+      mFailed = true;
+      return 0;
+  }
+  return 0;
+}
+
+VkDeviceSize glTFModel::LoadStructure(LoadEvent& event) {
+  const ModelDesc& desc = *event.desc;
+  const SceneResources& resources = *event.resources;
+  // the default image is uploaded along with the reached images
+  mSceneMeshCount = static_cast<uint32_t>(resources.meshIndices.size());
+  mSceneImageCount = static_cast<uint32_t>(resources.imageIndices.size()) + 1;
 
   // samplers
-  LoadSamplers(model);
+  LoadSamplers(desc, resources);
 
-  // images
-  LoadImages(model);
+  // images, filled in as they arrive, default image at the back
+  images.resize(desc.imageCount);
+  auto getImage = [&](int32_t textureIndex) -> glTFImage* {
+    if (textureIndex > -1 && desc.textures[textureIndex].imageIndex > -1) {
+      return &images[desc.textures[textureIndex].imageIndex];
+    }
+    return nullptr;
+  };
+  for (const MaterialDesc& material : desc.materials) {
+    if (mSrgbColorTextures) {
+      for (int32_t textureIndex :
+           {material.baseColorTextureIndex, material.emissiveTextureIndex}) {
+        if (glTFImage* image = getImage(textureIndex)) {
+          image->format = VK_FORMAT_R8G8B8A8_SRGB;
+          image->mipFlags |= MIP_FLAG_SRGB;
+        }
+      }
+    }
+    if (glTFImage* image = getImage(material.normalTextureIndex)) {
+      image->mipFlags |= MIP_FLAG_NORMAL;
+    }
+    glTFImage* baseColor = getImage(material.baseColorTextureIndex);
+    if (baseColor && material.alphaCutoff >= 0.0f) {
+      baseColor->mipFlags |= MIP_FLAG_ALPHA_COVERAGE;
+      baseColor->alphaCutoff = material.alphaCutoff;
+    }
+  }
+  auto& defaultImage = images.emplace_back();
+  CreateDefaultImage(mDevice, *mUploader, mAllocator, defaultImage);
+  mPendingUploads.push_back(
+      {0, LoadEvent::Type::Image, static_cast<uint32_t>(images.size() - 1)});
 
-  // textures
-  LoadTextures(model);
+  // textures, and the feedback of the shaders sampling them
+  LoadTextures(desc, resources);
+  mMipChains.resize(images.size());
+  mSparseImages.resize(images.size());
+  mFeedback.Create(mAllocator, static_cast<uint32_t>(textures.size()));
 
   // materials
-  LoadMaterials(model);
+  LoadMaterials(desc);
 
-  // meshes
-  LoadMeshes(model);
+  // meshes, vertex/index data follows per mesh
+  LoadMeshes(desc);
+  // the loader created the geometry buffers before publishing the structure
+  if (!HasVertexStream(VERTEX_STREAM_COLOR)) {
+    // bound with a zero stride
+    const uint32_t white = 0xffffffff;
+    vertexStreams[VERTEX_STREAM_COLOR].Create(
+        mAllocator, sizeof(white),
+        VK_BUFFER_USAGE_2_VERTEX_BUFFER_BIT | mBufferUsageFlags,
+        mUploader->GetQueueFamilyIndices());
+    mUploader->UploadBuffer(vertexStreams[VERTEX_STREAM_COLOR].buffer, &white,
+                            sizeof(white));
+  }
 
   // nodes
-  LoadNodes(model);
+  LoadNodes(desc, resources);
 
   // default scene
-  LoadScene(model);
+  LoadScene(desc);
 
   // descriptor sets
   // CreateDescriptorSets();
+
+  mStructureReady = true;
+  auto tEnd = std::chrono::high_resolution_clock::now();
+  HKR_INFO(
+      "Model structure ready after {:.2f} ms",
+      std::chrono::duration<double, std::milli>(tEnd - mLoadStart).count());
+  return 0;
 }
 
-void glTFModel::LoadSamplers(const tinygltf::Model& model) {
-  const size_t samplerCount = model.samplers.size();
+void glTFModel::LoadSamplers(const ModelDesc& desc,
+                             const SceneResources& resources) {
+  const size_t samplerCount = desc.samplers.size();
   samplers.resize(samplerCount);
   for (size_t i = 0; i < samplerCount; i++) {
-    const auto& sampler = model.samplers[i];
+    if (!resources.samplers[i]) {
+      samplers[i].sampler = VK_NULL_HANDLE;
+      continue;
+    }
+    const auto& sampler = desc.samplers[i];
     glTFSampler& newSampler = samplers[i];
     SamplerBuilder builder;
     builder.SetMinFilter(glTFFilterToVkFilter(sampler.minFilter))
@@ -155,146 +917,660 @@ void glTFModel::LoadSamplers(const tinygltf::Model& model) {
   newSampler.sampler = builder.Build(mDevice);
 }
 
-static void CreateDefaultImage(VkDevice device,
-                               VkQueue queue,
-                               VkCommandPool commandPool,
-                               VmaAllocator allocator,
-                               glTFImage& defaultImage) {
-  defaultImage.image.Create(device, allocator, 1, 1, 1,
-                            VK_FORMAT_R8G8B8A8_UNORM);
-  std::array<uint8_t, 4> defaultImageData{255, 255, 255, 255};
-  uint32_t dataSize = defaultImageData.size() * sizeof(uint8_t);
-  StagingBuffer staging;
-  staging.Create(allocator, dataSize);
-  staging.Map(allocator);
-  staging.Write(defaultImageData.data(), dataSize);
-  staging.Unmap(allocator);
-  VkCommandBuffer commandBuffer = BeginOneTimeCommands(device, commandPool);
-  TransitImageLayout(commandBuffer, defaultImage.image.image,
-                     VK_IMAGE_LAYOUT_UNDEFINED,
-                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1);
-  CopyBufferToImage(commandBuffer, staging.buffer, defaultImage.image.image, 1,
-                    1);
-  TransitImageLayout(commandBuffer, defaultImage.image.image,
-                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1);
-  EndOneTimeCommands(device, queue, commandPool, commandBuffer);
-  staging.Cleanup(allocator);
-}
-
-// create image in gpu and generate mipmap
-void glTFModel::LoadImages(const tinygltf::Model& model) {
-  const size_t imageCount = model.images.size();
-  images.resize(imageCount);
-  for (size_t i = 0; i < imageCount; i++) {
-    const auto& image = model.images[i];
-    glTFImage& newImage = images[i];
-
-    // if (image.uri.empty() || image.width == 0 || image.height == 0 ||
-    //     image.component == -1) {
-    //   CreateDefaultImage(mDevice, mQueue, mCommandPool, mAllocator,
-    //   newImage); continue;
-    // }
-
-    if (!image.uri.empty() && GetFileExtension(image.uri) == "ktx2") {
-      const std::string fileName = mFilePath + "/" + image.uri;
-      newImage.image.Load(mDevice, mAllocator, mQueue, mCommandPool, fileName);
+// create image in gpu, copy its mip chain or generate mipmap
+VkDeviceSize glTFModel::UploadImage(LoadEvent& event) {
+  glTFImage& newImage = images[event.index];
+  VkDeviceSize uploaded = 0;
+  if (RegisterMipChain(event, uploaded)) {
+    // streamed, starts out with its mip tail
+  } else if (event.ktxTexture) {
+    uploaded = newImage.image.Load(mDevice, mAllocator, *mUploader,
+                                   event.ktxTexture.get(),
+                                   newImage.format == VK_FORMAT_R8G8B8A8_SRGB);
+    event.ktxTexture.reset();
+  } else {
+    const uint32_t width = static_cast<uint32_t>(event.width);
+    const uint32_t height = static_cast<uint32_t>(event.height);
+    // decoded images are already in their own staging buffer, cooked ones
+    // are copied from the mapped file
+    UploadBatcher::Allocation staging{event.staging.buffer, 0, nullptr};
+    VkDeviceSize imageSize = VkDeviceSize{width} * height * 4;
+    if (staging.buffer == VK_NULL_HANDLE) {
+      imageSize = event.pixelBytes.size();
+      staging = mUploader->Allocate(imageSize);
+      memcpy(staging.data, event.pixelBytes.data(), imageSize);
+    }
+    const bool generateMipmaps =
+        event.mipLevels == 1 && GetMipLevels(width, height) > 1;
+    uint32_t mipLevels = event.mipLevels;
+    if (generateMipmaps) {
+      mipLevels = std::min(GetMipLevels(width, height),
+                           MipGenerator::MAX_MIP_LEVELS);
+      newImage.image.CreateWithMipStorage(mDevice, mAllocator, width, height,
+                                          mipLevels, newImage.format);
     } else {
-      const int width = image.width;
-      const int height = image.height;
-      std::vector<unsigned char> imageData;
-      // const unsigned char* imageData = nullptr;
-      imageData.resize(width * height * 4);
-      if (image.component == 4) {
-        imageData = image.image;
-        HKR_ASSERT(imageData.size() * sizeof(unsigned char) ==
-                   width * height * 4);
-      } else {
-        for (size_t j = 0; j < width * height; j++) {
-          for (size_t k = 0; k < image.component; k++) {
-            imageData[j * 4 + k] = image.image[j * image.component + k];
+      newImage.image.Create(mDevice, mAllocator, width, height, mipLevels,
+                            newImage.format);
+    }
+
+    VkCommandBuffer commandBuffer = mUploader->GetCommandBuffer();
+    TransitImageLayout(commandBuffer, newImage.image.image,
+                       VK_IMAGE_LAYOUT_UNDEFINED,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
+    if (generateMipmaps) {
+      CopyBufferToImage(commandBuffer, staging.buffer, newImage.image.image,
+                        width, height, staging.offset);
+      // mips are generated by a compute dispatch on the graphics queue,
+      // acquire the image there first
+      mUploader->TransferImage(newImage.image.image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               VK_IMAGE_LAYOUT_GENERAL,
+                               {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1});
+      // transits to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL once the mips
+      // are generated
+      mMipGenerator->Add(newImage.image.image, newImage.format, width, height,
+                         mipLevels, newImage.mipFlags, newImage.alphaCutoff);
+    } else {
+      // cooked mip chain, levels are tightly packed rgba8
+      std::vector<VkBufferImageCopy2> copyRegions(mipLevels);
+      VkDeviceSize offset = staging.offset;
+      for (uint32_t level = 0; level < mipLevels; level++) {
+        const uint32_t levelWidth = std::max(width >> level, 1u);
+        const uint32_t levelHeight = std::max(height >> level, 1u);
+        VkBufferImageCopy2& region = copyRegions[level];
+        region.sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2;
+        region.bufferOffset = offset;
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+        region.imageExtent = {levelWidth, levelHeight, 1};
+        offset += levelWidth * levelHeight * 4;
+      }
+      CopyBufferToTexture(commandBuffer, staging.buffer, newImage.image.image,
+                          copyRegions);
+      mUploader->TransferImage(newImage.image.image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                               {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1});
+    }
+    if (event.staging.buffer != VK_NULL_HANDLE) {
+      // the staging buffer lives until the batch has executed
+      mUploader->Defer(
+          [allocator = mAllocator, staging = event.staging]() mutable {
+            staging.Unmap(allocator);
+            staging.Cleanup(allocator);
+          });
+      event.staging = {};
+    }
+    uploaded = imageSize;
+  }
+  mPendingUploads.push_back({0, LoadEvent::Type::Image, event.index});
+  return uploaded;
+}
+
+VkDeviceSize glTFModel::MipChain::GetSize(uint32_t firstLevel) const {
+  VkDeviceSize size = 0;
+  for (size_t level = firstLevel; level < levelSizes.size(); level++) {
+    size += levelSizes[level];
+  }
+  return size;
+}
+
+const uint8_t* glTFModel::MipChain::GetLevel(uint32_t level) const {
+  const uint8_t* data = ktxTexture ? ktxTexture->pData : pixelBytes.data();
+  return data + levelOffsets[level];
+}
+
+void glTFModel::SparseImage::GetTileCoords(uint32_t tile,
+                                           uint32_t& level,
+                                           uint32_t& x,
+                                           uint32_t& y) const {
+  level = 0;
+  while (level + 1 < levelTiles.size() && levelTiles[level + 1] <= tile) {
+    level++;
+  }
+  const uint32_t columns = texture.GetTileCount(level).width;
+  x = (tile - levelTiles[level]) % columns;
+  y = (tile - levelTiles[level]) / columns;
+}
+
+bool glTFModel::RegisterMipChain(LoadEvent& event, VkDeviceSize& uploaded) {
+  glTFImage& image = images[event.index];
+  MipChain& chain = mMipChains[event.index];
+  if (event.ktxTexture) {
+    ktxTexture2* texture = event.ktxTexture.get();
+    if (texture->numLevels < 2) {
+      return false;
+    }
+    image.width = texture->baseWidth;
+    image.height = texture->baseHeight;
+    image.mipLevels = texture->numLevels;
+    chain.format = static_cast<VkFormat>(texture->vkFormat);
+    if (image.format == VK_FORMAT_R8G8B8A8_SRGB) {
+      chain.format = GetSrgbFormat(chain.format);
+    }
+    for (uint32_t level = 0; level < image.mipLevels; level++) {
+      ktx_size_t offset = 0;
+      ktxTexture2_GetImageOffset(texture, level, 0, 0, &offset);
+      chain.levelOffsets.push_back(offset);
+      chain.levelSizes.push_back(
+          ktxTexture_GetImageSize(ktxTexture(texture), level));
+    }
+    chain.ktxTexture = std::move(event.ktxTexture);
+  } else {
+    // cooked chains only, decoded images get their mips on the gpu
+    if (event.mipLevels < 2 || !event.cooked) {
+      return false;
+    }
+    image.width = static_cast<uint32_t>(event.width);
+    image.height = static_cast<uint32_t>(event.height);
+    image.mipLevels = event.mipLevels;
+    chain.format = image.format;
+    VkDeviceSize offset = 0;
+    for (uint32_t level = 0; level < image.mipLevels; level++) {
+      const VkDeviceSize size = VkDeviceSize{std::max(image.width >> level, 1u)} *
+                                std::max(image.height >> level, 1u) * 4;
+      chain.levelOffsets.push_back(offset);
+      chain.levelSizes.push_back(size);
+      offset += size;
+    }
+    chain.pixelBytes = event.pixelBytes;
+    chain.cooked = std::move(event.cooked);
+  }
+  if (mTextureFormats.sparseResidency &&
+      CreateSparseImage(event.index, uploaded)) {
+    return true;
+  }
+  image.streamed = true;
+  image.residentMip = GetMipTail(image.width, image.height, image.mipLevels);
+  image.requestedMip = image.residentMip;
+  uploaded = UploadMips(event.index, image.residentMip, image.image);
+  SetTextureHeap(image.image.allocation);
+  return true;
+}
+
+void glTFModel::SetTextureHeap(VmaAllocation allocation) {
+  if (mTextureHeap != UINT32_MAX) {
+    return;
+  }
+  VmaAllocationInfo allocInfo;
+  vmaGetAllocationInfo(mAllocator, allocation, &allocInfo);
+  const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+  vmaGetMemoryProperties(mAllocator, &memoryProperties);
+  mTextureHeap = memoryProperties->memoryTypes[allocInfo.memoryType].heapIndex;
+}
+
+bool glTFModel::CreateSparseImage(uint32_t imageIndex, VkDeviceSize& uploaded) {
+  glTFImage& image = images[imageIndex];
+  const MipChain& chain = mMipChains[imageIndex];
+  SparseImage& sparse = mSparseImages[imageIndex];
+  if (!sparse.texture.Create(mDevice, mAllocator, *mUploader, image.width,
+                             image.height, image.mipLevels, chain.format)) {
+    return false;
+  }
+  const uint32_t mipTail = sparse.texture.GetMipTail();
+  for (uint32_t level = 0; level < mipTail; level++) {
+    const VkExtent2D tileCount = sparse.texture.GetTileCount(level);
+    sparse.levelTiles.push_back(static_cast<uint32_t>(sparse.tiles.size()));
+    sparse.tiles.resize(sparse.tiles.size() +
+                        size_t{tileCount.width} * tileCount.height);
+  }
+  // the mip tail is resident from the start and never dropped
+  for (uint32_t level = mipTail; level < image.mipLevels; level++) {
+    uploaded +=
+        sparse.texture.UploadLevel(*mUploader, level, chain.GetLevel(level));
+  }
+  mUploader->TransferSharedImage(
+      sparse.texture.GetImage(),
+      {VK_IMAGE_ASPECT_COLOR_BIT, 0, image.mipLevels, 0, 1});
+  image.sparse = true;
+  image.image.image = sparse.texture.GetImage();
+  image.image.imageView = sparse.texture.GetImageView();
+  return true;
+}
+
+VkDeviceSize glTFModel::UploadMips(uint32_t imageIndex,
+                                   uint32_t firstMip,
+                                   Texture& dst) {
+  const glTFImage& image = images[imageIndex];
+  const MipChain& chain = mMipChains[imageIndex];
+  const uint8_t* src = chain.ktxTexture ? chain.ktxTexture->pData
+                                        : chain.pixelBytes.data();
+  const uint32_t width = std::max(image.width >> firstMip, 1u);
+  const uint32_t height = std::max(image.height >> firstMip, 1u);
+  const uint32_t mipLevels = image.mipLevels - firstMip;
+  // the levels back to back, their sizes are multiples of the texel block
+  // size so every copy stays aligned
+  const VkDeviceSize size = chain.GetSize(firstMip);
+  UploadBatcher::Allocation staging = mUploader->Allocate(size);
+  std::vector<VkBufferImageCopy2> copyRegions(mipLevels);
+  VkDeviceSize offset = 0;
+  for (uint32_t i = 0; i < mipLevels; i++) {
+    const uint32_t level = firstMip + i;
+    memcpy(static_cast<uint8_t*>(staging.data) + offset,
+           src + chain.levelOffsets[level], chain.levelSizes[level]);
+    VkBufferImageCopy2& region = copyRegions[i];
+    region.sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2;
+    region.bufferOffset = staging.offset + offset;
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+    region.imageExtent = {std::max(width >> i, 1u), std::max(height >> i, 1u),
+                          1};
+    offset += chain.levelSizes[level];
+  }
+  dst.Create(mDevice, mAllocator, width, height, mipLevels, chain.format);
+  VkCommandBuffer commandBuffer = mUploader->GetCommandBuffer();
+  TransitImageLayout(commandBuffer, dst.image, VK_IMAGE_LAYOUT_UNDEFINED,
+                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
+  CopyBufferToTexture(commandBuffer, staging.buffer, dst.image, copyRegions);
+  mUploader->TransferImage(dst.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                           {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1});
+  return size;
+}
+
+void glTFModel::UpdateStreaming(uint32_t currentFrame, VkDeviceSize& uploaded) {
+  // requests of the frame that last used this slot. Sparse images get the
+  // tiles every cell asks for, the others the finest level any cell of any
+  // texture sharing the image asks for.
+  std::span<const uint32_t> requests = mFeedback.Read(currentFrame);
+  std::vector<TileRef> requestedTiles;
+  const size_t textureCount = requests.size() / TextureFeedback::CELL_COUNT;
+  for (size_t i = 0; i < textureCount; i++) {
+    if (textures[i].imageIndex < 0) {
+      continue;
+    }
+    const uint32_t imageIndex = static_cast<uint32_t>(textures[i].imageIndex);
+    glTFImage& image = images[imageIndex];
+    const std::span<const uint32_t> cells =
+        requests.subspan(i * TextureFeedback::CELL_COUNT,
+                         TextureFeedback::CELL_COUNT);
+    if (image.sparse) {
+      RequestTiles(imageIndex, cells, requestedTiles);
+      continue;
+    }
+    if (!image.streamed) {
+      continue;
+    }
+    const uint32_t request = *std::min_element(cells.begin(), cells.end());
+    if (request == TextureFeedback::NO_REQUEST) {
+      continue;
+    }
+    const float lod = std::floor(
+        TextureFeedback::DecodeLod(request, image.width, image.height));
+    const uint32_t mip = static_cast<uint32_t>(
+        std::clamp(lod, 0.0f, static_cast<float>(image.mipLevels - 1)));
+    image.requestedMip = image.requestFrame == mFrameCount
+                             ? std::min(image.requestedMip, mip)
+                             : mip;
+    image.requestFrame = mFrameCount;
+  }
+
+  // images whose range can change: resident and not being replaced
+  auto isIdle = [](const glTFImage& image) {
+    return image.streamed && image.resident &&
+           image.pendingImage.image == VK_NULL_HANDLE;
+  };
+  auto getTail = [](const glTFImage& image) {
+    return GetMipTail(image.width, image.height, image.mipLevels);
+  };
+  // resident levels missing from the request, negative if there are more
+  // than asked for. Images not asked for lately only need their tail.
+  auto getGap = [&](const glTFImage& image) {
+    uint32_t desired = getTail(image);
+    if (mFrameCount - image.requestFrame <= STREAM_RETAIN_FRAMES) {
+      desired = std::min(desired, image.requestedMip);
+    }
+    return static_cast<int32_t>(image.residentMip) -
+           static_cast<int32_t>(desired);
+  };
+
+  // memory of the streamed images now, and once their uploads complete
+  VkDeviceSize streamedBytes = mSparseBytes;
+  VkDeviceSize projectedBytes = mSparseBytes;
+  for (size_t i = 0; i < images.size(); i++) {
+    const glTFImage& image = images[i];
+    const MipChain& chain = mMipChains[i];
+    if (image.sparse) {
+      const VkDeviceSize mipTailSize =
+          chain.GetSize(mSparseImages[i].texture.GetMipTail());
+      streamedBytes += mipTailSize;
+      projectedBytes += mipTailSize;
+      continue;
+    }
+    if (!image.streamed) {
+      continue;
+    }
+    streamedBytes += chain.GetSize(image.residentMip);
+    if (image.pendingImage.image != VK_NULL_HANDLE) {
+      streamedBytes += chain.GetSize(image.pendingMip);
+      projectedBytes += chain.GetSize(image.pendingMip);
+    } else {
+      projectedBytes += chain.GetSize(image.residentMip);
+    }
+  }
+  if (streamedBytes == 0) {
+    return;
+  }
+  const VkDeviceSize budget = GetStreamingBudget(streamedBytes);
+
+  auto streamMips = [&](uint32_t index, uint32_t firstMip) {
+    glTFImage& image = images[index];
+    const MipChain& chain = mMipChains[index];
+    projectedBytes = projectedBytes - chain.GetSize(image.residentMip) +
+                     chain.GetSize(firstMip);
+    image.pendingMip = firstMip;
+    uploaded += UploadMips(index, firstMip, image.pendingImage);
+    mPendingUploads.push_back({0, LoadEvent::Type::Image, index, true});
+  };
+  // drop levels of the image whose request is best served, as long as it is
+  // not missing more than maxGap levels, the largest first on a tie. Levels
+  // nobody asked for go at once, others one at a time.
+  auto evict = [&](int32_t maxGap) {
+    int32_t best = -1;
+    int32_t bestGap = 0;
+    VkDeviceSize bestSize = 0;
+    for (size_t i = 0; i < images.size(); i++) {
+      const glTFImage& image = images[i];
+      if (!isIdle(image) || image.residentMip >= getTail(image)) {
+        continue;
+      }
+      const int32_t gap = getGap(image);
+      const VkDeviceSize size = mMipChains[i].GetSize(image.residentMip);
+      if (gap <= maxGap &&
+          (best == -1 || gap < bestGap || (gap == bestGap && size > bestSize))) {
+        best = static_cast<int32_t>(i);
+        bestGap = gap;
+        bestSize = size;
+      }
+    }
+    if (best == -1) {
+      return false;
+    }
+    const glTFImage& image = images[best];
+    streamMips(best, bestGap < 0 ? image.residentMip - bestGap
+                                 : image.residentMip + 1);
+    return true;
+  };
+
+  // scenes whose textures do not fit lose their finest levels first
+  while (projectedBytes > budget && evict(INT32_MAX)) {
+  }
+
+  // raise the images missing the most levels first, as many levels at once as
+  // the budget allows. Room is made by dropping a level of images that would
+  // still be better served than the raised one, so that quality evens out
+  // across the scene instead of going back and forth.
+  while (uploaded < UPLOAD_BUDGET_PER_FRAME) {
+    int32_t best = -1;
+    int32_t bestGap = 0;
+    for (size_t i = 0; i < images.size(); i++) {
+      const glTFImage& image = images[i];
+      if (!isIdle(image)) {
+        continue;
+      }
+      const int32_t gap = getGap(image);
+      if (gap > bestGap) {
+        best = static_cast<int32_t>(i);
+        bestGap = gap;
+      }
+    }
+    if (best == -1) {
+      break;
+    }
+    const glTFImage& image = images[best];
+    const MipChain& chain = mMipChains[best];
+    const VkDeviceSize residentSize = chain.GetSize(image.residentMip);
+    auto fits = [&](uint32_t firstMip) {
+      return projectedBytes - residentSize + chain.GetSize(firstMip) <= budget;
+    };
+    uint32_t firstMip = image.residentMip - bestGap;
+    while (firstMip + 1 < image.residentMip && !fits(firstMip)) {
+      firstMip++;
+    }
+    while (!fits(firstMip) && evict(bestGap - 2)) {
+    }
+    if (!fits(firstMip)) {
+      break;
+    }
+    streamMips(best, firstMip);
+  }
+
+  UpdateTiles(requestedTiles, budget, projectedBytes, uploaded);
+}
+
+void glTFModel::RequestTiles(uint32_t imageIndex,
+                             std::span<const uint32_t> cells,
+                             std::vector<TileRef>& requested) {
+  const glTFImage& image = images[imageIndex];
+  SparseImage& sparse = mSparseImages[imageIndex];
+  const uint32_t mipTail = sparse.texture.GetMipTail();
+  for (uint32_t cell = 0; cell < cells.size(); cell++) {
+    if (cells[cell] == TextureFeedback::NO_REQUEST) {
+      continue;
+    }
+    const float lod = std::floor(
+        TextureFeedback::DecodeLod(cells[cell], image.width, image.height));
+    // the coarser levels are blended in by trilinear filtering and stand in
+    // for the finer ones until they are resident
+    for (uint32_t level = static_cast<uint32_t>(std::max(lod, 0.0f));
+         level < mipTail; level++) {
+      const TileRange range = GetCellTiles(sparse.texture, cell, level);
+      for (uint32_t y = range.y0; y <= range.y1; y++) {
+        for (uint32_t x = range.x0; x <= range.x1; x++) {
+          const uint32_t index = sparse.GetTileIndex(level, x, y);
+          SparseTile& tile = sparse.tiles[index];
+          if (tile.requestFrame == mFrameCount) {
+            continue;
+          }
+          tile.requestFrame = mFrameCount;
+          if (tile.page == VK_NULL_HANDLE) {
+            requested.push_back({imageIndex, index, level});
           }
         }
       }
-      // upload image data to gpu image
-      StagingBuffer staging;
-      const uint32_t imageSize = imageData.size() * sizeof(unsigned char);
-      staging.Create(mAllocator, imageSize);
-      staging.Map(mAllocator);
-      staging.Write(imageData.data(), imageSize);
-      staging.Unmap(mAllocator);
-      uint32_t mipLevels = GetMipLevels(width, height);
-      newImage.image.Create(mDevice, mAllocator, width, height, mipLevels,
-                            VK_FORMAT_R8G8B8A8_UNORM);
-      // VK_FORMAT_R8G8B8A8_SRGB);
+    }
+  }
+}
 
-      VkCommandBuffer commandBuffer =
-          BeginOneTimeCommands(mDevice, mCommandPool);
-      TransitImageLayout(commandBuffer, newImage.image.image,
-                         VK_IMAGE_LAYOUT_UNDEFINED,
-                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
-      CopyBufferToImage(commandBuffer, staging.buffer, newImage.image.image,
-                        static_cast<uint32_t>(width),
-                        static_cast<uint32_t>(height));
-      // transit to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL while
-      // generating mipmaps
-      GenerateMipmaps(commandBuffer, newImage.image.image, width, height,
-                      mipLevels);
-      EndOneTimeCommands(mDevice, mQueue, mCommandPool, commandBuffer);
-      staging.Cleanup(mAllocator);
+void glTFModel::UpdateTiles(std::vector<TileRef>& requested,
+                            VkDeviceSize budget,
+                            VkDeviceSize& projectedBytes,
+                            VkDeviceSize& uploaded) {
+  // resident tiles not asked for this frame, the least recently requested
+  // and the finest first, collected once room is needed
+  std::vector<TileRef> evictable;
+  bool collected = false;
+  size_t nextEvicted = 0;
+  auto evictTile = [&]() {
+    if (!collected) {
+      collected = true;
+      for (uint32_t i = 0; i < mSparseImages.size(); i++) {
+        const SparseImage& sparse = mSparseImages[i];
+        for (uint32_t level = 0; level < sparse.levelTiles.size(); level++) {
+          const uint32_t end = level + 1 < sparse.levelTiles.size()
+                                   ? sparse.levelTiles[level + 1]
+                                   : static_cast<uint32_t>(sparse.tiles.size());
+          for (uint32_t tile = sparse.levelTiles[level]; tile < end; tile++) {
+            if (sparse.tiles[tile].resident &&
+                sparse.tiles[tile].requestFrame != mFrameCount) {
+              evictable.push_back({i, tile, level});
+            }
+          }
+        }
+      }
+      std::sort(evictable.begin(), evictable.end(),
+                [this](const TileRef& a, const TileRef& b) {
+                  const uint64_t frameA =
+                      mSparseImages[a.imageIndex].tiles[a.tile].requestFrame;
+                  const uint64_t frameB =
+                      mSparseImages[b.imageIndex].tiles[b.tile].requestFrame;
+                  return frameA != frameB ? frameA < frameB
+                                          : a.level < b.level;
+                });
+    }
+    if (nextEvicted == evictable.size()) {
+      return false;
+    }
+    const TileRef& ref = evictable[nextEvicted++];
+    SparseImage& sparse = mSparseImages[ref.imageIndex];
+    // dropped from the residency now and unbound once no frame in flight
+    // samples it
+    sparse.tiles[ref.tile].resident = false;
+    sparse.residencyDirty = true;
+    mRetiredTiles.push_back({mFrameCount, ref.imageIndex, ref.tile});
+    const VkDeviceSize pageSize = sparse.texture.GetPageRequirements().size;
+    mSparseBytes -= pageSize;
+    projectedBytes -= pageSize;
+    return true;
+  };
+
+  while (projectedBytes > budget && evictTile()) {
+  }
+
+  // coarse levels first, finer tiles are only sampled once the tiles of
+  // every coarser level around them are resident
+  std::stable_sort(requested.begin(), requested.end(),
+                   [](const TileRef& a, const TileRef& b) {
+                     return a.level > b.level;
+                   });
+  std::vector<uint32_t> uploadedImages;
+  for (const TileRef& ref : requested) {
+    if (uploaded >= UPLOAD_BUDGET_PER_FRAME) {
+      break;
+    }
+    SparseImage& sparse = mSparseImages[ref.imageIndex];
+    const VkMemoryRequirements& pageRequirements =
+        sparse.texture.GetPageRequirements();
+    while (projectedBytes + pageRequirements.size > budget && evictTile()) {
+    }
+    if (projectedBytes + pageRequirements.size > budget) {
+      break;
+    }
+    VmaAllocation page = mPagePool.Allocate(pageRequirements);
+    if (page == VK_NULL_HANDLE) {
+      break;
+    }
+    SetTextureHeap(page);
+    uint32_t level, x, y;
+    sparse.GetTileCoords(ref.tile, level, x, y);
+    sparse.texture.BindTile(*mUploader, level, x, y, page);
+    uploaded += sparse.texture.UploadTile(
+        *mUploader, level, x, y, mMipChains[ref.imageIndex].GetLevel(level));
+    SparseTile& tile = sparse.tiles[ref.tile];
+    tile.page = page;
+    tile.pending = true;
+    mSparseBytes += pageRequirements.size;
+    projectedBytes += pageRequirements.size;
+    mPendingUploads.push_back(
+        {0, LoadEvent::Type::Image, ref.imageIndex, false, ref.tile});
+    if (std::find(uploadedImages.begin(), uploadedImages.end(),
+                  ref.imageIndex) == uploadedImages.end()) {
+      uploadedImages.push_back(ref.imageIndex);
     }
   }
-  // create default image
-  auto& defaultImage = images.emplace_back();
-  CreateDefaultImage(mDevice, mQueue, mCommandPool, mAllocator, defaultImage);
+  for (uint32_t imageIndex : uploadedImages) {
+    const SparseImage& sparse = mSparseImages[imageIndex];
+    mUploader->TransferSharedImage(
+        sparse.texture.GetImage(),
+        {VK_IMAGE_ASPECT_COLOR_BIT, 0, sparse.texture.GetMipTail(), 0, 1});
+  }
+  mPagePool.Trim(SPARSE_FREE_PAGES);
+}
+
+void glTFModel::UpdateResidency() {
+  std::array<uint8_t, TextureFeedback::CELL_COUNT> lods;
+  for (size_t i = 0; i < mSparseImages.size(); i++) {
+    SparseImage& sparse = mSparseImages[i];
+    if (!sparse.residencyDirty || !images[i].resident) {
+      continue;
+    }
+    sparse.residencyDirty = false;
+    // the finest level whose tiles around the cell are resident along with
+    // those of every coarser level
+    auto isResident = [&](uint32_t cell, uint32_t level) {
+      const TileRange range = GetCellTiles(sparse.texture, cell, level);
+      for (uint32_t y = range.y0; y <= range.y1; y++) {
+        for (uint32_t x = range.x0; x <= range.x1; x++) {
+          if (!sparse.tiles[sparse.GetTileIndex(level, x, y)].resident) {
+            return false;
+          }
+        }
+      }
+      return true;
+    };
+    for (uint32_t cell = 0; cell < lods.size(); cell++) {
+      uint32_t lod = sparse.texture.GetMipTail();
+      while (lod > 0 && isResident(cell, lod - 1)) {
+        lod--;
+      }
+      lods[cell] = static_cast<uint8_t>(lod);
+    }
+    for (size_t t = 0; t < textures.size(); t++) {
+      if (textures[t].imageIndex == static_cast<int>(i)) {
+        std::span<uint8_t> residency =
+            mFeedback.GetResidency(static_cast<uint32_t>(t));
+        std::copy(lods.begin(), lods.end(), residency.begin());
+      }
+    }
+  }
+}
+
+VkDeviceSize glTFModel::GetStreamingBudget(VkDeviceSize streamedBytes) const {
+  VkDeviceSize budget = streamedBytes;
+  if (mTextureHeap != UINT32_MAX) {
+    // the streamed levels may grow into what is left of the heap budget but
+    // a reserve, and shrink if the budget has dropped below the usage
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(mAllocator, budgets);
+    const VmaBudget& heap = budgets[mTextureHeap];
+    const VkDeviceSize used = heap.usage + heap.budget / STREAM_RESERVE_DIVISOR;
+    if (used < heap.budget) {
+      budget += heap.budget - used;
+    } else {
+      budget -= std::min(budget, used - heap.budget);
+    }
+  }
+  if (mTextureBudget > 0) {
+    budget = std::min(budget, mTextureBudget);
+  }
+  return budget;
 }
 
-void glTFModel::LoadTextures(const tinygltf::Model& model) {
-  const size_t texCount = model.textures.size();
+void glTFModel::LoadTextures(const ModelDesc& desc,
+                             const SceneResources& resources) {
+  const size_t texCount = desc.textures.size();
   textures.resize(texCount);
   for (size_t i = 0; i < texCount; i++) {
-    const auto& tex = model.textures[i];
+    const auto& tex = desc.textures[i];
     glTFTexture& newTex = textures[i];
-    newTex.imageIndex = tex.source == -1 ? images.size() - 1 : tex.source;
-    newTex.samplerIndex = tex.sampler == -1 ? samplers.size() - 1 : tex.sampler;
+    newTex.imageIndex =
+        tex.imageIndex == -1 ? images.size() - 1 : tex.imageIndex;
+    // the renderers bind every texture, those of other scenes sample with
+    // the default sampler since their own was not created
+    newTex.samplerIndex = tex.samplerIndex == -1 || !resources.textures[i]
+                              ? samplers.size() - 1
+                              : tex.samplerIndex;
   }
   glTFTexture& defaultTex = textures.emplace_back();
   defaultTex.imageIndex = images.size() - 1;
   defaultTex.samplerIndex = samplers.size() - 1;
 }
 
-void glTFModel::LoadMaterials(const tinygltf::Model& model) {
-  const size_t matCount = model.materials.size();
+void glTFModel::LoadMaterials(const ModelDesc& desc) {
+  const size_t matCount = desc.materials.size();
   materials.resize(matCount);
   const uint32_t defaultTextureIndex =
       static_cast<uint32_t>(textures.size()) - 1;
   for (size_t i = 0; i < matCount; i++) {
-    const tinygltf::Material& mat = model.materials[i];
+    const MaterialDesc& mat = desc.materials[i];
     glTFMaterial& material = materials[i];
-    const auto& metallicRoughness = mat.pbrMetallicRoughness;
-    // base color texture
-    material.baseColorTextureIndex = metallicRoughness.baseColorTexture.index;
-    // base color factor
-    auto& colorFactor = metallicRoughness.baseColorFactor;
-    material.baseColorFactor = {colorFactor[0], colorFactor[1], colorFactor[2],
-                                colorFactor[3]};
-    // metallicRoughness texture
-    material.metallicRoughnessTextureIndex =
-        metallicRoughness.metallicRoughnessTexture.index;
-    // metallic factor
-    material.metallicFactor = metallicRoughness.metallicFactor;
-    // roughness factor
-    material.roughnessFactor = metallicRoughness.roughnessFactor;
-    // normal texture
-    material.normalTextureIndex = mat.normalTexture.index;
-    // occlusion texture
-    material.occlusionTextureIndex = mat.occlusionTexture.index;
-    // emissive texture
-    material.emissiveTextureIndex = mat.emissiveTexture.index;
-    // emissive factor
-    auto& emissiveFactor = mat.emissiveFactor;
-    material.emissiveFactor = {emissiveFactor[0], emissiveFactor[1],
-                               emissiveFactor[2]};
+    material.baseColorFactor = mat.baseColorFactor;
+    material.emissiveFactor = mat.emissiveFactor;
+    material.metallicFactor = mat.metallicFactor;
+    material.roughnessFactor = mat.roughnessFactor;
+    material.baseColorTextureIndex = mat.baseColorTextureIndex;
+    material.metallicRoughnessTextureIndex = mat.metallicRoughnessTextureIndex;
+    material.normalTextureIndex = mat.normalTextureIndex;
+    material.occlusionTextureIndex = mat.occlusionTextureIndex;
+    material.emissiveTextureIndex = mat.emissiveTextureIndex;
   }
   // default material
   auto& defaultMaterial = materials.emplace_back();
@@ -305,286 +1581,95 @@ void glTFModel::LoadMaterials(const tinygltf::Model& model) {
   defaultMaterial.emissiveTextureIndex = defaultTextureIndex;
 }
 
-void glTFModel::LoadMeshes(const tinygltf::Model& model) {
-  const size_t meshCount = model.meshes.size();
+void glTFModel::LoadMeshes(const ModelDesc& desc) {
+  const size_t meshCount = desc.meshes.size();
   meshes.resize(meshCount);
-  // vertex and index data for all primitives in all meshes
-  std::vector<glTFVertex> vertexData;
-  std::vector<uint32_t> indexData;
   for (size_t i = 0; i < meshCount; i++) {
-    const auto& mesh = model.meshes[i];
-    glTFMesh& newMesh = meshes[i];
-    for (const tinygltf::Primitive& prim : mesh.primitives) {
-      if (prim.indices < 0) {
-        continue;
-      }
-      glTFPrimitive& newPrim = newMesh.primitives.emplace_back();
-      size_t firstVertex = vertexData.size();
-      uint32_t vertexCount = 0;
-      size_t firstIndex = indexData.size();
-      uint32_t indexCount = 0;
-      // indices
-      {
-        const tinygltf::Accessor& accessor = model.accessors[prim.indices];
-        indexCount = static_cast<uint32_t>(accessor.count);
-        const tinygltf::BufferView& bufferView =
-            model.bufferViews[accessor.bufferView];
-        const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
-        const unsigned char* pIndex =
-            &buffer.data[accessor.byteOffset + bufferView.byteOffset];
-        const uint32_t indexStride = accessor.ByteStride(bufferView);
-
-        switch (accessor.componentType) {
-          case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
-            for (size_t index = 0; index < indexCount; index++) {
-              const uint32_t* idx = reinterpret_cast<const uint32_t*>(
-                  pIndex + index * indexStride);
-              indexData.push_back(*idx + firstVertex);
-            }
-            break;
-          }
-          case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
-            for (size_t index = 0; index < indexCount; index++) {
-              const uint16_t* idx = reinterpret_cast<const uint16_t*>(
-                  pIndex + index * indexStride);
-              indexData.push_back(*idx + firstVertex);
-            }
-            break;
-          }
-          case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
-            for (size_t index = 0; index < indexCount; index++) {
-              const uint8_t* idx = reinterpret_cast<const uint8_t*>(
-                  pIndex + index * indexStride);
-              indexData.push_back(*idx + firstVertex);
-            }
-            break;
-          }
-          default:
-            HKR_ASSERT(0);
-        }
-      }
+    const MeshDesc& mesh = desc.meshes[i];
+    for (uint32_t j = 0; j < mesh.primitiveCount; j++) {
+      const PrimitiveDesc& prim = desc.primitives[mesh.firstPrimitive + j];
+      glTFPrimitive& newPrim = meshes[i].primitives.emplace_back();
+      newPrim.firstVertex = prim.firstVertex;
+      newPrim.vertexCount = prim.vertexCount;
+      newPrim.firstIndex = prim.firstIndex;
+      newPrim.indexCount = prim.indexCount;
+      newPrim.materialIndex = prim.materialIndex;
+      newPrim.indexType = prim.indexType == IndexType::Uint16
+                              ? VK_INDEX_TYPE_UINT16
+                              : VK_INDEX_TYPE_UINT32;
+    }
+  }
+}
 
-      // POSITION
-      const unsigned char* pPos = nullptr;
-      uint32_t posStride = 0;
-      {
-        HKR_ASSERT(prim.attributes.find("POSITION") != prim.attributes.end());
-        const tinygltf::Accessor& posAccessor =
-            model.accessors[prim.attributes.find("POSITION")->second];
-        vertexCount = posAccessor.count;
-        const tinygltf::BufferView& posView =
-            model.bufferViews[posAccessor.bufferView];
-        pPos = reinterpret_cast<const unsigned char*>(
-            &model.buffers[posView.buffer]
-                 .data[posAccessor.byteOffset + posView.byteOffset]);
-        posStride = posAccessor.ByteStride(posView);
-      }
-      // NORMAL
-      const unsigned char* pNormal = nullptr;
-      uint32_t normalStride = 0;
-      {
-        if (prim.attributes.find("NORMAL") != prim.attributes.end()) {
-          const tinygltf::Accessor& normalAccessor =
-              model.accessors[prim.attributes.find("NORMAL")->second];
-          const tinygltf::BufferView& normalView =
-              model.bufferViews[normalAccessor.bufferView];
-          pNormal = reinterpret_cast<const unsigned char*>(
-              &model.buffers[normalView.buffer]
-                   .data[normalAccessor.byteOffset + normalView.byteOffset]);
-          normalStride = normalAccessor.ByteStride(normalView);
-        }
-      }
-      // TEXCOORD_0
-      const unsigned char* pTexCoord = nullptr;
-      uint32_t texCoordStride = 0;
-      {
-        if (prim.attributes.find("TEXCOORD_0") != prim.attributes.end()) {
-          const tinygltf::Accessor& texAccessor =
-              model.accessors[prim.attributes.find("TEXCOORD_0")->second];
-          const tinygltf::BufferView& texView =
-              model.bufferViews[texAccessor.bufferView];
-          pTexCoord = reinterpret_cast<const unsigned char*>(
-              &model.buffers[texView.buffer]
-                   .data[texAccessor.byteOffset + texView.byteOffset]);
-          texCoordStride = texAccessor.ByteStride(texView);
-        }
-      }
-      // COLOR_0
-      const unsigned char* pColor = nullptr;
-      uint32_t colorStride = 0;
-      uint32_t colorComponents = 0;
-      int colorComponentType = -1;
-      {
-        if (prim.attributes.find("COLOR_0") != prim.attributes.end()) {
-          const tinygltf::Accessor& colorAccessor =
-              model.accessors[prim.attributes.find("COLOR_0")->second];
-          const tinygltf::BufferView& colorView =
-              model.bufferViews[colorAccessor.bufferView];
-          pColor = reinterpret_cast<const unsigned char*>(
-              &model.buffers[colorView.buffer]
-                   .data[colorAccessor.byteOffset + colorView.byteOffset]);
-          colorStride = colorAccessor.ByteStride(colorView);
-          colorComponentType = colorAccessor.componentType;
-          HKR_ASSERT(colorAccessor.type == TINYGLTF_TYPE_VEC3 ||
-                     colorAccessor.type == TINYGLTF_TYPE_VEC4);
-          colorComponents = colorAccessor.type == TINYGLTF_TYPE_VEC3 ? 3 : 4;
-        }
-      }
-      // TANGENT
-      const unsigned char* pTangent = nullptr;
-      uint32_t tangentStride = 0;
-      {
-        if (prim.attributes.find("TANGENT") != prim.attributes.end()) {
-          const tinygltf::Accessor& tangentAccessor =
-              model.accessors[prim.attributes.find("TANGENT")->second];
-          const tinygltf::BufferView& tangentView =
-              model.bufferViews[tangentAccessor.bufferView];
-          pTangent = reinterpret_cast<const unsigned char*>(
-              &model.buffers[tangentView.buffer]
-                   .data[tangentAccessor.byteOffset + tangentView.byteOffset]);
-          tangentStride = tangentAccessor.ByteStride(tangentView);
-        }
-      }
-      vertexData.resize(firstVertex + vertexCount);
-      for (size_t v = 0; v < vertexCount; v++) {
-        glTFVertex& vertex = vertexData[firstVertex + v];
-#define RCASTF(...) reinterpret_cast<const float*>(__VA_ARGS__)
-#define RCASTUS(...) reinterpret_cast<const unsigned short*>(__VA_ARGS__)
-#define RCASTUI(...) reinterpret_cast<const unsigned int*>(__VA_ARGS__)
-        // position
-        vertex.position =
-            Vec4(glm::make_vec3(RCASTF(&pPos[v * posStride])), 1.0f);
-        // normal
-        vertex.normal = pNormal ? glm::normalize(glm::make_vec3(
-                                      RCASTF(&pNormal[v * normalStride])))
-                                : Vec3(0.0f);
-        // vertex.position.y *= -1.0f;
-        // vertex.normal.y *= -1.0f;
-        // uv
-        vertex.uv = pTexCoord
-                        ? glm::make_vec2(RCASTF(&pTexCoord[v * texCoordStride]))
-                        : Vec2(0.0f);
-        // color
-        if (pColor) {
-          switch (colorComponentType) {
-            case TINYGLTF_COMPONENT_TYPE_FLOAT:
-              if (colorComponents == 3) {
-                vertex.color = Vec4(
-                    glm::make_vec3(RCASTF(&pColor[v * colorStride])), 1.0f);
-              } else {
-                vertex.color = glm::make_vec4(RCASTF(&pColor[v * colorStride]));
-              }
-              break;
-            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-              if (colorComponents == 3) {
-                vertex.color = Vec4(
-                    glm::make_vec3(RCASTUS(&pColor[v * colorStride])), 1.0f);
-              } else {
-                vertex.color =
-                    glm::make_vec4(RCASTUS(&pColor[v * colorStride]));
-              }
-              break;
-            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-              if (colorComponents == 3) {
-                vertex.color = Vec4(
-                    glm::make_vec3(RCASTUI(&pColor[v * colorStride])), 1.0f);
-              } else {
-                vertex.color =
-                    glm::make_vec4(RCASTUI(&pColor[v * colorStride]));
-              }
-              break;
-          }
-        }
-        // tangent
-        vertex.tangent =
-            pTangent ? glm::make_vec4(RCASTF(&pTangent[v * tangentStride]))
-                     : Vec4(0.0f);
-#undef RCASTF
-#undef RCASTUS
-#undef RCASTUI
-      }
-      newPrim.firstVertex = firstVertex;
-      newPrim.vertexCount = vertexCount;
-      newPrim.firstIndex = firstIndex;
-      newPrim.indexCount = indexCount;
-      newPrim.materialIndex =
-          prim.material > -1 ? prim.material : materials.size() - 1;
-    }
-  }
-  size_t vertexDataSize = vertexData.size() * sizeof(glTFVertex);
-  size_t indexDataSize = indexData.size() * sizeof(uint32_t);
-
-  // upload vertex/index data to gpu buffer
-  StagingBuffer vertexStaging;
-  vertexStaging.Create(mAllocator, vertexDataSize);
-  vertexStaging.Map(mAllocator);
-  vertexStaging.Write(vertexData.data(), vertexDataSize);
-  vertexStaging.Unmap(mAllocator);
-  vertices.Create(mAllocator, vertexDataSize,
-                  VK_BUFFER_USAGE_2_VERTEX_BUFFER_BIT | mBufferUsageFlags);
-  StagingBuffer indexStaging;
-  indexStaging.Create(mAllocator, indexDataSize);
-  indexStaging.Map(mAllocator);
-  indexStaging.Write(indexData.data(), indexDataSize);
-  indexStaging.Unmap(mAllocator);
-  indices.Create(mAllocator, indexDataSize,
-                 VK_BUFFER_USAGE_2_INDEX_BUFFER_BIT | mBufferUsageFlags);
-
-  VkCommandBuffer commandBuffer = BeginOneTimeCommands(mDevice, mCommandPool);
-  CopyBufferToBuffer(commandBuffer, vertexStaging.buffer, vertices.buffer,
-                     vertexDataSize);
-  CopyBufferToBuffer(commandBuffer, indexStaging.buffer, indices.buffer,
-                     indexDataSize);
-  EndOneTimeCommands(mDevice, mQueue, mCommandPool, commandBuffer);
-  vertexStaging.Cleanup(mAllocator);
-  indexStaging.Cleanup(mAllocator);
-}
-
-void glTFModel::LoadNodes(const tinygltf::Model& model) {
-  const size_t nodeCount = model.nodes.size();
+VkDeviceSize glTFModel::UploadMesh(LoadEvent& event) {
+  glTFMesh& mesh = meshes[event.index];
+  if (mesh.primitives.empty()) {
+    mesh.resident = true;
+    mResidentMeshCount++;
+    return 0;
+  }
+  // written straight to the geometry buffers by the loader
+  if (event.staging.buffer == VK_NULL_HANDLE) {
+    mPendingUploads.push_back({0, LoadEvent::Type::Mesh, event.index});
+    return 0;
+  }
+  VkCommandBuffer commandBuffer = mUploader->GetCommandBuffer();
+  VkDeviceSize stagingOffset = 0;
+  auto copy = [&](VkBuffer dst, VkDeviceSize size, VkDeviceSize dstOffset) {
+    CopyBufferToBuffer(commandBuffer, event.staging.buffer, dst, size,
+                       stagingOffset, dstOffset);
+    mUploader->TransferBuffer(dst, dstOffset, size);
+    stagingOffset += size;
+  };
+  const MeshRange& range = event.meshRange;
+  for (uint32_t stream = 0; stream < VERTEX_STREAM_COUNT; stream++) {
+    if (HasVertexStream(static_cast<VertexStream>(stream))) {
+      const VkDeviceSize stride = VERTEX_STREAM_STRIDES[stream];
+      copy(vertexStreams[stream].buffer, range.vertexCount * stride,
+           range.firstVertex * stride);
+    }
+  }
+  copy(indices.buffer, range.indexDataSize, range.indexDataOffset);
+  // the staging buffer lives until the batch has executed
+  mUploader->Defer([allocator = mAllocator, staging = event.staging]() mutable {
+    staging.Unmap(allocator);
+    staging.Cleanup(allocator);
+  });
+  event.staging = {};
+  mPendingUploads.push_back({0, LoadEvent::Type::Mesh, event.index});
+  return stagingOffset;
+}
+
+void glTFModel::LoadNodes(const ModelDesc& desc,
+                          const SceneResources& resources) {
+  const size_t nodeCount = desc.nodes.size();
   nodes.resize(nodeCount);
   for (size_t i = 0; i < nodeCount; i++) {
-    const auto& node = model.nodes[i];
+    const NodeDesc& node = desc.nodes[i];
     glTFNode& newNode = nodes[i];
     // local transform
-    if (node.translation.size() == 3) {
-      newNode.translation = glm::make_vec3(node.translation.data());
-    }
-    if (node.rotation.size() == 4) {
-      newNode.rotation = glm::make_quat(node.rotation.data());
-    }
-    if (node.scale.size() == 3) {
-      newNode.scale = glm::make_vec3(node.scale.data());
-    }
-    newNode.localTransform = glm::translate(Mat4(1.0f), newNode.translation) *
-                             glm::mat4(newNode.rotation) *
-                             glm::scale(Mat4(1.0f), newNode.scale);
-    if (node.matrix.size() == 16) {
-      newNode.localTransform = glm::make_mat4x4(node.matrix.data());
-    }
+    newNode.localTransform = node.localTransform;
 
-    newNode.ubo.Create(mAllocator, sizeof(glTFNode::UniformData));
-    newNode.ubo.Map(mAllocator);
+    if (resources.nodes[i]) {
+      newNode.ubo.Create(mAllocator, sizeof(glTFNode::UniformData));
+      newNode.ubo.Map(mAllocator);
+    }
 
     // node has a mesh
-    if (node.mesh > -1) {
-      newNode.meshIndex = node.mesh;
-    }
+    newNode.meshIndex = node.meshIndex;
     // child
-    for (int child : node.children) {
-      newNode.childIndices.push_back(child);
+    for (uint32_t j = 0; j < node.childCount; j++) {
+      newNode.childIndices.push_back(desc.nodeChildren[node.firstChild + j]);
     }
   }
 }
 
-void glTFModel::LoadScene(const tinygltf::Model& model) {
-  uint32_t sceneIndex = model.defaultScene > -1 ? model.defaultScene : 0;
-  const tinygltf::Scene& scene = model.scenes[sceneIndex];
-  const size_t nodeCount = scene.nodes.size();
+void glTFModel::LoadScene(const ModelDesc& desc) {
+  const size_t nodeCount = desc.sceneNodes.size();
   // get top level node indices in default scene
   topLevelNodeIndices.resize(nodeCount);
   for (size_t i = 0; i < nodeCount; i++) {
-    topLevelNodeIndices[i] = scene.nodes[i];
+    topLevelNodeIndices[i] = desc.sceneNodes[i];
     UpdateNodes(-1, topLevelNodeIndices[i]);
   }
 
@@ -797,20 +1882,65 @@ void glTFModel::CreateDescriptorSets() {
 }
 
 void glTFModel::Cleanup() {
+  // stop the loader and wait until it no longer touches the model
+  {
+    std::lock_guard<std::mutex> lock(mEventsMutex);
+    mCancelled = true;
+    mEventsPopped.notify_all();
+  }
+  {
+    std::unique_lock<std::mutex> lock(mEventsMutex);
+    mJobsDone.wait(lock, [this] { return mPendingJobs == 0; });
+  }
+  std::unique_ptr<LoadEvent> event;
+  while (mEvents.TryPop(event)) {
+    DiscardEvent(*event);
+  }
+  // deferred work of recorded uploads may still refer to the model
+  mUploader->Flush();
   for (auto& node : nodes) {
-    node.ubo.Unmap(mAllocator);
-    node.ubo.Cleanup(mAllocator);
+    if (node.ubo.buffer != VK_NULL_HANDLE) {
+      node.ubo.Unmap(mAllocator);
+      node.ubo.Cleanup(mAllocator);
+    }
   }
   for (auto& image : images) {
-    image.image.Cleanup(mDevice, mAllocator);
+    if (!image.sparse) {
+      image.image.Cleanup(mDevice, mAllocator);
+    }
+    if (image.pendingImage.image != VK_NULL_HANDLE) {
+      image.pendingImage.Cleanup(mDevice, mAllocator);
+    }
+  }
+  for (auto& retired : mRetiredImages) {
+    retired.image.Cleanup(mDevice, mAllocator);
   }
+  mRetiredImages.clear();
+  for (auto& sparse : mSparseImages) {
+    if (!sparse.texture.IsCreated()) {
+      continue;
+    }
+    sparse.texture.Cleanup(mDevice, mAllocator);
+    for (const SparseTile& tile : sparse.tiles) {
+      if (tile.page != VK_NULL_HANDLE) {
+        mPagePool.Free(tile.page);
+      }
+    }
+  }
+  mSparseImages.clear();
+  mRetiredTiles.clear();
+  mPagePool.Cleanup();
+  mMipChains.clear();
+  mFeedback.Cleanup(mAllocator);
   for (auto& sampler : samplers) {
     vkDestroySampler(mDevice, sampler.sampler, nullptr);
   }
   for (auto& mat : materials) {
     vkDestroyDescriptorSetLayout(mDevice, mat.materialSetLayout, nullptr);
   }
-  vertices.Cleanup(mAllocator);
+  for (auto& vertexStream : vertexStreams) {
+    vertexStream.Cleanup(mAllocator);
+  }
   indices.Cleanup(mAllocator);
   // vkDestroyDescriptorPool(mDevice, descritorPool, nullptr);
   // vkDestroyDescriptorSetLayout(mDevice, uboSetLayout, nullptr);
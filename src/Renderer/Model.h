@@ -3,22 +3,32 @@
 #include "Core/Math.h"
 #include "Renderer/Image.h"
 #include "Renderer/Buffer.h"
+#include "Renderer/ModelDesc.h"
+#include "Renderer/SparseTexture.h"
+#include "Renderer/TextureFeedback.h"
+#include "Renderer/TextureTranscode.h"
+#include "Renderer/glTFDocument.h"
+#include "Util/ConcurrentQueue.h"
 
 #include <vk_mem_alloc.h>
 #include <volk.h>
 #include <tiny_gltf.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+
 namespace hkr {
 
-struct glTFVertex {
-  Vec3 position;
-  Vec3 normal;
-  Vec2 uv;
-  Vec4 color = Vec4(1.0f);
-  Vec4 joint0;
-  Vec4 weight0;
-  Vec4 tangent;
-};
+class UploadBatcher;
+class MipGenerator;
+class ThreadPool;
+class CookedModel;
 
 struct glTFSampler {
   VkSampler sampler;
@@ -26,6 +36,37 @@ struct glTFSampler {
 
 struct glTFImage {
   Texture image;
+  // of rgba8 images, srgb for color textures if enabled. Compressed images
+  // take the srgb variant of their own format.
+  VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+  // MipFlags of images whose mips are generated on the gpu, by the material
+  // slots the image is used in
+  uint32_t mipFlags = 0;
+  float alphaCutoff = 0.5f;
+  // set once the upload has completed on the gpu
+  bool resident = false;
+
+  // Streamed images, those whose whole mip chain stays on the cpu, only hold
+  // the levels from residentMip on and are recreated with another range as
+  // the requests of the shaders and the memory budget change
+  bool streamed = false;
+  // of the whole chain
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t mipLevels = 1;
+  uint32_t residentMip = 0;
+  // finest level the shaders asked for and the frame they last did
+  uint32_t requestedMip = 0;
+  uint64_t requestFrame = 0;
+  // holds the levels from pendingMip on once its upload has completed, then
+  // replaces image
+  Texture pendingImage;
+  uint32_t pendingMip = 0;
+
+  // Sparse images have every level but only bind memory to the tiles of the
+  // levels above their mip tail that the shaders sample, image holds the
+  // handles of their SparseTexture
+  bool sparse = false;
 };
 
 struct glTFTexture {
@@ -55,9 +96,11 @@ struct glTFMaterial {
 struct glTFPrimitive {
   uint32_t firstVertex;
   uint32_t vertexCount;
+  // in indices of indexType, the indices are relative to firstVertex
   uint32_t firstIndex;
   uint32_t indexCount;
   int materialIndex = -1;
+  VkIndexType indexType = VK_INDEX_TYPE_UINT32;
 
   struct Extent {
     Vec3 min = Vec3(FLT_MAX);
@@ -72,6 +115,8 @@ struct glTFPrimitive {
 
 struct glTFMesh {
   std::vector<glTFPrimitive> primitives;
+  // set once the vertex/index upload has completed on the gpu
+  bool resident = false;
 };
 
 struct glTFNode {
@@ -89,19 +134,71 @@ struct glTFNode {
   VkDescriptorSet uboDescriptorSet;
 };
 
+// The model is loaded asynchronously: Load returns immediately and a worker
+// thread maps the cooked model if there is an up to date one, or parses the
+// file and decodes meshes while every image is decoded by its own job,
+// results are handed to the render thread through a lock-free queue. Update
+// records their uploads and publishes each mesh and image once its upload has
+// completed, until then meshes are skipped and images are replaced by a
+// default white image. Only what the default scene reaches is decoded and
+// uploaded, the tables and geometry buffers still hold a slot for the rest.
+//
+// Textures are streamed: ktx2 textures and cooked mip chains start out with
+// their mip tail only, the levels of at most 64x64 texels, and get
+// finer levels as the shaders report the level of detail they sample them at
+// through TextureFeedback. The finer levels of the images whose requests are
+// best served are dropped again when the device memory budget runs out.
+//
+// On devices with sparse residency they are sparse images instead: the cells
+// of the feedback grid request the tiles they sample, which are bound to
+// pages of a shared pool and uploaded coarse levels first, and the least
+// recently requested tiles make room for them. The residency of each cell
+// is handed back to the shaders, which clamp sampling to the levels whose
+// tiles around the cell are all resident.
 class glTFModel {
 public:
   void Load(VkDevice device,
-            VkQueue queue,
-            VkCommandPool commandPool,
+            UploadBatcher& uploader,
+            MipGenerator& mipGenerator,
+            ThreadPool& threadPool,
             VmaAllocator allocator,
+            const TextureFormatSupport& textureFormats,
             const std::string& fileName,
-            VkBufferUsageFlags2 bufferUsageFlags);
+            VkBufferUsageFlags2 bufferUsageFlags,
+            bool srgbColorTextures = false,
+            glTFParser parser = glTFParser::TinyglTF);
+  // called once per frame on the render thread once the fence of the frame
+  // has signaled
+  void Update(uint32_t currentFrame);
   void Draw();
   void Cleanup();
 
-  // vertices and indices buffers for all primitives in all meshes
-  Buffer vertices;
+  // samplers, textures, materials, nodes and buffers exist
+  bool IsStructureReady() const { return mStructureReady; }
+  // every mesh and image the default scene reaches is resident
+  bool IsResident() const;
+  // the model could not be parsed, nothing of it will become resident
+  bool IsFailed() const { return mFailed; }
+  // bumped every time an image becomes resident
+  uint64_t GetImageVersion() const { return mImageVersion; }
+  bool HasVertexStream(VertexStream stream) const {
+    return mVertexStreamMask & (1u << stream);
+  }
+  // view of the image if resident, of the default image otherwise
+  VkImageView GetImageView(int imageIndex) const;
+  // layout the view is sampled in, sparse images stay in
+  // VK_IMAGE_LAYOUT_GENERAL
+  VkImageLayout GetImageLayout(int imageIndex) const;
+  // cap of the memory of streamed texture levels, 0 leaves it to the device
+  // memory budget
+  void SetTextureBudget(VkDeviceSize budget) { mTextureBudget = budget; }
+  // written by the renderers, exists once the structure is ready
+  TextureFeedback& GetTextureFeedback() { return mFeedback; }
+
+  // vertex streams and indices buffers for all primitives in all meshes, the
+  // color stream holds a single white vertex if the model has no colors and
+  // the skin stream is only created if the model has skins
+  std::array<Buffer, VERTEX_STREAM_COUNT> vertexStreams;
   Buffer indices;
   std::vector<glTFSampler> samplers;
   std::vector<glTFImage> images;
@@ -116,27 +213,243 @@ public:
   std::vector<uint32_t> topLevelNodeIndices;
 
 private:
-  void LoadSamplers(const tinygltf::Model& model);
-  void LoadImages(const tinygltf::Model& model);
-  void LoadTextures(const tinygltf::Model& model);
-  void LoadMaterials(const tinygltf::Model& model);
-  void LoadMeshes(const tinygltf::Model& model);
-  void LoadNodes(const tinygltf::Model& model);
-  void LoadScene(const tinygltf::Model& model);
+  // handed from the loader thread to the render thread
+  struct LoadEvent {
+    enum class Type { Structure, Mesh, Image, Failed } type;
+    uint32_t index = 0;
+    // structure
+    std::shared_ptr<const ModelDesc> desc;
+    std::shared_ptr<const SceneResources> resources;
+    // mesh, already in the geometry buffers if they are host visible,
+    // otherwise in staging as the vertex streams followed by the indices
+    MeshRange meshRange;
+    StagingBuffer staging;
+    // image, a ktx2 texture loaded and transcoded by the loader or rgba8
+    // pixels with mipLevels levels back to back (mips are generated on the
+    // gpu if there is one level), in staging if decoded by the loader, in
+    // pixelBytes if read from a cooked model
+    std::span<const uint8_t> pixelBytes;
+    int width = 0;
+    int height = 0;
+    uint32_t mipLevels = 1;
+    KtxTexturePtr ktxTexture;
+    // keeps the cooked model mapped while its bytes are referenced
+    std::shared_ptr<const CookedModel> cooked;
+  };
+
+  // upload waiting for its timeline value before being published
+  struct PendingUpload {
+    uint64_t value = 0;
+    LoadEvent::Type type;
+    uint32_t index = 0;
+    // another mip range of a resident streamed image
+    bool mipChange = false;
+    // a tile of a sparse image
+    uint32_t tile = UINT32_MAX;
+  };
+
+  // cpu copy of the mip chain of a streamed image, a transcoded ktx2 texture
+  // or tightly packed rgba8 levels in the mapped cooked model
+  struct MipChain {
+    KtxTexturePtr ktxTexture;
+    std::span<const uint8_t> pixelBytes;
+    std::shared_ptr<const CookedModel> cooked;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    // of every level in the ktx2 image data or pixelBytes
+    std::vector<VkDeviceSize> levelOffsets;
+    std::vector<VkDeviceSize> levelSizes;
+    // bytes of the levels from a level on
+    VkDeviceSize GetSize(uint32_t firstLevel) const;
+    const uint8_t* GetLevel(uint32_t level) const;
+  };
+
+  // replaced by another mip range, destroyed once no frame samples it
+  struct RetiredImage {
+    uint64_t frame = 0;
+    Texture image;
+  };
+
+  // tile of a sparse image, holds its page while the upload is pending, while
+  // resident and until it is unbound
+  struct SparseTile {
+    VmaAllocation page = VK_NULL_HANDLE;
+    uint64_t requestFrame = 0;
+    bool resident = false;
+    bool pending = false;
+  };
+
+  struct SparseImage {
+    SparseTexture texture;
+    // of the levels above the mip tail, row by row
+    std::vector<SparseTile> tiles;
+    // index of the first tile of every level
+    std::vector<uint32_t> levelTiles;
+    // the residency of its textures is out of date
+    bool residencyDirty = false;
+
+    uint32_t GetTileIndex(uint32_t level, uint32_t x, uint32_t y) const {
+      return levelTiles[level] + y * texture.GetTileCount(level).width + x;
+    }
+    void GetTileCoords(uint32_t tile,
+                       uint32_t& level,
+                       uint32_t& x,
+                       uint32_t& y) const;
+  };
+
+  struct TileRef {
+    uint32_t imageIndex;
+    uint32_t tile;
+    uint32_t level;
+  };
+
+  // evicted, unbound once no frame samples it
+  struct RetiredTile {
+    uint64_t frame = 0;
+    uint32_t imageIndex = 0;
+    uint32_t tile = 0;
+  };
+
+  // what DecodeModel reads a parsed glTF file through, the functions keep
+  // the parse result alive and are called from several jobs at once
+  struct glTFSource {
+    uint32_t imageCount = 0;
+    // uri of the image and its encoded bytes, left empty for external ktx2
+    // files
+    std::function<void(uint32_t imageIndex,
+                       std::string& uri,
+                       std::vector<uint8_t>& encoded)>
+        readImage;
+    std::function<void(const ModelDesc& desc,
+                       uint32_t meshIndex,
+                       const MeshDestination& dst)>
+        decodeMesh;
+  };
+
+  // run on worker threads
+  void LoadAsync(const std::string& fileName);
+  // returns false if there is no up to date cooked model
+  bool LoadCooked(const std::string& fileName);
+  // return false if the file cannot be parsed
+  bool LoadTinyglTF(const std::string& fileName);
+  bool LoadSimdjson(const std::string& fileName);
+  // publish the structure, then decode images and meshes
+  void DecodeModel(const std::shared_ptr<ModelDesc>& desc,
+                   const std::shared_ptr<const glTFSource>& source);
+  void DecodeImage(const std::string& uri,
+                   size_t imageIndex,
+                   std::vector<uint8_t>& encoded);
+  // blocks while the queue is full, returns false if the load was cancelled
+  bool Publish(std::unique_ptr<LoadEvent>&& event);
+  // called by every loader job as its last step
+  void FinishJob();
+  // release what an event holds if it never reaches ProcessEvent
+  void DiscardEvent(LoadEvent& event);
+  void CreateGeometryBuffers(const ModelDesc& desc);
+  // memory the mesh of the event is written to, the mapped geometry buffers
+  // or staging owned by the event, called for several meshes at once
+  MeshDestination BeginMeshWrite(const ModelDesc& desc, LoadEvent& event);
+  void EndMeshWrite(const ModelDesc& desc, LoadEvent& event);
+
+  // run on the render thread, return the number of bytes uploaded
+  VkDeviceSize ProcessEvent(LoadEvent& event);
+  VkDeviceSize LoadStructure(LoadEvent& event);
+  VkDeviceSize UploadMesh(LoadEvent& event);
+  VkDeviceSize UploadImage(LoadEvent& event);
+  // keep the mip chain of the event and upload its tail, returns false if the
+  // image cannot be streamed
+  bool RegisterMipChain(LoadEvent& event, VkDeviceSize& uploaded);
+  // record the upload of the levels from firstMip on into a new image,
+  // returns the number of bytes staged
+  VkDeviceSize UploadMips(uint32_t imageIndex, uint32_t firstMip, Texture& dst);
+  // create a sparse image for a registered mip chain and upload its mip tail,
+  // returns false if the device cannot make it sparse
+  bool CreateSparseImage(uint32_t imageIndex, VkDeviceSize& uploaded);
+  // mark the tiles the cells of a texture sample, appending those without a
+  // page to requested
+  void RequestTiles(uint32_t imageIndex,
+                    std::span<const uint32_t> cells,
+                    std::vector<TileRef>& requested);
+  // bind and upload requested tiles, evicting others to stay within budget
+  void UpdateTiles(std::vector<TileRef>& requested,
+                   VkDeviceSize budget,
+                   VkDeviceSize& projectedBytes,
+                   VkDeviceSize& uploaded);
+  // hand the residency of sparse images that changed to the shaders
+  void UpdateResidency();
+  // fold in the shader requests and stream levels in and out, bounded by the
+  // upload budget left this frame
+  void UpdateStreaming(uint32_t currentFrame, VkDeviceSize& uploaded);
+  VkDeviceSize GetStreamingBudget(VkDeviceSize streamedBytes) const;
+  void SetTextureHeap(VmaAllocation allocation);
+
+  // samplers and node uniform buffers are only created for what the default
+  // scene reaches
+  void LoadSamplers(const ModelDesc& desc, const SceneResources& resources);
+  void LoadTextures(const ModelDesc& desc, const SceneResources& resources);
+  void LoadMaterials(const ModelDesc& desc);
+  void LoadMeshes(const ModelDesc& desc);
+  void LoadNodes(const ModelDesc& desc, const SceneResources& resources);
+  void LoadScene(const ModelDesc& desc);
   void CreateDescriptorSets();
   void UpdateNodes(uint32_t parentIndex, uint32_t index);
 
 private:
   VkDevice mDevice;
-  VkQueue mQueue;
-  VkCommandPool mCommandPool;
+  UploadBatcher* mUploader = nullptr;
+  MipGenerator* mMipGenerator = nullptr;
+  ThreadPool* mThreadPool = nullptr;
   VmaAllocator mAllocator;
+  std::string mFileName;
   std::string mFilePath;
 
-  // usage flags for vertices and indices buffers
+  // usage flags for vertex streams and indices buffers
   VkBufferUsageFlags2 mBufferUsageFlags;
+  bool mSrgbColorTextures = false;
+  glTFParser mParser = glTFParser::TinyglTF;
+  // target formats of basis universal textures
+  TextureFormatSupport mTextureFormats;
+  uint32_t mVertexStreamMask = 0;
+  // geometry buffers as seen by the loader thread if they ended up in host
+  // visible memory, null otherwise
+  MeshDestination mMappedGeometry;
   VkDescriptorPool descritorPool;
   VkDescriptorSetLayout uboSetLayout;
+
+  // loader thread -> render thread
+  ConcurrentQueue<std::unique_ptr<LoadEvent>> mEvents{64};
+  // loader threads sleep on it while the queue is full
+  std::mutex mEventsMutex;
+  std::condition_variable mEventsPopped;
+  // Cleanup sleeps on it until the loader jobs are done, under mEventsMutex
+  std::condition_variable mJobsDone;
+  std::atomic<bool> mCancelled{false};
+  std::atomic<uint32_t> mPendingJobs{0};
+  std::deque<PendingUpload> mPendingUploads;
+  bool mStructureReady = false;
+  bool mFailed = false;
+  uint32_t mResidentMeshCount = 0;
+  uint32_t mResidentImageCount = 0;
+  // meshes and images the default scene reaches, with the default image
+  uint32_t mSceneMeshCount = 0;
+  uint32_t mSceneImageCount = 0;
+  uint64_t mImageVersion = 0;
+  std::chrono::high_resolution_clock::time_point mLoadStart;
+
+  // texture streaming, mip chains by image index
+  std::vector<MipChain> mMipChains;
+  TextureFeedback mFeedback;
+  std::deque<RetiredImage> mRetiredImages;
+  VkDeviceSize mTextureBudget = 0;
+  // memory heap of the streamed images
+  uint32_t mTextureHeap = UINT32_MAX;
+  // sparse images by image index, pages their tiles are bound to and the
+  // bytes of the pages of tiles that are pending or resident
+  std::vector<SparseImage> mSparseImages;
+  std::deque<RetiredTile> mRetiredTiles;
+  SparsePagePool mPagePool;
+  VkDeviceSize mSparseBytes = 0;
+  // Update calls so far
+  uint64_t mFrameCount = 0;
 };
 
 }  // namespace hkr
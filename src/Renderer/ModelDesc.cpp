@@ -0,0 +1,497 @@
+#include "Renderer/ModelDesc.h"
+#include "Renderer/AccessorReader.h"
+#include "Renderer/MeshCompression.h"
+#include "Renderer/TexelConvert.h"
+#include "Util/Assert.h"
+#include "Util/AssetPack.h"
+#include "Util/Filesystem.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+namespace {
+
+// octahedral mapping of a direction onto [-1, 1]^2
+hkr::Vec2 OctEncode(hkr::Vec3 n) {
+  const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  if (l1 == 0.0f) {
+    return hkr::Vec2(0.0f);
+  }
+  n /= l1;
+  hkr::Vec2 p(n.x, n.y);
+  if (n.z < 0.0f) {
+    const hkr::Vec2 sign(p.x >= 0.0f ? 1.0f : -1.0f,
+                         p.y >= 0.0f ? 1.0f : -1.0f);
+    p = (1.0f - glm::abs(hkr::Vec2(p.y, p.x))) * sign;
+  }
+  return p;
+}
+
+// primitives start 4 byte aligned in the index buffer so that shaders can
+// fetch their indices as whole words
+uint64_t AlignIndexData(uint64_t size) {
+  return (size + 3) & ~uint64_t{3};
+}
+
+template <typename T>
+T* GetStream(const hkr::MeshDestination& dst,
+             hkr::VertexStream stream,
+             size_t vertex) {
+  return reinterpret_cast<T*>(dst.vertexStreams[stream]) + vertex;
+}
+
+// external buffers and images are read through the asset pack or a mapping,
+// tinygltf still wants them copied into a vector. userData is the thread pool
+// compressed entries are decompressed on, if any.
+bool ReadAssetFile(std::vector<unsigned char>* out,
+                   std::string* err,
+                   const std::string& fileName,
+                   void* userData) {
+  hkr::AssetFile file;
+  if (!file.Open(fileName, static_cast<hkr::ThreadPool*>(userData))) {
+    if (err) {
+      *err += "file open error: " + fileName + "\n";
+    }
+    return false;
+  }
+  out->assign(file.GetData(), file.GetData() + file.GetSize());
+  return true;
+}
+
+bool GetAssetFileSize(size_t* size,
+                      std::string* err,
+                      const std::string& fileName,
+                      void*) {
+  if (!hkr::GetAssetSize(fileName, *size)) {
+    if (err) {
+      *err += "file open error: " + fileName + "\n";
+    }
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+namespace hkr {
+
+bool LoadglTFFile(tinygltf::TinyGLTF& loader,
+                  tinygltf::Model& model,
+                  const std::string& fileName,
+                  std::string& err,
+                  std::string& warn,
+                  ThreadPool* threadPool) {
+  tinygltf::FsCallbacks callbacks{};
+  callbacks.FileExists = [](const std::string& fileName, void*) {
+    return AssetExists(fileName);
+  };
+  callbacks.ExpandFilePath = &tinygltf::ExpandFilePath;
+  callbacks.ReadWholeFile = &ReadAssetFile;
+  callbacks.WriteWholeFile = &tinygltf::WriteWholeFile;
+  callbacks.GetFileSizeInBytes = &GetAssetFileSize;
+  callbacks.user_data = threadPool;
+  loader.SetFsCallbacks(callbacks);
+
+  const std::string fileExtension = GetFileExtension(fileName);
+  if (fileExtension != "gltf" && fileExtension != "glb") {
+    err = "unsupported model file: " + fileName;
+    return false;
+  }
+  // the model is parsed straight from the pack entry or mapping
+  AssetFile file;
+  if (!file.Open(fileName, threadPool)) {
+    err = "file open error: " + fileName;
+    return false;
+  }
+  const size_t pos = fileName.find_last_of('/');
+  const std::string baseDir =
+      pos == std::string::npos ? "" : fileName.substr(0, pos);
+  const auto size = static_cast<unsigned int>(file.GetSize());
+  const bool result =
+      fileExtension == "gltf"
+          ? loader.LoadASCIIFromString(
+                &model, &err, &warn,
+                reinterpret_cast<const char*>(file.GetData()), size, baseDir)
+          : loader.LoadBinaryFromMemory(&model, &err, &warn, file.GetData(),
+                                        size, baseDir);
+  // compressed geometry is decoded here so that accessors always point at
+  // plain data
+  return result && DecompressModel(model, threadPool, err);
+}
+
+void BuildModelDesc(const tinygltf::Model& model, ModelDesc& desc) {
+  desc = {};
+
+  // samplers
+  desc.samplers.reserve(model.samplers.size());
+  for (const tinygltf::Sampler& sampler : model.samplers) {
+    SamplerDesc& newSampler = desc.samplers.emplace_back();
+    newSampler.minFilter = sampler.minFilter;
+    newSampler.magFilter = sampler.magFilter;
+    newSampler.wrapS = sampler.wrapS;
+    newSampler.wrapT = sampler.wrapT;
+  }
+
+  // textures
+  desc.textures.reserve(model.textures.size());
+  for (const tinygltf::Texture& tex : model.textures) {
+    TextureDesc& newTex = desc.textures.emplace_back();
+    newTex.imageIndex = tex.source;
+    // the ktx2 image of KHR_texture_basisu takes precedence over the
+    // fallback source, which is optional
+    auto basisu = tex.extensions.find("KHR_texture_basisu");
+    if (basisu != tex.extensions.end() && basisu->second.Has("source")) {
+      newTex.imageIndex = basisu->second.Get("source").GetNumberAsInt();
+    }
+    newTex.samplerIndex = tex.sampler;
+  }
+
+  // materials
+  desc.materials.reserve(model.materials.size());
+  for (const tinygltf::Material& mat : model.materials) {
+    MaterialDesc& material = desc.materials.emplace_back();
+    const auto& metallicRoughness = mat.pbrMetallicRoughness;
+    auto& colorFactor = metallicRoughness.baseColorFactor;
+    material.baseColorFactor = {colorFactor[0], colorFactor[1], colorFactor[2],
+                                colorFactor[3]};
+    auto& emissiveFactor = mat.emissiveFactor;
+    material.emissiveFactor = {emissiveFactor[0], emissiveFactor[1],
+                               emissiveFactor[2]};
+    material.metallicFactor = metallicRoughness.metallicFactor;
+    material.roughnessFactor = metallicRoughness.roughnessFactor;
+    material.baseColorTextureIndex = metallicRoughness.baseColorTexture.index;
+    material.metallicRoughnessTextureIndex =
+        metallicRoughness.metallicRoughnessTexture.index;
+    material.normalTextureIndex = mat.normalTexture.index;
+    material.occlusionTextureIndex = mat.occlusionTexture.index;
+    material.emissiveTextureIndex = mat.emissiveTexture.index;
+    if (mat.alphaMode == "MASK") {
+      material.alphaCutoff = static_cast<float>(mat.alphaCutoff);
+    }
+  }
+
+  // meshes and primitives
+  const int32_t defaultMaterialIndex =
+      static_cast<int32_t>(model.materials.size());
+  desc.meshes.reserve(model.meshes.size());
+  for (const tinygltf::Mesh& mesh : model.meshes) {
+    MeshDesc& newMesh = desc.meshes.emplace_back();
+    newMesh.firstPrimitive = static_cast<uint32_t>(desc.primitives.size());
+    for (const tinygltf::Primitive& prim : mesh.primitives) {
+      if (prim.indices < 0) {
+        continue;
+      }
+      HKR_ASSERT(prim.attributes.find("POSITION") != prim.attributes.end());
+      const tinygltf::Accessor& posAccessor =
+          model.accessors[prim.attributes.find("POSITION")->second];
+      PrimitiveDesc& newPrim = desc.primitives.emplace_back();
+      newPrim.vertexCount = static_cast<uint32_t>(posAccessor.count);
+      newPrim.indexCount =
+          static_cast<uint32_t>(model.accessors[prim.indices].count);
+      newPrim.materialIndex =
+          prim.material > -1 ? prim.material : defaultMaterialIndex;
+      if (prim.attributes.count("COLOR_0")) {
+        desc.vertexStreamMask |= 1u << VERTEX_STREAM_COLOR;
+      }
+      if (prim.attributes.count("JOINTS_0") &&
+          prim.attributes.count("WEIGHTS_0")) {
+        desc.vertexStreamMask |= 1u << VERTEX_STREAM_SKIN;
+      }
+    }
+    newMesh.primitiveCount =
+        static_cast<uint32_t>(desc.primitives.size()) - newMesh.firstPrimitive;
+  }
+  LayoutPrimitives(desc);
+
+  // nodes
+  desc.nodes.reserve(model.nodes.size());
+  for (const tinygltf::Node& node : model.nodes) {
+    NodeDesc& newNode = desc.nodes.emplace_back();
+    Vec3 translation = Vec3(0.0f);
+    Vec3 scale = Vec3(1.0f);
+    glm::quat rotation{};
+    if (node.translation.size() == 3) {
+      translation = glm::make_vec3(node.translation.data());
+    }
+    if (node.rotation.size() == 4) {
+      rotation = glm::make_quat(node.rotation.data());
+    }
+    if (node.scale.size() == 3) {
+      scale = glm::make_vec3(node.scale.data());
+    }
+    newNode.localTransform = glm::translate(Mat4(1.0f), translation) *
+                             glm::mat4(rotation) *
+                             glm::scale(Mat4(1.0f), scale);
+    if (node.matrix.size() == 16) {
+      newNode.localTransform = glm::make_mat4x4(node.matrix.data());
+    }
+    newNode.meshIndex = node.mesh;
+    newNode.firstChild = static_cast<uint32_t>(desc.nodeChildren.size());
+    newNode.childCount = static_cast<uint32_t>(node.children.size());
+    for (int child : node.children) {
+      desc.nodeChildren.push_back(child);
+    }
+  }
+
+  // default scene
+  if (!model.scenes.empty()) {
+    const int sceneIndex = model.defaultScene > -1 ? model.defaultScene : 0;
+    for (int nodeIndex : model.scenes[sceneIndex].nodes) {
+      desc.sceneNodes.push_back(nodeIndex);
+    }
+  }
+
+  desc.imageCount = static_cast<uint32_t>(model.images.size());
+}
+
+void LayoutPrimitives(ModelDesc& desc) {
+  desc.vertexCount = 0;
+  desc.indexDataSize = 0;
+  for (PrimitiveDesc& prim : desc.primitives) {
+    prim.firstVertex = desc.vertexCount;
+    prim.indexType = prim.vertexCount <= 65536 ? IndexType::Uint16
+                                               : IndexType::Uint32;
+    const uint64_t indexDataOffset = AlignIndexData(desc.indexDataSize);
+    prim.firstIndex = static_cast<uint32_t>(indexDataOffset /
+                                            GetIndexSize(prim.indexType));
+    desc.vertexCount += prim.vertexCount;
+    desc.indexDataSize = indexDataOffset + GetIndexDataSize(prim);
+  }
+  desc.indexDataSize = AlignIndexData(desc.indexDataSize);
+}
+
+MeshRange GetMeshRange(const ModelDesc& desc, uint32_t meshIndex) {
+  const MeshDesc& mesh = desc.meshes[meshIndex];
+  MeshRange range;
+  if (mesh.primitiveCount == 0) {
+    return range;
+  }
+  const PrimitiveDesc& first = desc.primitives[mesh.firstPrimitive];
+  const PrimitiveDesc& last =
+      desc.primitives[mesh.firstPrimitive + mesh.primitiveCount - 1];
+  range.firstVertex = first.firstVertex;
+  range.vertexCount = last.firstVertex + last.vertexCount - first.firstVertex;
+  range.indexDataOffset = GetIndexDataOffset(first);
+  range.indexDataSize = GetIndexDataOffset(last) + GetIndexDataSize(last) -
+                        range.indexDataOffset;
+  return range;
+}
+
+MeshDestination GetMeshDestination(const ModelDesc& desc,
+                                   uint32_t meshIndex,
+                                   MeshData& data) {
+  const MeshRange range = GetMeshRange(desc, meshIndex);
+  MeshDestination dst;
+  for (uint32_t stream = 0; stream < VERTEX_STREAM_COUNT; stream++) {
+    if (desc.HasVertexStream(static_cast<VertexStream>(stream))) {
+      const size_t offset = static_cast<size_t>(range.firstVertex) *
+                            VERTEX_STREAM_STRIDES[stream];
+      dst.vertexStreams[stream] = data.vertexStreams[stream].data() + offset;
+    }
+  }
+  dst.indices = data.indices.data() + range.indexDataOffset;
+  return dst;
+}
+
+SceneResources GetSceneResources(const ModelDesc& desc) {
+  SceneResources resources;
+  resources.nodes.resize(desc.nodes.size());
+  resources.meshes.resize(desc.meshes.size());
+  resources.materials.resize(desc.materials.size());
+  resources.textures.resize(desc.textures.size());
+  resources.images.resize(desc.imageCount);
+  resources.samplers.resize(desc.samplers.size());
+  // marks an index and returns whether it was reached for the first time
+  auto reach = [](std::vector<bool>& reached, int64_t index) {
+    if (index < 0 || static_cast<size_t>(index) >= reached.size() ||
+        reached[index]) {
+      return false;
+    }
+    reached[index] = true;
+    return true;
+  };
+
+  // nodes, every node is visited once even if the file has cycles
+  std::vector<uint32_t> pending;
+  for (uint32_t nodeIndex : desc.sceneNodes) {
+    if (reach(resources.nodes, nodeIndex)) {
+      pending.push_back(nodeIndex);
+    }
+  }
+  while (!pending.empty()) {
+    const NodeDesc& node = desc.nodes[pending.back()];
+    pending.pop_back();
+    reach(resources.meshes, node.meshIndex);
+    for (uint32_t i = 0; i < node.childCount; i++) {
+      const uint32_t childIndex = desc.nodeChildren[node.firstChild + i];
+      if (reach(resources.nodes, childIndex)) {
+        pending.push_back(childIndex);
+      }
+    }
+  }
+
+  // meshes, materials, textures, images and samplers
+  for (uint32_t i = 0; i < desc.meshes.size(); i++) {
+    if (!resources.meshes[i]) {
+      continue;
+    }
+    resources.meshIndices.push_back(i);
+    const MeshDesc& mesh = desc.meshes[i];
+    for (uint32_t j = 0; j < mesh.primitiveCount; j++) {
+      reach(resources.materials,
+            desc.primitives[mesh.firstPrimitive + j].materialIndex);
+    }
+  }
+  for (size_t i = 0; i < desc.materials.size(); i++) {
+    if (!resources.materials[i]) {
+      continue;
+    }
+    const MaterialDesc& material = desc.materials[i];
+    for (int32_t textureIndex :
+         {material.baseColorTextureIndex,
+          material.metallicRoughnessTextureIndex, material.normalTextureIndex,
+          material.occlusionTextureIndex, material.emissiveTextureIndex}) {
+      reach(resources.textures, textureIndex);
+    }
+  }
+  for (size_t i = 0; i < desc.textures.size(); i++) {
+    if (resources.textures[i]) {
+      reach(resources.images, desc.textures[i].imageIndex);
+      reach(resources.samplers, desc.textures[i].samplerIndex);
+    }
+  }
+  for (uint32_t i = 0; i < desc.imageCount; i++) {
+    if (resources.images[i]) {
+      resources.imageIndices.push_back(i);
+    }
+  }
+  return resources;
+}
+
+void DecodeMesh(const tinygltf::Model& model,
+                const ModelDesc& desc,
+                uint32_t meshIndex,
+                const MeshDestination& dst) {
+  std::vector<PrimitiveAccessors> primitives;
+  for (const tinygltf::Primitive& prim : model.meshes[meshIndex].primitives) {
+    if (prim.indices < 0) {
+      continue;
+    }
+    PrimitiveAccessors& accessors = primitives.emplace_back();
+    accessors.indices = GetAccessorView(model, prim.indices);
+    accessors.position = GetAttributeView(model, prim, "POSITION");
+    accessors.normal = GetAttributeView(model, prim, "NORMAL");
+    accessors.tangent = GetAttributeView(model, prim, "TANGENT");
+    accessors.uv = GetAttributeView(model, prim, "TEXCOORD_0");
+    accessors.color = GetAttributeView(model, prim, "COLOR_0");
+    accessors.joints = GetAttributeView(model, prim, "JOINTS_0");
+    accessors.weights = GetAttributeView(model, prim, "WEIGHTS_0");
+  }
+  DecodeMesh(primitives, desc, meshIndex, dst);
+}
+
+void DecodeMesh(std::span<const PrimitiveAccessors> primitives,
+                const ModelDesc& desc,
+                uint32_t meshIndex,
+                const MeshDestination& dst) {
+  // float attributes are unpacked here before being quantized into streams
+  std::vector<Vec3> normals;
+  std::vector<Vec4> tangents;
+  std::vector<Vec2> uvs;
+  std::vector<Vec4> colors;
+  std::vector<Vec4> weights;
+
+  const MeshRange range = GetMeshRange(desc, meshIndex);
+  uint32_t primIndex = desc.meshes[meshIndex].firstPrimitive;
+  for (const PrimitiveAccessors& prim : primitives) {
+    const PrimitiveDesc& primDesc = desc.primitives[primIndex++];
+    const uint32_t vertexCount = primDesc.vertexCount;
+    // offsets of the primitive within the mesh
+    const size_t vertexOffset = primDesc.firstVertex - range.firstVertex;
+    uint8_t* indices =
+        dst.indices + (GetIndexDataOffset(primDesc) - range.indexDataOffset);
+
+    // indices, relative to the primitive's first vertex
+    if (primDesc.indexType == IndexType::Uint16) {
+      ReadIndices(prim.indices, reinterpret_cast<uint16_t*>(indices));
+    } else {
+      ReadIndices(prim.indices, 0, reinterpret_cast<uint32_t*>(indices));
+    }
+
+    // positions go straight into their stream
+    HKR_ASSERT(prim.position.data && prim.position.count == vertexCount);
+    ReadFloats(prim.position,
+               reinterpret_cast<float*>(GetStream<Vec3>(
+                   dst, VERTEX_STREAM_POSITION, vertexOffset)),
+               3);
+
+    // normal, tangent and uv
+    auto readAttribute = [&](auto& values, const AccessorView& view,
+                             auto defaultValue) {
+      using T = std::remove_reference_t<decltype(values[0])>;
+      values.assign(vertexCount, defaultValue);
+      if (view.data) {
+        HKR_ASSERT(view.count == vertexCount);
+        ReadFloats(view, reinterpret_cast<float*>(values.data()),
+                   static_cast<uint32_t>(T::length()));
+      }
+    };
+    readAttribute(normals, prim.normal, Vec3(0.0f, 0.0f, 1.0f));
+    readAttribute(tangents, prim.tangent, Vec4(1.0f, 0.0f, 0.0f, 1.0f));
+    readAttribute(uvs, prim.uv, Vec2(0.0f));
+    glTFVertexAttributes* attributes = GetStream<glTFVertexAttributes>(
+        dst, VERTEX_STREAM_ATTRIBUTES, vertexOffset);
+    for (size_t v = 0; v < vertexCount; v++) {
+      const Vec4& t = tangents[v];
+      attributes[v].normal = glm::packSnorm2x16(OctEncode(normals[v]));
+      attributes[v].tangent =
+          (glm::packSnorm2x16(OctEncode(Vec3(t))) & ~(1u << 16)) |
+          (t.w < 0.0f ? 1u << 16 : 0u);
+      attributes[v].uv = glm::packHalf2x16(uvs[v]);
+    }
+
+    // color, rgb colors keep the default alpha
+    if (desc.HasVertexStream(VERTEX_STREAM_COLOR)) {
+      readAttribute(colors, prim.color, Vec4(1.0f));
+      uint32_t* packed =
+          GetStream<uint32_t>(dst, VERTEX_STREAM_COLOR, vertexOffset);
+      for (size_t v = 0; v < vertexCount; v++) {
+        packed[v] = glm::packUnorm4x8(colors[v]);
+      }
+    }
+
+    // skin
+    if (desc.HasVertexStream(VERTEX_STREAM_SKIN)) {
+      glTFVertexSkin* skin =
+          GetStream<glTFVertexSkin>(dst, VERTEX_STREAM_SKIN, vertexOffset);
+      if (prim.joints.data) {
+        HKR_ASSERT(prim.joints.count == vertexCount);
+        ReadUint16(prim.joints, skin->joints,
+                   sizeof(glTFVertexSkin) / sizeof(uint16_t));
+      } else {
+        for (size_t v = 0; v < vertexCount; v++) {
+          std::fill(std::begin(skin[v].joints), std::end(skin[v].joints), 0);
+        }
+      }
+      readAttribute(weights, prim.weights, Vec4(0.0f));
+      for (size_t v = 0; v < vertexCount; v++) {
+        for (int k = 0; k < 4; k++) {
+          skin[v].weights[k] =
+              static_cast<uint16_t>(weights[v][k] * 65535.0f + 0.5f);
+        }
+      }
+    }
+  }
+}
+
+void ExpandToRGBA(const tinygltf::Image& image, std::vector<uint8_t>& pixels) {
+  const size_t texelCount = static_cast<size_t>(image.width) * image.height;
+  pixels.resize(texelCount * 4);
+  ConvertToRGBA8(image.image.data(), static_cast<uint32_t>(image.component),
+                 static_cast<uint32_t>(image.bits), texelCount, pixels.data());
+}
+
+}  // namespace hkr
@@ -0,0 +1,253 @@
+#pragma once
+
+#include "Core/Math.h"
+#include "Renderer/AccessorReader.h"
+
+#include <tiny_gltf.h>
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace hkr {
+
+class ThreadPool;
+
+// Vertices are split into streams so that passes only fetch what they use,
+// the position stream alone feeds acceleration structure builds. Color and
+// skin streams only exist if a primitive of the model has them.
+enum VertexStream : uint32_t {
+  // Vec3
+  VERTEX_STREAM_POSITION,
+  // glTFVertexAttributes
+  VERTEX_STREAM_ATTRIBUTES,
+  // rgba8 unorm
+  VERTEX_STREAM_COLOR,
+  // glTFVertexSkin
+  VERTEX_STREAM_SKIN,
+  VERTEX_STREAM_COUNT,
+};
+
+struct glTFVertexAttributes {
+  // octahedral encoded, snorm16x2
+  uint32_t normal;
+  // octahedral encoded, snorm16x2, the lowest bit of y holds the sign of the
+  // bitangent
+  uint32_t tangent;
+  // half2
+  uint32_t uv;
+};
+
+struct glTFVertexSkin {
+  uint16_t joints[4];
+  // unorm16
+  uint16_t weights[4];
+};
+
+constexpr std::array<uint32_t, VERTEX_STREAM_COUNT> VERTEX_STREAM_STRIDES = {
+    sizeof(Vec3),
+    sizeof(glTFVertexAttributes),
+    sizeof(uint32_t),
+    sizeof(glTFVertexSkin),
+};
+static_assert(sizeof(Vec3) == 12);
+
+// The flattened, graphics api independent tables of a glTF model. They are
+// either built from a parsed glTF file or read back from a cooked model, and
+// are plain data so that they can be written to disk as they are.
+
+// glTF filter and wrap enums
+struct SamplerDesc {
+  int32_t minFilter = -1;
+  int32_t magFilter = -1;
+  int32_t wrapS = TINYGLTF_TEXTURE_WRAP_REPEAT;
+  int32_t wrapT = TINYGLTF_TEXTURE_WRAP_REPEAT;
+};
+
+struct TextureDesc {
+  int32_t imageIndex = -1;
+  int32_t samplerIndex = -1;
+};
+
+struct MaterialDesc {
+  Vec4 baseColorFactor = Vec4(1.0f);
+  Vec3 emissiveFactor = Vec3(0.0f);
+  float metallicFactor = 1.0f;
+  float roughnessFactor = 1.0f;
+  // index of textures, -1 if absent
+  int32_t baseColorTextureIndex = -1;
+  int32_t metallicRoughnessTextureIndex = -1;
+  int32_t normalTextureIndex = -1;
+  int32_t occlusionTextureIndex = -1;
+  int32_t emissiveTextureIndex = -1;
+  // of alpha tested (MASK) materials, negative for the others
+  float alphaCutoff = -1.0f;
+};
+
+// primitives with at most 65536 vertices get 16 bit indices
+enum class IndexType : uint32_t {
+  Uint16,
+  Uint32,
+};
+
+inline uint32_t GetIndexSize(IndexType indexType) {
+  return indexType == IndexType::Uint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// range in the shared vertex/index buffers. Indices are relative to
+// firstVertex, firstIndex counts indices of the primitive's own type from the
+// start of the index buffer and every primitive starts 4 byte aligned.
+struct PrimitiveDesc {
+  uint32_t firstVertex = 0;
+  uint32_t vertexCount = 0;
+  uint32_t firstIndex = 0;
+  uint32_t indexCount = 0;
+  int32_t materialIndex = -1;
+  IndexType indexType = IndexType::Uint32;
+};
+
+inline uint64_t GetIndexDataOffset(const PrimitiveDesc& prim) {
+  return uint64_t{prim.firstIndex} * GetIndexSize(prim.indexType);
+}
+
+inline uint64_t GetIndexDataSize(const PrimitiveDesc& prim) {
+  return uint64_t{prim.indexCount} * GetIndexSize(prim.indexType);
+}
+
+// primitives of a mesh are consecutive, and so are their vertex/index ranges
+struct MeshDesc {
+  uint32_t firstPrimitive = 0;
+  uint32_t primitiveCount = 0;
+};
+
+struct NodeDesc {
+  Mat4 localTransform = Mat4(1.0f);
+  int32_t meshIndex = -1;
+  // range in ModelDesc::nodeChildren
+  uint32_t firstChild = 0;
+  uint32_t childCount = 0;
+};
+
+struct ModelDesc {
+  std::vector<SamplerDesc> samplers;
+  std::vector<TextureDesc> textures;
+  std::vector<MaterialDesc> materials;
+  std::vector<MeshDesc> meshes;
+  std::vector<PrimitiveDesc> primitives;
+  std::vector<NodeDesc> nodes;
+  std::vector<uint32_t> nodeChildren;
+  // root nodes of the default scene
+  std::vector<uint32_t> sceneNodes;
+  uint32_t imageCount = 0;
+  uint32_t vertexCount = 0;
+  // bytes of the index buffer, a multiple of 4
+  uint64_t indexDataSize = 0;
+  // bit per VertexStream
+  uint32_t vertexStreamMask =
+      (1u << VERTEX_STREAM_POSITION) | (1u << VERTEX_STREAM_ATTRIBUTES);
+
+  bool HasVertexStream(VertexStream stream) const {
+    return vertexStreamMask & (1u << stream);
+  }
+};
+
+// vertex/index range of all primitives of a mesh, the index range is in bytes
+// since primitives mix index types
+struct MeshRange {
+  uint32_t firstVertex = 0;
+  uint32_t vertexCount = 0;
+  uint64_t indexDataOffset = 0;
+  uint64_t indexDataSize = 0;
+};
+
+// memory DecodeMesh writes a mesh to, each pointer addresses the first vertex
+// or index byte of the mesh, streams the model lacks are null
+struct MeshDestination {
+  std::array<uint8_t*, VERTEX_STREAM_COUNT> vertexStreams{};
+  uint8_t* indices = nullptr;
+};
+
+// decoded vertex streams and indices of all meshes
+struct MeshData {
+  std::array<std::vector<uint8_t>, VERTEX_STREAM_COUNT> vertexStreams;
+  std::vector<uint8_t> indices;
+};
+
+// load a .gltf or .glb file through the asset pack or a mapping of the file,
+// external buffers and images are read the same way. Compressed pack entries
+// and compressed geometry (EXT_meshopt_compression, KHR_draco_mesh_compression)
+// are decoded on the thread pool if there is one.
+bool LoadglTFFile(tinygltf::TinyGLTF& loader,
+                  tinygltf::Model& model,
+                  const std::string& fileName,
+                  std::string& err,
+                  std::string& warn,
+                  ThreadPool* threadPool = nullptr);
+
+// flatten the model and assign every primitive its range in the shared
+// vertex/index buffers, primitives without indices are dropped and primitives
+// without a material use the default one appended after the glTF materials
+void BuildModelDesc(const tinygltf::Model& model, ModelDesc& desc);
+
+// assign the primitives consecutive ranges in the shared vertex/index buffers
+// and their index type from their vertex and index counts
+void LayoutPrimitives(ModelDesc& desc);
+
+MeshRange GetMeshRange(const ModelDesc& desc, uint32_t meshIndex);
+// destination of a mesh in data sized for the whole model
+MeshDestination GetMeshDestination(const ModelDesc& desc,
+                                   uint32_t meshIndex,
+                                   MeshData& data);
+
+// what the default scene reaches through its nodes, meshes, materials and
+// textures, by index in the tables of the ModelDesc. The default material is
+// reached by every primitive without one.
+struct SceneResources {
+  std::vector<bool> nodes;
+  std::vector<bool> meshes;
+  std::vector<bool> materials;
+  std::vector<bool> textures;
+  std::vector<bool> images;
+  std::vector<bool> samplers;
+  // reached meshes and images in ascending order
+  std::vector<uint32_t> meshIndices;
+  std::vector<uint32_t> imageIndices;
+};
+
+// walk the node hierarchy of the default scene, out of range indices are
+// ignored so that a malformed file loads what it can
+SceneResources GetSceneResources(const ModelDesc& desc);
+
+// decode and quantize the vertex streams and indices of one mesh into dst.
+// Nothing but dst is written so it may point straight into mapped gpu memory.
+void DecodeMesh(const tinygltf::Model& model,
+                const ModelDesc& desc,
+                uint32_t meshIndex,
+                const MeshDestination& dst);
+
+// accessors of a primitive with indices, attributes it lacks have no data
+struct PrimitiveAccessors {
+  AccessorView indices;
+  AccessorView position;
+  AccessorView normal;
+  AccessorView tangent;
+  AccessorView uv;
+  AccessorView color;
+  AccessorView joints;
+  AccessorView weights;
+};
+
+// same from the accessors of the primitives of the mesh that have indices, in
+// order, for front ends other than tinygltf
+void DecodeMesh(std::span<const PrimitiveAccessors> primitives,
+                const ModelDesc& desc,
+                uint32_t meshIndex,
+                const MeshDestination& dst);
+
+// glTF images decode to 1-4 components, the gpu images are rgba8, see
+// ConvertToRGBA8
+void ExpandToRGBA(const tinygltf::Image& image, std::vector<uint8_t>& pixels);
+
+}  // namespace hkr
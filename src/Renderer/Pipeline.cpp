@@ -40,23 +40,34 @@ void GraphicsPipelineBuilder::ShaderStage(
 void GraphicsPipelineBuilder::VertexInput(
     uint32_t stride,
     std::initializer_list<VertexAttributeInfo> attributeInfos) {
-  bindingDescription.binding = 0;
-  bindingDescription.stride = stride;
-  bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-  attributeDescriptions.resize(attributeInfos.size());
-  for (size_t i = 0; i < attributeDescriptions.size(); i++) {
-    auto attributeInfo = attributeInfos.begin() + i;
-    attributeDescriptions[i].binding = 0;
-    attributeDescriptions[i].location = i;
-    attributeDescriptions[i].format = attributeInfo->format;
-    attributeDescriptions[i].offset = attributeInfo->offset;
+  VertexInput({{stride, attributeInfos}});
+}
+
+void GraphicsPipelineBuilder::VertexInput(
+    std::initializer_list<VertexBindingInfo> bindingInfos) {
+  bindingDescriptions.resize(bindingInfos.size());
+  attributeDescriptions.clear();
+  for (size_t i = 0; i < bindingDescriptions.size(); i++) {
+    auto bindingInfo = bindingInfos.begin() + i;
+    bindingDescriptions[i].binding = i;
+    bindingDescriptions[i].stride = bindingInfo->stride;
+    bindingDescriptions[i].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    for (const auto& attributeInfo : bindingInfo->attributeInfos) {
+      VkVertexInputAttributeDescription& attributeDescription =
+          attributeDescriptions.emplace_back();
+      attributeDescription.binding = i;
+      attributeDescription.location = attributeDescriptions.size() - 1;
+      attributeDescription.format = attributeInfo.format;
+      attributeDescription.offset = attributeInfo.offset;
+    }
   }
   vertexInputInfo.sType =
       VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertexInputInfo.vertexBindingDescriptionCount = 1;
+  vertexInputInfo.vertexBindingDescriptionCount =
+      static_cast<uint32_t>(bindingDescriptions.size());
   vertexInputInfo.vertexAttributeDescriptionCount =
       static_cast<uint32_t>(attributeDescriptions.size());
-  vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+  vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
   vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 }
 
@@ -139,7 +150,9 @@ void GraphicsPipelineBuilder::ColorBlend(VkBool32 blendEnable,
   colorBlendInfo.blendConstants[3] = 0.0f;
 }
 
-void GraphicsPipelineBuilder::DynamicState() {
+void GraphicsPipelineBuilder::DynamicState(
+    std::initializer_list<VkDynamicState> extraStates) {
+  dynamicStates.insert(dynamicStates.end(), extraStates);
   dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
   dynamicInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
   dynamicInfo.pDynamicStates = dynamicStates.data();
@@ -4,7 +4,6 @@
 
 #include <initializer_list>
 #include <vector>
-#include <array>
 
 namespace hkr {
 
@@ -18,11 +17,18 @@ struct VertexAttributeInfo {
   uint32_t offset;
 };
 
+// attribute locations are assigned in order across bindings
+struct VertexBindingInfo {
+  uint32_t stride;
+  std::vector<VertexAttributeInfo> attributeInfos;
+};
+
 class GraphicsPipelineBuilder {
 public:
   void ShaderStage(std::initializer_list<ShaderInfo> shaderInfos);
   void VertexInput(uint32_t stride,
                    std::initializer_list<VertexAttributeInfo> attributeInfos);
+  void VertexInput(std::initializer_list<VertexBindingInfo> bindingInfos);
   void InputAssembly(VkPrimitiveTopology topology,
                      VkBool32 primitiveRestartEnable = VK_FALSE);
   void Viewport();
@@ -42,7 +48,8 @@ public:
       VkBlendFactor srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
       VkBlendFactor dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
       VkBlendOp colorBlendOp = VK_BLEND_OP_ADD);
-  void DynamicState();
+  // viewport and scissor are always dynamic
+  void DynamicState(std::initializer_list<VkDynamicState> extraStates = {});
   void Rendering(uint32_t colorAttachmentCount,
                  const VkFormat* pColorAttachmentFormats,
                  VkFormat depthAttachmentFormat,
@@ -54,7 +61,7 @@ private:
   std::vector<VkPipelineShaderStageCreateInfo> shaderStageInfos;
 
   // VertexInput
-  VkVertexInputBindingDescription bindingDescription{};
+  std::vector<VkVertexInputBindingDescription> bindingDescriptions;
   std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
   VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 
@@ -78,8 +85,8 @@ private:
   VkPipelineColorBlendStateCreateInfo colorBlendInfo{};
 
   // Dynamic
-  std::array<VkDynamicState, 2> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT,
-                                                 VK_DYNAMIC_STATE_SCISSOR};
+  std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT,
+                                              VK_DYNAMIC_STATE_SCISSOR};
   VkPipelineDynamicStateCreateInfo dynamicInfo{};
 
   // Rendering
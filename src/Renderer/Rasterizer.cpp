@@ -63,20 +63,15 @@ void Rasterizer::CreateAttachmentImage() {
 }
 
 void Rasterizer::CreateDescriptorPool() {
-  const uint32_t imageCount = mModel->textures.size();
-  std::array<VkDescriptorPoolSize, 2> poolSizes{};
-  poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-  poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  poolSizes[1].descriptorCount =
-      static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * imageCount;
+  VkDescriptorPoolSize poolSize{};
+  poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  poolSize.descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
 
   VkDescriptorPoolCreateInfo poolInfo{};
   poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-  poolInfo.pPoolSizes = poolSizes.data();
-  poolInfo.maxSets =
-      static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * (imageCount + 1);
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+  poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
 
   VK_CHECK(
       vkCreateDescriptorPool(mDevice, &poolInfo, nullptr, &mDescriptorPool));
@@ -91,11 +86,16 @@ void Rasterizer::CreateDescriptorSetLayout() {
     mUboDescriptorSetLayout = builder.Build(mDevice);
   }
 
-  // one descriptor set for model's texture
+  // one descriptor set for model's texture, the streaming feedback and the
+  // texture residency
   {
-    DescriptorSetLayoutBuilder builder(1);
+    DescriptorSetLayoutBuilder builder(3);
     builder.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                        VK_SHADER_STAGE_FRAGMENT_BIT);
+    builder.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                       VK_SHADER_STAGE_FRAGMENT_BIT);
+    builder.AddBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                       VK_SHADER_STAGE_FRAGMENT_BIT);
     mImageDescriptorSetLayout = builder.Build(mDevice);
   }
 
@@ -120,43 +120,82 @@ void Rasterizer::CreateDescriptorSets() {
   VK_CHECK(
       vkAllocateDescriptorSets(mDevice, &allocInfo, mUboDescriptorSets.data()));
 
+  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    DescriptorSetWriter writer(1);
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = mUniformBuffers[i];
+    bufferInfo.offset = 0;
+    bufferInfo.range = sizeof(UniformBufferObject);
+    writer.Write(mUboDescriptorSets[i], 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1,
+                 &bufferInfo);
+    writer.Update(mDevice);
+  }
+}
+
+void Rasterizer::CreateImageDescriptorSets() {
+  const uint32_t imageCount = mModel->textures.size();
+  std::array<VkDescriptorPoolSize, 2> poolSizes{};
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  poolSizes[0].descriptorCount =
+      static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * imageCount;
+  poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSizes[1].descriptorCount =
+      static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * imageCount * 2;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.pPoolSizes = poolSizes.data();
+  poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * imageCount;
+  VK_CHECK(vkCreateDescriptorPool(mDevice, &poolInfo, nullptr,
+                                  &mImageDescriptorPool));
+
   // image descriptor set
-  const size_t imageCount = mModel->textures.size();
   std::vector<VkDescriptorSetLayout> imageSetLayouts(imageCount,
                                                      mImageDescriptorSetLayout);
-  allocInfo.descriptorSetCount = static_cast<uint32_t>(imageCount);
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = mImageDescriptorPool;
+  allocInfo.descriptorSetCount = imageCount;
   allocInfo.pSetLayouts = imageSetLayouts.data();
   mImageDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT,
                               std::vector<VkDescriptorSet>(imageCount));
   for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
     VK_CHECK(vkAllocateDescriptorSets(mDevice, &allocInfo,
                                       mImageDescriptorSets[i].data()));
+    UpdateImageDescriptorSets(i);
   }
+}
 
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-    DescriptorSetWriter writer(1);
-    VkDescriptorBufferInfo bufferInfo{};
-    bufferInfo.buffer = mUniformBuffers[i];
-    bufferInfo.offset = 0;
-    bufferInfo.range = sizeof(UniformBufferObject);
-    writer.Write(mUboDescriptorSets[i], 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1,
-                 &bufferInfo);
+void Rasterizer::UpdateImageDescriptorSets(uint32_t currentFrame) {
+  // the sets of this frame are no longer in use by the gpu, images that are
+  // not resident yet fall back to the default image
+  VkDescriptorBufferInfo feedbackInfo{};
+  feedbackInfo.buffer = mModel->GetTextureFeedback().GetBuffer(currentFrame);
+  feedbackInfo.offset = 0;
+  feedbackInfo.range = VK_WHOLE_SIZE;
+  VkDescriptorBufferInfo residencyInfo{};
+  residencyInfo.buffer =
+      mModel->GetTextureFeedback().GetResidencyBuffer(currentFrame);
+  residencyInfo.offset = 0;
+  residencyInfo.range = VK_WHOLE_SIZE;
+  for (size_t j = 0; j < mImageDescriptorSets[currentFrame].size(); j++) {
+    DescriptorSetWriter writer(3);
+    const auto& texture = mModel->textures[j];
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.sampler = mModel->samplers[texture.samplerIndex].sampler;
+    imageInfo.imageView = mModel->GetImageView(texture.imageIndex);
+    imageInfo.imageLayout = mModel->GetImageLayout(texture.imageIndex);
+
+    writer.Write(mImageDescriptorSets[currentFrame][j], 0,
+                 VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageInfo);
+    writer.Write(mImageDescriptorSets[currentFrame][j], 1,
+                 VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &feedbackInfo);
+    writer.Write(mImageDescriptorSets[currentFrame][j], 2,
+                 VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &residencyInfo);
     writer.Update(mDevice);
-
-    for (size_t j = 0; j < imageCount; j++) {
-      DescriptorSetWriter writer(1);
-      const auto& texture = mModel->textures[j];
-      VkDescriptorImageInfo imageInfo{};
-      imageInfo.sampler = mModel->samplers[texture.samplerIndex].sampler;
-      imageInfo.imageView = mModel->images[texture.imageIndex].image.imageView;
-      // imageInfo.imageView = mModel->images.back().image.imageView;
-      imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-      writer.Write(mImageDescriptorSets[i][j], 0,
-                   VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageInfo);
-      writer.Update(mDevice);
-    }
   }
+  mImageDescriptorVersions[currentFrame] = mModel->GetImageVersion();
 }
 
 void Rasterizer::CreatePipelineCache() {
@@ -167,18 +206,23 @@ void Rasterizer::CreatePipelineCache() {
 }
 
 void Rasterizer::CreatePipelineLayout() {
-  VkPushConstantRange pushConstant{};
-  pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-  pushConstant.offset = 0;
-  pushConstant.size = sizeof(Mat4);
+  // model matrix, then the index of the texture for the streaming feedback
+  std::array<VkPushConstantRange, 2> pushConstants{};
+  pushConstants[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  pushConstants[0].offset = 0;
+  pushConstants[0].size = sizeof(Mat4);
+  pushConstants[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  pushConstants[1].offset = sizeof(Mat4);
+  pushConstants[1].size = sizeof(uint32_t);
   std::array<VkDescriptorSetLayout, 2> setLayouts{mUboDescriptorSetLayout,
                                                   mImageDescriptorSetLayout};
   VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
   pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
   pipelineLayoutInfo.setLayoutCount = setLayouts.size();
   pipelineLayoutInfo.pSetLayouts = setLayouts.data();
-  pipelineLayoutInfo.pushConstantRangeCount = 1;
-  pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+  pipelineLayoutInfo.pushConstantRangeCount =
+      static_cast<uint32_t>(pushConstants.size());
+  pipelineLayoutInfo.pPushConstantRanges = pushConstants.data();
   VK_CHECK(vkCreatePipelineLayout(mDevice, &pipelineLayoutInfo, nullptr,
                                   &mPipelineLayout));
 }
@@ -195,11 +239,13 @@ void Rasterizer::CreatePipeline() {
                        {VK_SHADER_STAGE_FRAGMENT_BIT, fragShaderModule}});
   // VertexInput
   builder.VertexInput(
-      sizeof(glTFVertex),
-      {{VK_FORMAT_R32G32B32_SFLOAT, offsetof(glTFVertex, position)},
-       {VK_FORMAT_R32G32B32_SFLOAT, offsetof(glTFVertex, normal)},
-       {VK_FORMAT_R32G32_SFLOAT, offsetof(glTFVertex, uv)},
-       {VK_FORMAT_R32G32B32_SFLOAT, offsetof(glTFVertex, color)}});
+      {{VERTEX_STREAM_STRIDES[VERTEX_STREAM_POSITION],
+        {{VK_FORMAT_R32G32B32_SFLOAT, 0}}},
+       {VERTEX_STREAM_STRIDES[VERTEX_STREAM_ATTRIBUTES],
+        {{VK_FORMAT_R16G16_SNORM, offsetof(glTFVertexAttributes, normal)},
+         {VK_FORMAT_R16G16_SFLOAT, offsetof(glTFVertexAttributes, uv)}}},
+       {VERTEX_STREAM_STRIDES[VERTEX_STREAM_COLOR],
+        {{VK_FORMAT_R8G8B8A8_UNORM, 0}}}});
 
   //  InputAssembly
   builder.InputAssembly(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
@@ -220,8 +266,9 @@ void Rasterizer::CreatePipeline() {
   // ColorBlend
   builder.ColorBlend();
 
-  // DynamicState
-  builder.DynamicState();
+  // DynamicState, models without vertex colors bind a single white one with
+  // a zero stride
+  builder.DynamicState({VK_DYNAMIC_STATE_VERTEX_INPUT_BINDING_STRIDE});
 
   // Dynamic Rendering
   VkFormat colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
@@ -237,7 +284,8 @@ void Rasterizer::CreatePipeline() {
 void Rasterizer::DrawNode(VkCommandBuffer commandBuffer,
                           uint32_t currentFrame,
                           const glTFNode& node) {
-  if (node.meshIndex != -1 &&
+  // meshes still being uploaded are skipped
+  if (node.meshIndex != -1 && mModel->meshes[node.meshIndex].resident &&
       mModel->meshes[node.meshIndex].primitives.size() > 0) {
     vkCmdPushConstants(commandBuffer, mPipelineLayout,
                        VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Mat4),
@@ -250,8 +298,19 @@ void Rasterizer::DrawNode(VkCommandBuffer commandBuffer,
         vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                                 mPipelineLayout, 1, 1, &imageDescriptorSet, 0,
                                 nullptr);
+        const uint32_t textureIndex =
+            static_cast<uint32_t>(material.baseColorTextureIndex);
+        vkCmdPushConstants(commandBuffer, mPipelineLayout,
+                           VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(Mat4),
+                           sizeof(textureIndex), &textureIndex);
+        if (primitive.indexType != mBoundIndexType) {
+          vkCmdBindIndexBuffer(commandBuffer, mModel->indices.buffer, 0,
+                               primitive.indexType);
+          mBoundIndexType = primitive.indexType;
+        }
         vkCmdDrawIndexed(commandBuffer, primitive.indexCount, 1,
-                         primitive.firstIndex, 0, 0);
+                         primitive.firstIndex,
+                         static_cast<int32_t>(primitive.firstVertex), 0);
       }
     }
   }
@@ -261,11 +320,20 @@ void Rasterizer::DrawNode(VkCommandBuffer commandBuffer,
 }
 
 void Rasterizer::Draw(VkCommandBuffer commandBuffer, uint32_t currentFrame) {
-  VkDeviceSize offsets[1] = {0};
-  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mModel->vertices.buffer,
-                         offsets);
-  vkCmdBindIndexBuffer(commandBuffer, mModel->indices.buffer, 0,
-                       VK_INDEX_TYPE_UINT32);
+  VkBuffer buffers[3] = {
+      mModel->vertexStreams[VERTEX_STREAM_POSITION].buffer,
+      mModel->vertexStreams[VERTEX_STREAM_ATTRIBUTES].buffer,
+      mModel->vertexStreams[VERTEX_STREAM_COLOR].buffer};
+  VkDeviceSize offsets[3] = {0, 0, 0};
+  VkDeviceSize strides[3] = {
+      VERTEX_STREAM_STRIDES[VERTEX_STREAM_POSITION],
+      VERTEX_STREAM_STRIDES[VERTEX_STREAM_ATTRIBUTES],
+      mModel->HasVertexStream(VERTEX_STREAM_COLOR)
+          ? VERTEX_STREAM_STRIDES[VERTEX_STREAM_COLOR]
+          : 0};
+  vkCmdBindVertexBuffers2(commandBuffer, 0, 3, buffers, offsets, nullptr,
+                          strides);
+  mBoundIndexType = VK_INDEX_TYPE_MAX_ENUM;
   for (uint32_t nodeIndex : mModel->topLevelNodeIndices) {
     const auto& node = mModel->nodes[nodeIndex];
     DrawNode(commandBuffer, currentFrame, node);
@@ -348,12 +416,21 @@ void Rasterizer::RecordCommandBuffer(VkCommandBuffer commandBuffer,
 
   mSkybox->Draw(commandBuffer, currentFrame);
 
-  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    mGraphicsPipeline);
-  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          mPipelineLayout, 0, 1,
-                          &mUboDescriptorSets[currentFrame], 0, nullptr);
-  Draw(commandBuffer, currentFrame);
+  // the skybox is drawn alone until the model structure has arrived
+  if (mModel->IsStructureReady()) {
+    if (mImageDescriptorPool == VK_NULL_HANDLE) {
+      CreateImageDescriptorSets();
+    } else if (mImageDescriptorVersions[currentFrame] !=
+               mModel->GetImageVersion()) {
+      UpdateImageDescriptorSets(currentFrame);
+    }
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      mGraphicsPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            mPipelineLayout, 0, 1,
+                            &mUboDescriptorSets[currentFrame], 0, nullptr);
+    Draw(commandBuffer, currentFrame);
+  }
 
   vkCmdEndRendering(commandBuffer);
   // This barrier prepares the color image for presentation, we don't need to
@@ -437,6 +514,9 @@ void Rasterizer::Cleanup() {
   vkDestroyPipelineCache(mDevice, mPipelineCache, nullptr);
 
   vkDestroyDescriptorPool(mDevice, mDescriptorPool, nullptr);
+  if (mImageDescriptorPool != VK_NULL_HANDLE) {
+    vkDestroyDescriptorPool(mDevice, mImageDescriptorPool, nullptr);
+  }
   vkDestroyDescriptorSetLayout(mDevice, mUboDescriptorSetLayout, nullptr);
   vkDestroyDescriptorSetLayout(mDevice, mImageDescriptorSetLayout, nullptr);
 }
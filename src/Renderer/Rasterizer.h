@@ -49,6 +49,10 @@ private:
   void CreateDescriptorPool();
   void CreateDescriptorSetLayout();
   void CreateDescriptorSets();
+  // texture descriptors are created once the model structure is known and
+  // rewritten per frame whenever an image becomes resident
+  void CreateImageDescriptorSets();
+  void UpdateImageDescriptorSets(uint32_t currentFrame);
   // VkSampleCountFlagBits GetMaxUsableSampleCount();
   VkFormat FindSupportedFormat(const std::vector<VkFormat>& candidates,
                                VkImageTiling tiling,
@@ -76,12 +80,18 @@ private:
 
   glTFModel* mModel = nullptr;
   Skybox* mSkybox = nullptr;
+  // the index buffer is rebound only when the index type of the next
+  // primitive differs
+  VkIndexType mBoundIndexType = VK_INDEX_TYPE_MAX_ENUM;
 
   VkDescriptorPool mDescriptorPool;
+  VkDescriptorPool mImageDescriptorPool = VK_NULL_HANDLE;
   VkDescriptorSetLayout mUboDescriptorSetLayout;
   VkDescriptorSetLayout mImageDescriptorSetLayout;
   std::vector<VkDescriptorSet> mUboDescriptorSets;
   std::vector<std::vector<VkDescriptorSet>> mImageDescriptorSets;
+  // model image version the image descriptor sets of each frame reflect
+  std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> mImageDescriptorVersions{};
 
   VkPipelineCache mPipelineCache{VK_NULL_HANDLE};
   VkPipelineLayout mPipelineLayout;
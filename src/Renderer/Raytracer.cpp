@@ -7,6 +7,8 @@
 #include "Util/vk_debug.h"
 #include "Util/vk_util.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 
@@ -20,8 +22,7 @@ namespace hkr {
 void Raytracer::Init(
     VkDevice device,
     VkPhysicalDevice physDevice,
-    VkQueue queue,
-    VkCommandPool commandPool,
+    UploadBatcher& uploader,
     const std::array<UniformBuffer, MAX_FRAMES_IN_FLIGHT>& uniformBuffers,
     VmaAllocator allocator,
     VkFormat swapchainImageFormat,
@@ -33,8 +34,7 @@ void Raytracer::Init(
   // setup rendering context
   mDevice = device;
   mPhysDevice = physDevice;
-  mGraphicsQueue = queue;
-  mCommandPool = commandPool;
+  mUploader = &uploader;
   mModel = model;
   mSkybox = skybox;
   for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
@@ -51,6 +51,10 @@ void Raytracer::Init(
       rayTracingPipelineProperties{};
   rayTracingPipelineProperties.sType =
       VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR;
+  VkPhysicalDeviceAccelerationStructurePropertiesKHR asProperties{};
+  asProperties.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
+  rayTracingPipelineProperties.pNext = &asProperties;
   VkPhysicalDeviceProperties2 deviceProperties2{};
   deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
   deviceProperties2.pNext = &rayTracingPipelineProperties;
@@ -66,6 +70,8 @@ void Raytracer::Init(
   mHandleSize = rayTracingPipelineProperties.shaderGroupHandleSize;
   mHandleAlignment = rayTracingPipelineProperties.shaderGroupHandleAlignment;
   mBaseAlignment = rayTracingPipelineProperties.shaderGroupBaseAlignment;
+  mScratchAlignment =
+      asProperties.minAccelerationStructureScratchOffsetAlignment;
   // clang-format off
   /*
     A shader binding table (SBT) consists of multiple "records", each record
@@ -90,6 +96,7 @@ void Raytracer::Init(
   // clang-format on
 
   BuildBLAS();
+  CompactBLAS(mBLAS);
   BuildTLAS();
 
   CreateStorageImage();
@@ -102,237 +109,337 @@ void Raytracer::Init(
 }
 
 void Raytracer::CreateStorageImage() {
+  // the running average of every frame since the view last changed, blitted
+  // to the swapchain image which converts it to its format
   mStorageImage.Create(
-      mDevice, mAllocator, mWidth, mHeight, 1, VK_FORMAT_R8G8B8A8_UNORM,
+      mDevice, mAllocator, mWidth, mHeight, 1, VK_FORMAT_R32G32B32A32_SFLOAT,
       VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
-  VkCommandBuffer commandBuffer = BeginOneTimeCommands(mDevice, mCommandPool);
   InsertImageMemoryBarrier(
-      commandBuffer, mStorageImage.image, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT,
-      VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, 0,
-      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+      mUploader->GetGraphicsCommandBuffer(), mStorageImage.image,
+      VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+      0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
       VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
       VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
-  EndOneTimeCommands(mDevice, mGraphicsQueue, mCommandPool, commandBuffer);
 }
 
 void Raytracer::BuildBLAS() {
-  // Create transform matrices, one VkTransformMatrixKHR for each gltf
-  // primitive. Note that gltf primitive is different from the primitive in
-  // VkAccelerationStructureBuildRangeInfoKHR (which is a triangle in this
-  // case).
-  uint32_t vertexCount = 0;
-  std::vector<VkTransformMatrixKHR> transformMatrices;
+  // One BLAS per mesh a node of the scene places, with a geometry and a
+  // GeometryNode per primitive in the mesh's own space. The nodes placing a
+  // mesh share its BLAS through their instances in the TLAS.
+  const VkDeviceAddress positionBufferAddr = GetBufferDeviceAddress(
+      mDevice, mModel->vertexStreams[VERTEX_STREAM_POSITION].buffer);
+  const VkDeviceAddress attributeBufferAddr = GetBufferDeviceAddress(
+      mDevice, mModel->vertexStreams[VERTEX_STREAM_ATTRIBUTES].buffer);
+  const VkDeviceAddress indexBufferAddr =
+      GetBufferDeviceAddress(mDevice, mModel->indices.buffer);
+  struct BLASInput {
+    std::vector<VkAccelerationStructureGeometryKHR> geometries;
+    std::vector<VkAccelerationStructureBuildRangeInfoKHR> buildRangeInfos;
+    std::vector<uint32_t> maxPrimitiveCounts;
+  };
+  std::vector<BLASInput> inputs;
+  std::vector<GeometryNode> geometryNodes;  // storage buffer descritor
+  mMeshBLASIndices.assign(mModel->meshes.size(), -1);
+  mBLASGeometryNodes.clear();
   for (uint32_t nodeIndex : mModel->nodeIndices) {
-    const auto& node = mModel->nodes[nodeIndex];
-    if (node.meshIndex != -1) {
-      const auto& primitives = mModel->meshes[node.meshIndex].primitives;
-      for (const auto& primitive : primitives) {
-        if (primitive.indexCount > 0) {
-          vertexCount += primitive.vertexCount;
-          auto& transform = transformMatrices.emplace_back();
-          auto matrix =
-              glm::mat3x4(glm::transpose(node.uniformData.globalTransform));
-          memcpy(&transform, &matrix, sizeof(glm::mat3x4));
-        }
-      }
+    const int meshIndex = mModel->nodes[nodeIndex].meshIndex;
+    if (meshIndex == -1 || mMeshBLASIndices[meshIndex] != -1) {
+      continue;
     }
-  }
-
-  // upload transform matrices data to gpu
-  VkBufferUsageFlags2 usage =
-      VK_BUFFER_USAGE_2_SHADER_DEVICE_ADDRESS_BIT |
-      VK_BUFFER_USAGE_2_STORAGE_BUFFER_BIT |
-      VK_BUFFER_USAGE_2_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
-  Buffer transformBuffer;
-  VkDeviceSize transformSize =
-      sizeof(VkTransformMatrixKHR) * transformMatrices.size();
-  transformBuffer.Create(mAllocator, transformSize, usage);
-  {
-    StagingBuffer staging;
-    staging.Create(mAllocator, transformSize);
-    staging.Map(mAllocator);
-    staging.Write(transformMatrices.data(), transformSize);
-    staging.Unmap(mAllocator);
-    VkCommandBuffer commandBuffer = BeginOneTimeCommands(mDevice, mCommandPool);
-    CopyBufferToBuffer(commandBuffer, staging.buffer, transformBuffer.buffer,
-                       transformSize);
-    EndOneTimeCommands(mDevice, mGraphicsQueue, mCommandPool, commandBuffer);
-    staging.Cleanup(mAllocator);
-  }
-
-  // Create geometries, one VkAccelerationStructureGeometryKHR,
-  // VkAccelerationStructureBuildRangeInfoKHR, GeometryNode for each gltf
-  // primitive.
-  std::vector<VkAccelerationStructureGeometryKHR> geometries;
-  std::vector<VkAccelerationStructureBuildRangeInfoKHR> buildRangeInfos;
-  std::vector<GeometryNode> geometryNodes;  // storage buffer descritor
-  std::vector<uint32_t> maxPrimitiveCounts;
-  for (int nodeIndex : mModel->nodeIndices) {
-    const auto& node = mModel->nodes[nodeIndex];
-    if (node.meshIndex != -1) {
-      const auto& primitives = mModel->meshes[node.meshIndex].primitives;
-      for (const auto& primitive : primitives) {
-        if (primitive.indexCount > 0) {
-          VkDeviceOrHostAddressConstKHR vertexBufferAddr;
-          vertexBufferAddr.deviceAddress =
-              GetBufferDeviceAddress(mDevice, mModel->vertices.buffer);
-          VkDeviceOrHostAddressConstKHR indexBufferAddr;
-          indexBufferAddr.deviceAddress =
-              GetBufferDeviceAddress(mDevice, mModel->indices.buffer) +
-              primitive.firstIndex * sizeof(uint32_t);
-          VkDeviceOrHostAddressConstKHR transformBufferAddr;
-          transformBufferAddr.deviceAddress =
-              GetBufferDeviceAddress(mDevice, transformBuffer.buffer) +
-              geometries.size() * sizeof(VkTransformMatrixKHR);
-          VkAccelerationStructureGeometryKHR geometry{};
-          geometry.sType =
-              VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
-          geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
-          geometry.geometry.triangles.sType =
-              VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
-          geometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
-          geometry.geometry.triangles.vertexData = vertexBufferAddr;
-          geometry.geometry.triangles.maxVertex = vertexCount - 1;
-          // geometry.geometry.triangles.maxVertex = primitive->vertexCount;
-          geometry.geometry.triangles.vertexStride = sizeof(glTFVertex);
-          geometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT32;
-          geometry.geometry.triangles.indexData = indexBufferAddr;
-          geometry.geometry.triangles.transformData = transformBufferAddr;
-          geometries.push_back(geometry);
-          maxPrimitiveCounts.push_back(primitive.indexCount / 3);
-
-          VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo{};
-          buildRangeInfo.primitiveCount = primitive.indexCount / 3;
-          buildRangeInfo.primitiveOffset = 0;
-          buildRangeInfo.firstVertex = 0;
-          buildRangeInfo.transformOffset = 0;
-          buildRangeInfos.push_back(buildRangeInfo);
-
-          GeometryNode geometryNode{};
-          geometryNode.vertexBufferDeviceAddr = vertexBufferAddr.deviceAddress;
-          geometryNode.indexBufferDeviceAddr = indexBufferAddr.deviceAddress;
-          if (primitive.materialIndex != -1) {
-            const auto& material = mModel->materials[primitive.materialIndex];
-            geometryNode.BaseColorTextureIndex = material.baseColorTextureIndex;
-            geometryNode.OcclusionTextureIndex = material.occlusionTextureIndex;
-            geometryNode.NormalTextureIndex = material.normalTextureIndex;
-          }
-          geometryNodes.push_back(geometryNode);
-        }
+    BLASInput input;
+    const uint32_t firstGeometryNode =
+        static_cast<uint32_t>(geometryNodes.size());
+    for (const auto& primitive : mModel->meshes[meshIndex].primitives) {
+      if (primitive.indexCount == 0) {
+        continue;
       }
+      // indices are relative to the primitive's first vertex, so the vertex
+      // addresses start there
+      const uint32_t indexSize = primitive.indexType == VK_INDEX_TYPE_UINT16
+                                     ? sizeof(uint16_t)
+                                     : sizeof(uint32_t);
+      VkDeviceOrHostAddressConstKHR vertexDataAddr;
+      vertexDataAddr.deviceAddress =
+          positionBufferAddr +
+          VkDeviceSize{primitive.firstVertex} *
+              VERTEX_STREAM_STRIDES[VERTEX_STREAM_POSITION];
+      VkDeviceOrHostAddressConstKHR indexDataAddr;
+      indexDataAddr.deviceAddress =
+          indexBufferAddr + VkDeviceSize{primitive.firstIndex} * indexSize;
+      VkAccelerationStructureGeometryKHR geometry{};
+      geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+      geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+      geometry.geometry.triangles.sType =
+          VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+      geometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
+      geometry.geometry.triangles.vertexData = vertexDataAddr;
+      geometry.geometry.triangles.maxVertex = primitive.vertexCount - 1;
+      geometry.geometry.triangles.vertexStride =
+          VERTEX_STREAM_STRIDES[VERTEX_STREAM_POSITION];
+      geometry.geometry.triangles.indexType = primitive.indexType;
+      geometry.geometry.triangles.indexData = indexDataAddr;
+      input.geometries.push_back(geometry);
+      input.maxPrimitiveCounts.push_back(primitive.indexCount / 3);
+
+      VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo{};
+      buildRangeInfo.primitiveCount = primitive.indexCount / 3;
+      buildRangeInfo.primitiveOffset = 0;
+      buildRangeInfo.firstVertex = 0;
+      buildRangeInfo.transformOffset = 0;
+      input.buildRangeInfos.push_back(buildRangeInfo);
+
+      GeometryNode geometryNode{};
+      geometryNode.positionBufferDeviceAddr = vertexDataAddr.deviceAddress;
+      geometryNode.attributeBufferDeviceAddr =
+          attributeBufferAddr +
+          VkDeviceSize{primitive.firstVertex} *
+              VERTEX_STREAM_STRIDES[VERTEX_STREAM_ATTRIBUTES];
+      geometryNode.indexBufferDeviceAddr = indexDataAddr.deviceAddress;
+      geometryNode.IndexSize = indexSize;
+      if (primitive.materialIndex != -1) {
+        const auto& material = mModel->materials[primitive.materialIndex];
+        geometryNode.BaseColorTextureIndex = material.baseColorTextureIndex;
+        geometryNode.OcclusionTextureIndex = material.occlusionTextureIndex;
+        geometryNode.NormalTextureIndex = material.normalTextureIndex;
+      }
+      geometryNodes.push_back(geometryNode);
     }
-  }
-  std::vector<VkAccelerationStructureBuildRangeInfoKHR*> pBuildRangeInfos(
-      buildRangeInfos.size());
-  for (size_t i = 0; i < pBuildRangeInfos.size(); i++) {
-    pBuildRangeInfos[i] = &buildRangeInfos[i];
+    if (input.geometries.empty()) {
+      continue;
+    }
+    mMeshBLASIndices[meshIndex] = static_cast<int32_t>(inputs.size());
+    mBLASGeometryNodes.push_back(firstGeometryNode);
+    inputs.push_back(std::move(input));
   }
   // Upload geometry node data to gpu buffer.
   {
     uint32_t geometryNodeSize = geometryNodes.size() * sizeof(GeometryNode);
     mGeometryNodeBuffer.Create(mAllocator, geometryNodeSize,
                                VK_BUFFER_USAGE_2_SHADER_DEVICE_ADDRESS_BIT |
-                                   VK_BUFFER_USAGE_2_STORAGE_BUFFER_BIT);
-    StagingBuffer staging;
-    staging.Create(mAllocator, geometryNodeSize);
-    staging.Map(mAllocator);
-    staging.Write(geometryNodes.data(), geometryNodeSize);
-    staging.Unmap(mAllocator);
-    VkCommandBuffer commandBuffer = BeginOneTimeCommands(mDevice, mCommandPool);
-    CopyBufferToBuffer(commandBuffer, staging.buffer,
-                       mGeometryNodeBuffer.buffer, geometryNodeSize);
-    EndOneTimeCommands(mDevice, mGraphicsQueue, mCommandPool, commandBuffer);
-    staging.Cleanup(mAllocator);
+                                   VK_BUFFER_USAGE_2_STORAGE_BUFFER_BIT,
+                               mUploader->GetQueueFamilyIndices());
+    mUploader->UploadBuffer(mGeometryNodeBuffer.buffer, geometryNodes.data(),
+                            geometryNodeSize);
   }
-  // Get acceleration structure buffer/scratch buffer size infos.
-  VkAccelerationStructureBuildGeometryInfoKHR buildGeometryInfo{};
-  VkAccelerationStructureBuildSizesInfoKHR buildSizesInfo{};
-  {
+
+  // Get the acceleration structure/scratch sizes of every BLAS and create
+  // them, the builds share one scratch buffer.
+  const size_t blasCount = inputs.size();
+  mBLAS.resize(blasCount);
+  std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildGeometryInfos(
+      blasCount);
+  std::vector<const VkAccelerationStructureBuildRangeInfoKHR*>
+      pBuildRangeInfos(blasCount);
+  std::vector<VkDeviceSize> scratchOffsets(blasCount);
+  VkDeviceSize scratchSize = 0;
+  for (size_t i = 0; i < blasCount; i++) {
+    VkAccelerationStructureBuildGeometryInfoKHR& buildGeometryInfo =
+        buildGeometryInfos[i];
     buildGeometryInfo.sType =
         VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
     buildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
     buildGeometryInfo.flags =
-        VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-    buildGeometryInfo.geometryCount = static_cast<uint32_t>(geometries.size());
-    buildGeometryInfo.pGeometries = geometries.data();
-
+        VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR |
+        VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+    buildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+    buildGeometryInfo.geometryCount =
+        static_cast<uint32_t>(inputs[i].geometries.size());
+    buildGeometryInfo.pGeometries = inputs[i].geometries.data();
+    pBuildRangeInfos[i] = inputs[i].buildRangeInfos.data();
+
+    VkAccelerationStructureBuildSizesInfoKHR buildSizesInfo{};
     buildSizesInfo.sType =
         VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
     vkGetAccelerationStructureBuildSizesKHR(
         mDevice, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
-        &buildGeometryInfo, maxPrimitiveCounts.data(), &buildSizesInfo);
+        &buildGeometryInfo, inputs[i].maxPrimitiveCounts.data(),
+        &buildSizesInfo);
+
+    AccelerationStructure& blas = mBLAS[i];
+    blas.size = buildSizesInfo.accelerationStructureSize;
+    blas.buffer.Create(
+        mAllocator, blas.size,
+        VK_BUFFER_USAGE_2_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR |
+            VK_BUFFER_USAGE_2_SHADER_DEVICE_ADDRESS_BIT);
+    VkAccelerationStructureCreateInfoKHR createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+    createInfo.buffer = blas.buffer.buffer;
+    createInfo.size = blas.size;
+    createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+    vkCreateAccelerationStructureKHR(mDevice, &createInfo, nullptr, &blas.AS);
+    buildGeometryInfo.dstAccelerationStructure = blas.AS;
+
+    scratchOffsets[i] = scratchSize;
+    scratchSize += (buildSizesInfo.buildScratchSize + mScratchAlignment - 1) /
+                   mScratchAlignment * mScratchAlignment;
   }
-  // Create BLAS buffer and BLAS.
-  mBLAS.buffer.Create(mAllocator, buildSizesInfo.accelerationStructureSize,
-                      VK_BUFFER_USAGE_2_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR |
-                          VK_BUFFER_USAGE_2_SHADER_DEVICE_ADDRESS_BIT);
-  VkAccelerationStructureCreateInfoKHR createInfo{};
-  createInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
-  createInfo.buffer = mBLAS.buffer.buffer;
-  createInfo.size = buildSizesInfo.accelerationStructureSize;
-  createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-  vkCreateAccelerationStructureKHR(mDevice, &createInfo, nullptr, &mBLAS.AS);
 
   // create scratch buffer
   Buffer scratchBuffer;
-  scratchBuffer.Create(mAllocator, buildSizesInfo.buildScratchSize,
+  scratchBuffer.Create(mAllocator, std::max(scratchSize, VkDeviceSize{1}),
                        VK_BUFFER_USAGE_2_STORAGE_BUFFER_BIT |
                            VK_BUFFER_USAGE_2_SHADER_DEVICE_ADDRESS_BIT);
-
-  // Build BLAS and get BLAS's device address.
-  buildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-  buildGeometryInfo.dstAccelerationStructure = mBLAS.AS;
-  buildGeometryInfo.scratchData.deviceAddress =
+  const VkDeviceAddress scratchAddr =
       GetBufferDeviceAddress(mDevice, scratchBuffer.buffer);
-  VkCommandBuffer cmdBuf = BeginOneTimeCommands(mDevice, mCommandPool);
-  vkCmdBuildAccelerationStructuresKHR(cmdBuf, 1, &buildGeometryInfo,
-                                      pBuildRangeInfos.data());
-  EndOneTimeCommands(mDevice, mGraphicsQueue, mCommandPool, cmdBuf);
+  for (size_t i = 0; i < blasCount; i++) {
+    buildGeometryInfos[i].scratchData.deviceAddress =
+        scratchAddr + scratchOffsets[i];
+  }
 
-  VkAccelerationStructureDeviceAddressInfoKHR asDeviceAddress{};
-  asDeviceAddress.sType =
-      VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
-  asDeviceAddress.accelerationStructure = mBLAS.AS;
-  mBLAS.deviceAddress =
-      vkGetAccelerationStructureDeviceAddressKHR(mDevice, &asDeviceAddress);
-  scratchBuffer.Cleanup(mAllocator);
-  transformBuffer.Cleanup(mAllocator);
+  // Build every BLAS and get their device addresses. Vertex/index data is
+  // copied earlier in the same batch, builds run on the graphics queue after
+  // the ownership transfer.
+  VkCommandBuffer cmdBuf = mUploader->GetGraphicsCommandBuffer();
+  InsertMemoryBarrier(
+      cmdBuf, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+      VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR |
+          VK_ACCESS_2_SHADER_READ_BIT);
+  if (blasCount > 0) {
+    vkCmdBuildAccelerationStructuresKHR(cmdBuf,
+                                        static_cast<uint32_t>(blasCount),
+                                        buildGeometryInfos.data(),
+                                        pBuildRangeInfos.data());
+  }
+  for (AccelerationStructure& blas : mBLAS) {
+    VkAccelerationStructureDeviceAddressInfoKHR asDeviceAddress{};
+    asDeviceAddress.sType =
+        VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+    asDeviceAddress.accelerationStructure = blas.AS;
+    blas.deviceAddress =
+        vkGetAccelerationStructureDeviceAddressKHR(mDevice, &asDeviceAddress);
+  }
+  // free the scratch buffer once the batch has executed
+  mUploader->Defer([allocator = mAllocator, scratchBuffer]() mutable {
+    scratchBuffer.Cleanup(allocator);
+  });
 }
 
-void Raytracer::BuildTLAS() {
-  VkTransformMatrixKHR transform{
-      // clang-format off
-    1.0f, 0.0f, 0.0f, 0.0f,
-    0.0f, 1.0f, 0.0f, 0.0f,
-    0.0f, 0.0f, 1.0f, 0.0f,
-      // clang-format on
-  };
+void Raytracer::CompactBLAS(std::span<AccelerationStructure> structures) {
+  const uint32_t count = static_cast<uint32_t>(structures.size());
+  if (count == 0) {
+    return;
+  }
+  auto tStart = std::chrono::high_resolution_clock::now();
+  VkQueryPoolCreateInfo queryPoolInfo{};
+  queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  queryPoolInfo.queryType =
+      VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+  queryPoolInfo.queryCount = count;
+  VkQueryPool queryPool;
+  VK_CHECK(vkCreateQueryPool(mDevice, &queryPoolInfo, nullptr, &queryPool));
+
+  // the compacted sizes are written once the builds recorded in this batch
+  // have completed
+  std::vector<VkAccelerationStructureKHR> handles(count);
+  for (uint32_t i = 0; i < count; i++) {
+    handles[i] = structures[i].AS;
+  }
+  VkCommandBuffer cmdBuf = mUploader->GetGraphicsCommandBuffer();
+  vkCmdResetQueryPool(cmdBuf, queryPool, 0, count);
+  InsertMemoryBarrier(cmdBuf,
+                      VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                      VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                      VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+                      VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR);
+  vkCmdWriteAccelerationStructuresPropertiesKHR(
+      cmdBuf, count, handles.data(),
+      VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, queryPool, 0);
+  mUploader->Wait(mUploader->Submit());
+  std::vector<VkDeviceSize> compactedSizes(count);
+  VK_CHECK(vkGetQueryPoolResults(
+      mDevice, queryPool, 0, count, count * sizeof(VkDeviceSize),
+      compactedSizes.data(), sizeof(VkDeviceSize),
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+  vkDestroyQueryPool(mDevice, queryPool, nullptr);
+
+  // copy into right-sized structures, the originals are destroyed once the
+  // copies have executed
+  cmdBuf = mUploader->GetGraphicsCommandBuffer();
+  for (uint32_t i = 0; i < count; i++) {
+    AccelerationStructure& original = structures[i];
+    mStats.blasBuildSize += original.size;
+    AccelerationStructure compacted;
+    compacted.size = compactedSizes[i];
+    compacted.buffer.Create(
+        mAllocator, compacted.size,
+        VK_BUFFER_USAGE_2_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR |
+            VK_BUFFER_USAGE_2_SHADER_DEVICE_ADDRESS_BIT);
+    VkAccelerationStructureCreateInfoKHR createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+    createInfo.buffer = compacted.buffer.buffer;
+    createInfo.size = compacted.size;
+    createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+    vkCreateAccelerationStructureKHR(mDevice, &createInfo, nullptr,
+                                     &compacted.AS);
+
+    VkCopyAccelerationStructureInfoKHR copyInfo{};
+    copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+    copyInfo.src = original.AS;
+    copyInfo.dst = compacted.AS;
+    copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+    vkCmdCopyAccelerationStructureKHR(cmdBuf, &copyInfo);
+
+    VkAccelerationStructureDeviceAddressInfoKHR asDeviceAddress{};
+    asDeviceAddress.sType =
+        VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+    asDeviceAddress.accelerationStructure = compacted.AS;
+    compacted.deviceAddress =
+        vkGetAccelerationStructureDeviceAddressKHR(mDevice, &asDeviceAddress);
+    mStats.blasCompactedSize += compacted.size;
+
+    mUploader->Defer([device = mDevice, allocator = mAllocator,
+                      original]() mutable {
+      vkDestroyAccelerationStructureKHR(device, original.AS, nullptr);
+      original.buffer.Cleanup(allocator);
+    });
+    original = compacted;
+  }
+  auto tEnd = std::chrono::high_resolution_clock::now();
+  HKR_INFO(
+      "Compacted {} BLAS from {:.2f} MB to {:.2f} MB in {:.2f} ms", count,
+      mStats.blasBuildSize / (1024.0 * 1024.0),
+      mStats.blasCompactedSize / (1024.0 * 1024.0),
+      std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+}
 
-  VkAccelerationStructureInstanceKHR instance{};
-  instance.transform = transform;
-  instance.instanceCustomIndex = 0;
-  instance.mask = 0xFF;
-  instance.instanceShaderBindingTableRecordOffset = 0;
-  instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
-  instance.accelerationStructureReference = mBLAS.deviceAddress;
+void Raytracer::BuildTLAS() {
+  // an instance per node with a mesh, placing the BLAS of the mesh with the
+  // node's global transform, its custom index is the first GeometryNode of
+  // the BLAS which the hit shaders add the geometry index to
+  std::vector<VkAccelerationStructureInstanceKHR> instances;
+  for (uint32_t nodeIndex : mModel->nodeIndices) {
+    const auto& node = mModel->nodes[nodeIndex];
+    if (node.meshIndex == -1 || mMeshBLASIndices[node.meshIndex] == -1) {
+      continue;
+    }
+    const int32_t blasIndex = mMeshBLASIndices[node.meshIndex];
+    VkAccelerationStructureInstanceKHR& instance = instances.emplace_back();
+    auto matrix = glm::mat3x4(glm::transpose(node.uniformData.globalTransform));
+    memcpy(&instance.transform, &matrix, sizeof(glm::mat3x4));
+    instance.instanceCustomIndex = mBLASGeometryNodes[blasIndex];
+    instance.mask = 0xFF;
+    instance.instanceShaderBindingTableRecordOffset = 0;
+    instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+    instance.accelerationStructureReference = mBLAS[blasIndex].deviceAddress;
+  }
+  const uint32_t instanceCount = static_cast<uint32_t>(instances.size());
+  HKR_INFO("{} TLAS instances of {} BLAS", instanceCount, mBLAS.size());
   // create instance buffer
   Buffer instanceBuffer;
-  VkDeviceSize instanceSize = sizeof(VkAccelerationStructureInstanceKHR);
+  VkDeviceSize instanceSize =
+      sizeof(VkAccelerationStructureInstanceKHR) * instanceCount;
   instanceBuffer.Create(
-      mAllocator, instanceSize,
+      mAllocator, std::max(instanceSize, VkDeviceSize{1}),
       VK_BUFFER_USAGE_2_SHADER_DEVICE_ADDRESS_BIT |
           VK_BUFFER_USAGE_2_STORAGE_BUFFER_BIT |
-          VK_BUFFER_USAGE_2_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR);
-  StagingBuffer staging;
-  staging.Create(mAllocator, instanceSize);
-  staging.Map(mAllocator);
-  staging.Write(&instance, instanceSize);
-  staging.Unmap(mAllocator);
-  VkCommandBuffer commandBuffer = BeginOneTimeCommands(mDevice, mCommandPool);
-  CopyBufferToBuffer(commandBuffer, staging.buffer, instanceBuffer.buffer,
-                     instanceSize);
-  EndOneTimeCommands(mDevice, mGraphicsQueue, mCommandPool, commandBuffer);
-  staging.Cleanup(mAllocator);
+          VK_BUFFER_USAGE_2_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+      mUploader->GetQueueFamilyIndices());
+  if (instanceCount > 0) {
+    mUploader->UploadBuffer(instanceBuffer.buffer, instances.data(),
+                            instanceSize);
+  }
 
   VkDeviceOrHostAddressConstKHR instanceBufferAddr{};
   instanceBufferAddr.deviceAddress =
@@ -358,7 +465,7 @@ void Raytracer::BuildTLAS() {
         VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
     buildGeometryInfo.geometryCount = 1;
     buildGeometryInfo.pGeometries = &geometry;
-    uint32_t primitive_count = 1;
+    uint32_t primitive_count = instanceCount;
 
     buildSizesInfo.sType =
         VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
@@ -376,6 +483,8 @@ void Raytracer::BuildTLAS() {
   createInfo.size = buildSizesInfo.accelerationStructureSize;
   createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
   vkCreateAccelerationStructureKHR(mDevice, &createInfo, nullptr, &mTLAS.AS);
+  mTLAS.size = buildSizesInfo.accelerationStructureSize;
+  mStats.tlasSize = mTLAS.size;
 
   // create scratch buffer
   Buffer scratchBuffer;
@@ -389,15 +498,24 @@ void Raytracer::BuildTLAS() {
   buildGeometryInfo.scratchData.deviceAddress =
       GetBufferDeviceAddress(mDevice, scratchBuffer.buffer);
   VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo{};
-  buildRangeInfo.primitiveCount = 1;
+  buildRangeInfo.primitiveCount = instanceCount;
   buildRangeInfo.primitiveOffset = 0;
   buildRangeInfo.firstVertex = 0;
   buildRangeInfo.transformOffset = 0;
   VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &buildRangeInfo;
-  VkCommandBuffer cmdBuf = BeginOneTimeCommands(mDevice, mCommandPool);
+  // wait for the instance copy and the BLAS compaction in the same batch
+  VkCommandBuffer cmdBuf = mUploader->GetGraphicsCommandBuffer();
+  InsertMemoryBarrier(
+      cmdBuf,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT |
+          VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+      VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+      VK_ACCESS_2_TRANSFER_WRITE_BIT |
+          VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+      VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR |
+          VK_ACCESS_2_SHADER_READ_BIT);
   vkCmdBuildAccelerationStructuresKHR(cmdBuf, 1, &buildGeometryInfo,
                                       &pBuildRangeInfo);
-  EndOneTimeCommands(mDevice, mGraphicsQueue, mCommandPool, cmdBuf);
 
   VkAccelerationStructureDeviceAddressInfoKHR asDeviceAddress{};
   asDeviceAddress.sType =
@@ -405,12 +523,15 @@ void Raytracer::BuildTLAS() {
   asDeviceAddress.accelerationStructure = mTLAS.AS;
   mTLAS.deviceAddress =
       vkGetAccelerationStructureDeviceAddressKHR(mDevice, &asDeviceAddress);
-  scratchBuffer.Cleanup(mAllocator);
-  instanceBuffer.Cleanup(mAllocator);
+  mUploader->Defer([allocator = mAllocator, scratchBuffer,
+                    instanceBuffer]() mutable {
+    scratchBuffer.Cleanup(allocator);
+    instanceBuffer.Cleanup(allocator);
+  });
 }
 
 void Raytracer::CreateDescriptorPool() {
-  std::array<VkDescriptorPoolSize, 6> poolSizes{
+  std::array<VkDescriptorPoolSize, 8> poolSizes{
       VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
                            MAX_FRAMES_IN_FLIGHT},
       VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
@@ -421,6 +542,10 @@ void Raytracer::CreateDescriptorPool() {
                            MAX_FRAMES_IN_FLIGHT},
       VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
                            MAX_FRAMES_IN_FLIGHT},
+      VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                           MAX_FRAMES_IN_FLIGHT},
+      VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                           MAX_FRAMES_IN_FLIGHT},
       VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                            static_cast<uint32_t>(mModel->textures.size()) *
                                MAX_FRAMES_IN_FLIGHT},
@@ -438,7 +563,7 @@ void Raytracer::CreateDescriptorPool() {
 }
 
 void Raytracer::CreateDescriptorSetLayout() {
-  DescriptorSetLayoutBuilder layoutBuilder(6);
+  DescriptorSetLayoutBuilder layoutBuilder(8);
 
   // TLAS
   layoutBuilder.AddBinding(
@@ -460,9 +585,16 @@ void Raytracer::CreateDescriptorSetLayout() {
   layoutBuilder.AddBinding(
       4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
       VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR);
-  // model's textures
+  // texture streaming feedback
+  layoutBuilder.AddBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                           VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
+  // texture residency the hit shaders clamp sampling to
   layoutBuilder.AddBinding(
-      5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR);
+  // model's textures, variable count so it comes last
+  layoutBuilder.AddBinding(
+      7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
       VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR,
       mModel->textures.size());
   mDescriptorSetLayout = layoutBuilder.Build(mDevice, true);
@@ -492,17 +624,8 @@ void Raytracer::CreateDescriptorSets() {
   VK_CHECK(
       vkAllocateDescriptorSets(mDevice, &allocateInfo, mDescriptorSets.data()));
 
-  // image infos in gltf model
-  std::vector<VkDescriptorImageInfo> imageInfos(imageCount);
-  for (size_t i = 0; i < imageCount; i++) {
-    imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    const auto& texture = mModel->textures[i];
-    imageInfos[i].imageView =
-        mModel->images[texture.imageIndex].image.imageView;
-    imageInfos[i].sampler = mModel->samplers[texture.samplerIndex].sampler;
-  }
   for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-    DescriptorSetWriter writer(6);
+    DescriptorSetWriter writer(7);
 
     // TLAS
     VkWriteDescriptorSetAccelerationStructureKHR writeAS{};
@@ -541,13 +664,43 @@ void Raytracer::CreateDescriptorSets() {
     ssboInfo.range = VK_WHOLE_SIZE;
     writer.Write(mDescriptorSets[i], 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
                  &ssboInfo);
-    // textures in gltf model
-    writer.Write(mDescriptorSets[i], 5,
-                 VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageCount,
-                 imageInfos.data());
+    // texture streaming feedback of the frame
+    VkDescriptorBufferInfo feedbackInfo{};
+    feedbackInfo.buffer = mModel->GetTextureFeedback().GetBuffer(i);
+    feedbackInfo.offset = 0;
+    feedbackInfo.range = VK_WHOLE_SIZE;
+    writer.Write(mDescriptorSets[i], 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                 &feedbackInfo);
+    // and the residency the frame samples with
+    VkDescriptorBufferInfo residencyInfo{};
+    residencyInfo.buffer = mModel->GetTextureFeedback().GetResidencyBuffer(i);
+    residencyInfo.offset = 0;
+    residencyInfo.range = VK_WHOLE_SIZE;
+    writer.Write(mDescriptorSets[i], 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                 &residencyInfo);
 
     writer.Update(mDevice);
+    UpdateImageDescriptors(i);
+  }
+}
+
+void Raytracer::UpdateImageDescriptors(uint32_t currentFrame) {
+  // the set of this frame is no longer in use by the gpu, streamed images are
+  // replaced whenever their resident mip levels change
+  const uint32_t imageCount = static_cast<uint32_t>(mModel->textures.size());
+  std::vector<VkDescriptorImageInfo> imageInfos(imageCount);
+  for (size_t i = 0; i < imageCount; i++) {
+    const auto& texture = mModel->textures[i];
+    imageInfos[i].imageLayout = mModel->GetImageLayout(texture.imageIndex);
+    imageInfos[i].imageView = mModel->GetImageView(texture.imageIndex);
+    imageInfos[i].sampler = mModel->samplers[texture.samplerIndex].sampler;
   }
+  DescriptorSetWriter writer(1);
+  writer.Write(mDescriptorSets[currentFrame], 7,
+               VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageCount,
+               imageInfos.data());
+  writer.Update(mDevice);
+  mImageDescriptorVersions[currentFrame] = mModel->GetImageVersion();
 }
 
 void Raytracer::CreatePipelineLayout() {
@@ -735,6 +888,9 @@ void Raytracer::RecordCommandBuffer(VkCommandBuffer commandBuffer,
                                     VkImage swapchainImage) {
   VkStridedDeviceAddressRegionKHR callableShaderSBTAddr{};
 
+  if (mImageDescriptorVersions[currentFrame] != mModel->GetImageVersion()) {
+    UpdateImageDescriptors(currentFrame);
+  }
   vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR,
                     mRaytracingPipeline);
   // PushConstant pushConstant;
@@ -754,10 +910,11 @@ void Raytracer::RecordCommandBuffer(VkCommandBuffer commandBuffer,
   VkImageSubresourceRange subresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0,
                                            1};
   InsertImageMemoryBarrier(
-      commandBuffer, mStorageImage.image, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-      VK_PIPELINE_STAGE_2_TRANSFER_BIT, 0, VK_ACCESS_2_TRANSFER_READ_BIT,
-      VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-      subresourceRange);
+      commandBuffer, mStorageImage.image,
+      VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+      VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, subresourceRange);
   InsertImageMemoryBarrier(
       commandBuffer, swapchainImage, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
       VK_PIPELINE_STAGE_2_TRANSFER_BIT, 0, VK_ACCESS_2_TRANSFER_WRITE_BIT,
@@ -769,9 +926,12 @@ void Raytracer::RecordCommandBuffer(VkCommandBuffer commandBuffer,
   CopyImageToImage(commandBuffer, mStorageImage.image, swapchainImage, extent,
                    extent);
 
+  // the next frame reads the average back before adding its samples
   InsertImageMemoryBarrier(
-      commandBuffer, mStorageImage.image, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-      VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_TRANSFER_READ_BIT, 0,
+      commandBuffer, mStorageImage.image, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR,
+      VK_ACCESS_2_TRANSFER_READ_BIT,
+      VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT,
       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL,
       subresourceRange);
 }
@@ -803,8 +963,10 @@ void Raytracer::Cleanup() {
   vkDestroyDescriptorPool(mDevice, mDescriptorPool, nullptr);
   vkDestroyDescriptorSetLayout(mDevice, mDescriptorSetLayout, nullptr);
 
-  mBLAS.buffer.Cleanup(mAllocator);
-  vkDestroyAccelerationStructureKHR(mDevice, mBLAS.AS, nullptr);
+  for (AccelerationStructure& blas : mBLAS) {
+    blas.buffer.Cleanup(mAllocator);
+    vkDestroyAccelerationStructureKHR(mDevice, blas.AS, nullptr);
+  }
   mTLAS.buffer.Cleanup(mAllocator);
   vkDestroyAccelerationStructureKHR(mDevice, mTLAS.AS, nullptr);
   mGeometryNodeBuffer.Cleanup(mAllocator);
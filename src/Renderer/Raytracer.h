@@ -5,9 +5,11 @@
 #include "Renderer/Common.h"
 #include "Renderer/Model.h"
 #include "Renderer/Skybox.h"
+#include "Renderer/UploadBatcher.h"
 
 #include <volk.h>
 
+#include <span>
 #include <vector>
 
 namespace hkr {
@@ -16,14 +18,27 @@ struct AccelerationStructure {
   VkAccelerationStructureKHR AS;
   Buffer buffer;
   VkDeviceAddress deviceAddress;
+  // bytes of the structure in its buffer
+  VkDeviceSize size = 0;
+};
+
+// acceleration structure memory, bottom level structures are compacted once
+// built
+struct AccelerationStructureStats {
+  VkDeviceSize blasBuildSize = 0;
+  VkDeviceSize blasCompactedSize = 0;
+  VkDeviceSize tlasSize = 0;
 };
 
 struct GeometryNode {
-  VkDeviceAddress vertexBufferDeviceAddr;
+  VkDeviceAddress positionBufferDeviceAddr;
+  VkDeviceAddress attributeBufferDeviceAddr;
   VkDeviceAddress indexBufferDeviceAddr;
   int32_t BaseColorTextureIndex = -1;
   int32_t OcclusionTextureIndex = -1;
   int32_t NormalTextureIndex = -1;
+  // bytes per index
+  uint32_t IndexSize = sizeof(uint32_t);
 };
 
 class Raytracer {
@@ -31,8 +46,7 @@ public:
   void Init(
       VkDevice device,
       VkPhysicalDevice physDevice,
-      VkQueue queue,
-      VkCommandPool commandPool,
+      UploadBatcher& uploader,
       const std::array<UniformBuffer, MAX_FRAMES_IN_FLIGHT>& uniformBuffers,
       VmaAllocator allocator,
       VkFormat swapchainImageFormat,
@@ -46,9 +60,14 @@ public:
   void RecordCommandBuffer(VkCommandBuffer commandBuffer,
                            uint32_t currentFrame,
                            VkImage swapchainImage);
+  const AccelerationStructureStats& GetStats() const { return mStats; }
 
 private:
   void BuildBLAS();
+  // copy bottom level structures built with ALLOW_COMPACTION into buffers of
+  // their compacted size and free the originals, waits for their build to
+  // complete in order to read the sizes
+  void CompactBLAS(std::span<AccelerationStructure> structures);
   void BuildTLAS();
   void CreateShaderBindingTables();
 
@@ -60,15 +79,16 @@ private:
   void CreateDescriptorPool();
   void CreateDescriptorSetLayout();
   void CreateDescriptorSets();
+  // rewrite the textures of a frame whenever the model images change
+  void UpdateImageDescriptors(uint32_t currentFrame);
 
 private:
   // rendering context
   VkDevice mDevice;
   VkPhysicalDevice mPhysDevice;
-  VkQueue mGraphicsQueue;
+  UploadBatcher* mUploader = nullptr;
   VmaAllocator mAllocator;
   VkFormat mSwapchainImageFormat;
-  VkCommandPool mCommandPool;
   int mWidth = 0;
   int mHeight = 0;
   glTFModel* mModel = nullptr;
@@ -77,6 +97,7 @@ private:
   std::array<VkBuffer, MAX_FRAMES_IN_FLIGHT> mUniformBuffers;
 
   // raytracing
+  // rgba32f running average of the traced frames
   Image mStorageImage;
   VkDeviceSize mHandleSize;
   VkDeviceSize mHandleAlignment;
@@ -85,8 +106,15 @@ private:
   Buffer mGeometryNodeBuffer;
   VkDeviceAddress mVertexBufferDeviceAddress;
   VkDeviceAddress mIndexBufferDeviceAddress;
-  AccelerationStructure mBLAS;
+  // one per mesh the scene places, meshes without triangles have none
+  std::vector<AccelerationStructure> mBLAS;
+  // BLAS of every mesh, -1 if it has none
+  std::vector<int32_t> mMeshBLASIndices;
+  // first GeometryNode of the primitives of every BLAS
+  std::vector<uint32_t> mBLASGeometryNodes;
+  VkDeviceSize mScratchAlignment = 1;
   AccelerationStructure mTLAS;
+  AccelerationStructureStats mStats;
   MappableBuffer mRaygenShaderBindingTable;
   VkStridedDeviceAddressRegionKHR mRaygenSBTAddr{};
   MappableBuffer mMissShaderBindingTable;
@@ -97,6 +125,8 @@ private:
   VkDescriptorSetLayout mDescriptorSetLayout;
   VkDescriptorPool mDescriptorPool;
   std::vector<VkDescriptorSet> mDescriptorSets;
+  // model image version the textures of each frame reflect
+  std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> mImageDescriptorVersions{};
 
   VkPipelineCache mPipelineCache{VK_NULL_HANDLE};
   VkPipelineLayout mPipelineLayout;
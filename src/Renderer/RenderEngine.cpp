@@ -4,6 +4,7 @@
 #include "Renderer/Common.h"
 #include "Renderer/RenderEngine.h"
 #include "Core/Math.h"
+#include "Util/AssetPack.h"
 #include "Util/Assert.h"
 #include "Util/vk_debug.h"
 #include "Util/vk_util.h"
@@ -17,6 +18,8 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_vulkan.h>
 
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <vector>
 #include <cstring>
@@ -58,7 +61,15 @@ void RenderEngine::Init(const AppSettings& settings, GLFWwindow* window) {
   mWidth = settings.width;
   mHeight = settings.height;
   mVsync = settings.vsync;
+  mSamplesPerFrame = std::max(settings.raytracingSamples, 1u);
   mWindow = window;
+  if (settings.assetPackPath) {
+    if (MountAssetPack(mAssetPath, settings.assetPackPath)) {
+      HKR_INFO("Using asset pack: {}", settings.assetPackPath);
+    } else {
+      HKR_WARN("Ignoring invalid asset pack: {}", settings.assetPackPath);
+    }
+  }
 
   // instance, physical device, logical device, graphics queue, vma allocator
   InitVulkan();
@@ -71,37 +82,42 @@ void RenderEngine::Init(const AppSettings& settings, GLFWwindow* window) {
   CreateSyncObjects();
   InitImGui();
   InitCamera();
+  mUploader.Init(mDevice, mAllocator, mTransferQueue, mTransferFamilyIndex,
+                 mGraphicsQueue, mGraphicsFamilyIndex);
+
+  mMipGenerator.Init(mDevice, mAllocator, mAssetPath);
+  mThreadPool.Init();
+
+  // the model streams in on worker threads, the first frames show the skybox
+  // and whatever meshes and images are resident
+  mInitStart = std::chrono::high_resolution_clock::now();
   mModel = new glTFModel;
   mModel->Load(
-      mDevice, mGraphicsQueue, mCommandPool, mAllocator,
+      mDevice, mUploader, mMipGenerator, mThreadPool, mAllocator,
+      QueryTextureFormatSupport(mPhysDevice, mGraphicsFamilyIndex),
       mAssetPath + settings.modelRelPath,
       VK_BUFFER_USAGE_2_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
           VK_BUFFER_USAGE_2_SHADER_DEVICE_ADDRESS_BIT |
-          VK_BUFFER_USAGE_2_STORAGE_BUFFER_BIT);
+          VK_BUFFER_USAGE_2_STORAGE_BUFFER_BIT,
+      settings.srgbColorTextures,
+      settings.simdjsonglTF ? glTFParser::Simdjson : glTFParser::TinyglTF);
+  mModel->SetTextureBudget(VkDeviceSize{settings.textureBudgetMB} * 1024 *
+                           1024);
   mSkybox = new Skybox;
-  mSkybox->Create(mDevice, mGraphicsQueue, mCommandPool, mUniformBuffers,
-                  mAllocator, mAssetPath, settings.cubemapRelPath, 0);
+  mSkybox->Create(mDevice, mUploader, mUniformBuffers, mAllocator, mAssetPath,
+                  settings.cubemapRelPath, 0);
 
-#if defined(RASTERIZER_ONLY)
+#if !defined(RAYTRACER_ONLY)
   mRasterizer = new Rasterizer;
   mRasterizer->Init(mDevice, mPhysDevice, mGraphicsQueue, mCommandPool,
                     mUniformBuffers, mAllocator, mSwapchainImageFormat, mWidth,
                     mHeight, mModel, mSkybox, mAssetPath);
-#elif defined(RAYTRACER_ONLY)
-  mRaytracer = new Raytracer;
-  mRaytracer->Init(mDevice, mPhysDevice, mGraphicsQueue, mCommandPool,
-                   mUniformBuffers, mAllocator, mSwapchainImageFormat, mWidth,
-                   mHeight, mModel, mSkybox, mAssetPath);
-#else
-  mRasterizer = new Rasterizer;
-  mRasterizer->Init(mDevice, mPhysDevice, mGraphicsQueue, mCommandPool,
-                    mUniformBuffers, mAllocator, mSwapchainImageFormat, mWidth,
-                    mHeight, mModel, mSkybox, mAssetPath);
-  mRaytracer = new Raytracer;
-  mRaytracer->Init(mDevice, mPhysDevice, mGraphicsQueue, mCommandPool,
-                   mUniformBuffers, mAllocator, mSwapchainImageFormat, mWidth,
-                   mHeight, mModel, mSkybox, mAssetPath);
 #endif
+  // the ray tracer needs the whole model for its acceleration structures, it
+  // is created once the model is resident
+
+  // frames wait for the skybox on the timeline semaphore
+  mRenderUploadValue = mUploader.Submit();
 }
 
 void RenderEngine::InitVulkan() {
@@ -173,6 +189,8 @@ void RenderEngine::InitVulkan() {
   VkPhysicalDeviceFeatures required_features{};
   required_features.samplerAnisotropy = true;
   required_features.shaderInt64 = true;
+  // compute mip generation indexes the levels of a texture
+  required_features.shaderStorageImageArrayDynamicIndexing = true;
   selector.set_required_features(required_features);
   // 1.2 feature
   VkPhysicalDeviceVulkan12Features features12{};
@@ -183,6 +201,7 @@ void RenderEngine::InitVulkan() {
   features12.descriptorBindingVariableDescriptorCount = true;
   features12.runtimeDescriptorArray = true;
   features12.shaderSampledImageArrayNonUniformIndexing = true;
+  features12.timelineSemaphore = true;
   selector.set_required_features_12(features12);
   // 1.3 feature
   VkPhysicalDeviceVulkan13Features features13{};
@@ -215,6 +234,17 @@ void RenderEngine::InitVulkan() {
   auto phys_ret = selector.select();
   HKR_ASSERT(phys_ret);
   vkb::PhysicalDevice physDevice = phys_ret.value();
+  // block compressed formats basis universal textures are transcoded to
+  VkPhysicalDeviceFeatures compressionFeatures{};
+  compressionFeatures.textureCompressionBC = true;
+  compressionFeatures.textureCompressionASTC_LDR = true;
+  compressionFeatures.textureCompressionETC2 = true;
+  physDevice.enable_features_if_present(compressionFeatures);
+  // partially resident textures, bound on the graphics queue
+  VkPhysicalDeviceFeatures sparseFeatures{};
+  sparseFeatures.sparseBinding = true;
+  sparseFeatures.sparseResidencyImage2D = true;
+  physDevice.enable_features_if_present(sparseFeatures);
   // bool supported =
   //     physDevice.enable_extension_if_present("VK_KHR_timeline_semaphore");
   mPhysDevice = physDevice.physical_device;
@@ -227,12 +257,19 @@ void RenderEngine::InitVulkan() {
   mDevice = vkb_device.device;
   volkLoadDevice(mDevice);
 
-  // 4. get graphics queue
+  // 4. get graphics and transfer queues
   auto graphics_queue_ret = vkb_device.get_queue(vkb::QueueType::graphics);
   HKR_ASSERT(graphics_queue_ret);
   mGraphicsQueue = graphics_queue_ret.value();
   mGraphicsFamilyIndex =
       vkb_device.get_queue_index(vkb::QueueType::graphics).value();
+  // dedicated transfer queue for uploads, required by the device selector
+  auto transfer_queue_ret =
+      vkb_device.get_dedicated_queue(vkb::QueueType::transfer);
+  HKR_ASSERT(transfer_queue_ret);
+  mTransferQueue = transfer_queue_ret.value();
+  mTransferFamilyIndex =
+      vkb_device.get_dedicated_queue_index(vkb::QueueType::transfer).value();
 
   // 5. setup vma allocator
   VmaAllocatorCreateInfo allocatorInfo{};
@@ -308,12 +345,29 @@ void RenderEngine::RecreateSwapchain() {
 #if defined(RASTERIZER_ONLY)
   mRasterizer->OnResize(mWidth, mHeight);
 #elif defined(RAYTRACER_ONLY)
-  mRaytracer->OnResize(mWidth, mHeight);
+  if (mRaytracer) {
+    mRaytracer->OnResize(mWidth, mHeight);
+  }
 #else
   mRasterizer->OnResize(mWidth, mHeight);
-  mRaytracer->OnResize(mWidth, mHeight);
+  if (mRaytracer) {
+    mRaytracer->OnResize(mWidth, mHeight);
+  }
 #endif
+  // the new accumulation image holds no samples yet
+  mAccumulatedFrames = 0;
+  mRenderUploadValue = mUploader.Submit();
+}
+
+#if !defined(RASTERIZER_ONLY)
+void RenderEngine::CreateRaytracer() {
+  mRaytracer = new Raytracer;
+  mRaytracer->Init(mDevice, mPhysDevice, mUploader, mUniformBuffers,
+                   mAllocator, mSwapchainImageFormat, mWidth, mHeight, mModel,
+                   mSkybox, mAssetPath);
+  mRenderUploadValue = mUploader.Submit();
 }
+#endif
 
 void RenderEngine::CreateCommandPool() {
   VkCommandPoolCreateInfo poolInfo{};
@@ -524,6 +578,35 @@ void RenderEngine::DrawFrame() {
 
   UpdateUniformBuffer(mCurrentFrame);
 
+  // record uploads for newly decoded model data and publish completed ones,
+  // texture streaming reads the feedback of the frame that used this slot
+  mModel->Update(mCurrentFrame);
+  if (mModel->IsFailed() && !glfwWindowShouldClose(mWindow)) {
+    // the loader has logged why, there is nothing to show but the skybox
+    HKR_CRITICAL("Failed to load the model, closing");
+    glfwSetWindowShouldClose(mWindow, GLFW_TRUE);
+  }
+#if !defined(RASTERIZER_ONLY)
+  if (!mRaytracer && mModel->IsResident()) {
+    CreateRaytracer();
+  }
+#endif
+  if (!mFirstFrameLogged) {
+    mFirstFrameLogged = true;
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    HKR_INFO(
+        "First frame after {:.2f} ms",
+        std::chrono::duration<double, std::milli>(tEnd - mInitStart).count());
+  }
+
+  // submit uploads recorded since the last frame and recycle the staging
+  // memory of retired batches, the copies run on the transfer queue while
+  // earlier frames are still rendering. The graphics side of a batch is only
+  // submitted once its copies are done, so this frame is not ordered behind
+  // them unless it waits for the batch itself.
+  mUploader.Submit();
+  mUploader.Collect();
+
   vkResetFences(mDevice, 1, &mInFlightFences[mCurrentFrame]);
 
   vkResetCommandBuffer(mCommandBuffers[mCurrentFrame],
@@ -544,6 +627,21 @@ void RenderEngine::DrawFrame() {
   waitInfo.deviceIndex = 0;
   waitInfo.value = 1;
 
+  // skybox and render targets are owned by the graphics queue once their
+  // upload batch has signaled, model data is only used after its batch has
+  // completed
+  std::array<VkSemaphoreSubmitInfo, 2> waitInfos{waitInfo};
+  uint32_t waitCount = 1;
+  if (mRenderUploadValue > 0) {
+    mUploader.SubmitGraphics(mRenderUploadValue);
+    VkSemaphoreSubmitInfo& uploadWaitInfo = waitInfos[waitCount++];
+    uploadWaitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    uploadWaitInfo.semaphore = mUploader.GetTimelineSemaphore();
+    uploadWaitInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    uploadWaitInfo.deviceIndex = 0;
+    uploadWaitInfo.value = mRenderUploadValue;
+  }
+
   VkSemaphoreSubmitInfo signalInfo{};
   signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
   signalInfo.semaphore = mRenderFinishedSemaphores[mCurrentFrame];
@@ -555,8 +653,8 @@ void RenderEngine::DrawFrame() {
   // batch
   VkSubmitInfo2 submitInfo{};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
-  submitInfo.waitSemaphoreInfoCount = 1;
-  submitInfo.pWaitSemaphoreInfos = &waitInfo;
+  submitInfo.waitSemaphoreInfoCount = waitCount;
+  submitInfo.pWaitSemaphoreInfos = waitInfos.data();
   submitInfo.signalSemaphoreInfoCount = 1;
   submitInfo.pSignalSemaphoreInfos = &signalInfo;
   submitInfo.commandBufferInfoCount = 1;
@@ -591,7 +689,6 @@ void RenderEngine::UpdateUniformBuffer(uint32_t currentImage) {
 #elif defined(RAYTRACER_ONLY)
   ubo.view = glm::inverse(mCamera.view);
   ubo.proj = glm::inverse(mCamera.proj);
-  ubo.frame = ubo.frame + 1;
 #else
   if (mRenderMode == RenderMode::Rasterizing) {
     ubo.view = mCamera.view;
@@ -605,7 +702,27 @@ void RenderEngine::UpdateUniformBuffer(uint32_t currentImage) {
   // ubo.viewInverse = glm::inverse(mCamera.GetView());
   // ubo.projInverse = glm::inverse(mCamera.GetProj());
   ubo.viewPos = Vec4(mCamera.position, 0.0f);
-  ubo.frame = ubo.frame + 1;
+#endif
+#if !defined(RASTERIZER_ONLY)
+  // the average starts over with the first frame traced after a change, and
+  // after frames of the rasterizer
+#if defined(RAYTRACER_ONLY)
+  const bool tracing = mRaytracer != nullptr;
+#else
+  const bool tracing = mRaytracer && mRenderMode == RenderMode::Raytracing;
+#endif
+  if (!tracing || mCamera.view != mAccumulatedView ||
+      mCamera.proj != mAccumulatedProj || mLightPos != mAccumulatedLightPos) {
+    mAccumulatedFrames = 0;
+    mAccumulatedView = mCamera.view;
+    mAccumulatedProj = mCamera.proj;
+    mAccumulatedLightPos = mLightPos;
+  }
+  ubo.frame = mAccumulatedFrames;
+  ubo.samplesPerFrame = mSamplesPerFrame;
+  if (tracing) {
+    mAccumulatedFrames++;
+  }
 #endif
   mUniformBuffers[currentImage].Write(&ubo, sizeof(ubo));
 }
@@ -617,14 +734,36 @@ void RenderEngine::RecordCommandBuffer(VkCommandBuffer commandBuffer,
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
   VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
 
+  // the renderers report the level of detail they sample textures at
+  const bool textureFeedback = mModel->IsStructureReady();
+  if (textureFeedback) {
+    mModel->GetTextureFeedback().Begin(commandBuffer, currentFrame);
+  }
+
 #if defined(RASTERIZER_ONLY)
   mRasterizer->RecordCommandBuffer(commandBuffer, currentFrame,
                                    mSwapchainImages[imageIndex]);
 #elif defined(RAYTRACER_ONLY)
-  mRaytracer->RecordCommandBuffer(commandBuffer, currentFrame,
-                                  mSwapchainImages[imageIndex]);
+  if (mRaytracer) {
+    mRaytracer->RecordCommandBuffer(commandBuffer, currentFrame,
+                                    mSwapchainImages[imageIndex]);
+  } else {
+    // nothing to trace yet, clear the swapchain image
+    InsertImageMemoryBarrier(
+        commandBuffer, mSwapchainImages[imageIndex],
+        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT, 0, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+    VkClearColorValue clearColor{{0.0f, 0.0f, 0.0f, 1.0f}};
+    VkImageSubresourceRange range{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdClearColorImage(commandBuffer, mSwapchainImages[imageIndex],
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor, 1,
+                         &range);
+  }
 #else
-  if (mRenderMode == RenderMode::Rasterizing) {
+  // rasterize until the ray tracer exists
+  if (mRenderMode == RenderMode::Rasterizing || !mRaytracer) {
     mRasterizer->RecordCommandBuffer(commandBuffer, currentFrame,
                                      mSwapchainImages[imageIndex]);
   } else if (mRenderMode == RenderMode::Raytracing) {
@@ -647,6 +786,9 @@ void RenderEngine::RecordCommandBuffer(VkCommandBuffer commandBuffer,
       VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
       VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
 
+  if (textureFeedback) {
+    mModel->GetTextureFeedback().End(commandBuffer, currentFrame);
+  }
   VK_CHECK(vkEndCommandBuffer(commandBuffer));
 }
 
@@ -683,6 +825,18 @@ void RenderEngine::DrawUI(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
     //     "clear color",
     //     (float*)&clear_color);  // Edit 3 floats representing a color
     ImGui::SliderFloat3("light position", (float*)&mLightPos, -10.0, 10.0f);
+#if !defined(RASTERIZER_ONLY)
+    ImGui::SliderInt("samples per frame", (int*)&mSamplesPerFrame, 1, 8, "%d",
+                     ImGuiSliderFlags_AlwaysClamp);
+    ImGui::Text("accumulated frames %u", mAccumulatedFrames);
+    if (mRaytracer) {
+      const AccelerationStructureStats& stats = mRaytracer->GetStats();
+      ImGui::Text("BLAS %.2f MB (%.2f MB before compaction), TLAS %.2f MB",
+                  stats.blasCompactedSize / (1024.0 * 1024.0),
+                  stats.blasBuildSize / (1024.0 * 1024.0),
+                  stats.tlasSize / (1024.0 * 1024.0));
+    }
+#endif
     // camera settings
     ImGui::SliderFloat("camera move speed", &mCamera.moveSpeed, 0.0f, 5.0f);
     ImGui::SliderFloat("camera rotate speed", &mCamera.rotateSpeed, 0.0f, 1.0f);
@@ -768,23 +922,26 @@ void RenderEngine::Cleanup() {
 
   CleanupImGui();
 
-#if defined(RASTERIZER_ONLY)
+#if !defined(RAYTRACER_ONLY)
   mRasterizer->Cleanup();
   delete mRasterizer;
-#elif defined(RAYTRACER_ONLY)
-  mRaytracer->Cleanup();
-  delete mRaytracer;
-#else
-  mRasterizer->Cleanup();
-  delete mRasterizer;
-  mRaytracer->Cleanup();
-  delete mRaytracer;
+#endif
+#if !defined(RASTERIZER_ONLY)
+  if (mRaytracer) {
+    mRaytracer->Cleanup();
+    delete mRaytracer;
+  }
 #endif
 
+  // cancels the loader before its worker threads are joined
   mModel->Cleanup();
   delete mModel;
+  mThreadPool.Cleanup();
   mSkybox->Cleanup(mAllocator);
   delete mSkybox;
+  mUploader.Cleanup();
+  mMipGenerator.Cleanup();
+  UnmountAssetPack();
 
   vkDestroyDescriptorPool(mDevice, mImGuiDescriptorPool, nullptr);
   for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
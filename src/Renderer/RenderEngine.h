@@ -5,7 +5,10 @@
 #include "Renderer/Camera.h"
 #include "Renderer/Image.h"
 #include "Renderer/Buffer.h"
+#include "Renderer/MipGenerator.h"
 #include "Renderer/Model.h"
+#include "Renderer/UploadBatcher.h"
+#include "Util/ThreadPool.h"
 #include "hikari/Core/App.h"
 
 // #define RASTERIZER_ONLY
@@ -19,6 +22,7 @@
 #include "Renderer/Raytracer.h"
 #endif
 
+#include <chrono>
 #include <vector>
 #include <string>
 
@@ -44,7 +48,7 @@ public:
 
 private:
   // create instance, choose physical device, build logical device, get graphics
-  // queue, setup vma allocator
+  // and transfer queues, setup vma allocator
   void InitVulkan();
 
   void CreateSwapchain();
@@ -66,6 +70,9 @@ private:
                            uint32_t imageIndex);
 
   void InitCamera();
+#if !defined(RASTERIZER_ONLY)
+  void CreateRaytracer();
+#endif
 
 private:
   std::string mAssetPath;
@@ -84,6 +91,8 @@ private:
 
   VkQueue mGraphicsQueue;
   uint32_t mGraphicsFamilyIndex;
+  VkQueue mTransferQueue;
+  uint32_t mTransferFamilyIndex;
 
   VkSwapchainKHR mSwapchain;
   VkFormat mSwapchainImageFormat;
@@ -94,6 +103,15 @@ private:
   VkCommandPool mCommandPool;
   std::vector<VkCommandBuffer> mCommandBuffers;
 
+  // batched staging uploads on the transfer queue
+  UploadBatcher mUploader;
+  // timeline value of the uploads the renderers themselves depend on
+  uint64_t mRenderUploadValue = 0;
+  // compute mip generation of uploaded textures
+  MipGenerator mMipGenerator;
+  // workers for asset loading
+  ThreadPool mThreadPool;
+
   // descriptor resources
   std::array<UniformBuffer, MAX_FRAMES_IN_FLIGHT> mUniformBuffers;
   VkDescriptorPool mImGuiDescriptorPool;
@@ -105,6 +123,8 @@ private:
 
   uint32_t mCurrentFrame = 0;
   bool mFramebufferResized = false;
+  std::chrono::high_resolution_clock::time_point mInitStart;
+  bool mFirstFrameLogged = false;
 
   Camera mCamera;
   Mouse mMouse;
@@ -112,6 +132,14 @@ private:
   Skybox* mSkybox;
   Vec3 mLightPos = Vec3(5, 5, 5);
 
+  // the ray tracer accumulates a running average of its frames, restarted
+  // whenever the camera, the light or the window changes
+  uint32_t mSamplesPerFrame = 1;
+  uint32_t mAccumulatedFrames = 0;
+  Mat4 mAccumulatedView = Mat4(1.0f);
+  Mat4 mAccumulatedProj = Mat4(1.0f);
+  Vec3 mAccumulatedLightPos = Vec3(0.0f);
+
   // VkSampleCountFlagBits mMsaaSamples = VK_SAMPLE_COUNT_1_BIT;
 
   enum RenderMode {
@@ -1,9 +1,11 @@
 #include "Renderer/Skybox.h"
+#include "Renderer/CookedTexture.h"
 #include "Renderer/Cube.h"
 #include "Renderer/Image.h"
 #include "Renderer/Common.h"
 #include "Renderer/Descriptor.h"
 #include "Renderer/Pipeline.h"
+#include "Renderer/UploadBatcher.h"
 #include "Util/vk_util.h"
 #include "Util/vk_debug.h"
 
@@ -13,8 +15,7 @@ namespace hkr {
 
 void Skybox::Create(
     VkDevice device,
-    VkQueue queue,
-    VkCommandPool commandPool,
+    UploadBatcher& uploader,
     const std::array<UniformBuffer, MAX_FRAMES_IN_FLIGHT>& uniformBuffers,
     VmaAllocator allocator,
     const std::string& assetPath,
@@ -23,9 +24,14 @@ void Skybox::Create(
   // setup rendering context
   mDevice = device;
   mAssetPath = assetPath;
-  mCube.Create(device, queue, commandPool, allocator, bufferUsageFlags);
-  cubemap.Load(mDevice, allocator, queue, commandPool,
-               mAssetPath + cubemapRelPath);
+  mCube.Create(device, uploader, allocator, bufferUsageFlags);
+  // the bc6h variant cooked by hikari_cook is used while it matches its source
+  const std::string cubemapFileName = mAssetPath + cubemapRelPath;
+  const std::string cookedFileName = GetCookedCubemapFileName(cubemapFileName);
+  cubemap.Load(mDevice, allocator, uploader,
+               IsCookedCubemapCurrent(cookedFileName, cubemapFileName)
+                   ? cookedFileName
+                   : cubemapFileName);
   SamplerBuilder builder;
   builder.SetMaxAnisotropy(8.0f);
   cubemapSampler = builder.Build(mDevice);
@@ -10,12 +10,13 @@
 
 namespace hkr {
 
+class UploadBatcher;
+
 class Skybox {
 public:
   void Create(
       VkDevice device,
-      VkQueue queue,
-      VkCommandPool commandPool,
+      UploadBatcher& uploader,
       const std::array<UniformBuffer, MAX_FRAMES_IN_FLIGHT>& uniformBuffers,
       VmaAllocator allocator,
       const std::string& assetPath,
@@ -0,0 +1,327 @@
+#include "Renderer/SparseTexture.h"
+#include "Renderer/UploadBatcher.h"
+#include "Util/vk_debug.h"
+#include "Util/vk_util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <span>
+
+namespace {
+
+constexpr VkImageUsageFlags SPARSE_TEXTURE_USAGE =
+    VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+// texel block of the formats textures are cooked or transcoded to, returns
+// false for others
+bool GetTexelBlock(VkFormat format, VkExtent2D& extent, uint32_t& size) {
+  extent = {4, 4};
+  switch (format) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+      extent = {1, 1};
+      size = 4;
+      return true;
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+    case VK_FORMAT_EAC_R11_UNORM_BLOCK:
+      size = 8;
+      return true;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+    case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+      size = 16;
+      return true;
+    default:
+      return false;
+  }
+}
+
+// the device binds images of the format in tiles of the standard shape
+bool HasStandardSparseBlocks(VmaAllocator allocator, VkFormat format) {
+  VmaAllocatorInfo allocatorInfo;
+  vmaGetAllocatorInfo(allocator, &allocatorInfo);
+  uint32_t count = 0;
+  vkGetPhysicalDeviceSparseImageFormatProperties(
+      allocatorInfo.physicalDevice, format, VK_IMAGE_TYPE_2D,
+      VK_SAMPLE_COUNT_1_BIT, SPARSE_TEXTURE_USAGE, VK_IMAGE_TILING_OPTIMAL,
+      &count, nullptr);
+  std::vector<VkSparseImageFormatProperties> properties(count);
+  vkGetPhysicalDeviceSparseImageFormatProperties(
+      allocatorInfo.physicalDevice, format, VK_IMAGE_TYPE_2D,
+      VK_SAMPLE_COUNT_1_BIT, SPARSE_TEXTURE_USAGE, VK_IMAGE_TILING_OPTIMAL,
+      &count, properties.data());
+  return std::any_of(properties.begin(), properties.end(),
+                     [](const VkSparseImageFormatProperties& property) {
+                       return (property.aspectMask &
+                               VK_IMAGE_ASPECT_COLOR_BIT) &&
+                              !(property.flags &
+                                VK_SPARSE_IMAGE_FORMAT_NONSTANDARD_BLOCK_SIZE_BIT);
+                     });
+}
+
+VmaAllocation AllocateDeviceMemory(VmaAllocator allocator,
+                                   const VkMemoryRequirements& requirements) {
+  VmaAllocationCreateInfo createInfo{};
+  createInfo.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  createInfo.priority = 1.0f;
+  VmaAllocation allocation = VK_NULL_HANDLE;
+  if (vmaAllocateMemory(allocator, &requirements, &createInfo, &allocation,
+                        nullptr) != VK_SUCCESS) {
+    return VK_NULL_HANDLE;
+  }
+  return allocation;
+}
+
+}  // namespace
+
+namespace hkr {
+
+void SparsePagePool::Cleanup() {
+  Trim(0);
+}
+
+VmaAllocation SparsePagePool::Allocate(
+    const VkMemoryRequirements& requirements) {
+  for (size_t i = 0; i < mFree.size(); i++) {
+    const Page& page = mFree[i];
+    if ((requirements.memoryTypeBits & (1u << page.memoryType)) &&
+        page.size == requirements.alignment) {
+      VmaAllocation allocation = page.allocation;
+      mFree[i] = mFree.back();
+      mFree.pop_back();
+      return allocation;
+    }
+  }
+  VkMemoryRequirements pageRequirements = requirements;
+  pageRequirements.size = requirements.alignment;
+  return AllocateDeviceMemory(mAllocator, pageRequirements);
+}
+
+void SparsePagePool::Free(VmaAllocation page) {
+  VmaAllocationInfo allocInfo;
+  vmaGetAllocationInfo(mAllocator, page, &allocInfo);
+  mFree.push_back({page, allocInfo.memoryType, allocInfo.size});
+}
+
+void SparsePagePool::Trim(size_t maxFree) {
+  while (mFree.size() > maxFree) {
+    vmaFreeMemory(mAllocator, mFree.back().allocation);
+    mFree.pop_back();
+  }
+}
+
+bool SparseTexture::Create(VkDevice device,
+                           VmaAllocator allocator,
+                           UploadBatcher& uploader,
+                           uint32_t width,
+                           uint32_t height,
+                           uint32_t mipLevels,
+                           VkFormat format) {
+  if (!GetTexelBlock(format, mBlockExtent, mBlockSize) ||
+      !HasStandardSparseBlocks(allocator, format)) {
+    return false;
+  }
+  mAllocator = allocator;
+  mWidth = width;
+  mHeight = height;
+  mMipLevels = mipLevels;
+
+  const std::span<const uint32_t> queueFamilyIndices =
+      uploader.GetQueueFamilyIndices();
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.flags =
+      VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent = {width, height, 1};
+  imageInfo.mipLevels = mipLevels;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = format;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage = SPARSE_TEXTURE_USAGE;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = queueFamilyIndices.size() > 1
+                              ? VK_SHARING_MODE_CONCURRENT
+                              : VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.queueFamilyIndexCount =
+      static_cast<uint32_t>(queueFamilyIndices.size());
+  imageInfo.pQueueFamilyIndices = queueFamilyIndices.data();
+  VK_CHECK(vkCreateImage(device, &imageInfo, nullptr, &mImage));
+
+  // tiles are pages of the alignment of the image
+  vkGetImageMemoryRequirements(device, mImage, &mPageRequirements);
+  mPageRequirements.size = mPageRequirements.alignment;
+  uint32_t requirementCount = 0;
+  vkGetImageSparseMemoryRequirements(device, mImage, &requirementCount,
+                                     nullptr);
+  std::vector<VkSparseImageMemoryRequirements> requirements(requirementCount);
+  vkGetImageSparseMemoryRequirements(device, mImage, &requirementCount,
+                                     requirements.data());
+  const VkSparseImageMemoryRequirements* colorRequirements = nullptr;
+  bool metadata = false;
+  for (const auto& requirement : requirements) {
+    const VkImageAspectFlags aspect = requirement.formatProperties.aspectMask;
+    if (aspect & VK_IMAGE_ASPECT_COLOR_BIT) {
+      colorRequirements = &requirement;
+    }
+    metadata = metadata || (aspect & VK_IMAGE_ASPECT_METADATA_BIT);
+  }
+  // the mip tail holds the coarsest levels the shaders fall back to
+  if (!colorRequirements || metadata ||
+      colorRequirements->imageMipTailFirstLod == 0 ||
+      colorRequirements->imageMipTailFirstLod >= mipLevels) {
+    Cleanup(device, allocator);
+    return false;
+  }
+  const VkExtent3D& granularity =
+      colorRequirements->formatProperties.imageGranularity;
+  mTileExtent = {granularity.width, granularity.height};
+  mMipTail = colorRequirements->imageMipTailFirstLod;
+
+  VkMemoryRequirements mipTailRequirements = mPageRequirements;
+  mipTailRequirements.size = colorRequirements->imageMipTailSize;
+  mMipTailMemory = AllocateDeviceMemory(allocator, mipTailRequirements);
+  if (mMipTailMemory == VK_NULL_HANDLE) {
+    Cleanup(device, allocator);
+    return false;
+  }
+  VmaAllocationInfo allocInfo;
+  vmaGetAllocationInfo(allocator, mMipTailMemory, &allocInfo);
+  VkSparseMemoryBind mipTailBind{};
+  mipTailBind.resourceOffset = colorRequirements->imageMipTailOffset;
+  mipTailBind.size = colorRequirements->imageMipTailSize;
+  mipTailBind.memory = allocInfo.deviceMemory;
+  mipTailBind.memoryOffset = allocInfo.offset;
+  uploader.BindSparse(mImage, mipTailBind);
+
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = mImage;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = format;
+  viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1};
+  VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &mImageView));
+
+  InsertImageMemoryBarrier(uploader.GetCommandBuffer(), mImage,
+                           VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                           VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                           VK_ACCESS_TRANSFER_WRITE_BIT,
+                           VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                           {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1});
+  return true;
+}
+
+void SparseTexture::Cleanup(VkDevice device, VmaAllocator allocator) {
+  vkDestroyImageView(device, mImageView, nullptr);
+  vkDestroyImage(device, mImage, nullptr);
+  if (mMipTailMemory != VK_NULL_HANDLE) {
+    vmaFreeMemory(allocator, mMipTailMemory);
+  }
+  mImageView = VK_NULL_HANDLE;
+  mImage = VK_NULL_HANDLE;
+  mMipTailMemory = VK_NULL_HANDLE;
+}
+
+VkExtent2D SparseTexture::GetTileCount(uint32_t level) const {
+  const VkExtent2D extent = GetLevelExtent(level);
+  return {(extent.width + mTileExtent.width - 1) / mTileExtent.width,
+          (extent.height + mTileExtent.height - 1) / mTileExtent.height};
+}
+
+void SparseTexture::BindTile(UploadBatcher& uploader,
+                             uint32_t level,
+                             uint32_t x,
+                             uint32_t y,
+                             VmaAllocation page) const {
+  const uint32_t levelWidth = std::max(mWidth >> level, 1u);
+  const uint32_t levelHeight = std::max(mHeight >> level, 1u);
+  VkSparseImageMemoryBind bind{};
+  bind.subresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0};
+  bind.offset = {static_cast<int32_t>(x * mTileExtent.width),
+                 static_cast<int32_t>(y * mTileExtent.height), 0};
+  // tiles on the right and bottom edges may be partial
+  bind.extent = {std::min(mTileExtent.width, levelWidth - x * mTileExtent.width),
+                 std::min(mTileExtent.height,
+                          levelHeight - y * mTileExtent.height),
+                 1};
+  if (page != VK_NULL_HANDLE) {
+    VmaAllocationInfo allocInfo;
+    vmaGetAllocationInfo(mAllocator, page, &allocInfo);
+    bind.memory = allocInfo.deviceMemory;
+    bind.memoryOffset = allocInfo.offset;
+  }
+  uploader.BindSparse(mImage, bind);
+}
+
+VkDeviceSize SparseTexture::UploadTile(UploadBatcher& uploader,
+                                       uint32_t level,
+                                       uint32_t x,
+                                       uint32_t y,
+                                       const uint8_t* levelData) const {
+  const uint32_t levelWidth = std::max(mWidth >> level, 1u);
+  const uint32_t levelHeight = std::max(mHeight >> level, 1u);
+  const VkOffset2D offset{static_cast<int32_t>(x * mTileExtent.width),
+                          static_cast<int32_t>(y * mTileExtent.height)};
+  const VkExtent2D extent{
+      std::min(mTileExtent.width, levelWidth - x * mTileExtent.width),
+      std::min(mTileExtent.height, levelHeight - y * mTileExtent.height)};
+  return Upload(uploader, level, offset, extent, levelData);
+}
+
+VkDeviceSize SparseTexture::UploadLevel(UploadBatcher& uploader,
+                                        uint32_t level,
+                                        const uint8_t* levelData) const {
+  return Upload(uploader, level, {0, 0}, GetLevelExtent(level), levelData);
+}
+
+VkDeviceSize SparseTexture::Upload(UploadBatcher& uploader,
+                                   uint32_t level,
+                                   VkOffset2D offset,
+                                   VkExtent2D extent,
+                                   const uint8_t* levelData) const {
+  // gather the rows of blocks of the region, tiles are whole blocks
+  const uint32_t levelWidth = std::max(mWidth >> level, 1u);
+  const VkDeviceSize levelPitch =
+      VkDeviceSize{(levelWidth + mBlockExtent.width - 1) / mBlockExtent.width} *
+      mBlockSize;
+  const uint32_t rowCount =
+      (extent.height + mBlockExtent.height - 1) / mBlockExtent.height;
+  const VkDeviceSize rowSize =
+      VkDeviceSize{(extent.width + mBlockExtent.width - 1) /
+                   mBlockExtent.width} *
+      mBlockSize;
+  const VkDeviceSize size = rowSize * rowCount;
+  UploadBatcher::Allocation staging = uploader.Allocate(size);
+  const uint8_t* src =
+      levelData + offset.y / mBlockExtent.height * levelPitch +
+      VkDeviceSize{offset.x / mBlockExtent.width} * mBlockSize;
+  uint8_t* dst = static_cast<uint8_t*>(staging.data);
+  for (uint32_t row = 0; row < rowCount; row++) {
+    memcpy(dst + row * rowSize, src + row * levelPitch, rowSize);
+  }
+
+  VkBufferImageCopy2 region{};
+  region.sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2;
+  region.bufferOffset = staging.offset;
+  region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+  region.imageOffset = {offset.x, offset.y, 0};
+  region.imageExtent = {extent.width, extent.height, 1};
+  CopyBufferToTexture(uploader.GetCommandBuffer(), staging.buffer, mImage,
+                      {&region, 1}, VK_IMAGE_LAYOUT_GENERAL);
+  return size;
+}
+
+}  // namespace hkr
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <volk.h>
+#include <vk_mem_alloc.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace hkr {
+
+class UploadBatcher;
+
+// Pages of device memory the tiles of sparse textures are bound to. Freed
+// pages are kept for the next tiles and only released by Trim.
+class SparsePagePool {
+public:
+  void Init(VmaAllocator allocator) { mAllocator = allocator; }
+  void Cleanup();
+
+  // page for a tile of an image with the given memory requirements, its size
+  // is their alignment. Returns null if the memory runs out.
+  VmaAllocation Allocate(const VkMemoryRequirements& requirements);
+  // the page must no longer be bound
+  void Free(VmaAllocation page);
+  // release free pages beyond maxFree
+  void Trim(size_t maxFree);
+
+private:
+  struct Page {
+    VmaAllocation allocation;
+    uint32_t memoryType;
+    VkDeviceSize size;
+  };
+
+  VmaAllocator mAllocator = VK_NULL_HANDLE;
+  std::vector<Page> mFree;
+};
+
+// A texture whose levels above the mip tail are bound to memory tile by tile
+// while the mip tail is bound as a whole. Images are shared by the transfer
+// and graphics queue families and stay in VK_IMAGE_LAYOUT_GENERAL, so that
+// tiles can be bound and uploaded while frames sample the rest of the image.
+// Tiles that are not bound read as zero, shaders must not sample them.
+class SparseTexture {
+public:
+  // record the creation of the image with its mip tail bound and in
+  // VK_IMAGE_LAYOUT_GENERAL, returns false if the format cannot be sparse on
+  // the device or the image has no level above its mip tail
+  bool Create(VkDevice device,
+              VmaAllocator allocator,
+              UploadBatcher& uploader,
+              uint32_t width,
+              uint32_t height,
+              uint32_t mipLevels,
+              VkFormat format);
+  void Cleanup(VkDevice device, VmaAllocator allocator);
+  bool IsCreated() const { return mImage != VK_NULL_HANDLE; }
+
+  VkImage GetImage() const { return mImage; }
+  VkImageView GetImageView() const { return mImageView; }
+  // first level of the mip tail
+  uint32_t GetMipTail() const { return mMipTail; }
+  // of the pages tiles are bound to
+  const VkMemoryRequirements& GetPageRequirements() const {
+    return mPageRequirements;
+  }
+  VkExtent2D GetLevelExtent(uint32_t level) const {
+    return {std::max(mWidth >> level, 1u), std::max(mHeight >> level, 1u)};
+  }
+  // in texels
+  VkExtent2D GetTileExtent() const { return mTileExtent; }
+  // tiles of a level above the mip tail
+  VkExtent2D GetTileCount(uint32_t level) const;
+
+  // bind a tile of a level above the mip tail to a page, or unbind it if
+  // page is null, ahead of the copies of the current batch
+  void BindTile(UploadBatcher& uploader,
+                uint32_t level,
+                uint32_t x,
+                uint32_t y,
+                VmaAllocation page) const;
+  // record the copy of a tile from levelData, the level in tightly packed
+  // rows of texel blocks, returns the number of bytes staged
+  VkDeviceSize UploadTile(UploadBatcher& uploader,
+                          uint32_t level,
+                          uint32_t x,
+                          uint32_t y,
+                          const uint8_t* levelData) const;
+  // same for a whole level, of the mip tail
+  VkDeviceSize UploadLevel(UploadBatcher& uploader,
+                           uint32_t level,
+                           const uint8_t* levelData) const;
+
+private:
+  VkDeviceSize Upload(UploadBatcher& uploader,
+                      uint32_t level,
+                      VkOffset2D offset,
+                      VkExtent2D extent,
+                      const uint8_t* levelData) const;
+
+  VmaAllocator mAllocator = VK_NULL_HANDLE;
+  VkImage mImage = VK_NULL_HANDLE;
+  VkImageView mImageView = VK_NULL_HANDLE;
+  VmaAllocation mMipTailMemory = VK_NULL_HANDLE;
+  uint32_t mWidth = 0;
+  uint32_t mHeight = 0;
+  uint32_t mMipLevels = 0;
+  uint32_t mMipTail = 0;
+  VkMemoryRequirements mPageRequirements{};
+  VkExtent2D mTileExtent{};
+  // texel block of the format
+  VkExtent2D mBlockExtent{1, 1};
+  uint32_t mBlockSize = 4;
+};
+
+}  // namespace hkr
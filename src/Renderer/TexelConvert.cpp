@@ -0,0 +1,186 @@
+#include "Renderer/TexelConvert.h"
+#include "Util/Assert.h"
+#include "Util/Simd.h"
+
+#include <cstring>
+
+namespace {
+
+// the simd kernels below return how many leading texels they expanded, the
+// rest is left to the scalar loop of the caller
+
+size_t ExpandGray([[maybe_unused]] const uint8_t* src,
+                  [[maybe_unused]] size_t n,
+                  [[maybe_unused]] uint8_t* dst) {
+  size_t i = 0;
+#if defined(HKR_SIMD_SSE2)
+  const __m128i opaque = _mm_set1_epi8(static_cast<char>(0xff));
+  for (; i + 16 <= n; i += 16) {
+    const __m128i g =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    // gg and g255 pairs, interleaved into gg g255 quads
+    const __m128i ggLo = _mm_unpacklo_epi8(g, g);
+    const __m128i ggHi = _mm_unpackhi_epi8(g, g);
+    const __m128i gaLo = _mm_unpacklo_epi8(g, opaque);
+    const __m128i gaHi = _mm_unpackhi_epi8(g, opaque);
+    __m128i* out = reinterpret_cast<__m128i*>(dst + i * 4);
+    _mm_storeu_si128(out, _mm_unpacklo_epi16(ggLo, gaLo));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(ggLo, gaLo));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(ggHi, gaHi));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(ggHi, gaHi));
+  }
+#elif defined(HKR_SIMD_NEON)
+  for (; i + 16 <= n; i += 16) {
+    const uint8x16_t g = vld1q_u8(src + i);
+    const uint8x16x4_t rgba = {g, g, g, vdupq_n_u8(0xff)};
+    vst4q_u8(dst + i * 4, rgba);
+  }
+#endif
+  return i;
+}
+
+size_t ExpandGrayAlpha([[maybe_unused]] const uint8_t* src,
+                       [[maybe_unused]] size_t n,
+                       [[maybe_unused]] uint8_t* dst) {
+  size_t i = 0;
+#if defined(HKR_SIMD_SSE2)
+  const __m128i lowByte = _mm_set1_epi16(0x00ff);
+  for (; i + 8 <= n; i += 8) {
+    // ga pairs as 16 bit lanes, interleaved with gg pairs into gg ga quads
+    const __m128i ga =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+    const __m128i g = _mm_and_si128(ga, lowByte);
+    const __m128i gg = _mm_or_si128(g, _mm_slli_epi16(g, 8));
+    __m128i* out = reinterpret_cast<__m128i*>(dst + i * 4);
+    _mm_storeu_si128(out, _mm_unpacklo_epi16(gg, ga));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(gg, ga));
+  }
+#elif defined(HKR_SIMD_NEON)
+  for (; i + 16 <= n; i += 16) {
+    const uint8x16x2_t ga = vld2q_u8(src + i * 2);
+    const uint8x16x4_t rgba = {ga.val[0], ga.val[0], ga.val[0], ga.val[1]};
+    vst4q_u8(dst + i * 4, rgba);
+  }
+#endif
+  return i;
+}
+
+#if defined(HKR_SIMD_SSE2)
+HKR_TARGET_SSSE3 size_t ExpandRGBShuffle(const uint8_t* src,
+                                         size_t n,
+                                         uint8_t* dst) {
+  size_t i = 0;
+  // 16 byte loads cover 5 1/3 texels, the last 4 bytes of each are unused
+  const __m128i shuffle =
+      _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const __m128i opaque = _mm_set1_epi32(static_cast<int>(0xff000000));
+  for (; i + 6 <= n; i += 4) {
+    const __m128i rgb =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4),
+                     _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), opaque));
+  }
+  return i;
+}
+#endif
+
+size_t ExpandRGB([[maybe_unused]] const uint8_t* src,
+                 [[maybe_unused]] size_t n,
+                 [[maybe_unused]] uint8_t* dst) {
+  size_t i = 0;
+#if defined(HKR_SIMD_SSE2)
+  if (hkr::HasSSSE3()) {
+    return ExpandRGBShuffle(src, n, dst);
+  }
+  // without byte shuffles texel k is moved into lane k by shifting the load
+  // left by k bytes, then masked to its 3 bytes
+  const __m128i lane0 = _mm_setr_epi32(0x00ffffff, 0, 0, 0);
+  const __m128i lane1 = _mm_setr_epi32(0, 0x00ffffff, 0, 0);
+  const __m128i lane2 = _mm_setr_epi32(0, 0, 0x00ffffff, 0);
+  const __m128i lane3 = _mm_setr_epi32(0, 0, 0, 0x00ffffff);
+  const __m128i opaque = _mm_set1_epi32(static_cast<int>(0xff000000));
+  for (; i + 6 <= n; i += 4) {
+    const __m128i rgb =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+    const __m128i texels01 =
+        _mm_or_si128(_mm_and_si128(rgb, lane0),
+                     _mm_and_si128(_mm_slli_si128(rgb, 1), lane1));
+    const __m128i texels23 =
+        _mm_or_si128(_mm_and_si128(_mm_slli_si128(rgb, 2), lane2),
+                     _mm_and_si128(_mm_slli_si128(rgb, 3), lane3));
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(dst + i * 4),
+        _mm_or_si128(_mm_or_si128(texels01, texels23), opaque));
+  }
+#elif defined(HKR_SIMD_NEON)
+  for (; i + 16 <= n; i += 16) {
+    const uint8x16x3_t rgb = vld3q_u8(src + i * 3);
+    const uint8x16x4_t rgba = {rgb.val[0], rgb.val[1], rgb.val[2],
+                               vdupq_n_u8(0xff)};
+    vst4q_u8(dst + i * 4, rgba);
+  }
+#endif
+  return i;
+}
+
+}  // namespace
+
+namespace hkr {
+
+void ConvertToRGBA8(const uint8_t* src,
+                    uint32_t components,
+                    uint32_t bits,
+                    size_t texelCount,
+                    uint8_t* dst) {
+  HKR_ASSERT(components >= 1 && components <= 4);
+  HKR_ASSERT(bits == 8 || bits == 16);
+  if (bits == 16) {
+    // little endian, the high byte comes second
+    for (size_t i = 0; i < texelCount; i++) {
+      const uint8_t* texel = src + i * components * 2;
+      uint8_t* out = dst + i * 4;
+      if (components < 3) {
+        out[0] = out[1] = out[2] = texel[1];
+        out[3] = components == 2 ? texel[3] : 0xff;
+      } else {
+        out[0] = texel[1];
+        out[1] = texel[3];
+        out[2] = texel[5];
+        out[3] = components == 4 ? texel[7] : 0xff;
+      }
+    }
+    return;
+  }
+
+  size_t i = 0;
+  switch (components) {
+    case 1:
+      i = ExpandGray(src, texelCount, dst);
+      for (; i < texelCount; i++) {
+        dst[i * 4] = dst[i * 4 + 1] = dst[i * 4 + 2] = src[i];
+        dst[i * 4 + 3] = 0xff;
+      }
+      break;
+    case 2:
+      i = ExpandGrayAlpha(src, texelCount, dst);
+      for (; i < texelCount; i++) {
+        dst[i * 4] = dst[i * 4 + 1] = dst[i * 4 + 2] = src[i * 2];
+        dst[i * 4 + 3] = src[i * 2 + 1];
+      }
+      break;
+    case 3:
+      i = ExpandRGB(src, texelCount, dst);
+      for (; i < texelCount; i++) {
+        dst[i * 4] = src[i * 3];
+        dst[i * 4 + 1] = src[i * 3 + 1];
+        dst[i * 4 + 2] = src[i * 3 + 2];
+        dst[i * 4 + 3] = 0xff;
+      }
+      break;
+    case 4:
+      memcpy(dst, src, texelCount * 4);
+      break;
+  }
+}
+
+}  // namespace hkr
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hkr {
+
+// Expand the 1-4 component texels glTF images decode to into the rgba8 the
+// gpu images use: gray is replicated into rgb and missing alpha is opaque.
+// 16 bit components keep their high byte. 8 bit gray, gray-alpha and rgb
+// texels are expanded with simd, rgba ones are copied as they are. dst needs
+// texelCount * 4 bytes and may be mapped staging memory.
+void ConvertToRGBA8(const uint8_t* src,
+                    uint32_t components,
+                    uint32_t bits,
+                    size_t texelCount,
+                    uint8_t* dst);
+
+}  // namespace hkr
@@ -0,0 +1,247 @@
+#include "Renderer/TextureCompress.h"
+#include "Util/Assert.h"
+#include "Util/ThreadPool.h"
+
+#include <bc7enc.h>
+#include <rgbcx.h>
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <utility>
+
+namespace {
+
+// VkFormat values, the cook tool is built without the vulkan headers
+constexpr uint32_t FORMAT_BC4_UNORM_BLOCK = 139;
+constexpr uint32_t FORMAT_BC5_UNORM_BLOCK = 141;
+constexpr uint32_t FORMAT_BC6H_UFLOAT_BLOCK = 143;
+constexpr uint32_t FORMAT_BC7_UNORM_BLOCK = 145;
+
+constexpr uint32_t BLOCK_DIM = 4;
+constexpr uint32_t BLOCK_TEXELS = BLOCK_DIM * BLOCK_DIM;
+
+// copy the texels of a block to 16 consecutive texels, texels past the right
+// or bottom edge repeat the last column or row
+template <size_t TexelSize>
+void GatherBlock(const uint8_t* texels,
+                 uint32_t width,
+                 uint32_t height,
+                 uint32_t blockX,
+                 uint32_t blockY,
+                 uint8_t* block) {
+  for (uint32_t y = 0; y < BLOCK_DIM; y++) {
+    const size_t row = std::min(blockY * BLOCK_DIM + y, height - 1);
+    for (uint32_t x = 0; x < BLOCK_DIM; x++) {
+      const size_t column = std::min(blockX * BLOCK_DIM + x, width - 1);
+      memcpy(block + (y * BLOCK_DIM + x) * TexelSize,
+             texels + (row * width + column) * TexelSize, TexelSize);
+    }
+  }
+}
+
+// bc6h interpolation weights of 4 bit indices
+constexpr int BC6H_WEIGHTS[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                  34, 38, 43, 47, 51, 55, 60, 64};
+
+// half bits to the 16 bit space unsigned bc6h interpolates in, the inverse
+// of the decoder's final (x * 31) >> 6. Negative values clamp to 0 and
+// infinities and nans to the largest finite half.
+int HalfToBC6H(uint16_t half) {
+  if (half & 0x8000) {
+    return 0;
+  }
+  const int h = std::min<int>(half, 0x7bff);
+  return (h * 64 + 30) / 31;
+}
+
+int Quantize10(int value) {
+  return (value * 1023 + 32767) / 65535;
+}
+
+int Unquantize10(int endpoint) {
+  if (endpoint == 0) {
+    return 0;
+  }
+  if (endpoint == 1023) {
+    return 0xffff;
+  }
+  return ((endpoint << 16) + 0x8000) >> 10;
+}
+
+class BlockWriter {
+public:
+  // bits are filled from the lowest bit of the first byte up
+  void Write(uint32_t value, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++, mPos++) {
+      if ((value >> i) & 1) {
+        mBytes[mPos >> 3] |= static_cast<uint8_t>(1u << (mPos & 7));
+      }
+    }
+  }
+  const uint8_t* GetBytes() const { return mBytes; }
+
+private:
+  uint8_t mBytes[16] = {};
+  uint32_t mPos = 0;
+};
+
+// Mode 11 only: one region with two 10 bit endpoints stored as they are and
+// 4 bit indices. Without partitions or delta coded endpoints it is the
+// simplest of the modes, which suits the smooth gradients of skies. The
+// endpoints span the bounding box of the block along the diagonal that
+// follows the correlation of the channels with the widest one.
+void EncodeBC6HBlock(const uint16_t* texels, uint8_t* dst) {
+  int values[BLOCK_TEXELS][3];
+  int lo[3] = {0xffff, 0xffff, 0xffff};
+  int hi[3] = {0, 0, 0};
+  int64_t sum[3] = {0, 0, 0};
+  for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+    for (int c = 0; c < 3; c++) {
+      values[i][c] = HalfToBC6H(texels[i * 4 + c]);
+      lo[c] = std::min(lo[c], values[i][c]);
+      hi[c] = std::max(hi[c], values[i][c]);
+      sum[c] += values[i][c];
+    }
+  }
+  int widest = 0;
+  for (int c = 1; c < 3; c++) {
+    if (hi[c] - lo[c] > hi[widest] - lo[widest]) {
+      widest = c;
+    }
+  }
+  for (int c = 0; c < 3; c++) {
+    int64_t covariance = 0;
+    for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+      covariance += (values[i][widest] * 16 - sum[widest]) *
+                    (values[i][c] * 16 - sum[c]);
+    }
+    if (covariance < 0) {
+      std::swap(lo[c], hi[c]);
+    }
+  }
+
+  int endpoints[2][3];
+  int unquantized[2][3];
+  for (int c = 0; c < 3; c++) {
+    endpoints[0][c] = Quantize10(lo[c]);
+    endpoints[1][c] = Quantize10(hi[c]);
+    unquantized[0][c] = Unquantize10(endpoints[0][c]);
+    unquantized[1][c] = Unquantize10(endpoints[1][c]);
+  }
+  uint32_t indices[BLOCK_TEXELS];
+  for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+    int64_t bestError = INT64_MAX;
+    for (uint32_t k = 0; k < 16; k++) {
+      const int w = BC6H_WEIGHTS[k];
+      int64_t error = 0;
+      for (int c = 0; c < 3; c++) {
+        const int64_t d =
+            (((64 - w) * unquantized[0][c] + w * unquantized[1][c] + 32) >>
+             6) -
+            values[i][c];
+        error += d * d;
+      }
+      if (error < bestError) {
+        bestError = error;
+        indices[i] = k;
+      }
+    }
+  }
+  // the highest bit of the first index is implicitly 0
+  if (indices[0] & 8) {
+    std::swap(endpoints[0], endpoints[1]);
+    for (uint32_t& index : indices) {
+      index = 15 - index;
+    }
+  }
+
+  BlockWriter writer;
+  writer.Write(0x03, 5);
+  for (int e = 0; e < 2; e++) {
+    for (int c = 0; c < 3; c++) {
+      writer.Write(static_cast<uint32_t>(endpoints[e][c]), 10);
+    }
+  }
+  writer.Write(indices[0], 3);
+  for (uint32_t i = 1; i < BLOCK_TEXELS; i++) {
+    writer.Write(indices[i], 4);
+  }
+  memcpy(dst, writer.GetBytes(), 16);
+}
+
+}  // namespace
+
+namespace hkr {
+
+uint32_t GetBlockVkFormat(BlockFormat format) {
+  switch (format) {
+    case BlockFormat::BC4:
+      return FORMAT_BC4_UNORM_BLOCK;
+    case BlockFormat::BC5:
+      return FORMAT_BC5_UNORM_BLOCK;
+    case BlockFormat::BC6H:
+      return FORMAT_BC6H_UFLOAT_BLOCK;
+    case BlockFormat::BC7:
+      return FORMAT_BC7_UNORM_BLOCK;
+  }
+  return 0;
+}
+
+uint32_t GetBlockSize(BlockFormat format) {
+  return format == BlockFormat::BC4 ? 8 : 16;
+}
+
+size_t GetCompressedSize(BlockFormat format, uint32_t width, uint32_t height) {
+  const size_t blocksX = (width + BLOCK_DIM - 1) / BLOCK_DIM;
+  const size_t blocksY = (height + BLOCK_DIM - 1) / BLOCK_DIM;
+  return blocksX * blocksY * GetBlockSize(format);
+}
+
+void CompressImage(BlockFormat format,
+                   const void* texels,
+                   uint32_t width,
+                   uint32_t height,
+                   uint8_t* dst,
+                   ThreadPool& threadPool) {
+  static std::once_flag initFlag;
+  static bc7enc_compress_block_params bc7Params;
+  std::call_once(initFlag, [] {
+    bc7enc_compress_block_init();
+    bc7enc_compress_block_params_init(&bc7Params);
+    rgbcx::init();
+  });
+
+  const uint8_t* src = static_cast<const uint8_t*>(texels);
+  const uint32_t blocksX = (width + BLOCK_DIM - 1) / BLOCK_DIM;
+  const uint32_t blocksY = (height + BLOCK_DIM - 1) / BLOCK_DIM;
+  const uint32_t blockSize = GetBlockSize(format);
+  threadPool.ParallelFor(blocksY, [&](uint32_t blockY) {
+    uint8_t block[BLOCK_TEXELS * 8];
+    for (uint32_t blockX = 0; blockX < blocksX; blockX++) {
+      uint8_t* out =
+          dst + (static_cast<size_t>(blockY) * blocksX + blockX) * blockSize;
+      if (format == BlockFormat::BC6H) {
+        GatherBlock<8>(src, width, height, blockX, blockY, block);
+        EncodeBC6HBlock(reinterpret_cast<const uint16_t*>(block), out);
+        continue;
+      }
+      GatherBlock<4>(src, width, height, blockX, blockY, block);
+      switch (format) {
+        case BlockFormat::BC4:
+          rgbcx::encode_bc4(out, block, 4);
+          break;
+        case BlockFormat::BC5:
+          rgbcx::encode_bc5(out, block, 0, 1, 4);
+          break;
+        case BlockFormat::BC7:
+          bc7enc_compress_block(out, block, &bc7Params);
+          break;
+        default:
+          HKR_ASSERT(0);
+      }
+    }
+  });
+}
+
+}  // namespace hkr
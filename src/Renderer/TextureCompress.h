@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hkr {
+
+class ThreadPool;
+
+// block compressed formats written by the cook step, all of them store 4x4
+// texel blocks
+enum class BlockFormat : uint32_t {
+  // r of rgba8 texels, 8 bytes per block
+  BC4,
+  // rg of rgba8 texels
+  BC5,
+  // rgb of rgba16f texels, unsigned
+  BC6H,
+  // rgba8 texels
+  BC7,
+};
+
+// VkFormat of the blocks, as written to ktx2 files
+uint32_t GetBlockVkFormat(BlockFormat format);
+uint32_t GetBlockSize(BlockFormat format);
+size_t GetCompressedSize(BlockFormat format, uint32_t width, uint32_t height);
+
+// compress one image into its blocks, row by row. Blocks overhanging the
+// right or bottom edge repeat the last column or row. Rows of blocks are
+// compressed in parallel on the thread pool.
+void CompressImage(BlockFormat format,
+                   const void* texels,
+                   uint32_t width,
+                   uint32_t height,
+                   uint8_t* dst,
+                   ThreadPool& threadPool);
+
+}  // namespace hkr
@@ -0,0 +1,112 @@
+#include "Renderer/TextureFeedback.h"
+#include "Util/vk_util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// encoding of shaders/feedback.glsl
+constexpr float LOD_OFFSET = 32.0f;
+constexpr float LOD_SCALE = 16.0f;
+
+}  // namespace
+
+namespace hkr {
+
+void TextureFeedback::Create(VmaAllocator allocator, uint32_t textureCount) {
+  mAllocator = allocator;
+  mTextureCount = textureCount;
+  // buffers are not empty even without textures
+  const VkDeviceSize cellCount =
+      VkDeviceSize{std::max(textureCount, 1u)} * CELL_COUNT;
+  for (auto& buffer : mBuffers) {
+    buffer.Create(allocator,
+                  VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+                  cellCount * sizeof(uint32_t),
+                  VK_BUFFER_USAGE_2_STORAGE_BUFFER_BIT |
+                      VK_BUFFER_USAGE_2_TRANSFER_DST_BIT);
+    buffer.Map(allocator);
+  }
+  mRecorded = {};
+  // written sequentially, read by the shaders straight from host memory
+  mResidency.assign(cellCount, 0);
+  for (auto& buffer : mResidencyBuffers) {
+    buffer.Create(allocator,
+                  VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+                  cellCount, VK_BUFFER_USAGE_2_STORAGE_BUFFER_BIT);
+    buffer.Map(allocator);
+    memset(buffer.map, 0, cellCount);
+    vmaFlushAllocation(allocator, buffer.allocation, 0, VK_WHOLE_SIZE);
+  }
+  mResidencyVersion = 0;
+  mResidencyVersions = {};
+}
+
+void TextureFeedback::Cleanup(VmaAllocator allocator) {
+  if (!IsCreated()) {
+    return;
+  }
+  for (auto& buffer : mBuffers) {
+    buffer.Unmap(allocator);
+    buffer.Cleanup(allocator);
+  }
+  for (auto& buffer : mResidencyBuffers) {
+    buffer.Unmap(allocator);
+    buffer.Cleanup(allocator);
+  }
+  mResidency.clear();
+  mTextureCount = 0;
+}
+
+void TextureFeedback::Begin(VkCommandBuffer commandBuffer,
+                            uint32_t currentFrame) {
+  // the previous frame in this slot has finished reading it
+  if (mResidencyVersions[currentFrame] != mResidencyVersion) {
+    MappableBuffer& buffer = mResidencyBuffers[currentFrame];
+    memcpy(buffer.map, mResidency.data(), mResidency.size());
+    vmaFlushAllocation(mAllocator, buffer.allocation, 0, VK_WHOLE_SIZE);
+    mResidencyVersions[currentFrame] = mResidencyVersion;
+  }
+  vkCmdFillBuffer(commandBuffer, mBuffers[currentFrame].buffer, 0,
+                  VK_WHOLE_SIZE, NO_REQUEST);
+  InsertMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                      VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+                          VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR,
+                      VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                      VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                          VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+}
+
+void TextureFeedback::End(VkCommandBuffer commandBuffer,
+                          uint32_t currentFrame) {
+  InsertMemoryBarrier(commandBuffer,
+                      VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+                          VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR,
+                      VK_PIPELINE_STAGE_2_HOST_BIT,
+                      VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                      VK_ACCESS_2_HOST_READ_BIT);
+  mRecorded[currentFrame] = true;
+}
+
+std::span<const uint32_t> TextureFeedback::Read(uint32_t currentFrame) {
+  if (!IsCreated() || !mRecorded[currentFrame]) {
+    return {};
+  }
+  mRecorded[currentFrame] = false;
+  // host cached memory need not be coherent
+  vmaInvalidateAllocation(mAllocator, mBuffers[currentFrame].allocation, 0,
+                          VK_WHOLE_SIZE);
+  return {static_cast<const uint32_t*>(mBuffers[currentFrame].map),
+          size_t{mTextureCount} * CELL_COUNT};
+}
+
+float TextureFeedback::DecodeLod(uint32_t request,
+                                 uint32_t width,
+                                 uint32_t height) {
+  const float uvLod = static_cast<float>(request) / LOD_SCALE - LOD_OFFSET;
+  return uvLod + std::log2(static_cast<float>(std::max(width, height)));
+}
+
+}  // namespace hkr
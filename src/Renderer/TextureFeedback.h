@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Renderer/Buffer.h"
+#include "Renderer/Common.h"
+
+#include <volk.h>
+#include <vk_mem_alloc.h>
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace hkr {
+
+// Level of detail requests of the shaders for texture streaming, and the
+// resident levels they clamp sampling to. Textures are split into a grid of
+// cells in uv space (see shaders/feedback.glsl). Every frame in flight has a
+// host visible buffer with one uint per cell that the shaders atomicMin the
+// level of detail they sample the cell at into, the buffer is cleared when the
+// frame is recorded and read back once its fence has signaled. It also has a
+// buffer with the finest resident level around each cell, one byte per cell,
+// copied from the one kept here when the frame is recorded.
+class TextureFeedback {
+public:
+  // no shader sampled the cell in the frame
+  static constexpr uint32_t NO_REQUEST = UINT32_MAX;
+  // of shaders/feedback.glsl
+  static constexpr uint32_t GRID_SIZE = 32;
+  static constexpr uint32_t CELL_COUNT = GRID_SIZE * GRID_SIZE;
+
+  void Create(VmaAllocator allocator, uint32_t textureCount);
+  void Cleanup(VmaAllocator allocator);
+  bool IsCreated() const { return !mResidency.empty(); }
+
+  // record the clear of the feedback buffer of the frame before the shaders
+  // write it and update its residency buffer
+  void Begin(VkCommandBuffer commandBuffer, uint32_t currentFrame);
+  // make the writes of the frame visible to the host
+  void End(VkCommandBuffer commandBuffer, uint32_t currentFrame);
+  // requests of the last frame recorded in this slot, CELL_COUNT per texture,
+  // empty if there is none. The fence of the frame must have signaled.
+  std::span<const uint32_t> Read(uint32_t currentFrame);
+  VkBuffer GetBuffer(uint32_t currentFrame) const {
+    return mBuffers[currentFrame].buffer;
+  }
+
+  // finest resident level around every cell of a texture, levels of the
+  // image views, 0 until set
+  std::span<uint8_t> GetResidency(uint32_t textureIndex) {
+    mResidencyVersion++;
+    return {mResidency.data() + size_t{textureIndex} * CELL_COUNT, CELL_COUNT};
+  }
+  VkBuffer GetResidencyBuffer(uint32_t currentFrame) const {
+    return mResidencyBuffers[currentFrame].buffer;
+  }
+
+  // level of detail of a request in a texture of the given size, the shaders
+  // write it in uv space so that it does not depend on the resident levels
+  static float DecodeLod(uint32_t request, uint32_t width, uint32_t height);
+
+private:
+  VmaAllocator mAllocator = VK_NULL_HANDLE;
+  uint32_t mTextureCount = 0;
+  std::array<MappableBuffer, MAX_FRAMES_IN_FLIGHT> mBuffers;
+  std::array<bool, MAX_FRAMES_IN_FLIGHT> mRecorded{};
+  std::vector<uint8_t> mResidency;
+  uint64_t mResidencyVersion = 0;
+  std::array<MappableBuffer, MAX_FRAMES_IN_FLIGHT> mResidencyBuffers;
+  // residency version each frame buffer holds
+  std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> mResidencyVersions{};
+};
+
+}  // namespace hkr
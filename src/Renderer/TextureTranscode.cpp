@@ -0,0 +1,154 @@
+#include "Renderer/TextureTranscode.h"
+#include "Util/AssetPack.h"
+
+#include <ktx.h>
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+bool IsSampleable(VkPhysicalDevice physicalDevice, VkFormat format) {
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+  return properties.optimalTilingFeatures &
+         VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+}
+
+// One and two component textures (occlusion, roughness, normal maps) keep
+// their own block formats where there is one. Two component textures are
+// normal maps with y in alpha: the rg formats move it to green, where the
+// shaders read it, and astc, which would keep it in alpha, is skipped for
+// them.
+ktx_transcode_fmt_e SelectTranscodeFormat(
+    const hkr::TextureFormatSupport& support,
+    uint32_t componentCount) {
+  if (support.bc) {
+    if (componentCount == 1) {
+      return KTX_TTF_BC4_R;
+    }
+    if (componentCount == 2) {
+      return KTX_TTF_BC5_RG;
+    }
+    return KTX_TTF_BC7_RGBA;
+  }
+  if (support.etc2 && componentCount == 2) {
+    return KTX_TTF_ETC2_EAC_RG11;
+  }
+  if (support.astc && componentCount != 2) {
+    return KTX_TTF_ASTC_4x4_RGBA;
+  }
+  if (support.etc2) {
+    if (componentCount == 1) {
+      return KTX_TTF_ETC2_EAC_R11;
+    }
+    return KTX_TTF_ETC2_RGBA;
+  }
+  return KTX_TTF_RGBA32;
+}
+
+hkr::KtxTexturePtr Transcode(ktxTexture2* texture,
+                             const hkr::TextureFormatSupport& support,
+                             std::string& err) {
+  hkr::KtxTexturePtr result(texture);
+  if (!ktxTexture2_NeedsTranscoding(texture)) {
+    return result;
+  }
+  const uint32_t componentCount = ktxTexture2_GetNumComponents(texture);
+  const ktx_transcode_fmt_e format =
+      SelectTranscodeFormat(support, componentCount);
+  const KTX_error_code code = ktxTexture2_TranscodeBasis(texture, format, 0);
+  if (code != KTX_SUCCESS) {
+    err = std::string("cannot transcode texture: ") + ktxErrorString(code);
+    return nullptr;
+  }
+  // rgba8 normal maps get y copied from alpha to green
+  if (format == KTX_TTF_RGBA32 && componentCount == 2) {
+    for (ktx_size_t i = 0; i + 4 <= texture->dataSize; i += 4) {
+      texture->pData[i + 1] = texture->pData[i + 3];
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+namespace hkr {
+
+TextureFormatSupport QueryTextureFormatSupport(
+    VkPhysicalDevice physicalDevice,
+    uint32_t sparseQueueFamilyIndex) {
+  VkPhysicalDeviceFeatures features;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+  TextureFormatSupport support;
+  support.bc = features.textureCompressionBC &&
+               IsSampleable(physicalDevice, VK_FORMAT_BC7_UNORM_BLOCK) &&
+               IsSampleable(physicalDevice, VK_FORMAT_BC5_UNORM_BLOCK) &&
+               IsSampleable(physicalDevice, VK_FORMAT_BC4_UNORM_BLOCK);
+  support.astc = features.textureCompressionASTC_LDR &&
+                 IsSampleable(physicalDevice, VK_FORMAT_ASTC_4x4_UNORM_BLOCK);
+  support.etc2 =
+      features.textureCompressionETC2 &&
+      IsSampleable(physicalDevice, VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK) &&
+      IsSampleable(physicalDevice, VK_FORMAT_EAC_R11G11_UNORM_BLOCK) &&
+      IsSampleable(physicalDevice, VK_FORMAT_EAC_R11_UNORM_BLOCK);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount,
+                                           nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount,
+                                           queueFamilies.data());
+  support.sparseResidency =
+      features.sparseBinding && features.sparseResidencyImage2D &&
+      properties.sparseProperties.residencyStandard2DBlockShape &&
+      sparseQueueFamilyIndex < queueFamilyCount &&
+      (queueFamilies[sparseQueueFamilyIndex].queueFlags &
+       VK_QUEUE_SPARSE_BINDING_BIT);
+  return support;
+}
+
+void KtxTextureDeleter::operator()(ktxTexture2* texture) const {
+  ktxTexture2_Destroy(texture);
+}
+
+KtxTexturePtr LoadKtxTexture(const std::string& fileName,
+                             const TextureFormatSupport& support,
+                             std::string& err) {
+  // the image data is copied out of the file, the texture outlives it
+  AssetFile file;
+  ktxTexture2* texture = nullptr;
+  if (!file.Open(fileName) ||
+      ktxTexture2_CreateFromMemory(file.GetData(), file.GetSize(),
+                                   KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT,
+                                   &texture) != KTX_SUCCESS) {
+    err = "cannot read texture: " + fileName;
+    return nullptr;
+  }
+  return Transcode(texture, support, err);
+}
+
+KtxTexturePtr LoadKtxTexture(const uint8_t* bytes,
+                             size_t size,
+                             const TextureFormatSupport& support,
+                             std::string& err) {
+  ktxTexture2* texture = nullptr;
+  if (ktxTexture2_CreateFromMemory(bytes, size,
+                                   KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT,
+                                   &texture) != KTX_SUCCESS) {
+    err = "cannot read embedded texture";
+    return nullptr;
+  }
+  return Transcode(texture, support, err);
+}
+
+bool IsKtx2(const uint8_t* bytes, size_t size) {
+  static constexpr uint8_t IDENTIFIER[12] = {0xab, 'K',  'T',  'X', ' ',  '2',
+                                             '0',  0xbb, '\r', '\n', 0x1a, '\n'};
+  return size >= sizeof(IDENTIFIER) &&
+         memcmp(bytes, IDENTIFIER, sizeof(IDENTIFIER)) == 0;
+}
+
+}  // namespace hkr
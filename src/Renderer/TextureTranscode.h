@@ -0,0 +1,50 @@
+#pragma once
+
+#include <volk.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct ktxTexture2;
+
+namespace hkr {
+
+// block compressed formats the device can sample, queried once on the render
+// thread and read by the loader threads
+struct TextureFormatSupport {
+  bool bc = false;
+  bool astc = false;
+  bool etc2 = false;
+  // 2d images can be partially resident with the standard tile shapes and the
+  // queue family of sparseQueueFamilyIndex binds their memory
+  bool sparseResidency = false;
+};
+
+TextureFormatSupport QueryTextureFormatSupport(VkPhysicalDevice physicalDevice,
+                                               uint32_t sparseQueueFamilyIndex);
+
+struct KtxTextureDeleter {
+  void operator()(ktxTexture2* texture) const;
+};
+using KtxTexturePtr = std::unique_ptr<ktxTexture2, KtxTextureDeleter>;
+
+// Load a ktx2 texture with its image data. UASTC and ETC1S (Basis Universal,
+// KHR_texture_basisu) textures are transcoded to the best block format the
+// device supports: bc7/bc5/bc4, astc 4x4, etc2/eac, in that order, rgba8
+// otherwise. Two component normal maps always get x and y in red and green,
+// the shaders rebuild z. Runs on the loader threads. Returns null and fills
+// err on failure.
+KtxTexturePtr LoadKtxTexture(const std::string& fileName,
+                             const TextureFormatSupport& support,
+                             std::string& err);
+KtxTexturePtr LoadKtxTexture(const uint8_t* bytes,
+                             size_t size,
+                             const TextureFormatSupport& support,
+                             std::string& err);
+
+// whether the bytes start with the ktx2 identifier
+bool IsKtx2(const uint8_t* bytes, size_t size);
+
+}  // namespace hkr
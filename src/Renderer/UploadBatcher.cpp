@@ -0,0 +1,528 @@
+#include "Renderer/UploadBatcher.h"
+#include "Util/vk_debug.h"
+#include "Util/vk_util.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+VkCommandPool CreateCommandPool(VkDevice device, uint32_t queueFamilyIndex) {
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT |
+                   VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  poolInfo.queueFamilyIndex = queueFamilyIndex;
+  VkCommandPool commandPool;
+  VK_CHECK(vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool));
+  return commandPool;
+}
+
+void PipelineBarrier(VkCommandBuffer commandBuffer,
+                     const VkBufferMemoryBarrier2* bufferBarrier,
+                     const VkImageMemoryBarrier2* imageBarrier) {
+  VkDependencyInfo dependencyInfo{};
+  dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  dependencyInfo.bufferMemoryBarrierCount = bufferBarrier ? 1 : 0;
+  dependencyInfo.pBufferMemoryBarriers = bufferBarrier;
+  dependencyInfo.imageMemoryBarrierCount = imageBarrier ? 1 : 0;
+  dependencyInfo.pImageMemoryBarriers = imageBarrier;
+  vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+}
+
+}  // namespace
+
+namespace hkr {
+
+void UploadBatcher::Init(VkDevice device,
+                         VmaAllocator allocator,
+                         VkQueue transferQueue,
+                         uint32_t transferFamilyIndex,
+                         VkQueue graphicsQueue,
+                         uint32_t graphicsFamilyIndex,
+                         VkDeviceSize ringSize) {
+  mDevice = device;
+  mAllocator = allocator;
+  mTransferQueue = transferQueue;
+  mTransferFamilyIndex = transferFamilyIndex;
+  mGraphicsQueue = graphicsQueue;
+  mGraphicsFamilyIndex = graphicsFamilyIndex;
+  mQueueFamilyIndices = {mTransferFamilyIndex, mGraphicsFamilyIndex};
+  mRingSize = ringSize;
+
+  mTransferCommandPool = CreateCommandPool(mDevice, mTransferFamilyIndex);
+  if (HasDedicatedTransferQueue()) {
+    mGraphicsCommandPool = CreateCommandPool(mDevice, mGraphicsFamilyIndex);
+  }
+
+  VkSemaphoreTypeCreateInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  timelineInfo.initialValue = 0;
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = &timelineInfo;
+  VK_CHECK(vkCreateSemaphore(mDevice, &semaphoreInfo, nullptr, &mTimeline));
+
+  // map the ring for the whole lifetime of the batcher
+  mRing.Create(mAllocator, mRingSize);
+  mRing.Map(mAllocator);
+}
+
+void UploadBatcher::Cleanup() {
+  Flush();
+  mRing.Unmap(mAllocator);
+  mRing.Cleanup(mAllocator);
+  vkDestroySemaphore(mDevice, mTimeline, nullptr);
+  vkDestroyCommandPool(mDevice, mTransferCommandPool, nullptr);
+  if (mGraphicsCommandPool != VK_NULL_HANDLE) {
+    vkDestroyCommandPool(mDevice, mGraphicsCommandPool, nullptr);
+  }
+}
+
+UploadBatcher::Allocation UploadBatcher::Allocate(VkDeviceSize size,
+                                                  VkDeviceSize alignment) {
+  // too large for the ring, fall back to a dedicated staging buffer that is
+  // destroyed once the batch retires
+  if (size > mRingSize) {
+    StagingBuffer staging;
+    staging.Create(mAllocator, size);
+    staging.Map(mAllocator);
+    mCurrent.dedicated.push_back(staging.allocation);
+    Defer([allocator = mAllocator, staging]() mutable {
+      staging.Unmap(allocator);
+      staging.Cleanup(allocator);
+    });
+    return Allocation{staging.buffer, 0, staging.map};
+  }
+
+  VkDeviceSize offset = AlignUp(mHead, alignment);
+  // do not straddle the end of the ring, skip to the start of the next lap
+  if (offset % mRingSize + size > mRingSize) {
+    offset = AlignUp(offset, mRingSize);
+  }
+  // ring is full, recycle memory of the oldest batches
+  while (offset + size - mTail > mRingSize) {
+    if (mInFlight.empty()) {
+      if (mCurrent.transferCommandBuffer == VK_NULL_HANDLE) {
+        // nothing references the ring anymore
+        mTail = mHead;
+        break;
+      }
+      Submit();
+    }
+    RetireOldest();
+  }
+  mHead = offset + size;
+
+  Allocation allocation;
+  allocation.buffer = mRing.buffer;
+  allocation.offset = offset % mRingSize;
+  allocation.data = static_cast<char*>(mRing.map) + allocation.offset;
+  return allocation;
+}
+
+VkCommandBuffer UploadBatcher::GetCommandBuffer() {
+  if (mCurrent.transferCommandBuffer == VK_NULL_HANDLE) {
+    mCurrent.transferCommandBuffer =
+        BeginCommandBuffer(mTransferCommandPool, mFreeTransferCommandBuffers);
+  }
+  return mCurrent.transferCommandBuffer;
+}
+
+VkCommandBuffer UploadBatcher::GetGraphicsCommandBuffer() {
+  if (!HasDedicatedTransferQueue()) {
+    return GetCommandBuffer();
+  }
+  if (mCurrent.graphicsCommandBuffer == VK_NULL_HANDLE) {
+    mCurrent.graphicsCommandBuffer =
+        BeginCommandBuffer(mGraphicsCommandPool, mFreeGraphicsCommandBuffers);
+  }
+  return mCurrent.graphicsCommandBuffer;
+}
+
+void UploadBatcher::UploadBuffer(VkBuffer dst,
+                                 const void* data,
+                                 VkDeviceSize size,
+                                 VkDeviceSize dstOffset) {
+  Allocation staging = Allocate(size);
+  memcpy(staging.data, data, size);
+  CopyBufferToBuffer(GetCommandBuffer(), staging.buffer, dst, size,
+                     staging.offset, dstOffset);
+  TransferBuffer(dst, dstOffset, size);
+}
+
+void UploadBatcher::TransferBuffer(VkBuffer buffer,
+                                   VkDeviceSize offset,
+                                   VkDeviceSize size) {
+  VkBufferMemoryBarrier2 barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = buffer;
+  barrier.offset = offset;
+  barrier.size = size;
+
+  if (!HasDedicatedTransferQueue()) {
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    barrier.dstAccessMask =
+        VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+    PipelineBarrier(GetCommandBuffer(), &barrier, nullptr);
+    return;
+  }
+
+  // the buffer is shared by both queue families, ranges of it are written
+  // batch after batch while the graphics queue reads the others, which an
+  // ownership transfer of the whole buffer could not express. The semaphore
+  // wait makes the writes available to the graphics command buffer and the
+  // barrier to the frames after it.
+  barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+  barrier.srcAccessMask = VK_ACCESS_2_NONE;
+  barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+  barrier.dstAccessMask =
+      VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+  PipelineBarrier(GetGraphicsCommandBuffer(), &barrier, nullptr);
+}
+
+void UploadBatcher::TransferImage(
+    VkImage image,
+    VkImageLayout oldLayout,
+    VkImageLayout newLayout,
+    const VkImageSubresourceRange& subresourceRange) {
+  VkImageMemoryBarrier2 barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.oldLayout = oldLayout;
+  barrier.newLayout = newLayout;
+  barrier.image = image;
+  barrier.subresourceRange = subresourceRange;
+
+  if (!HasDedicatedTransferQueue()) {
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    barrier.dstAccessMask =
+        VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+    PipelineBarrier(GetCommandBuffer(), nullptr, &barrier);
+    return;
+  }
+
+  // the layout transition happens once, between release and acquire
+  barrier.srcQueueFamilyIndex = mTransferFamilyIndex;
+  barrier.dstQueueFamilyIndex = mGraphicsFamilyIndex;
+  barrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+  barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+  barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+  barrier.dstAccessMask = VK_ACCESS_2_NONE;
+  PipelineBarrier(GetCommandBuffer(), nullptr, &barrier);
+
+  barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+  barrier.srcAccessMask = VK_ACCESS_2_NONE;
+  barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+  barrier.dstAccessMask =
+      VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+  PipelineBarrier(GetGraphicsCommandBuffer(), nullptr, &barrier);
+}
+
+void UploadBatcher::TransferSharedImage(
+    VkImage image,
+    const VkImageSubresourceRange& subresourceRange) {
+  VkImageMemoryBarrier2 barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.image = image;
+  barrier.subresourceRange = subresourceRange;
+  barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+  barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+
+  if (!HasDedicatedTransferQueue()) {
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    PipelineBarrier(GetCommandBuffer(), nullptr, &barrier);
+    return;
+  }
+
+  // no ownership to transfer, the semaphore wait makes the writes available
+  // to the graphics command buffer and the barrier to the frames after it
+  barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+  barrier.srcAccessMask = VK_ACCESS_2_NONE;
+  PipelineBarrier(GetGraphicsCommandBuffer(), nullptr, &barrier);
+}
+
+void UploadBatcher::BindSparse(VkImage image,
+                               const VkSparseImageMemoryBind& bind) {
+  GetSparseBinds(image).imageBinds.push_back(bind);
+}
+
+void UploadBatcher::BindSparse(VkImage image, const VkSparseMemoryBind& bind) {
+  GetSparseBinds(image).opaqueBinds.push_back(bind);
+}
+
+void UploadBatcher::Defer(std::function<void()>&& func) {
+  // make sure the work is tied to a batch that will be submitted
+  GetCommandBuffer();
+  mCurrent.deferred.push_back(std::move(func));
+}
+
+uint64_t UploadBatcher::Submit() {
+  VkCommandBuffer transferCommandBuffer = mCurrent.transferCommandBuffer;
+  VkCommandBuffer graphicsCommandBuffer = mCurrent.graphicsCommandBuffer;
+  if (transferCommandBuffer == VK_NULL_HANDLE &&
+      graphicsCommandBuffer == VK_NULL_HANDLE &&
+      mCurrent.sparseBinds.empty()) {
+    return mLastSubmitted;
+  }
+
+  // a sparse bind must not wait on the graphics queue for a graphics command
+  // buffer that is only submitted after it
+  if (!mCurrent.sparseBinds.empty()) {
+    SubmitPendingGraphics(mLastSubmitted, true);
+  }
+
+  // no-op for host coherent memory
+  vmaFlushAllocation(mAllocator, mRing.allocation, 0, VK_WHOLE_SIZE);
+  for (VmaAllocation allocation : mCurrent.dedicated) {
+    vmaFlushAllocation(mAllocator, allocation, 0, VK_WHOLE_SIZE);
+  }
+
+  // every submission of a batch, sparse binds, transfer and graphics command
+  // buffers in that order, waits for the timeline value the previous one
+  // signals and signals the next one, the last one is the value the batch is
+  // tracked by. The first one waits for the previous batch so that the values
+  // are signaled in order and a batch never retires ahead of an earlier one,
+  // even while the graphics command buffer of the previous batch has not been
+  // submitted yet.
+  uint64_t value = mLastSubmitted;
+  uint64_t waitValue = mLastSubmitted;
+  if (!mCurrent.sparseBinds.empty()) {
+    SubmitSparseBinds(waitValue, ++value);
+    waitValue = value;
+  }
+  if (transferCommandBuffer != VK_NULL_HANDLE) {
+    VK_CHECK(vkEndCommandBuffer(transferCommandBuffer));
+    SubmitCommandBuffer(mTransferQueue, transferCommandBuffer, waitValue,
+                        ++value);
+    waitValue = value;
+  }
+  mCurrent.transferValue = value;
+  if (graphicsCommandBuffer != VK_NULL_HANDLE) {
+    VK_CHECK(vkEndCommandBuffer(graphicsCommandBuffer));
+    mCurrent.graphicsPending = true;
+    ++value;
+  }
+  mCurrent.value = value;
+  mCurrent.ringEnd = mHead;
+  mLastSubmitted = mCurrent.value;
+
+  mInFlight.push_back(std::move(mCurrent));
+  mCurrent = Batch{};
+  SubmitPendingGraphics(mLastSubmitted, false);
+  return mLastSubmitted;
+}
+
+void UploadBatcher::SubmitGraphics(uint64_t value) {
+  SubmitPendingGraphics(value, true);
+}
+
+void UploadBatcher::Flush() {
+  Submit();
+  while (!mInFlight.empty()) {
+    RetireOldest();
+  }
+}
+
+void UploadBatcher::Wait(uint64_t value) {
+  SubmitPendingGraphics(value, true);
+  WaitTimeline(value);
+}
+
+bool UploadBatcher::IsComplete(uint64_t value) {
+  uint64_t completed = 0;
+  VK_CHECK(vkGetSemaphoreCounterValue(mDevice, mTimeline, &completed));
+  return completed >= value;
+}
+
+void UploadBatcher::Collect() {
+  if (mInFlight.empty()) {
+    return;
+  }
+  SubmitPendingGraphics(mLastSubmitted, false);
+  uint64_t completed = 0;
+  VK_CHECK(vkGetSemaphoreCounterValue(mDevice, mTimeline, &completed));
+  while (!mInFlight.empty() && mInFlight.front().value <= completed) {
+    Retire(mInFlight.front());
+    mInFlight.pop_front();
+  }
+}
+
+VkCommandBuffer UploadBatcher::BeginCommandBuffer(
+    VkCommandPool commandPool,
+    std::vector<VkCommandBuffer>& freeList) {
+  VkCommandBuffer commandBuffer;
+  if (!freeList.empty()) {
+    commandBuffer = freeList.back();
+    freeList.pop_back();
+  } else {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    VK_CHECK(vkAllocateCommandBuffers(mDevice, &allocInfo, &commandBuffer));
+  }
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+  return commandBuffer;
+}
+
+void UploadBatcher::SubmitCommandBuffer(VkQueue queue,
+                                        VkCommandBuffer commandBuffer,
+                                        uint64_t waitValue,
+                                        uint64_t signalValue) {
+  VkCommandBufferSubmitInfo commandInfo{};
+  commandInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+  commandInfo.commandBuffer = commandBuffer;
+  commandInfo.deviceMask = 0;
+
+  VkSemaphoreSubmitInfo waitInfo{};
+  waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+  waitInfo.semaphore = mTimeline;
+  waitInfo.value = waitValue;
+  waitInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+  VkSemaphoreSubmitInfo signalInfo{};
+  signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+  signalInfo.semaphore = mTimeline;
+  signalInfo.value = signalValue;
+  signalInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+  VkSubmitInfo2 submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+  submitInfo.waitSemaphoreInfoCount = waitValue > 0 ? 1 : 0;
+  submitInfo.pWaitSemaphoreInfos = &waitInfo;
+  submitInfo.commandBufferInfoCount = 1;
+  submitInfo.pCommandBufferInfos = &commandInfo;
+  submitInfo.signalSemaphoreInfoCount = 1;
+  submitInfo.pSignalSemaphoreInfos = &signalInfo;
+  VK_CHECK(vkQueueSubmit2(queue, 1, &submitInfo, VK_NULL_HANDLE));
+}
+
+void UploadBatcher::SubmitSparseBinds(uint64_t waitValue,
+                                      uint64_t signalValue) {
+  std::vector<VkSparseImageMemoryBindInfo> imageBindInfos;
+  std::vector<VkSparseImageOpaqueMemoryBindInfo> opaqueBindInfos;
+  for (const SparseBinds& binds : mCurrent.sparseBinds) {
+    if (!binds.imageBinds.empty()) {
+      imageBindInfos.push_back(
+          {binds.image, static_cast<uint32_t>(binds.imageBinds.size()),
+           binds.imageBinds.data()});
+    }
+    if (!binds.opaqueBinds.empty()) {
+      opaqueBindInfos.push_back(
+          {binds.image, static_cast<uint32_t>(binds.opaqueBinds.size()),
+           binds.opaqueBinds.data()});
+    }
+  }
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.waitSemaphoreValueCount = waitValue > 0 ? 1 : 0;
+  timelineInfo.pWaitSemaphoreValues = &waitValue;
+  timelineInfo.signalSemaphoreValueCount = 1;
+  timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+  // the graphics queue is the one checked for sparse binding support
+  VkBindSparseInfo bindInfo{};
+  bindInfo.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+  bindInfo.pNext = &timelineInfo;
+  bindInfo.waitSemaphoreCount = waitValue > 0 ? 1 : 0;
+  bindInfo.pWaitSemaphores = &mTimeline;
+  bindInfo.imageOpaqueBindCount = static_cast<uint32_t>(opaqueBindInfos.size());
+  bindInfo.pImageOpaqueBinds = opaqueBindInfos.data();
+  bindInfo.imageBindCount = static_cast<uint32_t>(imageBindInfos.size());
+  bindInfo.pImageBinds = imageBindInfos.data();
+  bindInfo.signalSemaphoreCount = 1;
+  bindInfo.pSignalSemaphores = &mTimeline;
+  VK_CHECK(vkQueueBindSparse(mGraphicsQueue, 1, &bindInfo, VK_NULL_HANDLE));
+}
+
+void UploadBatcher::SubmitPendingGraphics(uint64_t value, bool wait) {
+  uint64_t completed = 0;
+  VK_CHECK(vkGetSemaphoreCounterValue(mDevice, mTimeline, &completed));
+  for (Batch& batch : mInFlight) {
+    if (batch.value > value) {
+      break;
+    }
+    if (!batch.graphicsPending) {
+      continue;
+    }
+    if (batch.transferValue > completed) {
+      if (!wait) {
+        break;
+      }
+      // the batch waits for the graphics command buffers of earlier ones,
+      // which have been submitted by now
+      WaitTimeline(batch.transferValue);
+    }
+    // the wait is already satisfied, it makes the copies visible to the
+    // command buffer
+    SubmitCommandBuffer(mGraphicsQueue, batch.graphicsCommandBuffer,
+                        batch.transferValue, batch.value);
+    batch.graphicsPending = false;
+  }
+}
+
+void UploadBatcher::WaitTimeline(uint64_t value) {
+  VkSemaphoreWaitInfo waitInfo{};
+  waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  waitInfo.semaphoreCount = 1;
+  waitInfo.pSemaphores = &mTimeline;
+  waitInfo.pValues = &value;
+  VK_CHECK(vkWaitSemaphores(mDevice, &waitInfo, UINT64_MAX));
+}
+
+UploadBatcher::SparseBinds& UploadBatcher::GetSparseBinds(VkImage image) {
+  // binds of an image are usually recorded together
+  if (mCurrent.sparseBinds.empty() ||
+      mCurrent.sparseBinds.back().image != image) {
+    mCurrent.sparseBinds.push_back({image, {}, {}});
+  }
+  return mCurrent.sparseBinds.back();
+}
+
+void UploadBatcher::RetireOldest() {
+  Batch& batch = mInFlight.front();
+  Wait(batch.value);
+  Retire(batch);
+  mInFlight.pop_front();
+}
+
+void UploadBatcher::Retire(Batch& batch) {
+  mTail = std::max(mTail, batch.ringEnd);
+  for (auto& func : batch.deferred) {
+    func();
+  }
+  if (batch.transferCommandBuffer != VK_NULL_HANDLE) {
+    vkResetCommandBuffer(batch.transferCommandBuffer, 0);
+    mFreeTransferCommandBuffers.push_back(batch.transferCommandBuffer);
+  }
+  if (batch.graphicsCommandBuffer != VK_NULL_HANDLE) {
+    vkResetCommandBuffer(batch.graphicsCommandBuffer, 0);
+    mFreeGraphicsCommandBuffers.push_back(batch.graphicsCommandBuffer);
+  }
+}
+
+}  // namespace hkr
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "Renderer/Buffer.h"
+
+#include <volk.h>
+#include <vk_mem_alloc.h>
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <span>
+#include <vector>
+
+namespace hkr {
+
+// Records many staging copies, layout transitions and mip generations into
+// one batch and submits it at once. Staging memory is carved out of a
+// persistently mapped ring buffer and is only reused once the timeline
+// semaphore reports that the batch which used it has retired.
+//
+// Copies run on the dedicated transfer queue when its family differs from
+// the graphics one. Buffers written this way are shared by both families (see
+// GetQueueFamilyIndices), ownership of uploaded images is released on the
+// transfer side and acquired on the graphics side, and work that needs
+// the graphics queue (mip generation, acceleration structure builds) is
+// recorded into the graphics command buffer of the batch. That command buffer
+// is only submitted once the transfer submission has been seen complete on the
+// host, so that frames submitted in the meantime are not ordered behind the
+// copies. Memory bindings of sparse images are submitted to the graphics queue
+// ahead of the transfer submission, which waits for them on the timeline
+// semaphore. The first submission of a batch waits for the previous batch, so
+// batches execute and retire in order.
+class UploadBatcher {
+public:
+  // a slice of staging memory, valid until the batch it belongs to retires
+  struct Allocation {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    void* data = nullptr;
+  };
+
+  void Init(VkDevice device,
+            VmaAllocator allocator,
+            VkQueue transferQueue,
+            uint32_t transferFamilyIndex,
+            VkQueue graphicsQueue,
+            uint32_t graphicsFamilyIndex,
+            VkDeviceSize ringSize = 64 * 1024 * 1024);
+  // wait for all in flight batches and destroy resources
+  void Cleanup();
+
+  // reserve staging memory in the current batch, the copy reading from it must
+  // be recorded before the next call to Allocate
+  Allocation Allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+  // transfer command buffer of the current batch, begun on first use
+  VkCommandBuffer GetCommandBuffer();
+  // graphics command buffer of the current batch, executed after the transfer
+  // one (the same command buffer if there is no dedicated transfer queue)
+  VkCommandBuffer GetGraphicsCommandBuffer();
+
+  // copy data into staging memory, record a copy into dst and hand the range
+  // over to the graphics queue, dst is shared by GetQueueFamilyIndices
+  void UploadBuffer(VkBuffer dst,
+                    const void* data,
+                    VkDeviceSize size,
+                    VkDeviceSize dstOffset = 0);
+  // hand a range of a buffer shared by GetQueueFamilyIndices, written by the
+  // transfer command buffer, over to the graphics queue
+  void TransferBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size);
+  // hand an image written by the transfer command buffer over to the graphics
+  // queue, transitioning it from oldLayout to newLayout
+  void TransferImage(VkImage image,
+                     VkImageLayout oldLayout,
+                     VkImageLayout newLayout,
+                     const VkImageSubresourceRange& subresourceRange);
+  // make the writes of the transfer command buffer to an image shared by both
+  // queue families visible to the graphics queue, the image stays in
+  // VK_IMAGE_LAYOUT_GENERAL
+  void TransferSharedImage(VkImage image,
+                           const VkImageSubresourceRange& subresourceRange);
+  // bind memory to a region of a sparse image, or unbind it with a null
+  // memory, before the copies of the current batch execute
+  void BindSparse(VkImage image, const VkSparseImageMemoryBind& bind);
+  // same for a range of the opaque memory of a sparse image, its mip tail
+  void BindSparse(VkImage image, const VkSparseMemoryBind& bind);
+  // run func once the current batch has finished executing on the gpu
+  void Defer(std::function<void()>&& func);
+
+  // submit the current batch, returns the timeline value it signals (or the
+  // last submitted value if nothing was recorded). Its graphics command buffer
+  // is submitted by a later Submit, Collect or Wait once the copies are done.
+  uint64_t Submit();
+  // submit the graphics command buffers of the batches up to value, waiting
+  // for their copies on the host if needed. Call it before the graphics queue
+  // waits for value, which would otherwise wait for a later submission to the
+  // same queue.
+  void SubmitGraphics(uint64_t value);
+  // submit the current batch and wait for every batch to retire
+  void Flush();
+  void Wait(uint64_t value);
+  bool IsComplete(uint64_t value);
+  // submit the graphics command buffers of batches whose copies are done,
+  // release staging memory and run deferred work of retired batches
+  void Collect();
+
+  VkSemaphore GetTimelineSemaphore() const { return mTimeline; }
+  uint64_t GetLastSubmittedValue() const { return mLastSubmitted; }
+  bool HasDedicatedTransferQueue() const {
+    return mTransferFamilyIndex != mGraphicsFamilyIndex;
+  }
+  // families of buffers and images shared by both queues, one if they are the
+  // same
+  std::span<const uint32_t> GetQueueFamilyIndices() const {
+    return {mQueueFamilyIndices.data(), HasDedicatedTransferQueue() ? 2u : 1u};
+  }
+
+private:
+  struct SparseBinds {
+    VkImage image = VK_NULL_HANDLE;
+    std::vector<VkSparseImageMemoryBind> imageBinds;
+    std::vector<VkSparseMemoryBind> opaqueBinds;
+  };
+
+  struct Batch {
+    // bound before the command buffers execute
+    std::vector<SparseBinds> sparseBinds;
+    VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+    VkCommandBuffer graphicsCommandBuffer = VK_NULL_HANDLE;
+    // signaled by the transfer submission, the graphics command buffer is
+    // submitted once it is reached
+    uint64_t transferValue = 0;
+    bool graphicsPending = false;
+    uint64_t value = 0;
+    // ring head when the batch was submitted
+    VkDeviceSize ringEnd = 0;
+    // staging buffers too large for the ring
+    std::vector<VmaAllocation> dedicated;
+    std::vector<std::function<void()>> deferred;
+  };
+
+  VkCommandBuffer BeginCommandBuffer(VkCommandPool commandPool,
+                                     std::vector<VkCommandBuffer>& freeList);
+  void SubmitCommandBuffer(VkQueue queue,
+                           VkCommandBuffer commandBuffer,
+                           uint64_t waitValue,
+                           uint64_t signalValue);
+  void SubmitSparseBinds(uint64_t waitValue, uint64_t signalValue);
+  // submit pending graphics command buffers in order, up to the first batch
+  // whose copies are still running unless wait is set, then only up to value
+  void SubmitPendingGraphics(uint64_t value, bool wait);
+  // wait on the host without submitting anything
+  void WaitTimeline(uint64_t value);
+  SparseBinds& GetSparseBinds(VkImage image);
+  // wait for the oldest in flight batch and retire it
+  void RetireOldest();
+  void Retire(Batch& batch);
+
+private:
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VmaAllocator mAllocator = VK_NULL_HANDLE;
+  VkQueue mTransferQueue = VK_NULL_HANDLE;
+  VkQueue mGraphicsQueue = VK_NULL_HANDLE;
+  uint32_t mTransferFamilyIndex = 0;
+  uint32_t mGraphicsFamilyIndex = 0;
+  std::array<uint32_t, 2> mQueueFamilyIndices{};
+  VkCommandPool mTransferCommandPool = VK_NULL_HANDLE;
+  VkCommandPool mGraphicsCommandPool = VK_NULL_HANDLE;
+  VkSemaphore mTimeline = VK_NULL_HANDLE;
+  uint64_t mLastSubmitted = 0;
+
+  // staging ring, head and tail grow monotonically and wrap by modulo
+  StagingBuffer mRing;
+  VkDeviceSize mRingSize = 0;
+  VkDeviceSize mHead = 0;
+  VkDeviceSize mTail = 0;
+
+  Batch mCurrent;
+  std::deque<Batch> mInFlight;
+  std::vector<VkCommandBuffer> mFreeTransferCommandBuffers;
+  std::vector<VkCommandBuffer> mFreeGraphicsCommandBuffers;
+};
+
+}  // namespace hkr
@@ -0,0 +1,1057 @@
+#include "Renderer/glTFDocument.h"
+#include "Util/Assert.h"
+#include "Util/Filesystem.h"
+#include "Util/ThreadPool.h"
+
+#include <simdjson.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+namespace ondemand = simdjson::ondemand;
+
+constexpr uint32_t GLB_MAGIC = 0x46546c67;        // "glTF"
+constexpr uint32_t GLB_CHUNK_JSON = 0x4e4f534a;   // "JSON"
+constexpr uint32_t GLB_CHUNK_BIN = 0x004e4942;    // "BIN\0"
+
+// the readers below return false if the value has another type, which fails
+// the whole parse
+bool GetInt(ondemand::value& value, int32_t& out) {
+  int64_t i = 0;
+  if (value.get_int64().get(i)) {
+    return false;
+  }
+  out = static_cast<int32_t>(i);
+  return true;
+}
+
+bool GetUint(ondemand::value& value, uint64_t& out) {
+  return !value.get_uint64().get(out);
+}
+
+bool GetFloat(ondemand::value& value, float& out) {
+  double d = 0.0;
+  if (value.get_double().get(d)) {
+    return false;
+  }
+  out = static_cast<float>(d);
+  return true;
+}
+
+bool GetString(ondemand::value& value, std::string_view& out) {
+  return !value.get_string().get(out);
+}
+
+template <typename F>
+bool ForEachElement(ondemand::value& value, F&& f) {
+  ondemand::array array;
+  if (value.get_array().get(array)) {
+    return false;
+  }
+  for (auto result : array) {
+    ondemand::value element;
+    if (std::move(result).get(element) || !f(element)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename F>
+bool ForEachField(ondemand::object& object, F&& f) {
+  for (auto result : object) {
+    ondemand::field field;
+    std::string_view key;
+    if (std::move(result).get(field) || field.unescaped_key().get(key) ||
+        !f(key, field.value())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename F>
+bool ForEachField(ondemand::value& value, F&& f) {
+  ondemand::object object;
+  if (value.get_object().get(object)) {
+    return false;
+  }
+  return ForEachField(object, f);
+}
+
+// up to count floats, returns the number read in n
+bool GetFloats(ondemand::value& value, float* out, size_t count, size_t& n) {
+  n = 0;
+  return ForEachElement(value, [&](ondemand::value& element) {
+    float f = 0.0f;
+    if (!GetFloat(element, f)) {
+      return false;
+    }
+    if (n < count) {
+      out[n] = f;
+    }
+    n++;
+    return true;
+  });
+}
+
+// index of a textureInfo
+bool GetTextureIndex(ondemand::value& value, int32_t& index) {
+  return ForEachField(value, [&](std::string_view key, ondemand::value& v) {
+    return key != "index" || GetInt(v, index);
+  });
+}
+
+uint32_t GetComponentCount(std::string_view type) {
+  if (type == "SCALAR") {
+    return 1;
+  }
+  if (type == "VEC2") {
+    return 2;
+  }
+  if (type == "VEC3") {
+    return 3;
+  }
+  if (type == "VEC4" || type == "MAT2") {
+    return 4;
+  }
+  if (type == "MAT3") {
+    return 9;
+  }
+  if (type == "MAT4") {
+    return 16;
+  }
+  return 0;
+}
+
+uint32_t GetComponentSize(int32_t componentType) {
+  switch (componentType) {
+    case TINYGLTF_COMPONENT_TYPE_BYTE:
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      return 1;
+    case TINYGLTF_COMPONENT_TYPE_SHORT:
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+      return 2;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    case TINYGLTF_COMPONENT_TYPE_FLOAT:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+int HexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+std::string DecodeUri(std::string_view uri) {
+  std::string decoded;
+  decoded.reserve(uri.size());
+  for (size_t i = 0; i < uri.size(); i++) {
+    if (uri[i] == '%' && i + 2 < uri.size() && HexValue(uri[i + 1]) >= 0 &&
+        HexValue(uri[i + 2]) >= 0) {
+      decoded += static_cast<char>(HexValue(uri[i + 1]) * 16 +
+                                   HexValue(uri[i + 2]));
+      i += 2;
+    } else {
+      decoded += uri[i];
+    }
+  }
+  return decoded;
+}
+
+bool IsDataUri(std::string_view uri) {
+  return uri.rfind("data:", 0) == 0;
+}
+
+// payload of a base64 data uri
+bool DecodeDataUri(std::string_view uri, std::vector<uint8_t>& out) {
+  static constexpr std::string_view BASE64 = ";base64,";
+  const size_t pos = uri.find(BASE64);
+  if (!IsDataUri(uri) || pos == std::string_view::npos) {
+    return false;
+  }
+  auto sextet = [](char c) -> int {
+    if (c >= 'A' && c <= 'Z') {
+      return c - 'A';
+    }
+    if (c >= 'a' && c <= 'z') {
+      return c - 'a' + 26;
+    }
+    if (c >= '0' && c <= '9') {
+      return c - '0' + 52;
+    }
+    if (c == '+' || c == '-') {
+      return 62;
+    }
+    if (c == '/' || c == '_') {
+      return 63;
+    }
+    return -1;
+  };
+  const std::string_view data = uri.substr(pos + BASE64.size());
+  out.clear();
+  out.reserve(data.size() / 4 * 3);
+  uint32_t bits = 0;
+  int bitCount = 0;
+  for (char c : data) {
+    if (c == '=') {
+      break;
+    }
+    const int value = sextet(c);
+    if (value < 0) {
+      return false;
+    }
+    bits = (bits << 6) | static_cast<uint32_t>(value);
+    bitCount += 6;
+    if (bitCount >= 8) {
+      bitCount -= 8;
+      out.push_back(static_cast<uint8_t>(bits >> bitCount));
+    }
+  }
+  return true;
+}
+
+bool ParseSampler(ondemand::value& value, hkr::SamplerDesc& sampler) {
+  return ForEachField(value, [&](std::string_view key, ondemand::value& v) {
+    if (key == "minFilter") {
+      return GetInt(v, sampler.minFilter);
+    }
+    if (key == "magFilter") {
+      return GetInt(v, sampler.magFilter);
+    }
+    if (key == "wrapS") {
+      return GetInt(v, sampler.wrapS);
+    }
+    if (key == "wrapT") {
+      return GetInt(v, sampler.wrapT);
+    }
+    return true;
+  });
+}
+
+bool ParseTexture(ondemand::value& value, hkr::TextureDesc& texture) {
+  // the ktx2 image of KHR_texture_basisu takes precedence over the fallback
+  // source, which is optional
+  int32_t basisuSource = -1;
+  const bool result =
+      ForEachField(value, [&](std::string_view key, ondemand::value& v) {
+        if (key == "source") {
+          return GetInt(v, texture.imageIndex);
+        }
+        if (key == "sampler") {
+          return GetInt(v, texture.samplerIndex);
+        }
+        if (key == "extensions") {
+          return ForEachField(
+              v, [&](std::string_view extension, ondemand::value& ext) {
+                if (extension != "KHR_texture_basisu") {
+                  return true;
+                }
+                return ForEachField(
+                    ext, [&](std::string_view k, ondemand::value& source) {
+                      return k != "source" || GetInt(source, basisuSource);
+                    });
+              });
+        }
+        return true;
+      });
+  if (basisuSource > -1) {
+    texture.imageIndex = basisuSource;
+  }
+  return result;
+}
+
+bool ParseMaterial(ondemand::value& value, hkr::MaterialDesc& material) {
+  std::string_view alphaMode = "OPAQUE";
+  float alphaCutoff = 0.5f;
+  size_t n = 0;
+  const bool result = ForEachField(value, [&](std::string_view key,
+                                              ondemand::value& v) {
+    if (key == "pbrMetallicRoughness") {
+      return ForEachField(v, [&](std::string_view k, ondemand::value& pbr) {
+        if (k == "baseColorFactor") {
+          return GetFloats(pbr, &material.baseColorFactor[0], 4, n);
+        }
+        if (k == "metallicFactor") {
+          return GetFloat(pbr, material.metallicFactor);
+        }
+        if (k == "roughnessFactor") {
+          return GetFloat(pbr, material.roughnessFactor);
+        }
+        if (k == "baseColorTexture") {
+          return GetTextureIndex(pbr, material.baseColorTextureIndex);
+        }
+        if (k == "metallicRoughnessTexture") {
+          return GetTextureIndex(pbr, material.metallicRoughnessTextureIndex);
+        }
+        return true;
+      });
+    }
+    if (key == "normalTexture") {
+      return GetTextureIndex(v, material.normalTextureIndex);
+    }
+    if (key == "occlusionTexture") {
+      return GetTextureIndex(v, material.occlusionTextureIndex);
+    }
+    if (key == "emissiveTexture") {
+      return GetTextureIndex(v, material.emissiveTextureIndex);
+    }
+    if (key == "emissiveFactor") {
+      return GetFloats(v, &material.emissiveFactor[0], 3, n);
+    }
+    if (key == "alphaMode") {
+      return GetString(v, alphaMode);
+    }
+    if (key == "alphaCutoff") {
+      return GetFloat(v, alphaCutoff);
+    }
+    return true;
+  });
+  if (alphaMode == "MASK") {
+    material.alphaCutoff = alphaCutoff;
+  }
+  return result;
+}
+
+// accessor indices or draco attribute ids by attribute
+bool ParseAttributes(
+    ondemand::value& value,
+    std::array<int32_t, hkr::glTFDocument::ATTRIBUTE_COUNT>& attributes) {
+  static constexpr std::string_view NAMES[] = {
+      "POSITION",  "NORMAL",   "TANGENT",   "TEXCOORD_0",
+      "COLOR_0",   "JOINTS_0", "WEIGHTS_0",
+  };
+  static_assert(std::size(NAMES) == hkr::glTFDocument::ATTRIBUTE_COUNT);
+  return ForEachField(value, [&](std::string_view key, ondemand::value& v) {
+    auto it = std::find(std::begin(NAMES), std::end(NAMES), key);
+    return it == std::end(NAMES) ||
+           GetInt(v, attributes[it - std::begin(NAMES)]);
+  });
+}
+
+// f(extension) for the named extension of an object
+template <typename F>
+bool ParseExtension(ondemand::value& value, std::string_view name, F&& f) {
+  return ForEachField(value, [&](std::string_view key, ondemand::value& ext) {
+    return key != name || f(ext);
+  });
+}
+
+bool ParseDraco(ondemand::value& value,
+                hkr::glTFDocument::Primitive& primitive) {
+  return ForEachField(value, [&](std::string_view key, ondemand::value& v) {
+    if (key == "bufferView") {
+      return GetInt(v, primitive.dracoBufferView);
+    }
+    if (key == "attributes") {
+      return ParseAttributes(v, primitive.dracoAttributes);
+    }
+    return true;
+  });
+}
+
+bool ParseMeshopt(ondemand::value& value, hkr::MeshoptBufferView& meshopt) {
+  bool hasMode = false;
+  const bool result =
+      ForEachField(value, [&](std::string_view key, ondemand::value& v) {
+        uint64_t u = 0;
+        std::string_view name;
+        if (key == "buffer") {
+          return GetInt(v, meshopt.buffer);
+        }
+        if (key == "byteOffset") {
+          return GetUint(v, meshopt.byteOffset);
+        }
+        if (key == "byteLength") {
+          return GetUint(v, meshopt.byteLength);
+        }
+        if (key == "byteStride" || key == "count") {
+          if (!GetUint(v, u)) {
+            return false;
+          }
+          (key == "count" ? meshopt.count : meshopt.byteStride) =
+              static_cast<uint32_t>(u);
+          return true;
+        }
+        if (key == "mode") {
+          hasMode = true;
+          return GetString(v, name) &&
+                 hkr::ParseMeshoptMode(std::string(name), meshopt.mode);
+        }
+        if (key == "filter") {
+          return GetString(v, name) &&
+                 hkr::ParseMeshoptFilter(std::string(name), meshopt.filter);
+        }
+        return true;
+      });
+  return result && hasMode;
+}
+
+bool ParseMesh(ondemand::value& value,
+               std::vector<hkr::glTFDocument::Primitive>& primitives) {
+  return ForEachField(value, [&](std::string_view key, ondemand::value& v) {
+    if (key != "primitives") {
+      return true;
+    }
+    return ForEachElement(v, [&](ondemand::value& element) {
+      hkr::glTFDocument::Primitive& primitive = primitives.emplace_back();
+      primitive.attributes.fill(-1);
+      primitive.dracoAttributes.fill(-1);
+      return ForEachField(element, [&](std::string_view k,
+                                       ondemand::value& p) {
+        if (k == "attributes") {
+          return ParseAttributes(p, primitive.attributes);
+        }
+        if (k == "extensions") {
+          return ParseExtension(
+              p, "KHR_draco_mesh_compression",
+              [&](ondemand::value& ext) { return ParseDraco(ext, primitive); });
+        }
+        if (k == "indices") {
+          return GetInt(p, primitive.indices);
+        }
+        if (k == "material") {
+          return GetInt(p, primitive.material);
+        }
+        return true;
+      });
+    });
+  });
+}
+
+bool ParseNode(ondemand::value& value, hkr::ModelDesc& desc) {
+  hkr::NodeDesc& node = desc.nodes.emplace_back();
+  node.firstChild = static_cast<uint32_t>(desc.nodeChildren.size());
+  float matrix[16];
+  float translation[3] = {0.0f, 0.0f, 0.0f};
+  float rotation[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+  float scale[3] = {1.0f, 1.0f, 1.0f};
+  size_t matrixCount = 0;
+  size_t n = 0;
+  const bool result =
+      ForEachField(value, [&](std::string_view key, ondemand::value& v) {
+        if (key == "mesh") {
+          return GetInt(v, node.meshIndex);
+        }
+        if (key == "children") {
+          return ForEachElement(v, [&](ondemand::value& child) {
+            int32_t index = 0;
+            if (!GetInt(child, index) || index < 0) {
+              return false;
+            }
+            desc.nodeChildren.push_back(static_cast<uint32_t>(index));
+            return true;
+          });
+        }
+        if (key == "matrix") {
+          return GetFloats(v, matrix, 16, matrixCount);
+        }
+        if (key == "translation") {
+          return GetFloats(v, translation, 3, n);
+        }
+        if (key == "rotation") {
+          return GetFloats(v, rotation, 4, n);
+        }
+        if (key == "scale") {
+          return GetFloats(v, scale, 3, n);
+        }
+        return true;
+      });
+  node.childCount =
+      static_cast<uint32_t>(desc.nodeChildren.size()) - node.firstChild;
+  if (matrixCount == 16) {
+    node.localTransform = glm::make_mat4x4(matrix);
+  } else {
+    node.localTransform = glm::translate(hkr::Mat4(1.0f),
+                                         glm::make_vec3(translation)) *
+                          glm::mat4(glm::make_quat(rotation)) *
+                          glm::scale(hkr::Mat4(1.0f), glm::make_vec3(scale));
+  }
+  return result;
+}
+
+bool ParseBuffer(ondemand::value& value, hkr::glTFDocument::Buffer& buffer) {
+  return ForEachField(value, [&](std::string_view key, ondemand::value& v) {
+    if (key == "uri") {
+      std::string_view uri;
+      if (!GetString(v, uri)) {
+        return false;
+      }
+      buffer.uri = IsDataUri(uri) ? std::string(uri) : DecodeUri(uri);
+      return true;
+    }
+    if (key == "byteLength") {
+      return GetUint(v, buffer.byteLength);
+    }
+    if (key == "extensions") {
+      return ParseExtension(v, "EXT_meshopt_compression",
+                            [&](ondemand::value& ext) {
+                              return ForEachField(
+                                  ext, [&](std::string_view k,
+                                           ondemand::value& fallback) {
+                                    return k != "fallback" ||
+                                           !fallback.get_bool().get(
+                                               buffer.fallback);
+                                  });
+                            });
+    }
+    return true;
+  });
+}
+
+bool ParseBufferView(ondemand::value& value,
+                     hkr::glTFDocument::BufferView& bufferView) {
+  return ForEachField(value, [&](std::string_view key, ondemand::value& v) {
+    uint64_t stride = 0;
+    if (key == "buffer") {
+      return GetInt(v, bufferView.buffer);
+    }
+    if (key == "byteOffset") {
+      return GetUint(v, bufferView.byteOffset);
+    }
+    if (key == "byteLength") {
+      return GetUint(v, bufferView.byteLength);
+    }
+    if (key == "byteStride") {
+      if (!GetUint(v, stride)) {
+        return false;
+      }
+      bufferView.byteStride = static_cast<uint32_t>(stride);
+    }
+    if (key == "extensions") {
+      return ParseExtension(v, "EXT_meshopt_compression",
+                            [&](ondemand::value& ext) {
+                              bufferView.compressed = true;
+                              return ParseMeshopt(ext, bufferView.meshopt);
+                            });
+    }
+    return true;
+  });
+}
+
+bool ParseAccessor(ondemand::value& value,
+                   hkr::glTFDocument::Accessor& accessor) {
+  return ForEachField(value, [&](std::string_view key, ondemand::value& v) {
+    if (key == "bufferView") {
+      return GetInt(v, accessor.bufferView);
+    }
+    if (key == "byteOffset") {
+      return GetUint(v, accessor.byteOffset);
+    }
+    if (key == "componentType") {
+      return GetInt(v, accessor.componentType);
+    }
+    if (key == "count") {
+      uint64_t count = 0;
+      if (!GetUint(v, count)) {
+        return false;
+      }
+      accessor.count = static_cast<uint32_t>(count);
+      return true;
+    }
+    if (key == "type") {
+      std::string_view type;
+      if (!GetString(v, type)) {
+        return false;
+      }
+      accessor.components = GetComponentCount(type);
+      return true;
+    }
+    if (key == "normalized") {
+      return !v.get_bool().get(accessor.normalized);
+    }
+    return true;
+  });
+}
+
+bool ParseImage(ondemand::value& value, hkr::glTFDocument::Image& image) {
+  return ForEachField(value, [&](std::string_view key, ondemand::value& v) {
+    if (key == "uri") {
+      std::string_view uri;
+      if (!GetString(v, uri)) {
+        return false;
+      }
+      image.uri = IsDataUri(uri) ? std::string(uri) : DecodeUri(uri);
+      return true;
+    }
+    if (key == "bufferView") {
+      return GetInt(v, image.bufferView);
+    }
+    return true;
+  });
+}
+
+}  // namespace
+
+namespace hkr {
+
+bool glTFDocument::Load(const std::string& fileName,
+                        ModelDesc& desc,
+                        std::string& err,
+                        ThreadPool* threadPool) {
+  desc = {};
+  *this = {};
+  const std::string fileExtension = GetFileExtension(fileName);
+  if (fileExtension != "gltf" && fileExtension != "glb") {
+    err = "unsupported model file: " + fileName;
+    return false;
+  }
+  if (!mFile.Open(fileName, threadPool)) {
+    err = "file open error: " + fileName;
+    return false;
+  }
+  const size_t pos = fileName.find_last_of('/');
+  mDirectory = pos == std::string::npos ? "." : fileName.substr(0, pos);
+
+  // the json chunk of a .glb is followed by its binary chunk
+  std::span<const uint8_t> json(mFile.GetData(), mFile.GetSize());
+  std::span<const uint8_t> binaryChunk;
+  if (fileExtension == "glb") {
+    uint32_t header[5] = {};
+    if (json.size() < sizeof(header)) {
+      err = "truncated glb file: " + fileName;
+      return false;
+    }
+    memcpy(header, json.data(), sizeof(header));
+    if (header[0] != GLB_MAGIC || header[1] != 2 ||
+        header[4] != GLB_CHUNK_JSON ||
+        header[3] > json.size() - sizeof(header)) {
+      err = "invalid glb file: " + fileName;
+      return false;
+    }
+    std::span<const uint8_t> chunks = json.subspan(sizeof(header) + header[3]);
+    json = json.subspan(sizeof(header), header[3]);
+    uint32_t chunkHeader[2] = {};
+    if (chunks.size() >= sizeof(chunkHeader)) {
+      memcpy(chunkHeader, chunks.data(), sizeof(chunkHeader));
+      if (chunkHeader[1] == GLB_CHUNK_BIN &&
+          chunkHeader[0] <= chunks.size() - sizeof(chunkHeader)) {
+        binaryChunk = chunks.subspan(sizeof(chunkHeader), chunkHeader[0]);
+      }
+    }
+  }
+
+  // simdjson reads past the end of the json, which the mapping does not
+  // allow for
+  simdjson::padded_string padded(reinterpret_cast<const char*>(json.data()),
+                                 json.size());
+  ondemand::parser parser;
+  ondemand::document document;
+  ondemand::object root;
+  if (parser.iterate(padded).get(document) || document.get_object().get(root)) {
+    err = "invalid json: " + fileName;
+    return false;
+  }
+  std::string_view version;
+  int32_t sceneIndex = -1;
+  std::vector<std::vector<uint32_t>> scenes;
+  const bool parsed =
+      ForEachField(root, [&](std::string_view key, ondemand::value& value) {
+        if (key == "asset") {
+          return ForEachField(value,
+                              [&](std::string_view k, ondemand::value& v) {
+                                return k != "version" || GetString(v, version);
+                              });
+        }
+        if (key == "samplers") {
+          return ForEachElement(value, [&](ondemand::value& v) {
+            return ParseSampler(v, desc.samplers.emplace_back());
+          });
+        }
+        if (key == "textures") {
+          return ForEachElement(value, [&](ondemand::value& v) {
+            return ParseTexture(v, desc.textures.emplace_back());
+          });
+        }
+        if (key == "materials") {
+          return ForEachElement(value, [&](ondemand::value& v) {
+            return ParseMaterial(v, desc.materials.emplace_back());
+          });
+        }
+        if (key == "meshes") {
+          return ForEachElement(value, [&](ondemand::value& v) {
+            Mesh& mesh = mMeshes.emplace_back();
+            mesh.firstPrimitive = static_cast<uint32_t>(mPrimitives.size());
+            const bool result = ParseMesh(v, mPrimitives);
+            mesh.primitiveCount =
+                static_cast<uint32_t>(mPrimitives.size()) -
+                mesh.firstPrimitive;
+            return result;
+          });
+        }
+        if (key == "nodes") {
+          return ForEachElement(
+              value, [&](ondemand::value& v) { return ParseNode(v, desc); });
+        }
+        if (key == "scenes") {
+          return ForEachElement(value, [&](ondemand::value& v) {
+            std::vector<uint32_t>& nodes = scenes.emplace_back();
+            return ForEachField(v, [&](std::string_view k,
+                                       ondemand::value& sceneNodes) {
+              if (k != "nodes") {
+                return true;
+              }
+              return ForEachElement(sceneNodes, [&](ondemand::value& node) {
+                int32_t index = 0;
+                if (!GetInt(node, index) || index < 0) {
+                  return false;
+                }
+                nodes.push_back(static_cast<uint32_t>(index));
+                return true;
+              });
+            });
+          });
+        }
+        if (key == "scene") {
+          return GetInt(value, sceneIndex) && sceneIndex >= 0;
+        }
+        if (key == "buffers") {
+          return ForEachElement(value, [&](ondemand::value& v) {
+            return ParseBuffer(v, mBuffers.emplace_back());
+          });
+        }
+        if (key == "bufferViews") {
+          return ForEachElement(value, [&](ondemand::value& v) {
+            return ParseBufferView(v, mBufferViews.emplace_back());
+          });
+        }
+        if (key == "accessors") {
+          return ForEachElement(value, [&](ondemand::value& v) {
+            return ParseAccessor(v, mAccessors.emplace_back());
+          });
+        }
+        if (key == "images") {
+          return ForEachElement(value, [&](ondemand::value& v) {
+            return ParseImage(v, mImages.emplace_back());
+          });
+        }
+        return true;
+      });
+  // nodes may come after the scenes, indices are checked against them once
+  // everything is parsed
+  const size_t nodeCount = desc.nodes.size();
+  auto isNodeIndex = [nodeCount](uint32_t index) { return index < nodeCount; };
+  bool validNodes =
+      std::all_of(desc.nodeChildren.begin(), desc.nodeChildren.end(),
+                  isNodeIndex);
+  for (const std::vector<uint32_t>& nodes : scenes) {
+    validNodes = validNodes &&
+                 std::all_of(nodes.begin(), nodes.end(), isNodeIndex);
+  }
+  if (!parsed || !validNodes ||
+      sceneIndex >= static_cast<int32_t>(scenes.size())) {
+    err = "invalid glTF: " + fileName;
+    return false;
+  }
+  if (version.empty() || version[0] != '2') {
+    err = "unsupported glTF version: " + fileName;
+    return false;
+  }
+  if (!LoadBuffers(binaryChunk, err, threadPool) ||
+      !DecompressMeshes(err, threadPool) || !ValidateAccessors(err)) {
+    return false;
+  }
+
+  BuildPrimitives(desc);
+  if (!scenes.empty()) {
+    desc.sceneNodes = scenes[sceneIndex > -1 ? sceneIndex : 0];
+  }
+  desc.imageCount = static_cast<uint32_t>(mImages.size());
+  return true;
+}
+
+bool glTFDocument::LoadBuffers(std::span<const uint8_t> binaryChunk,
+                               std::string& err,
+                               ThreadPool* threadPool) {
+  for (size_t i = 0; i < mBuffers.size(); i++) {
+    Buffer& buffer = mBuffers[i];
+    if (buffer.fallback && buffer.uri.empty()) {
+      continue;
+    }
+    if (buffer.uri.empty()) {
+      // only the first buffer of a .glb may refer to its binary chunk
+      if (i != 0 || binaryChunk.empty()) {
+        err = "buffer without data";
+        return false;
+      }
+      buffer.data = binaryChunk;
+    } else if (IsDataUri(buffer.uri)) {
+      if (!DecodeDataUri(buffer.uri, buffer.decoded)) {
+        err = "invalid data uri of buffer " + std::to_string(i);
+        return false;
+      }
+      buffer.data = buffer.decoded;
+    } else {
+      if (!buffer.file.Open(mDirectory + "/" + buffer.uri, threadPool)) {
+        err = "file open error: " + mDirectory + "/" + buffer.uri;
+        return false;
+      }
+      buffer.data = {buffer.file.GetData(), buffer.file.GetSize()};
+    }
+    if (buffer.data.size() < buffer.byteLength) {
+      err = "buffer " + std::to_string(i) + " is shorter than its byteLength";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool glTFDocument::DecompressMeshes(std::string& err, ThreadPool* threadPool) {
+  std::vector<uint64_t> bufferSizes;
+  for (const Buffer& buffer : mBuffers) {
+    bufferSizes.push_back(buffer.data.size());
+  }
+  MeshDecompressor decompressor(std::move(bufferSizes));
+  // the views and accessors are pointed at the decoded buffers before the
+  // jobs fill them
+  for (size_t i = 0; i < mBufferViews.size(); i++) {
+    BufferView& view = mBufferViews[i];
+    if (!view.compressed) {
+      continue;
+    }
+    uint32_t dstBuffer = 0;
+    if (!decompressor.AddMeshoptView(static_cast<int32_t>(i), view.meshopt,
+                                     dstBuffer, err)) {
+      return false;
+    }
+    view.buffer = static_cast<int32_t>(dstBuffer);
+    view.byteOffset = 0;
+    view.byteLength = view.meshopt.GetDecodedSize();
+  }
+
+  std::vector<MeshDecompressor::Accessor> accessors;
+  std::vector<MeshDecompressor::Attribute> dracoAttributes;
+  std::vector<MeshDecompressor::TargetView> targetViews;
+  for (const Primitive& prim : mPrimitives) {
+    if (prim.dracoBufferView < 0 || prim.indices < 0) {
+      continue;
+    }
+    if (static_cast<size_t>(prim.dracoBufferView) >= mBufferViews.size()) {
+      err = "invalid KHR_draco_mesh_compression buffer view";
+      return false;
+    }
+    if (accessors.empty()) {
+      for (const Accessor& accessor : mAccessors) {
+        MeshDecompressor::Accessor& target = accessors.emplace_back();
+        target.componentType = accessor.componentType;
+        target.components = accessor.components;
+        target.count = accessor.count;
+      }
+    }
+    dracoAttributes.clear();
+    for (uint32_t a = 0; a < ATTRIBUTE_COUNT; a++) {
+      if (prim.dracoAttributes[a] > -1 && prim.attributes[a] > -1) {
+        MeshDecompressor::Attribute& attribute = dracoAttributes.emplace_back();
+        attribute.uniqueId = static_cast<uint32_t>(prim.dracoAttributes[a]);
+        attribute.accessor = prim.attributes[a];
+      }
+    }
+    const BufferView& view = mBufferViews[prim.dracoBufferView];
+    if (!decompressor.AddDracoPrimitive(
+            prim.dracoBufferView, view.buffer, view.byteOffset,
+            view.byteLength, dracoAttributes, prim.indices, accessors,
+            targetViews, err)) {
+      return false;
+    }
+  }
+  if (decompressor.IsEmpty()) {
+    return true;
+  }
+
+  for (const MeshDecompressor::TargetView& target : targetViews) {
+    BufferView& view = mBufferViews.emplace_back();
+    view.buffer = static_cast<int32_t>(target.buffer);
+    view.byteOffset = target.byteOffset;
+    view.byteLength = target.byteLength;
+    Accessor& accessor = mAccessors[target.accessor];
+    accessor.bufferView = static_cast<int32_t>(mBufferViews.size() - 1);
+    accessor.byteOffset = 0;
+  }
+  const size_t firstBuffer = mBuffers.size();
+  mBuffers.resize(firstBuffer + decompressor.GetBufferCount());
+  std::vector<std::span<const uint8_t>> sources;
+  std::vector<uint8_t*> decoded;
+  for (size_t i = 0; i < mBuffers.size(); i++) {
+    Buffer& buffer = mBuffers[i];
+    if (i < firstBuffer) {
+      sources.push_back(buffer.data);
+    } else {
+      buffer.byteLength = decompressor.GetBufferSize(
+          static_cast<uint32_t>(i - firstBuffer));
+      buffer.decoded.resize(buffer.byteLength);
+      buffer.data = buffer.decoded;
+      decoded.push_back(buffer.decoded.data());
+    }
+  }
+  return decompressor.Decode(sources, decoded, threadPool, err);
+}
+
+bool glTFDocument::ValidateAccessors(std::string& err) const {
+  for (size_t i = 0; i < mAccessors.size(); i++) {
+    const Accessor& accessor = mAccessors[i];
+    if (accessor.bufferView < 0) {
+      continue;
+    }
+    const uint32_t elementSize =
+        GetComponentSize(accessor.componentType) * accessor.components;
+    bool valid = elementSize > 0 && static_cast<size_t>(accessor.bufferView) <
+                                        mBufferViews.size();
+    if (valid) {
+      const BufferView& view = mBufferViews[accessor.bufferView];
+      const uint64_t stride = view.byteStride ? view.byteStride : elementSize;
+      const uint64_t end =
+          accessor.count > 0
+              ? accessor.byteOffset + stride * (accessor.count - 1) +
+                    elementSize
+              : 0;
+      valid = view.buffer >= 0 &&
+              static_cast<size_t>(view.buffer) < mBuffers.size() &&
+              end <= view.byteLength &&
+              view.byteOffset + view.byteLength <=
+                  mBuffers[view.buffer].data.size();
+    }
+    if (!valid) {
+      err = "accessor " + std::to_string(i) + " lies outside its buffer";
+      return false;
+    }
+  }
+  return true;
+}
+
+void glTFDocument::BuildPrimitives(ModelDesc& desc) const {
+  // primitives without a material use the default one appended after the
+  // glTF materials, primitives without indices are dropped
+  const int32_t defaultMaterialIndex =
+      static_cast<int32_t>(desc.materials.size());
+  desc.meshes.reserve(mMeshes.size());
+  for (const Mesh& mesh : mMeshes) {
+    MeshDesc& newMesh = desc.meshes.emplace_back();
+    newMesh.firstPrimitive = static_cast<uint32_t>(desc.primitives.size());
+    for (uint32_t i = 0; i < mesh.primitiveCount; i++) {
+      const Primitive& prim = mPrimitives[mesh.firstPrimitive + i];
+      if (prim.indices < 0) {
+        continue;
+      }
+      const AccessorView position =
+          GetAccessorView(prim.attributes[ATTRIBUTE_POSITION]);
+      HKR_ASSERT(position.data);
+      PrimitiveDesc& newPrim = desc.primitives.emplace_back();
+      newPrim.vertexCount = position.count;
+      newPrim.indexCount = GetAccessorView(prim.indices).count;
+      newPrim.materialIndex =
+          prim.material > -1 ? prim.material : defaultMaterialIndex;
+      if (prim.attributes[ATTRIBUTE_COLOR_0] > -1) {
+        desc.vertexStreamMask |= 1u << VERTEX_STREAM_COLOR;
+      }
+      if (prim.attributes[ATTRIBUTE_JOINTS_0] > -1 &&
+          prim.attributes[ATTRIBUTE_WEIGHTS_0] > -1) {
+        desc.vertexStreamMask |= 1u << VERTEX_STREAM_SKIN;
+      }
+    }
+    newMesh.primitiveCount =
+        static_cast<uint32_t>(desc.primitives.size()) - newMesh.firstPrimitive;
+  }
+  LayoutPrimitives(desc);
+}
+
+AccessorView glTFDocument::GetAccessorView(int32_t accessorIndex) const {
+  AccessorView view;
+  if (accessorIndex < 0 ||
+      static_cast<size_t>(accessorIndex) >= mAccessors.size()) {
+    return view;
+  }
+  const Accessor& accessor = mAccessors[accessorIndex];
+  if (accessor.bufferView < 0) {
+    return view;
+  }
+  const BufferView& bufferView = mBufferViews[accessor.bufferView];
+  view.data = mBuffers[bufferView.buffer].data.data() + bufferView.byteOffset +
+              accessor.byteOffset;
+  view.count = accessor.count;
+  view.stride = bufferView.byteStride
+                    ? bufferView.byteStride
+                    : GetComponentSize(accessor.componentType) *
+                          accessor.components;
+  view.componentType = accessor.componentType;
+  view.components = accessor.components;
+  view.normalized = accessor.normalized;
+  return view;
+}
+
+std::vector<PrimitiveAccessors> glTFDocument::GetPrimitiveAccessors(
+    uint32_t meshIndex) const {
+  std::vector<PrimitiveAccessors> primitives;
+  const Mesh& mesh = mMeshes[meshIndex];
+  for (uint32_t i = 0; i < mesh.primitiveCount; i++) {
+    const Primitive& prim = mPrimitives[mesh.firstPrimitive + i];
+    if (prim.indices < 0) {
+      continue;
+    }
+    PrimitiveAccessors& accessors = primitives.emplace_back();
+    accessors.indices = GetAccessorView(prim.indices);
+    accessors.position = GetAccessorView(prim.attributes[ATTRIBUTE_POSITION]);
+    accessors.normal = GetAccessorView(prim.attributes[ATTRIBUTE_NORMAL]);
+    accessors.tangent = GetAccessorView(prim.attributes[ATTRIBUTE_TANGENT]);
+    accessors.uv = GetAccessorView(prim.attributes[ATTRIBUTE_TEXCOORD_0]);
+    accessors.color = GetAccessorView(prim.attributes[ATTRIBUTE_COLOR_0]);
+    accessors.joints = GetAccessorView(prim.attributes[ATTRIBUTE_JOINTS_0]);
+    accessors.weights = GetAccessorView(prim.attributes[ATTRIBUTE_WEIGHTS_0]);
+  }
+  return primitives;
+}
+
+bool glTFDocument::ReadImage(uint32_t imageIndex,
+                             std::vector<uint8_t>& encoded,
+                             std::string& err) const {
+  const Image& image = mImages[imageIndex];
+  encoded.clear();
+  if (image.uri.empty()) {
+    if (image.bufferView < 0 ||
+        static_cast<size_t>(image.bufferView) >= mBufferViews.size()) {
+      err = "image " + std::to_string(imageIndex) + " has no data";
+      return false;
+    }
+    const BufferView& view = mBufferViews[image.bufferView];
+    if (view.buffer < 0 ||
+        static_cast<size_t>(view.buffer) >= mBuffers.size() ||
+        view.byteOffset + view.byteLength > mBuffers[view.buffer].data.size()) {
+      err = "image " + std::to_string(imageIndex) + " lies outside its buffer";
+      return false;
+    }
+    const uint8_t* data = mBuffers[view.buffer].data.data() + view.byteOffset;
+    encoded.assign(data, data + view.byteLength);
+    return true;
+  }
+  if (IsDataUri(image.uri)) {
+    if (!DecodeDataUri(image.uri, encoded)) {
+      err = "invalid data uri of image " + std::to_string(imageIndex);
+      return false;
+    }
+    return true;
+  }
+  if (GetFileExtension(image.uri) == "ktx2") {
+    return true;
+  }
+  AssetFile file;
+  if (!file.Open(mDirectory + "/" + image.uri)) {
+    err = "file open error: " + mDirectory + "/" + image.uri;
+    return false;
+  }
+  encoded.assign(file.GetData(), file.GetData() + file.GetSize());
+  return true;
+}
+
+}  // namespace hkr
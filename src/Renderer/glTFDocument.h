@@ -0,0 +1,146 @@
+#pragma once
+
+#include "Renderer/AccessorReader.h"
+#include "Renderer/MeshCompression.h"
+#include "Renderer/ModelDesc.h"
+#include "Util/AssetPack.h"
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace hkr {
+
+class ThreadPool;
+
+// front end glTF files are parsed with
+enum class glTFParser {
+  // a tinygltf::Model is built first and flattened by BuildModelDesc
+  TinyglTF,
+  // see glTFDocument
+  Simdjson,
+};
+
+// A .gltf or .glb file parsed with simdjson's on demand api. Samplers,
+// textures, materials, nodes and the default scene go straight into
+// ModelDesc, only what meshes and images are decoded from is kept: buffers,
+// buffer views, accessors, primitives and images. Buffers are read through
+// the asset pack or mappings and accessors point into them, there is no copy
+// of the document like tinygltf::Model. EXT_meshopt_compression buffer views
+// and KHR_draco_mesh_compression primitives are decoded on load, extensions
+// other than those and KHR_texture_basisu are ignored.
+class glTFDocument {
+public:
+  // returns false and fills err if the file cannot be read, is not glTF 2.0
+  // or an accessor lies outside its buffer. Compressed pack entries are
+  // decompressed on the thread pool if there is one.
+  bool Load(const std::string& fileName,
+            ModelDesc& desc,
+            std::string& err,
+            ThreadPool* threadPool = nullptr);
+
+  // of the primitives of a mesh that have indices, see DecodeMesh
+  std::vector<PrimitiveAccessors> GetPrimitiveAccessors(
+      uint32_t meshIndex) const;
+  uint32_t GetImageCount() const {
+    return static_cast<uint32_t>(mImages.size());
+  }
+  // of an image, empty for images in a buffer view
+  const std::string& GetImageUri(uint32_t imageIndex) const {
+    return mImages[imageIndex].uri;
+  }
+  // encoded bytes of an image, left empty for external ktx2 files which are
+  // read by name
+  bool ReadImage(uint32_t imageIndex,
+                 std::vector<uint8_t>& encoded,
+                 std::string& err) const;
+
+  enum Attribute : uint32_t {
+    ATTRIBUTE_POSITION,
+    ATTRIBUTE_NORMAL,
+    ATTRIBUTE_TANGENT,
+    ATTRIBUTE_TEXCOORD_0,
+    ATTRIBUTE_COLOR_0,
+    ATTRIBUTE_JOINTS_0,
+    ATTRIBUTE_WEIGHTS_0,
+    ATTRIBUTE_COUNT,
+  };
+
+  struct Buffer {
+    std::string uri;
+    uint64_t byteLength = 0;
+    // external file, decoded data uri or compressed data, or the binary
+    // chunk of a .glb
+    AssetFile file;
+    std::vector<uint8_t> decoded;
+    std::span<const uint8_t> data;
+    // EXT_meshopt_compression fallback, only referenced by compressed views
+    // and left without data
+    bool fallback = false;
+  };
+
+  struct BufferView {
+    int32_t buffer = -1;
+    uint64_t byteOffset = 0;
+    uint64_t byteLength = 0;
+    uint32_t byteStride = 0;
+    // EXT_meshopt_compression, the view is pointed at the decoded data
+    bool compressed = false;
+    MeshoptBufferView meshopt;
+  };
+
+  struct Accessor {
+    int32_t bufferView = -1;
+    uint64_t byteOffset = 0;
+    int32_t componentType = -1;
+    uint32_t count = 0;
+    uint32_t components = 0;
+    bool normalized = false;
+  };
+
+  struct Primitive {
+    int32_t indices = -1;
+    int32_t material = -1;
+    // accessor indices, -1 if absent
+    std::array<int32_t, ATTRIBUTE_COUNT> attributes;
+    // KHR_draco_mesh_compression buffer view and attribute ids, -1 if absent
+    int32_t dracoBufferView = -1;
+    std::array<int32_t, ATTRIBUTE_COUNT> dracoAttributes;
+  };
+
+  struct Mesh {
+    uint32_t firstPrimitive = 0;
+    uint32_t primitiveCount = 0;
+  };
+
+  struct Image {
+    // percent decoded
+    std::string uri;
+    int32_t bufferView = -1;
+  };
+
+private:
+  bool LoadBuffers(std::span<const uint8_t> binaryChunk,
+                   std::string& err,
+                   ThreadPool* threadPool);
+  // decode compressed buffer views and primitives into buffers appended to
+  // mBuffers, one job per view or primitive
+  bool DecompressMeshes(std::string& err, ThreadPool* threadPool);
+  bool ValidateAccessors(std::string& err) const;
+  void BuildPrimitives(ModelDesc& desc) const;
+  AccessorView GetAccessorView(int32_t accessorIndex) const;
+
+private:
+  std::string mDirectory;
+  AssetFile mFile;
+  std::vector<Buffer> mBuffers;
+  std::vector<BufferView> mBufferViews;
+  std::vector<Accessor> mAccessors;
+  std::vector<Primitive> mPrimitives;
+  std::vector<Mesh> mMeshes;
+  std::vector<Image> mImages;
+};
+
+}  // namespace hkr
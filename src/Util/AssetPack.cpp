@@ -0,0 +1,400 @@
+#include "Util/AssetPack.h"
+#include "Util/Hash.h"
+#include "Util/ThreadPool.h"
+
+#include <lz4.h>
+#include <lz4hc.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <type_traits>
+
+namespace hkr {
+
+struct AssetPackMount {
+  // normalized, ends with '/'
+  std::string directory;
+  AssetPack pack;
+};
+
+}  // namespace hkr
+
+namespace {
+
+static_assert(std::is_trivially_copyable_v<hkr::AssetPackEntry>);
+
+std::mutex gMountMutex;
+std::shared_ptr<const hkr::AssetPackMount> gMount;
+
+std::shared_ptr<const hkr::AssetPackMount> GetMount() {
+  std::lock_guard<std::mutex> lock(gMountMutex);
+  return gMount;
+}
+
+std::string NormalizePath(const std::string& fileName) {
+  return std::filesystem::path(fileName).lexically_normal().generic_string();
+}
+
+// path of a file relative to the mounted directory, empty if it lies outside
+std::string GetPackPath(const hkr::AssetPackMount& mount,
+                        const std::string& fileName) {
+  const std::string path = NormalizePath(fileName);
+  if (path.size() <= mount.directory.size() ||
+      path.compare(0, mount.directory.size(), mount.directory) != 0) {
+    return {};
+  }
+  return path.substr(mount.directory.size());
+}
+
+const hkr::AssetPackEntry* FindEntry(const hkr::AssetPackMount& mount,
+                                     const std::string& fileName) {
+  const std::string path = GetPackPath(mount, fileName);
+  return path.empty() ? nullptr : mount.pack.Find(path);
+}
+
+uint32_t GetBlockCount(uint64_t size) {
+  return static_cast<uint32_t>((size + hkr::ASSET_PACK_BLOCK_SIZE - 1) /
+                               hkr::ASSET_PACK_BLOCK_SIZE);
+}
+
+uint64_t Align(uint64_t offset) {
+  return (offset + hkr::ASSET_PACK_ALIGNMENT - 1) &
+         ~(hkr::ASSET_PACK_ALIGNMENT - 1);
+}
+
+// a file being packed, data is what ends up in the pack
+struct PackedFile {
+  std::string path;
+  hkr::AssetPackEntry entry;
+  std::vector<uint32_t> blockSizes;
+  std::vector<uint8_t> data;
+  std::string err;
+};
+
+void CompressFile(const std::string& fileName, PackedFile& file) {
+  hkr::MappedFile source;
+  if (!source.Open(fileName)) {
+    file.err = "cannot read " + fileName;
+    return;
+  }
+  const uint8_t* src = source.GetData();
+  const uint64_t size = source.GetSize();
+  file.entry.size = size;
+  const uint32_t blockCount = GetBlockCount(size);
+  std::vector<uint8_t> compressed;
+  std::vector<uint32_t> blockSizes(blockCount);
+  for (uint32_t i = 0; i < blockCount; i++) {
+    const uint64_t offset = uint64_t{i} * hkr::ASSET_PACK_BLOCK_SIZE;
+    const int blockSize = static_cast<int>(
+        std::min<uint64_t>(size - offset, hkr::ASSET_PACK_BLOCK_SIZE));
+    const size_t start = compressed.size();
+    compressed.resize(start + LZ4_compressBound(blockSize));
+    const int compressedSize = LZ4_compress_HC(
+        reinterpret_cast<const char*>(src + offset),
+        reinterpret_cast<char*>(compressed.data() + start), blockSize,
+        LZ4_compressBound(blockSize), LZ4HC_CLEVEL_DEFAULT);
+    if (compressedSize <= 0) {
+      file.err = "cannot compress " + fileName;
+      return;
+    }
+    compressed.resize(start + compressedSize);
+    blockSizes[i] = static_cast<uint32_t>(compressedSize);
+  }
+  if (blockCount > 0 && compressed.size() < size - size / 8) {
+    file.entry.compression = hkr::AssetCompression::LZ4;
+    file.blockSizes = std::move(blockSizes);
+    file.data = std::move(compressed);
+  } else {
+    file.data.assign(src, src + size);
+  }
+  file.entry.storedSize = file.data.size();
+}
+
+}  // namespace
+
+namespace hkr {
+
+bool AssetPack::Open(const std::string& fileName) {
+  if (!mFile.Open(fileName)) {
+    return false;
+  }
+  const uint8_t* data = mFile.GetData();
+  const uint64_t fileSize = mFile.GetSize();
+  AssetPackHeader header;
+  if (fileSize < sizeof(AssetPackHeader)) {
+    mFile.Close();
+    return false;
+  }
+  memcpy(&header, data, sizeof(AssetPackHeader));
+  const uint64_t entriesSize =
+      uint64_t{header.entryCount} * sizeof(AssetPackEntry);
+  const uint64_t blocksSize = uint64_t{header.blockCount} * sizeof(uint32_t);
+  if (header.magic != ASSET_PACK_MAGIC ||
+      header.version != ASSET_PACK_VERSION ||
+      fileSize < sizeof(AssetPackHeader) + entriesSize + blocksSize) {
+    mFile.Close();
+    return false;
+  }
+  mEntries = {reinterpret_cast<const AssetPackEntry*>(
+                  data + sizeof(AssetPackHeader)),
+              header.entryCount};
+  mBlockSizes = {reinterpret_cast<const uint32_t*>(
+                     data + sizeof(AssetPackHeader) + entriesSize),
+                 header.blockCount};
+  for (const AssetPackEntry& entry : mEntries) {
+    const bool compressed = entry.compression == AssetCompression::LZ4;
+    if (entry.offset > fileSize || entry.storedSize > fileSize - entry.offset ||
+        (!compressed && (entry.compression != AssetCompression::None ||
+                         entry.storedSize != entry.size)) ||
+        (compressed && uint64_t{entry.firstBlock} + GetBlockCount(entry.size) >
+                           header.blockCount)) {
+      mFile.Close();
+      mEntries = {};
+      mBlockSizes = {};
+      return false;
+    }
+  }
+  return true;
+}
+
+const AssetPackEntry* AssetPack::Find(const std::string& path) const {
+  const uint64_t hash = HashFnv1a(path.data(), path.size());
+  auto it = std::lower_bound(
+      mEntries.begin(), mEntries.end(), hash,
+      [](const AssetPackEntry& entry, uint64_t h) { return entry.hash < h; });
+  return it != mEntries.end() && it->hash == hash ? &*it : nullptr;
+}
+
+bool AssetPack::Decompress(const AssetPackEntry& entry,
+                           uint8_t* dst,
+                           ThreadPool* threadPool) const {
+  const uint32_t blockCount = GetBlockCount(entry.size);
+  std::span<const uint32_t> blockSizes =
+      mBlockSizes.subspan(entry.firstBlock, blockCount);
+  std::vector<uint64_t> offsets(blockCount);
+  uint64_t offset = 0;
+  for (uint32_t i = 0; i < blockCount; i++) {
+    offsets[i] = offset;
+    offset += blockSizes[i];
+  }
+  if (offset != entry.storedSize) {
+    return false;
+  }
+  const uint8_t* src = GetData(entry);
+  std::atomic<bool> failed = false;
+  auto decompressBlock = [&](uint32_t i) {
+    const uint64_t dstOffset = uint64_t{i} * ASSET_PACK_BLOCK_SIZE;
+    const int blockSize = static_cast<int>(
+        std::min<uint64_t>(entry.size - dstOffset, ASSET_PACK_BLOCK_SIZE));
+    const int size = LZ4_decompress_safe(
+        reinterpret_cast<const char*>(src + offsets[i]),
+        reinterpret_cast<char*>(dst + dstOffset),
+        static_cast<int>(blockSizes[i]), blockSize);
+    if (size != blockSize) {
+      failed = true;
+    }
+  };
+  if (threadPool && blockCount > 1) {
+    threadPool->ParallelFor(blockCount, decompressBlock);
+  } else {
+    for (uint32_t i = 0; i < blockCount; i++) {
+      decompressBlock(i);
+    }
+  }
+  return !failed;
+}
+
+std::string GetAssetPackFileName(const std::string& directory) {
+  std::string name = directory;
+  while (!name.empty() && name.back() == '/') {
+    name.pop_back();
+  }
+  return name + ".hkp";
+}
+
+bool MountAssetPack(const std::string& directory,
+                    const std::string& packFileName) {
+  auto mount = std::make_shared<AssetPackMount>();
+  if (!mount->pack.Open(packFileName)) {
+    UnmountAssetPack();
+    return false;
+  }
+  mount->directory = NormalizePath(directory);
+  if (mount->directory.empty() || mount->directory.back() != '/') {
+    mount->directory += '/';
+  }
+  std::lock_guard<std::mutex> lock(gMountMutex);
+  gMount = std::move(mount);
+  return true;
+}
+
+void UnmountAssetPack() {
+  std::lock_guard<std::mutex> lock(gMountMutex);
+  gMount.reset();
+}
+
+bool AssetFile::Open(const std::string& fileName, ThreadPool* threadPool) {
+  Close();
+  std::shared_ptr<const AssetPackMount> mount = GetMount();
+  const AssetPackEntry* entry = mount ? FindEntry(*mount, fileName) : nullptr;
+  if (!entry) {
+    if (!mFile.Open(fileName)) {
+      return false;
+    }
+    mData = mFile.GetData();
+    mSize = mFile.GetSize();
+    mOpen = true;
+    return true;
+  }
+  if (entry->compression == AssetCompression::None) {
+    mMount = std::move(mount);
+    mData = mMount->pack.GetData(*entry);
+  } else {
+    mBuffer.resize(entry->size);
+    if (!mount->pack.Decompress(*entry, mBuffer.data(), threadPool)) {
+      mBuffer = {};
+      return false;
+    }
+    mData = mBuffer.data();
+  }
+  mSize = entry->size;
+  mOpen = true;
+  return true;
+}
+
+void AssetFile::Close() {
+  mMount.reset();
+  mFile.Close();
+  mBuffer = {};
+  mData = nullptr;
+  mSize = 0;
+  mOpen = false;
+}
+
+bool AssetExists(const std::string& fileName) {
+  std::error_code ec;
+  return IsPackedAsset(fileName) ||
+         std::filesystem::is_regular_file(fileName, ec);
+}
+
+bool GetAssetSize(const std::string& fileName, size_t& size) {
+  std::shared_ptr<const AssetPackMount> mount = GetMount();
+  if (const AssetPackEntry* entry =
+          mount ? FindEntry(*mount, fileName) : nullptr) {
+    size = entry->size;
+    return true;
+  }
+  std::error_code ec;
+  const auto fileSize = std::filesystem::file_size(fileName, ec);
+  if (ec) {
+    return false;
+  }
+  size = static_cast<size_t>(fileSize);
+  return true;
+}
+
+bool IsPackedAsset(const std::string& fileName) {
+  std::shared_ptr<const AssetPackMount> mount = GetMount();
+  return mount && FindEntry(*mount, fileName);
+}
+
+bool WriteAssetPack(const std::string& directory,
+                    const std::string& packFileName,
+                    ThreadPool& threadPool,
+                    AssetPackReport& report,
+                    std::string& err) {
+  namespace fs = std::filesystem;
+  const fs::path root(directory);
+  std::vector<PackedFile> files;
+  std::error_code ec;
+  for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    if (!it->is_regular_file() || it->path().extension() == ".hkp") {
+      continue;
+    }
+    PackedFile& file = files.emplace_back();
+    file.path = it->path().lexically_relative(root).generic_string();
+    file.entry.hash = HashFnv1a(file.path.data(), file.path.size());
+  }
+  if (ec) {
+    err = "cannot list " + directory;
+    return false;
+  }
+  std::sort(files.begin(), files.end(),
+            [](const PackedFile& a, const PackedFile& b) {
+              return a.entry.hash < b.entry.hash;
+            });
+  for (size_t i = 1; i < files.size(); i++) {
+    if (files[i].entry.hash == files[i - 1].entry.hash) {
+      err = "path hashes collide: " + files[i - 1].path + ", " + files[i].path;
+      return false;
+    }
+  }
+
+  threadPool.ParallelFor(
+      static_cast<uint32_t>(files.size()), [&](uint32_t i) {
+        CompressFile((root / files[i].path).string(), files[i]);
+      });
+
+  AssetPackHeader header;
+  header.entryCount = static_cast<uint32_t>(files.size());
+  std::vector<uint32_t> blockSizes;
+  for (PackedFile& file : files) {
+    if (!file.err.empty()) {
+      err = file.err;
+      return false;
+    }
+    file.entry.firstBlock = static_cast<uint32_t>(blockSizes.size());
+    blockSizes.insert(blockSizes.end(), file.blockSizes.begin(),
+                      file.blockSizes.end());
+  }
+  header.blockCount = static_cast<uint32_t>(blockSizes.size());
+  uint64_t offset = sizeof(AssetPackHeader) +
+                    files.size() * sizeof(AssetPackEntry) +
+                    blockSizes.size() * sizeof(uint32_t);
+  for (PackedFile& file : files) {
+    offset = Align(offset);
+    file.entry.offset = offset;
+    offset += file.entry.storedSize;
+  }
+
+  std::ofstream out(packFileName, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    err = "cannot write asset pack: " + packFileName;
+    return false;
+  }
+  auto write = [&out](const void* data, size_t size) {
+    out.write(static_cast<const char*>(data),
+              static_cast<std::streamsize>(size));
+  };
+  write(&header, sizeof(AssetPackHeader));
+  for (const PackedFile& file : files) {
+    write(&file.entry, sizeof(AssetPackEntry));
+  }
+  write(blockSizes.data(), blockSizes.size() * sizeof(uint32_t));
+  uint64_t written = sizeof(AssetPackHeader) +
+                     files.size() * sizeof(AssetPackEntry) +
+                     blockSizes.size() * sizeof(uint32_t);
+  static constexpr uint8_t PADDING[ASSET_PACK_ALIGNMENT] = {};
+  for (const PackedFile& file : files) {
+    write(PADDING, file.entry.offset - written);
+    write(file.data.data(), file.data.size());
+    written = file.entry.offset + file.entry.storedSize;
+    report.fileCount++;
+    report.compressedCount +=
+        file.entry.compression == AssetCompression::LZ4 ? 1 : 0;
+    report.size += file.entry.size;
+    report.storedSize += file.entry.storedSize;
+  }
+  if (!out) {
+    err = "cannot write asset pack: " + packFileName;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace hkr
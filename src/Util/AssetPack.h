@@ -0,0 +1,140 @@
+#pragma once
+
+#include "Util/MappedFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace hkr {
+
+class ThreadPool;
+
+// An asset pack (.hkp) holds the files of an asset directory in one file that
+// is mapped as a whole, so that startup opens one file instead of one per
+// shader, texture and model. Entries are found by the hash of their path
+// relative to the directory. They are either stored as they are and read
+// straight from the mapping, or LZ4 compressed in independent blocks that are
+// decompressed in parallel.
+//
+// layout: AssetPackHeader, the AssetPackEntry array sorted by hash, the
+// uint32_t compressed sizes of the blocks of all compressed entries, then the
+// entry data, each entry starting at a 16 byte aligned offset
+constexpr uint32_t ASSET_PACK_MAGIC = 0x504b4b48;  // "HKKP"
+constexpr uint32_t ASSET_PACK_VERSION = 1;
+constexpr uint64_t ASSET_PACK_ALIGNMENT = 16;
+// uncompressed size of a compressed block, only the last one is smaller
+constexpr uint32_t ASSET_PACK_BLOCK_SIZE = 1u << 20;
+
+struct AssetPackHeader {
+  uint32_t magic = ASSET_PACK_MAGIC;
+  uint32_t version = ASSET_PACK_VERSION;
+  uint32_t entryCount = 0;
+  uint32_t blockCount = 0;
+};
+
+enum class AssetCompression : uint32_t {
+  None,
+  LZ4,
+};
+
+struct AssetPackEntry {
+  // HashFnv1a of the path relative to the asset directory, '/' separated
+  uint64_t hash = 0;
+  uint64_t offset = 0;
+  // of the data in the pack
+  uint64_t storedSize = 0;
+  uint64_t size = 0;
+  AssetCompression compression = AssetCompression::None;
+  // index of the first block size of a compressed entry, it has
+  // ceil(size / ASSET_PACK_BLOCK_SIZE) blocks
+  uint32_t firstBlock = 0;
+};
+
+class AssetPack {
+public:
+  // map the pack, returns false if it is missing or malformed
+  bool Open(const std::string& fileName);
+
+  // entry of a path relative to the asset directory, null if it is not packed
+  const AssetPackEntry* Find(const std::string& path) const;
+  // data of a stored entry
+  const uint8_t* GetData(const AssetPackEntry& entry) const {
+    return mFile.GetData() + entry.offset;
+  }
+  // decompress a compressed entry into dst of entry.size bytes, its blocks
+  // are spread across the thread pool if there is one. Returns false if the
+  // data is corrupt.
+  bool Decompress(const AssetPackEntry& entry,
+                  uint8_t* dst,
+                  ThreadPool* threadPool) const;
+
+private:
+  MappedFile mFile;
+  std::span<const AssetPackEntry> mEntries;
+  std::span<const uint32_t> mBlockSizes;
+};
+
+// pack file next to the asset directory
+std::string GetAssetPackFileName(const std::string& directory);
+
+// files below directory are looked up in the pack first and read from the
+// directory if they are not packed. Returns false and leaves no pack mounted
+// if it cannot be opened.
+bool MountAssetPack(const std::string& directory,
+                    const std::string& packFileName);
+void UnmountAssetPack();
+
+struct AssetPackMount;
+
+// Contents of a file below the asset directory, read through the mounted
+// pack or mapped from disk. Stored entries keep the pack mapped while they
+// are open, compressed ones are decompressed into memory of their own.
+class AssetFile {
+public:
+  // returns false if the file is neither packed nor on disk
+  bool Open(const std::string& fileName, ThreadPool* threadPool = nullptr);
+  void Close();
+
+  bool IsOpen() const { return mOpen; }
+  // 16 byte aligned
+  const uint8_t* GetData() const { return mData; }
+  size_t GetSize() const { return mSize; }
+
+private:
+  std::shared_ptr<const AssetPackMount> mMount;
+  MappedFile mFile;
+  std::vector<uint8_t> mBuffer;
+  const uint8_t* mData = nullptr;
+  size_t mSize = 0;
+  bool mOpen = false;
+};
+
+// whether the file is in the mounted pack or on disk
+bool AssetExists(const std::string& fileName);
+// uncompressed size of the file, returns false if it does not exist
+bool GetAssetSize(const std::string& fileName, size_t& size);
+// whether the file is in the mounted pack
+bool IsPackedAsset(const std::string& fileName);
+
+struct AssetPackReport {
+  uint32_t fileCount = 0;
+  uint32_t compressedCount = 0;
+  uint64_t size = 0;
+  uint64_t storedSize = 0;
+};
+
+// pack every file below directory but other packs. Entries are compressed on
+// the thread pool and kept stored where LZ4 saves less than an eighth, which
+// includes supercompressed ktx2 files. Returns false and fills err on
+// failure.
+bool WriteAssetPack(const std::string& directory,
+                    const std::string& packFileName,
+                    ThreadPool& threadPool,
+                    AssetPackReport& report,
+                    std::string& err);
+
+}  // namespace hkr
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Util/Assert.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace hkr {
+
+// bounded lock-free multi-producer multi-consumer queue, each cell carries a
+// sequence number telling producers and consumers whose turn it is (Vyukov's
+// bounded MPMC queue)
+template <typename T>
+class ConcurrentQueue {
+public:
+  // capacity must be a power of two
+  explicit ConcurrentQueue(size_t capacity)
+      : mCells(new Cell[capacity]), mMask(capacity - 1) {
+    HKR_ASSERT(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+    for (size_t i = 0; i < capacity; i++) {
+      mCells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  ConcurrentQueue(const ConcurrentQueue&) = delete;
+  ConcurrentQueue& operator=(const ConcurrentQueue&) = delete;
+
+  // returns false if the queue is full
+  bool TryPush(T&& value) {
+    Cell* cell;
+    size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &mCells[pos & mMask];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (mEnqueuePos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = mEnqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(value);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // returns false if the queue is empty
+  bool TryPop(T& value) {
+    Cell* cell;
+    size_t pos = mDequeuePos.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &mCells[pos & mMask];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (mDequeuePos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = mDequeuePos.load(std::memory_order_relaxed);
+      }
+    }
+    value = std::move(cell->value);
+    cell->sequence.store(pos + mMask + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> mCells;
+  const size_t mMask;
+  // keep producers and consumers on separate cache lines
+  alignas(64) std::atomic<size_t> mEnqueuePos{0};
+  alignas(64) std::atomic<size_t> mDequeuePos{0};
+};
+
+}  // namespace hkr
@@ -1,24 +1,18 @@
 #include "Util/Filesystem.h"
+#include "Util/AssetPack.h"
 #include "Util/Assert.h"
 
-#include <fstream>
+#include <filesystem>
 
 namespace hkr {
 
 std::vector<char> ReadFile(const std::string& fileName) {
-  std::ifstream file(fileName, std::ios::ate | std::ios::binary);
+  AssetFile file;
+  [[maybe_unused]] const bool opened = file.Open(fileName);
+  HKR_ASSERT(opened);
 
-  HKR_ASSERT(file.is_open());
-
-  const size_t fileSize = (size_t)file.tellg();
-  std::vector<char> buffer(fileSize);
-
-  file.seekg(0);
-  file.read(buffer.data(), fileSize);
-
-  file.close();
-
-  return buffer;
+  const char* data = reinterpret_cast<const char*>(file.GetData());
+  return std::vector<char>(data, data + file.GetSize());
 }
 
 std::string GetFilePath(const std::string& fileName) {
@@ -34,4 +28,28 @@ std::string GetFileExtension(const std::string& fileName) {
   return fileExtension;
 }
 
+bool IsUpToDate(const std::string& fileName,
+                const std::string& sourceFileName) {
+  // packs are built from cooked trees, their files carry no times
+  if (IsPackedAsset(fileName)) {
+    return true;
+  }
+  std::error_code ec;
+  const auto time = std::filesystem::last_write_time(fileName, ec);
+  if (ec) {
+    return false;
+  }
+  const auto sourceTime = std::filesystem::last_write_time(sourceFileName, ec);
+  return !ec && time >= sourceTime;
+}
+
+int64_t GetWriteTime(const std::string& fileName) {
+  if (IsPackedAsset(fileName)) {
+    return -1;
+  }
+  std::error_code ec;
+  const auto time = std::filesystem::last_write_time(fileName, ec);
+  return ec ? -1 : static_cast<int64_t>(time.time_since_epoch().count());
+}
+
 }  // namespace hkr
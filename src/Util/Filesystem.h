@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <string>
 
@@ -11,4 +12,12 @@ std::string GetFilePath(const std::string& fileName);
 
 std::string GetFileExtension(const std::string& fileName);
 
+// whether the file exists and was written no earlier than its source, files
+// in the mounted asset pack always are
+bool IsUpToDate(const std::string& fileName, const std::string& sourceFileName);
+
+// last write time of a file on disk in ticks of the filesystem clock, -1 if it
+// does not exist or is in the mounted asset pack
+int64_t GetWriteTime(const std::string& fileName);
+
 }  // namespace hkr
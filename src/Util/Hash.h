@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hkr {
+
+constexpr uint64_t FNV1A_OFFSET_BASIS = 14695981039346656037ull;
+constexpr uint64_t FNV1A_PRIME = 1099511628211ull;
+
+// 64-bit FNV-1a, pass the previous result as hash to continue hashing
+inline uint64_t HashFnv1a(const void* data,
+                          size_t size,
+                          uint64_t hash = FNV1A_OFFSET_BASIS) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= FNV1A_PRIME;
+  }
+  return hash;
+}
+
+}  // namespace hkr
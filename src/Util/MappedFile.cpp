@@ -0,0 +1,132 @@
+#include "Util/MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <utility>
+
+namespace hkr {
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+  *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    Close();
+    mData = std::exchange(other.mData, nullptr);
+    mSize = std::exchange(other.mSize, 0);
+    mOpen = std::exchange(other.mOpen, false);
+#ifdef _WIN32
+    mFile = std::exchange(other.mFile, nullptr);
+    mMapping = std::exchange(other.mMapping, nullptr);
+#endif
+  }
+  return *this;
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(const std::string& fileName) {
+  Close();
+  HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    return false;
+  }
+  mFile = file;
+  mSize = static_cast<size_t>(size.QuadPart);
+  mOpen = true;
+  // empty files cannot be mapped
+  if (mSize == 0) {
+    return true;
+  }
+  HANDLE mapping =
+      CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping == nullptr) {
+    Close();
+    return false;
+  }
+  mMapping = mapping;
+  mData = static_cast<const uint8_t*>(
+      MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (mData == nullptr) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::Close() {
+  if (mData) {
+    UnmapViewOfFile(mData);
+  }
+  if (mMapping) {
+    CloseHandle(mMapping);
+  }
+  if (mFile) {
+    CloseHandle(mFile);
+  }
+  mData = nullptr;
+  mSize = 0;
+  mOpen = false;
+  mFile = nullptr;
+  mMapping = nullptr;
+}
+#else
+bool MappedFile::Open(const std::string& fileName) {
+  Close();
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  mSize = static_cast<size_t>(st.st_size);
+  // empty files cannot be mapped
+  if (mSize > 0) {
+    void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      mSize = 0;
+      return false;
+    }
+    mData = static_cast<const uint8_t*>(data);
+  }
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  mOpen = true;
+  return true;
+}
+
+void MappedFile::Close() {
+  if (mData) {
+    munmap(const_cast<uint8_t*>(mData), mSize);
+  }
+  mData = nullptr;
+  mSize = 0;
+  mOpen = false;
+}
+#endif
+
+}  // namespace hkr
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace hkr {
+
+// read-only memory mapping of a whole file
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  // returns false if the file does not exist or cannot be mapped
+  bool Open(const std::string& fileName);
+  void Close();
+
+  bool IsOpen() const { return mOpen; }
+  const uint8_t* GetData() const { return mData; }
+  size_t GetSize() const { return mSize; }
+
+private:
+  const uint8_t* mData = nullptr;
+  size_t mSize = 0;
+  bool mOpen = false;
+#ifdef _WIN32
+  void* mFile = nullptr;
+  void* mMapping = nullptr;
+#endif
+};
+
+}  // namespace hkr
@@ -0,0 +1,50 @@
+#pragma once
+
+// widest instruction set the translation unit is compiled for, sse2 is part
+// of every x86-64 target and neon of every aarch64 one so one of them is
+// usually available without extra compiler flags
+#if defined(__AVX2__)
+#define HKR_SIMD_AVX2
+#define HKR_SIMD_SSE2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HKR_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define HKR_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+// ssse3 byte shuffles are not part of the x86-64 baseline, kernels that need
+// them are compiled for ssse3 with HKR_TARGET_SSSE3 and only called once
+// HasSSSE3 says the cpu supports it
+#if defined(HKR_SIMD_SSE2)
+#include <tmmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define HKR_TARGET_SSSE3 __attribute__((target("ssse3")))
+#else
+#define HKR_TARGET_SSSE3
+#include <intrin.h>
+#endif
+
+namespace hkr {
+
+inline bool HasSSSE3() {
+#if defined(__SSSE3__)
+  return true;
+#elif defined(__GNUC__) || defined(__clang__)
+  static const bool supported = __builtin_cpu_supports("ssse3");
+  return supported;
+#else
+  static const bool supported = [] {
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+  }();
+  return supported;
+#endif
+}
+
+}  // namespace hkr
+#endif
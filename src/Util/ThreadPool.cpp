@@ -0,0 +1,93 @@
+#include "Util/ThreadPool.h"
+
+#include <algorithm>
+#include <memory>
+
+namespace hkr {
+
+void ThreadPool::Init(uint32_t threadCount) {
+  if (threadCount == 0) {
+    threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+  }
+  mStopping = false;
+  mThreads.reserve(threadCount);
+  for (uint32_t i = 0; i < threadCount; i++) {
+    mThreads.emplace_back(&ThreadPool::WorkerLoop, this);
+  }
+}
+
+void ThreadPool::Cleanup() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopping = true;
+  }
+  mCondition.notify_all();
+  for (auto& thread : mThreads) {
+    thread.join();
+  }
+  mThreads.clear();
+}
+
+void ThreadPool::Submit(std::function<void()>&& job) {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mJobs.push_back(std::move(job));
+  }
+  mCondition.notify_one();
+}
+
+void ThreadPool::ParallelFor(uint32_t count,
+                             const std::function<void(uint32_t)>& func) {
+  if (count == 0) {
+    return;
+  }
+  // shared with the helper jobs, which may only start after the range has
+  // been finished and func is gone
+  struct State {
+    const std::function<void(uint32_t)>* func;
+    uint32_t count;
+    std::atomic<uint32_t> next{0};
+    std::atomic<uint32_t> completed{0};
+    std::mutex mutex;
+    std::condition_variable condition;
+  };
+  auto state = std::make_shared<State>();
+  state->func = &func;
+  state->count = count;
+  auto run = [](State& state) {
+    uint32_t i;
+    while ((i = state.next++) < state.count) {
+      (*state.func)(i);
+      if (++state.completed == state.count) {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.condition.notify_all();
+      }
+    }
+  };
+  const uint32_t helperCount = std::min(GetThreadCount(), count - 1);
+  for (uint32_t i = 0; i < helperCount; i++) {
+    Submit([state, run]() { run(*state); });
+  }
+  run(*state);
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->condition.wait(lock,
+                        [&state] { return state->completed == state->count; });
+}
+
+void ThreadPool::WorkerLoop() {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mCondition.wait(lock, [this] { return mStopping || !mJobs.empty(); });
+      if (mJobs.empty()) {
+        return;
+      }
+      job = std::move(mJobs.front());
+      mJobs.pop_front();
+    }
+    job();
+  }
+}
+
+}  // namespace hkr
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hkr {
+
+// fixed set of worker threads running jobs in submission order
+class ThreadPool {
+public:
+  // threadCount 0 picks one thread per hardware thread minus the render thread
+  void Init(uint32_t threadCount = 0);
+  // finish queued jobs and join the workers
+  void Cleanup();
+
+  void Submit(std::function<void()>&& job);
+  // run func(i) for every i in [0, count) on the workers and the calling
+  // thread and return once all calls have finished. The caller works through
+  // the range itself while the workers are busy, so it may be called from a
+  // job.
+  void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& func);
+  uint32_t GetThreadCount() const {
+    return static_cast<uint32_t>(mThreads.size());
+  }
+
+private:
+  void WorkerLoop();
+
+private:
+  std::vector<std::thread> mThreads;
+  std::deque<std::function<void()>> mJobs;
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  bool mStopping = false;
+};
+
+}  // namespace hkr
@@ -1,6 +1,7 @@
 #include "Util/vk_util.h"
 #include "Util/vk_debug.h"
-#include "Util/Filesystem.h"
+#include "Util/Assert.h"
+#include "Util/AssetPack.h"
 
 #include <ktx.h>
 
@@ -80,6 +81,27 @@ void InsertImageMemoryBarrier(VkCommandBuffer commandbuffer,
   vkCmdPipelineBarrier2(commandbuffer, &dependInfo);
 }
 
+void InsertMemoryBarrier(VkCommandBuffer commandBuffer,
+                         VkPipelineStageFlags2 srcStageMask,
+                         VkPipelineStageFlags2 dstStageMask,
+                         VkAccessFlags2 srcAccessMask,
+                         VkAccessFlags2 dstAccessMask) {
+  VkMemoryBarrier2 memoryBarrier{};
+  memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+  memoryBarrier.srcStageMask = srcStageMask;
+  memoryBarrier.srcAccessMask = srcAccessMask;
+  memoryBarrier.dstStageMask = dstStageMask;
+  memoryBarrier.dstAccessMask = dstAccessMask;
+
+  VkDependencyInfo dependInfo{};
+  dependInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  dependInfo.pNext = nullptr;
+  dependInfo.memoryBarrierCount = 1;
+  dependInfo.pMemoryBarriers = &memoryBarrier;
+
+  vkCmdPipelineBarrier2(commandBuffer, &dependInfo);
+}
+
 void TransitImageLayout(VkCommandBuffer commandBuffer,
                         VkImage image,
                         VkImageLayout oldLayout,
@@ -122,98 +144,15 @@ void TransitImageLayout(VkCommandBuffer commandBuffer,
                            dstAccess, oldLayout, newLayout, subresourceRange);
 }
 
-void GenerateMipmaps(VkCommandBuffer commandBuffer,
-                     VkImage image,
-                     int32_t texWidth,
-                     int32_t texHeight,
-                     uint32_t mipLevels) {
-  VkImageMemoryBarrier2 barrier{};
-  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
-  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
-  barrier.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
-  barrier.image = image;
-  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  barrier.subresourceRange.baseMipLevel = 0;
-  barrier.subresourceRange.levelCount = 1;
-  barrier.subresourceRange.baseArrayLayer = 0;
-  barrier.subresourceRange.layerCount = 1;
-
-  VkDependencyInfo dependInfo{};
-  dependInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
-  dependInfo.pNext = nullptr;
-  dependInfo.imageMemoryBarrierCount = 1;
-  dependInfo.pImageMemoryBarriers = &barrier;
-
-  int32_t mipWidth = texWidth;
-  int32_t mipHeight = texHeight;
-
-  for (uint32_t i = 1; i < mipLevels; i++) {
-    barrier.subresourceRange.baseMipLevel = i - 1;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
-    barrier.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
-    barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
-
-    vkCmdPipelineBarrier2(commandBuffer, &dependInfo);
-
-    VkImageBlit2 blit{};
-    blit.sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2;
-    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    blit.srcSubresource.mipLevel = i - 1;
-    blit.srcSubresource.baseArrayLayer = 0;
-    blit.srcSubresource.layerCount = 1;
-    blit.srcOffsets[0] = {0, 0, 0};
-    blit.srcOffsets[1] = {std::max(mipWidth >> (i - 1), 1),
-                          std::max(mipHeight >> (i - 1), 1), 1};
-    blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    blit.dstSubresource.mipLevel = i;
-    blit.dstSubresource.baseArrayLayer = 0;
-    blit.dstSubresource.layerCount = 1;
-    blit.dstOffsets[0] = {0, 0, 0};
-    blit.dstOffsets[1] = {std::max(mipWidth >> i, 1),
-                          std::max(mipHeight >> i, 1), 1};
-
-    VkBlitImageInfo2 blitInfo{};
-    blitInfo.sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2;
-    blitInfo.srcImage = image;
-    blitInfo.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-    blitInfo.dstImage = image;
-    blitInfo.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    blitInfo.filter = VK_FILTER_LINEAR;
-    blitInfo.regionCount = 1;
-    blitInfo.pRegions = &blit;
-
-    vkCmdBlitImage2(commandBuffer, &blitInfo);
-
-    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
-    barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
-    barrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT;
-
-    vkCmdPipelineBarrier2(commandBuffer, &dependInfo);
-  }
-
-  barrier.subresourceRange.baseMipLevel = mipLevels - 1;
-  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-  barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
-  barrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT;
-
-  vkCmdPipelineBarrier2(commandBuffer, &dependInfo);
-}
-
 void CopyBufferToImage(VkCommandBuffer commandBuffer,
                        VkBuffer buffer,
                        VkImage image,
                        uint32_t width,
-                       uint32_t height) {
+                       uint32_t height,
+                       VkDeviceSize bufferOffset) {
   VkBufferImageCopy2 copyRegion{};
   copyRegion.sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2;
-  copyRegion.bufferOffset = 0;
+  copyRegion.bufferOffset = bufferOffset;
   copyRegion.bufferRowLength = 0;
   copyRegion.bufferImageHeight = 0;
   copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -235,12 +174,13 @@ void CopyBufferToImage(VkCommandBuffer commandBuffer,
 void CopyBufferToTexture(VkCommandBuffer commandBuffer,
                          VkBuffer buffer,
                          VkImage image,
-                         std::span<VkBufferImageCopy2> copyRegions) {
+                         std::span<VkBufferImageCopy2> copyRegions,
+                         VkImageLayout dstImageLayout) {
   VkCopyBufferToImageInfo2 copyInfo{};
   copyInfo.sType = VK_STRUCTURE_TYPE_COPY_BUFFER_TO_IMAGE_INFO_2;
   copyInfo.srcBuffer = buffer;
   copyInfo.dstImage = image;
-  copyInfo.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  copyInfo.dstImageLayout = dstImageLayout;
   copyInfo.regionCount = static_cast<uint32_t>(copyRegions.size());
   copyInfo.pRegions = copyRegions.data();
   vkCmdCopyBufferToImage2(commandBuffer, &copyInfo);
@@ -300,7 +240,11 @@ void CopyImageToImage(VkCommandBuffer commandBuffer,
   blitInfo.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
   blitInfo.srcImage = src;
   blitInfo.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-  blitInfo.filter = VK_FILTER_LINEAR;
+  // unscaled copies need no filtering, so float sources like the raytracer's
+  // rgba32f accumulation image do not need linear filter support
+  const bool scaled = srcExtent.width != dstExtent.width ||
+                      srcExtent.height != dstExtent.height;
+  blitInfo.filter = scaled ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
   blitInfo.regionCount = 1;
   blitInfo.pRegions = &blitRegion;
 
@@ -322,11 +266,14 @@ VkShaderModule CreateShaderModule(VkDevice device,
 
 VkShaderModule LoadShaderModule(VkDevice device,
                                 const std::string& shaderFile) {
-  auto code = ReadFile(shaderFile);
+  // the code is read straight from the aligned pack entry or mapping
+  AssetFile code;
+  [[maybe_unused]] const bool opened = code.Open(shaderFile);
+  HKR_ASSERT(opened);
   VkShaderModuleCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  createInfo.codeSize = code.size();
-  createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+  createInfo.codeSize = code.GetSize();
+  createInfo.pCode = reinterpret_cast<const uint32_t*>(code.GetData());
 
   VkShaderModule shaderModule;
   VK_CHECK(vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule));
@@ -25,6 +25,12 @@ void InsertImageMemoryBarrier(VkCommandBuffer cmdbuffer,
                               VkImageLayout newImageLayout,
                               VkImageSubresourceRange subresourceRange);
 
+void InsertMemoryBarrier(VkCommandBuffer commandBuffer,
+                         VkPipelineStageFlags2 srcStageMask,
+                         VkPipelineStageFlags2 dstStageMask,
+                         VkAccessFlags2 srcAccessMask,
+                         VkAccessFlags2 dstAccessMask);
+
 void TransitImageLayout(VkCommandBuffer commandBuffer,
                         VkImage image,
                         VkImageLayout oldLayout,
@@ -32,22 +38,19 @@ void TransitImageLayout(VkCommandBuffer commandBuffer,
                         uint32_t mipLevels,
                         uint32_t arrayLayers = 1);
 
-void GenerateMipmaps(VkCommandBuffer commandBuffer,
-                     VkImage image,
-                     int32_t texWidth,
-                     int32_t texHeight,
-                     uint32_t mipLevels);
-
 void CopyBufferToImage(VkCommandBuffer commandBuffer,
                        VkBuffer buffer,
                        VkImage image,
                        uint32_t width,
-                       uint32_t height);
+                       uint32_t height,
+                       VkDeviceSize bufferOffset = 0);
 
 void CopyBufferToTexture(VkCommandBuffer commandBuffer,
                          VkBuffer buffer,
                          VkImage image,
-                         std::span<VkBufferImageCopy2> copyRegions);
+                         std::span<VkBufferImageCopy2> copyRegions,
+                         VkImageLayout dstImageLayout =
+                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
 void CopyBufferToBuffer(VkCommandBuffer commandBuffer,
                         VkBuffer srcBuffer,
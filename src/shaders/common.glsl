@@ -4,4 +4,8 @@ struct Payload {
     vec3 newDirection;
     uint rngState;
     bool miss;
+    // ray cone for texture streaming feedback, width at the origin and
+    // spread angle
+    float coneWidth;
+    float coneSpread;
 };
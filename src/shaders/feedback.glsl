@@ -0,0 +1,52 @@
+// Texture streaming feedback and residency, see TextureFeedback. Every
+// texture is split into a grid of cells in uv space. Shaders atomicMin the
+// level of detail they sample a cell at into its uint of the feedback buffer:
+// log2 of the uv footprint of a pixel, which does not depend on the levels of
+// the texture that are resident, in 1/16 steps offset by 32. The streamer
+// adds log2 of the texture size. In turn it writes the finest level that is
+// resident around each cell, one byte per cell, which shaders clamp sampling
+// to.
+
+const float FEEDBACK_LOD_OFFSET = 32.0;
+const float FEEDBACK_LOD_SCALE = 16.0;
+// of the model samplers
+const float FEEDBACK_MAX_ANISOTROPY = 8.0;
+// cells per side of the grid of a texture
+const uint FEEDBACK_GRID_SIZE = 32;
+const uint FEEDBACK_CELL_COUNT = FEEDBACK_GRID_SIZE * FEEDBACK_GRID_SIZE;
+
+uint EncodeFeedbackLod(float uvLod)
+{
+    return uint(clamp((uvLod + FEEDBACK_LOD_OFFSET) * FEEDBACK_LOD_SCALE, 0.0,
+                      2.0 * FEEDBACK_LOD_OFFSET * FEEDBACK_LOD_SCALE));
+}
+
+// uv space level of detail of a footprint with the given major and minor
+// axis lengths, anisotropic filtering covers the major axis with up to
+// FEEDBACK_MAX_ANISOTROPY samples
+float FeedbackLod(float major, float minor)
+{
+    return log2(max(max(major / FEEDBACK_MAX_ANISOTROPY, minor), 1e-12));
+}
+
+// one pixel in every 8x8 block reports, enough to find the finest level a
+// texture is sampled at while keeping the atomics rare
+bool IsFeedbackPixel(uvec2 pixel)
+{
+    return (pixel.x & 7) == 0 && (pixel.y & 7) == 0;
+}
+
+// index of the cell of a texture that a uv falls into, uvs repeat
+uint FeedbackIndex(uint textureIndex, vec2 uv)
+{
+    const uvec2 cell = min(uvec2(fract(uv) * float(FEEDBACK_GRID_SIZE)),
+                           uvec2(FEEDBACK_GRID_SIZE - 1));
+    return textureIndex * FEEDBACK_CELL_COUNT + cell.y * FEEDBACK_GRID_SIZE + cell.x;
+}
+
+// finest resident level of the cell at index, packed holds the residency
+// bytes of four cells
+float ResidentLod(uint packed, uint index)
+{
+    return float(bitfieldExtract(packed, int(index & 3) * 8, 8));
+}
@@ -1,18 +1,27 @@
+#include "feedback.glsl"
+
 hitAttributeEXT vec2 attribs;
 
 struct GeometryNode {
-    uint64_t vertexBufferDeviceAddress;
+    uint64_t positionBufferDeviceAddress;
+    uint64_t attributeBufferDeviceAddress;
     uint64_t indexBufferDeviceAddress;
     int baseColorTextureIndex;
     int occlusionTextureIndex;
     int normalTextureIndex;
+    // 2 or 4 bytes, indices are relative to the position/attribute addresses
+    uint indexSize;
 };
 
 layout(binding = 4, set = 0) buffer GeometryNodes {
     GeometryNode nodes[];
 } geometryNodes;
-layout(buffer_reference, scalar) buffer Vertices {
-    vec4 v[];
+layout(buffer_reference, scalar) buffer Positions {
+    vec3 p[];
+};
+// octahedral normal, octahedral tangent, half uv
+layout(buffer_reference, scalar) buffer Attributes {
+    uvec3 a[];
 };
 layout(buffer_reference, scalar) buffer Indices {
     uint i[];
@@ -21,12 +30,18 @@ layout(buffer_reference, scalar) buffer Data {
     vec4 f[];
 };
 
-layout(binding = 5, set = 0) uniform sampler2D textures[];
+// finest resident level around every cell of the textures, see feedback.glsl
+layout(binding = 6, set = 0) readonly buffer Residency {
+    uint lods[];
+} residency;
+layout(binding = 7, set = 0) uniform sampler2D textures[];
 
 struct Vertex
 {
     vec3 pos;
     vec3 normal;
+    // w is the sign of the bitangent
+    vec4 tangent;
     vec2 uv;
 };
 
@@ -37,26 +52,58 @@ struct HitInfo {
     vec3 worldNormal;
     vec4 color;
     vec2 uv;
+    // of the triangle, for the level of detail of ray cones
+    vec3 worldFaceNormal;
+    // half of log2 of the uv area over the world area of the triangle
+    float uvAreaLod;
 };
 
+vec3 OctDecode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0) {
+        v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
+// Normal maps are cooked to bc5 and transcoded to bc5 or eac rg11, two
+// channel formats without z, so only x and y are read and z is rebuilt.
+vec3 DecodeNormalMap(vec2 xy) {
+    vec3 n;
+    n.xy = xy * 2.0f - 1.0f;
+    n.z = sqrt(max(0.0f, 1.0f - dot(n.xy, n.xy)));
+    return n;
+}
+
+// finest resident level, there are no derivatives to select one with
+vec4 SampleTexture(int textureIndex, vec2 uv) {
+    const uint cell = FeedbackIndex(uint(textureIndex), uv);
+    const float lod = ResidentLod(residency.lods[cell >> 2], cell);
+    return textureLod(textures[nonuniformEXT(textureIndex)], uv, lod);
+}
+
 HitInfo GetHitInfo(uint primitiveID) {
     HitInfo hitInfo;
     const uint triIndex = primitiveID * 3;
 
-    GeometryNode geometryNode = geometryNodes.nodes[gl_GeometryIndexEXT];
+    // the instance's custom index is the first node of its mesh's primitives
+    GeometryNode geometryNode = geometryNodes.nodes[gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT];
 
     Indices indices = Indices(geometryNode.indexBufferDeviceAddress);
-    Vertices vertices = Vertices(geometryNode.vertexBufferDeviceAddress);
+    Positions positions = Positions(geometryNode.positionBufferDeviceAddress);
+    Attributes attributes = Attributes(geometryNode.attributeBufferDeviceAddress);
     Vertex verticeInfos[3];
     for (uint i = 0; i < 3; i++) {
-        const uint vertexIndex = indices.i[triIndex + i];
-        const uint glTFVertexSize = 24; // 24 float
-        const uint offset = vertexIndex * glTFVertexSize / 4;
-        vec4 d0 = vertices.v[offset + 0];
-        vec4 d1 = vertices.v[offset + 1];
-        verticeInfos[i].pos = d0.xyz;
-        verticeInfos[i].normal = vec3(d0.w, d1.xy);
-        verticeInfos[i].uv = d1.zw;
+        const uint index = triIndex + i;
+        // 16 bit indices are read as halves of the 4 byte aligned words
+        const uint vertexIndex = geometryNode.indexSize == 2
+            ? (indices.i[index >> 1] >> ((index & 1) * 16)) & 0xffff
+            : indices.i[index];
+        const uvec3 a = attributes.a[vertexIndex];
+        verticeInfos[i].pos = positions.p[vertexIndex];
+        verticeInfos[i].normal = OctDecode(unpackSnorm2x16(a.x));
+        verticeInfos[i].tangent = vec4(OctDecode(unpackSnorm2x16(a.y)), (a.y & 0x10000) != 0 ? -1.0f : 1.0f);
+        verticeInfos[i].uv = unpackHalf2x16(a.z);
     }
     const vec3 barycentric = vec3(1.0f - attribs.x - attribs.y, attribs.x, attribs.y);
     // position
@@ -66,13 +113,31 @@ HitInfo GetHitInfo(uint primitiveID) {
     // uv
     hitInfo.uv = verticeInfos[0].uv * barycentric.x + verticeInfos[1].uv * barycentric.y + verticeInfos[2].uv * barycentric.z;
 
-    // normal
-    hitInfo.localNormal = texture(textures[nonuniformEXT(geometryNode.normalTextureIndex)], hitInfo.uv).rgb;
+    // texture footprint per world area
+    const vec3 e1 = gl_ObjectToWorldEXT * vec4(verticeInfos[1].pos - verticeInfos[0].pos, 0.0f);
+    const vec3 e2 = gl_ObjectToWorldEXT * vec4(verticeInfos[2].pos - verticeInfos[0].pos, 0.0f);
+    const vec2 t1 = verticeInfos[1].uv - verticeInfos[0].uv;
+    const vec2 t2 = verticeInfos[2].uv - verticeInfos[0].uv;
+    const vec3 faceNormal = cross(e1, e2);
+    const float worldArea = length(faceNormal);
+    hitInfo.worldFaceNormal = worldArea > 0.0f ? faceNormal / worldArea : vec3(0.0f, 0.0f, 1.0f);
+    hitInfo.uvAreaLod = 0.5f * log2(max(abs(t1.x * t2.y - t2.x * t1.y), 1e-20f) / max(worldArea, 1e-20f));
+
+    // normal, the normal map is in the tangent space of the vertices
+    const vec3 normal = normalize(verticeInfos[0].normal * barycentric.x + verticeInfos[1].normal * barycentric.y + verticeInfos[2].normal * barycentric.z);
+    hitInfo.localNormal = normal;
+    if (geometryNode.normalTextureIndex >= 0) {
+        const vec3 tangent = verticeInfos[0].tangent.xyz * barycentric.x + verticeInfos[1].tangent.xyz * barycentric.y + verticeInfos[2].tangent.xyz * barycentric.z;
+        const vec3 t = normalize(tangent - normal * dot(normal, tangent));
+        const vec3 b = cross(normal, t) * verticeInfos[0].tangent.w;
+        const vec3 n = DecodeNormalMap(SampleTexture(geometryNode.normalTextureIndex, hitInfo.uv).xy);
+        hitInfo.localNormal = t * n.x + b * n.y + normal * n.z;
+    }
     hitInfo.worldNormal = normalize((hitInfo.localNormal * gl_WorldToObjectEXT).xyz);
     hitInfo.worldNormal = faceforward(hitInfo.worldNormal, gl_WorldRayDirectionEXT, hitInfo.worldNormal);
 
     // color
-    hitInfo.color = texture(textures[nonuniformEXT(geometryNode.baseColorTextureIndex)], hitInfo.uv);
+    hitInfo.color = SampleTexture(geometryNode.baseColorTextureIndex, hitInfo.uv);
 
     return hitInfo;
 }
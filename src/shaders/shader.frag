@@ -1,6 +1,21 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "feedback.glsl"
 
 layout(set = 1, binding = 0) uniform sampler2D samplerColorMap;
+// texture streaming requests of the frame, one per cell of every texture
+layout(set = 1, binding = 1) buffer Feedback {
+    uint requests[];
+} feedback;
+// finest resident level around every cell, one byte each
+layout(set = 1, binding = 2) readonly buffer Residency {
+    uint lods[];
+} residency;
+
+layout(push_constant) uniform PushConsts {
+    layout(offset = 64) uint textureIndex;
+} primitive;
 
 layout(location = 0) in vec3 inNormal;
 layout(location = 1) in vec3 inColor;
@@ -12,7 +27,26 @@ layout(location = 0) out vec4 outFragColor;
 
 void main()
 {
-    vec4 color = texture(samplerColorMap, inUV) * vec4(inColor, 1.0);
+    // derivatives are taken in uniform control flow
+    const vec2 dx = dFdx(inUV);
+    const vec2 dy = dFdy(inUV);
+    const uint cell = FeedbackIndex(primitive.textureIndex, inUV);
+
+    // levels that are not resident are skipped by scaling the gradients,
+    // which keeps anisotropic filtering
+    const float minLod = ResidentLod(residency.lods[cell >> 2], cell);
+    const float lod = textureQueryLod(samplerColorMap, inUV).y;
+    const float scale = exp2(max(minLod - lod, 0.0));
+    vec4 color = textureGrad(samplerColorMap, inUV, dx * scale, dy * scale) * vec4(inColor, 1.0);
+
+    if (IsFeedbackPixel(uvec2(gl_FragCoord.xy))) {
+        const float lenX = length(dx);
+        const float lenY = length(dy);
+        const uint request = EncodeFeedbackLod(FeedbackLod(max(lenX, lenY), min(lenX, lenY)));
+        if (request < feedback.requests[cell]) {
+            atomicMin(feedback.requests[cell], request);
+        }
+    }
 
     vec3 N = normalize(inNormal);
     vec3 L = normalize(inLightVec);
@@ -1,9 +1,9 @@
 #version 450
 
 layout(location = 0) in vec3 inPos;
-layout(location = 1) in vec3 inNormal;
+layout(location = 1) in vec2 inNormal; // octahedral encoded
 layout(location = 2) in vec2 inUV;
-layout(location = 3) in vec3 inColor;
+layout(location = 3) in vec4 inColor;
 
 layout(set = 0, binding = 0) uniform UBO
 {
@@ -24,15 +24,24 @@ layout(location = 2) out vec2 outUV;
 layout(location = 3) out vec3 outViewVec;
 layout(location = 4) out vec3 outLightVec;
 
+vec3 OctDecode(vec2 e)
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0) {
+        v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
 void main()
 {
-    outNormal = inNormal;
-    outColor = inColor;
+    vec3 normal = OctDecode(inNormal);
+    outColor = inColor.rgb;
     outUV = inUV;
     gl_Position = ubo.proj * ubo.view * primitive.model * vec4(inPos.xyz, 1.0);
 
     vec4 pos = ubo.view * vec4(inPos, 1.0);
-    outNormal = mat3(ubo.view) * inNormal;
+    outNormal = mat3(ubo.view) * normal;
     vec3 lPos = mat3(ubo.view) * ubo.lightPos;
     outLightVec = ubo.lightPos - pos.xyz;
     outViewVec = ubo.viewPos.xyz - pos.xyz;
@@ -0,0 +1,151 @@
+#include "Renderer/CookedModel.h"
+#include "Renderer/CookedTexture.h"
+#include "Util/AssetPack.h"
+#include "Util/ThreadPool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+int CookCubemap(const std::string& fileName,
+                const std::string& cookedFileName) {
+  hkr::ThreadPool threadPool;
+  threadPool.Init();
+  auto tStart = std::chrono::high_resolution_clock::now();
+  std::string err;
+  const bool result =
+      hkr::CookCubemap(fileName, cookedFileName, threadPool, err);
+  threadPool.Cleanup();
+  if (!result) {
+    std::fprintf(stderr, "failed to cook %s: %s\n", fileName.c_str(),
+                 err.c_str());
+    return 1;
+  }
+  auto tEnd = std::chrono::high_resolution_clock::now();
+  std::printf(
+      "cooked %s -> %s in %.2f ms\n", fileName.c_str(), cookedFileName.c_str(),
+      std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+  return 0;
+}
+
+int PackAssets(const std::string& directory, const std::string& packFileName) {
+  hkr::ThreadPool threadPool;
+  threadPool.Init();
+  auto tStart = std::chrono::high_resolution_clock::now();
+  hkr::AssetPackReport report;
+  std::string err;
+  const bool result =
+      hkr::WriteAssetPack(directory, packFileName, threadPool, report, err);
+  threadPool.Cleanup();
+  if (!result) {
+    std::fprintf(stderr, "failed to pack %s: %s\n", directory.c_str(),
+                 err.c_str());
+    return 1;
+  }
+  auto tEnd = std::chrono::high_resolution_clock::now();
+  std::printf(
+      "packed %u files (%u compressed), %llu -> %llu bytes: %s -> %s in "
+      "%.2f ms\n",
+      report.fileCount, report.compressedCount,
+      static_cast<unsigned long long>(report.size),
+      static_cast<unsigned long long>(report.storedSize), directory.c_str(),
+      packFileName.c_str(),
+      std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+  return 0;
+}
+
+}  // namespace
+
+// usage: hikari_cook [--no-optimize] [--no-compress] <model.gltf|model.glb>
+//                    [output.hkm]
+//        hikari_cook --cubemap <cubemap.ktx2> [output.ktx2]
+//        hikari_cook --pack <asset directory> [output.hkp]
+int main(int argc, char** argv) {
+  hkr::CookOptions options;
+  bool cubemap = false;
+  bool pack = false;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--no-optimize") {
+      options.optimizeMeshes = false;
+    } else if (arg == "--no-compress") {
+      options.compressTextures = false;
+    } else if (arg == "--cubemap") {
+      cubemap = true;
+    } else if (arg == "--pack") {
+      pack = true;
+    } else {
+      args.push_back(arg);
+    }
+  }
+  if (args.empty() || args.size() > 2) {
+    std::fprintf(stderr,
+                 "usage: %s [--no-optimize] [--no-compress] "
+                 "<model.gltf|model.glb> [output.hkm]\n"
+                 "       %s --cubemap <cubemap.ktx2> [output.ktx2]\n"
+                 "       %s --pack <asset directory> [output.hkp]\n"
+                 "output defaults to the model path with a .hkm extension, "
+                 "the cubemap path with a .bc6h.ktx2 one or the directory "
+                 "path with a .hkp one\n"
+                 "--no-optimize keeps the vertex and triangle order of the "
+                 "model\n"
+                 "--no-compress keeps the images as rgba8 in the cooked model "
+                 "instead of writing bc7/bc5/bc4 ktx2 files next to them\n"
+                 "--cubemap compresses a half or float cubemap to bc6h\n"
+                 "--pack packs the cooked asset directory into one file\n",
+                 argv[0], argv[0], argv[0]);
+    return 1;
+  }
+  const std::string fileName = args[0];
+  if (pack) {
+    return PackAssets(fileName, args.size() == 2
+                                    ? args[1]
+                                    : hkr::GetAssetPackFileName(fileName));
+  }
+  if (cubemap) {
+    return CookCubemap(fileName, args.size() == 2
+                                     ? args[1]
+                                     : hkr::GetCookedCubemapFileName(fileName));
+  }
+  const std::string cookedFileName =
+      args.size() == 2 ? args[1] : hkr::GetCookedFileName(fileName);
+
+  hkr::ThreadPool threadPool;
+  threadPool.Init();
+  auto tStart = std::chrono::high_resolution_clock::now();
+  hkr::CookReport report;
+  std::string err;
+  const bool result = hkr::CookModel(fileName, cookedFileName, options,
+                                     threadPool, report, err);
+  threadPool.Cleanup();
+  if (!result) {
+    std::fprintf(stderr, "failed to cook %s: %s\n", fileName.c_str(),
+                 err.c_str());
+    return 1;
+  }
+  auto tEnd = std::chrono::high_resolution_clock::now();
+  if (options.optimizeMeshes) {
+    const hkr::MeshStats& before = report.meshesBefore;
+    const hkr::MeshStats& after = report.meshesAfter;
+    std::printf(
+        "optimized %llu triangles in %.2f ms: vertices %llu -> %llu, "
+        "acmr %.3f -> %.3f, atvr %.3f -> %.3f\n",
+        static_cast<unsigned long long>(after.triangleCount),
+        report.optimizeMilliseconds,
+        static_cast<unsigned long long>(before.vertexCount),
+        static_cast<unsigned long long>(after.vertexCount), before.GetACMR(),
+        after.GetACMR(), before.GetATVR(), after.GetATVR());
+  }
+  if (options.compressTextures) {
+    std::printf("compressed %u images in %.2f ms\n",
+                report.compressedImageCount, report.compressMilliseconds);
+  }
+  std::printf(
+      "cooked %s -> %s in %.2f ms\n", fileName.c_str(), cookedFileName.c_str(),
+      std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+  return 0;
+}
@@ -0,0 +1,259 @@
+#include "Renderer/ModelDesc.h"
+#include "Renderer/glTFDocument.h"
+#include "Util/ThreadPool.h"
+
+#include <tiny_gltf.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int RUN_COUNT = 5;
+
+// Writes a scene shaped like large exported levels: every mesh is a cube with
+// its own accessors and buffer views and is placed by a node of its own below
+// a root node, and every fourth mesh has a material of its own. The geometry
+// is shared so that the json dominates the file.
+bool WriteSyntheticScene(const std::string& fileName, uint32_t meshCount) {
+  static constexpr float POSITIONS[8][3] = {
+      {-1, -1, -1}, {1, -1, -1}, {1, 1, -1}, {-1, 1, -1},
+      {-1, -1, 1},  {1, -1, 1},  {1, 1, 1},  {-1, 1, 1},
+  };
+  static constexpr uint16_t INDICES[36] = {
+      0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+      3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5,
+  };
+  float normals[8][3];
+  float uvs[8][2];
+  for (int i = 0; i < 8; i++) {
+    for (int c = 0; c < 3; c++) {
+      normals[i][c] = POSITIONS[i][c] * 0.57735f;
+    }
+    uvs[i][0] = POSITIONS[i][0] * 0.5f + 0.5f;
+    uvs[i][1] = POSITIONS[i][1] * 0.5f + 0.5f;
+  }
+  // indices, positions, normals, uvs
+  const size_t offsets[4] = {0, sizeof(INDICES), sizeof(INDICES) + 96,
+                             sizeof(INDICES) + 192};
+  const size_t lengths[4] = {sizeof(INDICES), 96, 96, 64};
+
+  const size_t slash = fileName.find_last_of('/');
+  const std::string binName =
+      (slash == std::string::npos ? fileName : fileName.substr(slash + 1)) +
+      ".bin";
+  std::ofstream bin(fileName + ".bin", std::ios::binary);
+  bin.write(reinterpret_cast<const char*>(INDICES), sizeof(INDICES));
+  bin.write(reinterpret_cast<const char*>(POSITIONS), sizeof(POSITIONS));
+  bin.write(reinterpret_cast<const char*>(normals), sizeof(normals));
+  bin.write(reinterpret_cast<const char*>(uvs), sizeof(uvs));
+  if (!bin) {
+    return false;
+  }
+
+  const uint32_t materialCount = (meshCount + 3) / 4;
+  std::string json;
+  json.reserve(size_t{meshCount} * 1536);
+  char line[512];
+  auto append = [&](const char* format, auto... args) {
+    std::snprintf(line, sizeof(line), format, args...);
+    json += line;
+  };
+  append(
+      "{\"asset\":{\"version\":\"2.0\",\"generator\":\"hikari_gltf_bench\"},"
+      "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"buffers\":[{\"uri\":\"%s\","
+      "\"byteLength\":%zu}],\"samplers\":[{\"magFilter\":9729,\"minFilter\":"
+      "9987,\"wrapS\":10497,\"wrapT\":10497}],\n",
+      binName.c_str(), offsets[3] + lengths[3]);
+  json += "\"bufferViews\":[\n";
+  for (uint32_t i = 0; i < meshCount; i++) {
+    for (int v = 0; v < 4; v++) {
+      append(
+          "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,\"target\":%d,"
+          "\"name\":\"view_%u_%d\"}%s\n",
+          offsets[v], lengths[v], v == 0 ? 34963 : 34962, i, v,
+          i + 1 == meshCount && v == 3 ? "" : ",");
+    }
+  }
+  json += "],\"accessors\":[\n";
+  for (uint32_t i = 0; i < meshCount; i++) {
+    const uint32_t view = i * 4;
+    append(
+        "{\"bufferView\":%u,\"componentType\":5123,\"count\":36,\"type\":"
+        "\"SCALAR\",\"min\":[0],\"max\":[7]},\n",
+        view);
+    append(
+        "{\"bufferView\":%u,\"componentType\":5126,\"count\":8,\"type\":"
+        "\"VEC3\",\"min\":[-1.0,-1.0,-1.0],\"max\":[1.0,1.0,1.0]},\n",
+        view + 1);
+    append(
+        "{\"bufferView\":%u,\"componentType\":5126,\"count\":8,\"type\":"
+        "\"VEC3\"},\n",
+        view + 2);
+    append(
+        "{\"bufferView\":%u,\"componentType\":5126,\"count\":8,\"type\":"
+        "\"VEC2\"}%s\n",
+        view + 3, i + 1 == meshCount ? "" : ",");
+  }
+  json += "],\"materials\":[\n";
+  for (uint32_t i = 0; i < materialCount; i++) {
+    append(
+        "{\"name\":\"material_%u\",\"pbrMetallicRoughness\":{"
+        "\"baseColorFactor\":[%.3f,%.3f,%.3f,1.0],\"metallicFactor\":%.3f,"
+        "\"roughnessFactor\":%.3f},\"emissiveFactor\":[0.0,0.0,0.0],"
+        "\"alphaMode\":\"%s\",\"doubleSided\":false}%s\n",
+        i, (i % 7) / 7.0f, (i % 11) / 11.0f, (i % 13) / 13.0f, (i % 3) / 3.0f,
+        (i % 5) / 5.0f, i % 8 == 0 ? "MASK" : "OPAQUE",
+        i + 1 == materialCount ? "" : ",");
+  }
+  json += "],\"meshes\":[\n";
+  for (uint32_t i = 0; i < meshCount; i++) {
+    const uint32_t accessor = i * 4;
+    append(
+        "{\"name\":\"mesh_%u\",\"primitives\":[{\"attributes\":{\"POSITION\":"
+        "%u,\"NORMAL\":%u,\"TEXCOORD_0\":%u},\"indices\":%u,\"material\":%u,"
+        "\"mode\":4}]}%s\n",
+        i, accessor + 1, accessor + 2, accessor + 3, accessor, i / 4,
+        i + 1 == meshCount ? "" : ",");
+  }
+  json += "],\"nodes\":[\n{\"name\":\"root\",\"children\":[";
+  for (uint32_t i = 0; i < meshCount; i++) {
+    append("%u%s", i + 1, i + 1 == meshCount ? "" : ",");
+  }
+  json += "]}";
+  for (uint32_t i = 0; i < meshCount; i++) {
+    append(
+        ",\n{\"name\":\"node_%u\",\"mesh\":%u,\"translation\":[%.2f,%.2f,%.2f],"
+        "\"rotation\":[0.0,0.38268,0.0,0.92388],\"scale\":[0.5,0.5,0.5]}",
+        i, i, (i % 100) * 3.0f, (i / 100 % 100) * 3.0f, (i / 10000) * 3.0f);
+  }
+  json += "\n]}\n";
+
+  std::ofstream gltf(fileName, std::ios::binary);
+  gltf.write(json.data(), static_cast<std::streamsize>(json.size()));
+  return static_cast<bool>(gltf);
+}
+
+bool LoadTinyglTF(const std::string& fileName,
+                  hkr::ThreadPool& threadPool,
+                  hkr::ModelDesc& desc,
+                  std::string& err) {
+  tinygltf::TinyGLTF loader;
+  tinygltf::Model model;
+  std::string warn;
+  if (!hkr::LoadglTFFile(loader, model, fileName, err, warn, &threadPool)) {
+    return false;
+  }
+  hkr::BuildModelDesc(model, desc);
+  return true;
+}
+
+bool LoadSimdjson(const std::string& fileName,
+                  hkr::ThreadPool& threadPool,
+                  hkr::ModelDesc& desc,
+                  std::string& err) {
+  hkr::glTFDocument document;
+  return document.Load(fileName, desc, err, &threadPool);
+}
+
+// median of RUN_COUNT runs of a parse that includes building the ModelDesc
+template <typename F>
+bool Measure(const char* name,
+             F&& load,
+             hkr::ModelDesc& desc,
+             double& median) {
+  std::vector<double> times;
+  for (int run = 0; run < RUN_COUNT; run++) {
+    std::string err;
+    auto tStart = std::chrono::high_resolution_clock::now();
+    const bool result = load(desc, err);
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    if (!result) {
+      std::fprintf(stderr, "%s failed: %s\n", name, err.c_str());
+      return false;
+    }
+    times.push_back(
+        std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+  }
+  std::sort(times.begin(), times.end());
+  median = times[RUN_COUNT / 2];
+  std::printf("%-9s %10.2f ms (min %.2f, max %.2f)\n", name, median,
+              times.front(), times.back());
+  return true;
+}
+
+bool IsSameDesc(const hkr::ModelDesc& a, const hkr::ModelDesc& b) {
+  return a.samplers.size() == b.samplers.size() &&
+         a.textures.size() == b.textures.size() &&
+         a.materials.size() == b.materials.size() &&
+         a.meshes.size() == b.meshes.size() &&
+         a.primitives.size() == b.primitives.size() &&
+         a.nodes.size() == b.nodes.size() &&
+         a.nodeChildren == b.nodeChildren && a.sceneNodes == b.sceneNodes &&
+         a.imageCount == b.imageCount && a.vertexCount == b.vertexCount &&
+         a.indexDataSize == b.indexDataSize &&
+         a.vertexStreamMask == b.vertexStreamMask;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::vector<std::string> args(argv + 1, argv + argc);
+  if (args.empty() || (args[0] == "--synthetic" && args.size() < 2)) {
+    std::fprintf(stderr,
+                 "usage: %s <model.gltf|model.glb>\n"
+                 "       %s --synthetic <output.gltf> [mesh count]\n"
+                 "times parsing the model into its ModelDesc with tinygltf "
+                 "and with simdjson\n"
+                 "--synthetic first writes a scene of mesh count cubes, "
+                 "100000 by default, each with its own node, accessors and "
+                 "buffer views\n",
+                 argv[0], argv[0]);
+    return 1;
+  }
+  std::string fileName = args[0];
+  if (args[0] == "--synthetic") {
+    fileName = args[1];
+    const uint32_t meshCount =
+        args.size() > 2 ? static_cast<uint32_t>(std::stoul(args[2])) : 100000;
+    if (!WriteSyntheticScene(fileName, meshCount)) {
+      std::fprintf(stderr, "failed to write %s\n", fileName.c_str());
+      return 1;
+    }
+    std::printf("wrote %s with %u meshes\n", fileName.c_str(), meshCount);
+  }
+
+  hkr::ThreadPool threadPool;
+  threadPool.Init();
+  hkr::ModelDesc tinyglTFDesc;
+  hkr::ModelDesc simdjsonDesc;
+  double tinyglTFTime = 0.0;
+  double simdjsonTime = 0.0;
+  const bool result =
+      Measure("tinygltf",
+              [&](hkr::ModelDesc& desc, std::string& err) {
+                return LoadTinyglTF(fileName, threadPool, desc, err);
+              },
+              tinyglTFDesc, tinyglTFTime) &&
+      Measure("simdjson",
+              [&](hkr::ModelDesc& desc, std::string& err) {
+                return LoadSimdjson(fileName, threadPool, desc, err);
+              },
+              simdjsonDesc, simdjsonTime);
+  threadPool.Cleanup();
+  if (!result) {
+    return 1;
+  }
+  std::printf("%zu meshes, %zu nodes, %zu materials: %.2fx\n",
+              simdjsonDesc.meshes.size(), simdjsonDesc.nodes.size(),
+              simdjsonDesc.materials.size(), tinyglTFTime / simdjsonTime);
+  if (!IsSameDesc(tinyglTFDesc, simdjsonDesc)) {
+    std::fprintf(stderr, "the parsers disagree on %s\n", fileName.c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,218 @@
+#include "Renderer/MeshOptimize.h"
+#include "Renderer/ModelDesc.h"
+#include "Util/ThreadPool.h"
+
+#include <tiny_gltf.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int RUN_COUNT = 5;
+constexpr const char* DEFAULT_MODEL =
+    "assets/models/FlightHelmet/glTF/FlightHelmet.glb";
+
+struct MeshSet {
+  hkr::ModelDesc desc;
+  hkr::MeshData data;
+};
+
+// decode every mesh of the model the way hikari_cook does, images are skipped
+bool LoadModel(const std::string& fileName,
+               hkr::ThreadPool& threadPool,
+               MeshSet& set,
+               std::string& err) {
+  tinygltf::TinyGLTF loader;
+  loader.SetImageLoader(
+      [](tinygltf::Image*, const int, std::string*, std::string*, int, int,
+         const unsigned char*, int, void*) { return true; },
+      nullptr);
+  tinygltf::Model model;
+  std::string warn;
+  if (!hkr::LoadglTFFile(loader, model, fileName, err, warn, &threadPool)) {
+    return false;
+  }
+  hkr::BuildModelDesc(model, set.desc);
+  for (uint32_t stream = 0; stream < hkr::VERTEX_STREAM_COUNT; stream++) {
+    if (set.desc.HasVertexStream(static_cast<hkr::VertexStream>(stream))) {
+      set.data.vertexStreams[stream].resize(
+          static_cast<size_t>(set.desc.vertexCount) *
+          hkr::VERTEX_STREAM_STRIDES[stream]);
+    }
+  }
+  set.data.indices.resize(set.desc.indexDataSize);
+  threadPool.ParallelFor(
+      static_cast<uint32_t>(set.desc.meshes.size()), [&](uint32_t i) {
+        hkr::DecodeMesh(model, set.desc, i,
+                        hkr::GetMeshDestination(set.desc, i, set.data));
+      });
+  return true;
+}
+
+// Grids of size x size quads, one primitive each, with their triangles in
+// random order like meshes exported without care for the vertex cache. Soup
+// grids give every triangle vertices of its own, as exporters that split
+// vertices per face do, for the weld to merge again.
+MeshSet BuildSyntheticGrids(uint32_t gridCount, uint32_t size, bool soup) {
+  MeshSet set;
+  hkr::ModelDesc& desc = set.desc;
+  const uint32_t triangleCount = size * size * 2;
+  for (uint32_t i = 0; i < gridCount; i++) {
+    desc.meshes.push_back({i, 1});
+    hkr::PrimitiveDesc& prim = desc.primitives.emplace_back();
+    prim.vertexCount = soup ? triangleCount * 3 : (size + 1) * (size + 1);
+    prim.indexCount = triangleCount * 3;
+    prim.materialIndex = 0;
+  }
+  hkr::LayoutPrimitives(desc);
+  for (uint32_t stream = 0; stream < hkr::VERTEX_STREAM_COUNT; stream++) {
+    if (desc.HasVertexStream(static_cast<hkr::VertexStream>(stream))) {
+      set.data.vertexStreams[stream].resize(
+          static_cast<size_t>(desc.vertexCount) *
+          hkr::VERTEX_STREAM_STRIDES[stream]);
+    }
+  }
+  set.data.indices.resize(desc.indexDataSize);
+
+  std::mt19937 random(gridCount * 7919 + size);
+  std::vector<uint32_t> triangles(triangleCount);
+  std::vector<uint32_t> indices(triangleCount * 3);
+  for (uint32_t i = 0; i < gridCount; i++) {
+    const hkr::PrimitiveDesc& prim = desc.primitives[i];
+    hkr::Vec3* positions =
+        reinterpret_cast<hkr::Vec3*>(
+            set.data.vertexStreams[hkr::VERTEX_STREAM_POSITION].data()) +
+        prim.firstVertex;
+    hkr::glTFVertexAttributes* attributes =
+        reinterpret_cast<hkr::glTFVertexAttributes*>(
+            set.data.vertexStreams[hkr::VERTEX_STREAM_ATTRIBUTES].data()) +
+        prim.firstVertex;
+    // grid vertex at x, y, the uv tells vertices apart for the weld
+    auto writeVertex = [&](uint32_t vertex, uint32_t x, uint32_t y) {
+      positions[vertex] =
+          hkr::Vec3(static_cast<float>(x), static_cast<float>(y),
+                    static_cast<float>(i));
+      attributes[vertex] = {0x7fff7fffu, 0x7fff0000u, (y << 16) | x};
+    };
+    for (uint32_t t = 0; t < triangleCount; t++) {
+      triangles[t] = t;
+    }
+    std::shuffle(triangles.begin(), triangles.end(), random);
+    for (uint32_t t = 0; t < triangleCount; t++) {
+      const uint32_t quad = triangles[t] / 2;
+      const uint32_t x = quad % size;
+      const uint32_t y = quad / size;
+      const uint32_t corners[2][3][2] = {
+          {{x, y}, {x + 1, y}, {x + 1, y + 1}},
+          {{x, y}, {x + 1, y + 1}, {x, y + 1}},
+      };
+      for (uint32_t k = 0; k < 3; k++) {
+        const uint32_t* corner = corners[triangles[t] % 2][k];
+        if (soup) {
+          indices[t * 3 + k] = t * 3 + k;
+          writeVertex(t * 3 + k, corner[0], corner[1]);
+        } else {
+          indices[t * 3 + k] = corner[1] * (size + 1) + corner[0];
+          writeVertex(indices[t * 3 + k], corner[0], corner[1]);
+        }
+      }
+    }
+    uint8_t* dst = set.data.indices.data() + hkr::GetIndexDataOffset(prim);
+    if (prim.indexType == hkr::IndexType::Uint16) {
+      uint16_t* dst16 = reinterpret_cast<uint16_t*>(dst);
+      for (size_t j = 0; j < indices.size(); j++) {
+        dst16[j] = static_cast<uint16_t>(indices[j]);
+      }
+    } else {
+      memcpy(dst, indices.data(), hkr::GetIndexDataSize(prim));
+    }
+  }
+  return set;
+}
+
+// median of RUN_COUNT runs of OptimizeMeshes on copies of the set, the copy
+// is not timed
+void Measure(const char* name,
+             const MeshSet& set,
+             hkr::ThreadPool& threadPool) {
+  std::vector<double> times;
+  hkr::MeshStats before;
+  hkr::MeshStats after;
+  uint32_t vertexCount = 0;
+  for (int run = 0; run < RUN_COUNT; run++) {
+    MeshSet copy = set;
+    auto tStart = std::chrono::high_resolution_clock::now();
+    hkr::OptimizeMeshes(copy.desc, copy.data, threadPool, before, after);
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    times.push_back(
+        std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+    vertexCount = copy.desc.vertexCount;
+  }
+  std::sort(times.begin(), times.end());
+  std::printf(
+      "%-12s %6zu prims %9llu tris %9u -> %9u verts  acmr %.3f -> %.3f  "
+      "atvr %.3f -> %.3f  %9.2f ms (min %.2f, max %.2f)\n",
+      name, set.desc.primitives.size(),
+      static_cast<unsigned long long>(after.triangleCount),
+      set.desc.vertexCount, vertexCount, before.GetACMR(), after.GetACMR(),
+      before.GetATVR(), after.GetATVR(), times[RUN_COUNT / 2], times.front(),
+      times.back());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::vector<std::string> args(argv + 1, argv + argc);
+  uint32_t gridSize = 1024;
+  std::vector<std::string> fileNames;
+  for (size_t i = 0; i < args.size(); i++) {
+    if (args[i] == "--grid" && i + 1 < args.size()) {
+      gridSize = std::max(static_cast<uint32_t>(std::stoul(args[++i])), 1u);
+    } else if (args[i][0] == '-') {
+      std::fprintf(stderr,
+                   "usage: %s [--grid size] [model.gltf|model.glb ...]\n"
+                   "times the cook step's mesh optimization and reports the "
+                   "vertex cache statistics before and after, on the models "
+                   "(%s by default) and on synthetic meshes: one size x size "
+                   "grid, 1024 by default, the same grid with vertices of "
+                   "its own per triangle, and 4096 grids of 16 x 16, all "
+                   "with their triangles shuffled\n",
+                   argv[0], DEFAULT_MODEL);
+      return 1;
+    } else {
+      fileNames.push_back(args[i]);
+    }
+  }
+  const bool defaultModel = fileNames.empty();
+  if (defaultModel) {
+    fileNames.push_back(DEFAULT_MODEL);
+  }
+
+  hkr::ThreadPool threadPool;
+  threadPool.Init();
+  int result = 0;
+  for (const std::string& fileName : fileNames) {
+    MeshSet set;
+    std::string err;
+    if (!LoadModel(fileName, threadPool, set, err)) {
+      std::fprintf(stderr, "failed to load %s: %s\n", fileName.c_str(),
+                   err.c_str());
+      // the default model may be missing from the checkout
+      result = defaultModel ? result : 1;
+      continue;
+    }
+    const std::string name = fileName.substr(fileName.find_last_of('/') + 1);
+    Measure(name.c_str(), set, threadPool);
+  }
+  Measure("grid", BuildSyntheticGrids(1, gridSize, false), threadPool);
+  Measure("grid soup", BuildSyntheticGrids(1, gridSize, true), threadPool);
+  Measure("grids 16", BuildSyntheticGrids(4096, 16, false), threadPool);
+  threadPool.Cleanup();
+  return result;
+}